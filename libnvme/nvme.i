@@ -27,6 +27,7 @@
 	#include "nvme/private.h"
 	#include "nvme/log.h"
 	#include "nvme/ioctl.h"
+	#include "nvme/linux.h"
 	#include "nvme/types.h"
 	#include "nvme/nbft.h"
 
@@ -42,14 +43,26 @@
 		Py_XDECREF(val);                   /* .. therefore decrement ref. count. */
 	}
 	PyObject *hostnqn_from_file() {
-		char * val = nvmf_hostnqn_from_file();
-		PyObject * obj = PyUnicode_FromString(val);
+		char * val;
+		PyObject * obj;
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    val = nvmf_hostnqn_from_file();
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		obj = PyUnicode_FromString(val);
 		free(val);
 		return obj;
 	}
 	PyObject *hostid_from_file() {
-		char * val = nvmf_hostid_from_file();
-		PyObject * obj = PyUnicode_FromString(val);
+		char * val;
+		PyObject * obj;
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    val = nvmf_hostid_from_file();
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		obj = PyUnicode_FromString(val);
 		free(val);
 		return obj;
 	}
@@ -412,7 +425,13 @@ struct nvme_ns {
 
 %extend nvme_root {
 	nvme_root(const char *config_file = NULL) {
-		return nvme_scan(config_file);
+		struct nvme_root *r;
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    r = nvme_scan(config_file);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		return r;
 	}
 	~nvme_root() {
 		nvme_free_tree($self);
@@ -433,10 +452,14 @@ struct nvme_ns {
 		return nvme_first_host($self);
 	}
 	void refresh_topology() {
-		nvme_refresh_topology($self);
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    nvme_refresh_topology($self);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
 	}
 	void update_config() {
-		nvme_update_config($self);
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    nvme_update_config($self);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
 	}
 	void dump_config() {
 		nvme_dump_config($self);
@@ -639,7 +662,13 @@ struct nvme_ns {
 	}
 
 	bool init(struct nvme_host *h, int instance) {
-		return nvme_init_ctrl(h, $self, instance) == 0;
+		int ret;
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    ret = nvme_init_ctrl(h, $self, instance);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		return ret == 0;
 	}
 
 	void connect(struct nvme_host *h,
@@ -669,7 +698,9 @@ struct nvme_ns {
 		nvme_ctrl_set_persistent($self, persistent);
 	}
 	void rescan() {
-		nvme_rescan_ctrl($self);
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    nvme_rescan_ctrl($self);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
 	}
 	void disconnect() {
 		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
@@ -745,6 +776,124 @@ struct nvme_ns {
 		return obj;
 	}
 
+	%feature("autodoc",
+		 "Read a log page without an intermediate copy.\n"
+		 "The payload is transferred straight into the returned bytes\n"
+		 "object, so parsing with struct/numpy operates in place.\n\n"
+		 "@param lid: Log page identifier\n"
+		 "@param size: Number of bytes to read\n"
+		 "@param nsid: Namespace identifier, NVME_NSID_ALL by default\n"
+		 "@param lpo: Byte offset into the log page\n"
+		 "@param rae: Retain asynchronous events\n"
+		 "@return: bytes of length size, or None on error.") log_page;
+	PyObject *log_page(unsigned int lid, size_t size,
+			   unsigned int nsid = 0xffffffff,
+			   unsigned long long lpo = 0, bool rae = true) {
+		PyObject *obj;
+		__u32 xfer;
+		int ret;
+
+		obj = PyBytes_FromStringAndSize(NULL, size);
+		if (!obj) Py_RETURN_NONE;
+
+		struct nvme_get_log_args args = {
+			.args_size = sizeof(args),
+			.fd = nvme_ctrl_get_fd($self),
+			.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+			.lid = lid,
+			.log = PyBytes_AS_STRING(obj),
+			.len = size,
+			.nsid = nsid,
+			.lpo = lpo,
+			.rae = rae,
+		};
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    if (nvme_get_log_page_max(args.fd, &xfer))
+			    xfer = NVME_LOG_PAGE_PDU_SIZE;
+		    ret = nvme_get_log_page(args.fd, xfer, &args);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		if (ret) {
+			Py_DECREF(obj);
+			Py_RETURN_NONE;
+		}
+		return obj;
+	}
+
+	%feature("autodoc",
+		 "Read a log page in place into a caller-provided buffer.\n"
+		 "Accepts any writable buffer-protocol object (bytearray,\n"
+		 "numpy array, mmap); the whole buffer is filled.\n\n"
+		 "@param lid: Log page identifier\n"
+		 "@param buffer: Writable contiguous buffer to fill\n"
+		 "@param nsid: Namespace identifier, NVME_NSID_ALL by default\n"
+		 "@param lpo: Byte offset into the log page\n"
+		 "@param rae: Retain asynchronous events\n"
+		 "@return: Number of bytes read, or None on error.") log_page_into;
+	PyObject *log_page_into(unsigned int lid, PyObject *buffer,
+				unsigned int nsid = 0xffffffff,
+				unsigned long long lpo = 0, bool rae = true) {
+		Py_buffer view;
+		__u32 xfer;
+		int ret;
+
+		if (PyObject_GetBuffer(buffer, &view,
+				       PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+			return NULL;
+
+		struct nvme_get_log_args args = {
+			.args_size = sizeof(args),
+			.fd = nvme_ctrl_get_fd($self),
+			.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+			.lid = lid,
+			.log = view.buf,
+			.len = view.len,
+			.nsid = nsid,
+			.lpo = lpo,
+			.rae = rae,
+		};
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    if (nvme_get_log_page_max(args.fd, &xfer))
+			    xfer = NVME_LOG_PAGE_PDU_SIZE;
+		    ret = nvme_get_log_page(args.fd, xfer, &args);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		PyBuffer_Release(&view);
+		if (ret) Py_RETURN_NONE;
+		return PyLong_FromSsize_t(view.len);
+	}
+
+	%feature("autodoc",
+		 "Retrieve a raw identify data structure.\n"
+		 "The 4096-byte payload is transferred straight into the\n"
+		 "returned bytes object without an intermediate copy.\n\n"
+		 "@param cns: Controller or Namespace Structure, see\n"
+		 "            enum nvme_identify_cns (1 = controller)\n"
+		 "@param nsid: Namespace identifier, if applicable\n"
+		 "@return: 4096 bytes of identify data, or None on error.") identify_data;
+	PyObject *identify_data(unsigned int cns = 1, unsigned int nsid = 0) {
+		PyObject *obj;
+		int ret;
+		void *data;
+		int fd = nvme_ctrl_get_fd($self);
+
+		obj = PyBytes_FromStringAndSize(NULL, NVME_IDENTIFY_DATA_SIZE);
+		if (!obj) Py_RETURN_NONE;
+		data = PyBytes_AS_STRING(obj);
+
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    ret = nvme_identify_cns_nsid(fd, cns, nsid, data);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
+		if (ret) {
+			Py_DECREF(obj);
+			Py_RETURN_NONE;
+		}
+		return obj;
+	}
+
 	PyObject* __str__() {
 		return $self->address ?
 		       PyUnicode_FromFormat("nvme_ctrl(transport=%s,%s)", STR_OR_NONE($self->transport), STR_OR_NONE($self->address)) :
@@ -1042,7 +1191,10 @@ struct nvme_ns {
 		PyObject *output;
 		int ret;
 
-		ret = nvme_nbft_read(&nbft, filename);
+		Py_BEGIN_ALLOW_THREADS  /* Release Python GIL */
+		    ret = nvme_nbft_read(&nbft, filename);
+		Py_END_ALLOW_THREADS    /* Reacquire Python GIL */
+
 		if (ret) {
 			Py_RETURN_NONE;
 		}
@@ -22,6 +22,8 @@ extern "C" {
 #include "nvme/filters.h"
 #include "nvme/tree.h"
 #include "nvme/util.h"
+#include "nvme/uring.h"
+#include "nvme/poller.h"
 #include "nvme/log.h"
 
 #ifdef __cplusplus
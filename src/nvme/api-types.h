@@ -73,6 +73,14 @@ struct nvme_identify_args {
  * @ot:		Offset Type; if set @lpo specifies the index into the list
  *		of data structures, otherwise @lpo specifies the byte offset
  *		into the log page.
+ * @qdepth:	Number of chunk transfers nvme_get_log_page() keeps in
+ *		flight concurrently; zero or one selects the default
+ *		sequential transfer.
+ * @deadline:	Absolute CLOCK_MONOTONIC time in milliseconds (see
+ *		nvme_deadline_after()) bounding the whole transfer,
+ *		including all chunk commands; zero for no deadline. Once
+ *		it passes, commands fail with ETIMEDOUT and per-command
+ *		timeouts are clamped to the remaining budget.
  */
 struct nvme_get_log_args {
 	__u64 lpo;
@@ -90,6 +98,8 @@ struct nvme_get_log_args {
 	__u8 uuidx;
 	bool rae;
 	bool ot;
+	__u16 qdepth;
+	__u64 deadline;
 };
 
 /**
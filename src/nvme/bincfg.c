@@ -0,0 +1,611 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ * Copyright (c) 2026 SUSE Software Solutions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdint.h>
+
+#include <ccan/endian/endian.h>
+
+#include "cleanup.h"
+#include "fabrics.h"
+#include "log.h"
+#include "private.h"
+#include "linux.h"
+
+/*
+ * Binary configuration format. The JSON configuration has to be parsed
+ * in full on every library instantiation; on initrd boot paths that
+ * read the persistent connect state before the root filesystem is
+ * mounted the parse shows up directly in boot time. This codec stores
+ * the same state as a fixed header, flat little-endian record arrays
+ * for hosts, subsystems and ports, and a string table, so loading is a
+ * single mmap() plus bounds checks. nvme_read_config() selects it by
+ * the file extension.
+ *
+ * Records reference strings as offsets into the string table; offset 0
+ * is reserved and means "not set". Hosts own a contiguous range of
+ * subsystem records, subsystems a contiguous range of port records.
+ */
+
+#define NVME_BINCFG_MAGIC	"NVBC"
+#define NVME_BINCFG_VERSION	1
+
+struct nvme_bincfg_hdr {
+	char magic[4];
+	__le32 version;
+	__le32 strtab_off;
+	__le32 strtab_len;
+	__le32 nr_hosts;
+	__le32 hosts_off;
+	__le32 nr_subsys;
+	__le32 subsys_off;
+	__le32 nr_ports;
+	__le32 ports_off;
+};
+
+#define NVME_BINCFG_HOST_PDC_VALID	(1 << 0)
+#define NVME_BINCFG_HOST_PDC		(1 << 1)
+
+struct nvme_bincfg_host {
+	__le32 hostnqn;
+	__le32 hostid;
+	__le32 dhchap_key;
+	__le32 hostsymname;
+	__le32 flags;
+	__le32 first_subsys;
+	__le32 nr_subsys;
+};
+
+struct nvme_bincfg_subsys {
+	__le32 nqn;
+	__le32 application;
+	__le32 first_port;
+	__le32 nr_ports;
+};
+
+#define NVME_BINCFG_PORT_DUPLICATE_CONNECT	(1 << 0)
+#define NVME_BINCFG_PORT_DISABLE_SQFLOW		(1 << 1)
+#define NVME_BINCFG_PORT_HDR_DIGEST		(1 << 2)
+#define NVME_BINCFG_PORT_DATA_DIGEST		(1 << 3)
+#define NVME_BINCFG_PORT_TLS			(1 << 4)
+#define NVME_BINCFG_PORT_CONCAT			(1 << 5)
+#define NVME_BINCFG_PORT_PERSISTENT		(1 << 6)
+#define NVME_BINCFG_PORT_DISCOVERY		(1 << 7)
+
+struct nvme_bincfg_port {
+	__le32 transport;
+	__le32 traddr;
+	__le32 host_traddr;
+	__le32 host_iface;
+	__le32 trsvcid;
+	__le32 dhchap_key;
+	__le32 dhchap_ctrl_key;
+	__le32 keyring;
+	__le32 tls_key;
+	__le32 flags;
+	__le32 nr_io_queues;
+	__le32 nr_write_queues;
+	__le32 nr_poll_queues;
+	__le32 queue_size;
+	__le32 keep_alive_tmo;
+	__le32 reconnect_delay;
+	__le32 ctrl_loss_tmo;
+	__le32 fast_io_fail_tmo;
+	__le32 tos;
+};
+
+bool nvme_config_is_binary(const char *config_file)
+{
+	const char *ext = strrchr(config_file, '.');
+
+	return ext && !strcmp(ext, ".bin");
+}
+
+struct nvme_bincfg_view {
+	const void *map;
+	size_t len;
+	const struct nvme_bincfg_host *hosts;
+	__u32 nr_hosts;
+	const struct nvme_bincfg_subsys *subsys;
+	__u32 nr_subsys;
+	const struct nvme_bincfg_port *ports;
+	__u32 nr_ports;
+	const char *strtab;
+	__u32 strtab_len;
+};
+
+static const void *nvme_bincfg_array(const struct nvme_bincfg_view *v,
+				     __u32 off, __u32 nr, size_t size)
+{
+	if (off > v->len || nr > (v->len - off) / size)
+		return NULL;
+	return v->map + off;
+}
+
+static int nvme_bincfg_validate(struct nvme_bincfg_view *v)
+{
+	const struct nvme_bincfg_hdr *hdr = v->map;
+	__u32 off, len;
+
+	if (v->len < sizeof(*hdr) ||
+	    memcmp(hdr->magic, NVME_BINCFG_MAGIC, sizeof(hdr->magic)) ||
+	    le32_to_cpu(hdr->version) != NVME_BINCFG_VERSION)
+		return -1;
+
+	off = le32_to_cpu(hdr->strtab_off);
+	len = le32_to_cpu(hdr->strtab_len);
+	if (!len || off > v->len || len > v->len - off)
+		return -1;
+	v->strtab = v->map + off;
+	v->strtab_len = len;
+	/* every in-bounds string offset then ends in a terminator */
+	if (v->strtab[0] || v->strtab[len - 1])
+		return -1;
+
+	v->nr_hosts = le32_to_cpu(hdr->nr_hosts);
+	v->hosts = nvme_bincfg_array(v, le32_to_cpu(hdr->hosts_off),
+				     v->nr_hosts, sizeof(*v->hosts));
+	v->nr_subsys = le32_to_cpu(hdr->nr_subsys);
+	v->subsys = nvme_bincfg_array(v, le32_to_cpu(hdr->subsys_off),
+				      v->nr_subsys, sizeof(*v->subsys));
+	v->nr_ports = le32_to_cpu(hdr->nr_ports);
+	v->ports = nvme_bincfg_array(v, le32_to_cpu(hdr->ports_off),
+				     v->nr_ports, sizeof(*v->ports));
+	if (!v->hosts || !v->subsys || !v->ports)
+		return -1;
+	return 0;
+}
+
+static const char *nvme_bincfg_string(const struct nvme_bincfg_view *v,
+				      __le32 off)
+{
+	__u32 o = le32_to_cpu(off);
+
+	if (!o || o >= v->strtab_len)
+		return NULL;
+	return v->strtab + o;
+}
+
+static void nvme_bincfg_import_tls_key(nvme_ctrl_t c, const char *keyring_str,
+				       const char *encoded_key)
+{
+	struct nvme_fabrics_config *cfg = nvme_ctrl_get_config(c);
+	const char *hostnqn = nvme_host_get_hostnqn(c->s->h);
+	const char *subsysnqn = nvme_ctrl_get_subsysnqn(c);
+	int key_len;
+	unsigned int hmac;
+	long key_id;
+	_cleanup_free_ unsigned char *key_data = NULL;
+
+	if (!hostnqn || !subsysnqn)
+		return;
+	key_data = nvme_import_tls_key(encoded_key, &key_len, &hmac);
+	if (!key_data) {
+		nvme_msg(NULL, LOG_ERR, "Failed to decode TLS Key '%s'\n",
+			 encoded_key);
+		return;
+	}
+	key_id = nvme_insert_tls_key_versioned(keyring_str, "psk",
+					       hostnqn, subsysnqn,
+					       0, hmac, key_data, key_len);
+	if (key_id <= 0) {
+		nvme_msg(NULL, LOG_ERR, "Failed to insert TLS KEY, error %d\n",
+			 errno);
+		return;
+	}
+	cfg->tls_key = key_id;
+	cfg->tls = true;
+}
+
+#define NVME_BINCFG_APPLY_INT(cfg, rec, o)				\
+	if (!(cfg)->o)							\
+		(cfg)->o = le32_to_cpu((rec)->o)
+
+static void nvme_bincfg_apply_port(nvme_subsystem_t s,
+				   const struct nvme_bincfg_view *v,
+				   const struct nvme_bincfg_port *rec)
+{
+	struct nvme_fabrics_config *cfg;
+	const char *transport, *value, *keyring_str;
+	__u32 flags = le32_to_cpu(rec->flags);
+	nvme_ctrl_t c;
+
+	transport = nvme_bincfg_string(v, rec->transport);
+	if (!transport)
+		return;
+	c = nvme_lookup_ctrl(s, transport,
+			     nvme_bincfg_string(v, rec->traddr),
+			     nvme_bincfg_string(v, rec->host_traddr),
+			     nvme_bincfg_string(v, rec->host_iface),
+			     nvme_bincfg_string(v, rec->trsvcid), NULL);
+	if (!c)
+		return;
+	cfg = nvme_ctrl_get_config(c);
+	NVME_BINCFG_APPLY_INT(cfg, rec, nr_io_queues);
+	NVME_BINCFG_APPLY_INT(cfg, rec, nr_write_queues);
+	NVME_BINCFG_APPLY_INT(cfg, rec, nr_poll_queues);
+	NVME_BINCFG_APPLY_INT(cfg, rec, queue_size);
+	NVME_BINCFG_APPLY_INT(cfg, rec, keep_alive_tmo);
+	NVME_BINCFG_APPLY_INT(cfg, rec, reconnect_delay);
+	if (cfg->ctrl_loss_tmo != NVMF_DEF_CTRL_LOSS_TMO)
+		cfg->ctrl_loss_tmo = (__s32)le32_to_cpu(rec->ctrl_loss_tmo);
+	NVME_BINCFG_APPLY_INT(cfg, rec, fast_io_fail_tmo);
+	if (cfg->tos != -1)
+		cfg->tos = (__s32)le32_to_cpu(rec->tos);
+	if (flags & NVME_BINCFG_PORT_DUPLICATE_CONNECT)
+		cfg->duplicate_connect = true;
+	if (flags & NVME_BINCFG_PORT_DISABLE_SQFLOW)
+		cfg->disable_sqflow = true;
+	if (flags & NVME_BINCFG_PORT_HDR_DIGEST)
+		cfg->hdr_digest = true;
+	if (flags & NVME_BINCFG_PORT_DATA_DIGEST)
+		cfg->data_digest = true;
+	if (flags & NVME_BINCFG_PORT_TLS)
+		cfg->tls = true;
+	if (flags & NVME_BINCFG_PORT_CONCAT)
+		cfg->concat = true;
+	if (flags & NVME_BINCFG_PORT_PERSISTENT)
+		nvme_ctrl_set_persistent(c, true);
+	if (flags & NVME_BINCFG_PORT_DISCOVERY)
+		nvme_ctrl_set_discovery_ctrl(c, true);
+	value = nvme_bincfg_string(v, rec->dhchap_key);
+	if (value)
+		nvme_ctrl_set_dhchap_host_key(c, value);
+	value = nvme_bincfg_string(v, rec->dhchap_ctrl_key);
+	if (value)
+		nvme_ctrl_set_dhchap_key(c, value);
+	keyring_str = nvme_bincfg_string(v, rec->keyring);
+	if (keyring_str && cfg->keyring == 0) {
+		long keyring = nvme_lookup_keyring(keyring_str);
+
+		if (keyring) {
+			cfg->keyring = keyring;
+			nvme_set_keyring(cfg->keyring);
+		}
+	}
+	value = nvme_bincfg_string(v, rec->tls_key);
+	if (value && cfg->tls_key == 0)
+		nvme_bincfg_import_tls_key(c, keyring_str, value);
+}
+
+static void nvme_bincfg_apply_subsys(nvme_host_t h,
+				     const struct nvme_bincfg_view *v,
+				     const struct nvme_bincfg_subsys *rec)
+{
+	const char *nqn, *app;
+	nvme_subsystem_t s;
+	__u32 first = le32_to_cpu(rec->first_port);
+	__u32 nr = le32_to_cpu(rec->nr_ports);
+	__u32 p;
+
+	nqn = nvme_bincfg_string(v, rec->nqn);
+	if (!nqn)
+		return;
+	s = nvme_lookup_subsystem(h, NULL, nqn);
+	if (!s)
+		return;
+	app = nvme_bincfg_string(v, rec->application);
+	if (app)
+		nvme_subsystem_set_application(s, app);
+	if (first > v->nr_ports || nr > v->nr_ports - first)
+		return;
+	for (p = first; p < first + nr; p++)
+		nvme_bincfg_apply_port(s, v, &v->ports[p]);
+}
+
+static void nvme_bincfg_apply_host(nvme_root_t r,
+				   const struct nvme_bincfg_view *v,
+				   const struct nvme_bincfg_host *rec)
+{
+	const char *hostnqn, *value;
+	nvme_host_t h;
+	__u32 flags = le32_to_cpu(rec->flags);
+	__u32 first = le32_to_cpu(rec->first_subsys);
+	__u32 nr = le32_to_cpu(rec->nr_subsys);
+	__u32 s;
+
+	hostnqn = nvme_bincfg_string(v, rec->hostnqn);
+	if (!hostnqn)
+		return;
+	h = nvme_lookup_host(r, hostnqn, nvme_bincfg_string(v, rec->hostid));
+	if (!h)
+		return;
+	value = nvme_bincfg_string(v, rec->dhchap_key);
+	if (value)
+		nvme_host_set_dhchap_key(h, value);
+	value = nvme_bincfg_string(v, rec->hostsymname);
+	if (value)
+		nvme_host_set_hostsymname(h, value);
+	if (flags & NVME_BINCFG_HOST_PDC_VALID)
+		nvme_host_set_pdc_enabled(h,
+					  !!(flags & NVME_BINCFG_HOST_PDC));
+	if (first > v->nr_subsys || nr > v->nr_subsys - first)
+		return;
+	for (s = first; s < first + nr; s++)
+		nvme_bincfg_apply_subsys(h, v, &v->subsys[s]);
+}
+
+int nvme_bincfg_read_config(nvme_root_t r, const char *config_file)
+{
+	struct nvme_bincfg_view v = { };
+	struct stat st;
+	__u32 h;
+	int fd, ret = -1;
+
+	fd = open(config_file, O_RDONLY);
+	if (fd < 0) {
+		nvme_msg(r, LOG_DEBUG, "Error opening %s, %s\n",
+			 config_file, strerror(errno));
+		return fd;
+	}
+	if (fstat(fd, &st) < 0)
+		goto out_close;
+	v.len = st.st_size;
+	v.map = mmap(NULL, v.len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (v.map == MAP_FAILED)
+		goto out_close;
+	if (nvme_bincfg_validate(&v)) {
+		nvme_msg(r, LOG_DEBUG, "Invalid binary config %s\n",
+			 config_file);
+		errno = EPROTO;
+		goto out_unmap;
+	}
+	for (h = 0; h < v.nr_hosts; h++)
+		nvme_bincfg_apply_host(r, &v, &v.hosts[h]);
+	ret = 0;
+out_unmap:
+	munmap((void *)v.map, v.len);
+out_close:
+	close(fd);
+	return ret;
+}
+
+/*
+ * Writer. Strings are interned so repeated values (transports, service
+ * IDs, shared keys) are stored once.
+ */
+struct nvme_bincfg_buf {
+	void *data;
+	__u32 len;
+	__u32 cap;
+};
+
+static __u32 nvme_bincfg_append(struct nvme_bincfg_buf *buf, const void *data,
+				__u32 len)
+{
+	__u32 off = buf->len;
+
+	if (buf->len + len > buf->cap) {
+		__u32 cap = buf->cap ? buf->cap : 4096;
+		void *tmp;
+
+		while (cap < buf->len + len)
+			cap *= 2;
+		tmp = realloc(buf->data, cap);
+		if (!tmp)
+			return UINT32_MAX;
+		buf->data = tmp;
+		buf->cap = cap;
+	}
+	memcpy(buf->data + off, data, len);
+	buf->len += len;
+	return off;
+}
+
+static __le32 nvme_bincfg_intern(struct nvme_bincfg_buf *strtab,
+				 const char *str)
+{
+	__u32 off = 1, len;
+
+	if (!str)
+		return cpu_to_le32(0);
+	len = strlen(str) + 1;
+	while (off + len <= strtab->len) {
+		if (!memcmp(strtab->data + off, str, len))
+			return cpu_to_le32(off);
+		off += strlen(strtab->data + off) + 1;
+	}
+	off = nvme_bincfg_append(strtab, str, len);
+	if (off == UINT32_MAX)
+		return cpu_to_le32(0);
+	return cpu_to_le32(off);
+}
+
+static __le32 nvme_bincfg_intern_tls_key(struct nvme_bincfg_buf *strtab,
+					 long keyring_id, long tls_key)
+{
+	int key_len;
+	_cleanup_free_ unsigned char *key_data = NULL;
+
+	key_data = nvme_read_key(keyring_id, tls_key, &key_len);
+	if (key_data) {
+		_cleanup_free_ char *tls_str = NULL;
+
+		tls_str = nvme_export_tls_key(key_data, key_len);
+		if (tls_str)
+			return nvme_bincfg_intern(strtab, tls_str);
+	}
+	return cpu_to_le32(0);
+}
+
+static void nvme_bincfg_port_rec(struct nvme_bincfg_buf *strtab,
+				 nvme_ctrl_t c, struct nvme_bincfg_port *rec)
+{
+	struct nvme_fabrics_config *cfg = nvme_ctrl_get_config(c);
+	__u32 flags = 0;
+
+	rec->transport = nvme_bincfg_intern(strtab,
+					    nvme_ctrl_get_transport(c));
+	rec->traddr = nvme_bincfg_intern(strtab, nvme_ctrl_get_traddr(c));
+	rec->host_traddr = nvme_bincfg_intern(strtab,
+					      nvme_ctrl_get_host_traddr(c));
+	rec->host_iface = nvme_bincfg_intern(strtab,
+					     nvme_ctrl_get_host_iface(c));
+	rec->trsvcid = nvme_bincfg_intern(strtab, nvme_ctrl_get_trsvcid(c));
+	rec->dhchap_key = nvme_bincfg_intern(strtab,
+					     nvme_ctrl_get_dhchap_host_key(c));
+	rec->dhchap_ctrl_key = nvme_bincfg_intern(strtab,
+						  nvme_ctrl_get_dhchap_key(c));
+	if (cfg->keyring) {
+		_cleanup_free_ char *desc =
+			nvme_describe_key_serial(cfg->keyring);
+
+		rec->keyring = nvme_bincfg_intern(strtab, desc);
+	}
+	if (cfg->tls_key)
+		rec->tls_key = nvme_bincfg_intern_tls_key(strtab, cfg->keyring,
+							  cfg->tls_key);
+	if (cfg->duplicate_connect)
+		flags |= NVME_BINCFG_PORT_DUPLICATE_CONNECT;
+	if (cfg->disable_sqflow)
+		flags |= NVME_BINCFG_PORT_DISABLE_SQFLOW;
+	if (cfg->hdr_digest)
+		flags |= NVME_BINCFG_PORT_HDR_DIGEST;
+	if (cfg->data_digest)
+		flags |= NVME_BINCFG_PORT_DATA_DIGEST;
+	if (cfg->tls)
+		flags |= NVME_BINCFG_PORT_TLS;
+	if (cfg->concat)
+		flags |= NVME_BINCFG_PORT_CONCAT;
+	if (nvme_ctrl_is_persistent(c))
+		flags |= NVME_BINCFG_PORT_PERSISTENT;
+	if (nvme_ctrl_is_discovery_ctrl(c))
+		flags |= NVME_BINCFG_PORT_DISCOVERY;
+	rec->flags = cpu_to_le32(flags);
+	rec->nr_io_queues = cpu_to_le32(cfg->nr_io_queues);
+	rec->nr_write_queues = cpu_to_le32(cfg->nr_write_queues);
+	rec->nr_poll_queues = cpu_to_le32(cfg->nr_poll_queues);
+	rec->queue_size = cpu_to_le32(cfg->queue_size);
+	rec->keep_alive_tmo = cpu_to_le32(cfg->keep_alive_tmo);
+	rec->reconnect_delay = cpu_to_le32(cfg->reconnect_delay);
+	rec->ctrl_loss_tmo = cpu_to_le32(cfg->ctrl_loss_tmo);
+	rec->fast_io_fail_tmo = cpu_to_le32(cfg->fast_io_fail_tmo);
+	rec->tos = cpu_to_le32(cfg->tos);
+}
+
+int nvme_bincfg_update_config(nvme_root_t r, const char *config_file)
+{
+	struct nvme_bincfg_buf strtab = { }, hosts = { }, subsys = { },
+		ports = { };
+	struct nvme_bincfg_hdr hdr = { };
+	__u32 nr_hosts = 0, nr_subsys = 0, nr_ports = 0, off;
+	nvme_host_t h;
+	FILE *f;
+	int ret = -1;
+
+	/* reserve the "not set" slot */
+	if (nvme_bincfg_append(&strtab, "", 1) == UINT32_MAX)
+		goto out;
+
+	nvme_for_each_host(r, h) {
+		struct nvme_bincfg_host hrec = { };
+		nvme_subsystem_t s;
+		__u32 flags = 0;
+
+		hrec.hostnqn = nvme_bincfg_intern(&strtab,
+						  nvme_host_get_hostnqn(h));
+		hrec.hostid = nvme_bincfg_intern(&strtab,
+						 nvme_host_get_hostid(h));
+		hrec.dhchap_key = nvme_bincfg_intern(&strtab,
+						     nvme_host_get_dhchap_key(h));
+		hrec.hostsymname = nvme_bincfg_intern(&strtab,
+						      nvme_host_get_hostsymname(h));
+		if (h->pdc_enabled_valid) {
+			flags |= NVME_BINCFG_HOST_PDC_VALID;
+			if (h->pdc_enabled)
+				flags |= NVME_BINCFG_HOST_PDC;
+		}
+		hrec.flags = cpu_to_le32(flags);
+		hrec.first_subsys = cpu_to_le32(nr_subsys);
+
+		nvme_for_each_subsystem(h, s) {
+			struct nvme_bincfg_subsys srec = { };
+			nvme_ctrl_t c;
+
+			/* Skip discovery subsystems as the nqn is not unique */
+			if (!strcmp(nvme_subsystem_get_nqn(s),
+				    NVME_DISC_SUBSYS_NAME))
+				continue;
+			srec.nqn = nvme_bincfg_intern(&strtab,
+						      nvme_subsystem_get_nqn(s));
+			srec.application = nvme_bincfg_intern(&strtab,
+					nvme_subsystem_get_application(s));
+			srec.first_port = cpu_to_le32(nr_ports);
+
+			nvme_subsystem_for_each_ctrl(s, c) {
+				struct nvme_bincfg_port prec = { };
+
+				nvme_bincfg_port_rec(&strtab, c, &prec);
+				if (nvme_bincfg_append(&ports, &prec,
+						       sizeof(prec)) == UINT32_MAX)
+					goto out;
+				nr_ports++;
+			}
+			srec.nr_ports = cpu_to_le32(nr_ports -
+					le32_to_cpu(srec.first_port));
+			if (nvme_bincfg_append(&subsys, &srec,
+					       sizeof(srec)) == UINT32_MAX)
+				goto out;
+			nr_subsys++;
+		}
+		hrec.nr_subsys = cpu_to_le32(nr_subsys -
+				le32_to_cpu(hrec.first_subsys));
+		if (nvme_bincfg_append(&hosts, &hrec,
+				       sizeof(hrec)) == UINT32_MAX)
+			goto out;
+		nr_hosts++;
+	}
+
+	memcpy(hdr.magic, NVME_BINCFG_MAGIC, sizeof(hdr.magic));
+	hdr.version = cpu_to_le32(NVME_BINCFG_VERSION);
+	off = sizeof(hdr);
+	hdr.nr_hosts = cpu_to_le32(nr_hosts);
+	hdr.hosts_off = cpu_to_le32(off);
+	off += hosts.len;
+	hdr.nr_subsys = cpu_to_le32(nr_subsys);
+	hdr.subsys_off = cpu_to_le32(off);
+	off += subsys.len;
+	hdr.nr_ports = cpu_to_le32(nr_ports);
+	hdr.ports_off = cpu_to_le32(off);
+	off += ports.len;
+	hdr.strtab_off = cpu_to_le32(off);
+	hdr.strtab_len = cpu_to_le32(strtab.len);
+
+	f = fopen(config_file, "w");
+	if (!f) {
+		nvme_msg(r, LOG_ERR, "Failed to open %s, %s\n",
+			 config_file, strerror(errno));
+		goto out;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    (hosts.len && fwrite(hosts.data, hosts.len, 1, f) != 1) ||
+	    (subsys.len && fwrite(subsys.data, subsys.len, 1, f) != 1) ||
+	    (ports.len && fwrite(ports.data, ports.len, 1, f) != 1) ||
+	    fwrite(strtab.data, strtab.len, 1, f) != 1 ||
+	    fflush(f)) {
+		nvme_msg(r, LOG_ERR, "Failed to write to %s, %s\n",
+			 config_file, strerror(errno));
+		fclose(f);
+		errno = EIO;
+		goto out;
+	}
+	fclose(f);
+	ret = 0;
+out:
+	free(strtab.data);
+	free(hosts.data);
+	free(subsys.data);
+	free(ports.data);
+	return ret;
+}
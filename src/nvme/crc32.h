@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
-uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+uint32_t nvme_crc32(uint32_t crc, const void *buf, size_t len);
+
+/* raw CRC32C update (no initial/final inversion), hardware-accelerated
+ * where the CPU supports it */
+uint32_t nvme_crc32c(uint32_t crc, const void *buf, size_t len);
 
 #endif
@@ -19,6 +19,8 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
 
 #include <sys/param.h>
 #include <sys/stat.h>
@@ -26,6 +28,9 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <linux/netlink.h>
 
 #include <ccan/endian/endian.h>
 #include <ccan/list/list.h>
@@ -232,14 +237,25 @@ void nvmf_default_config(struct nvme_fabrics_config *cfg)
 	cfg->ctrl_loss_tmo = NVMF_DEF_CTRL_LOSS_TMO;
 }
 
-#define MERGE_CFG_OPTION(c, n, o, d)			\
-	if ((c)->o == d) (c)->o = (n)->o
-#define MERGE_CFG_OPTION_STR(c, n, o, d)		\
-	if ((c)->o == d && (n)->o) (c)->o = strdup((n)->o)
+#define MERGE_CFG_OPTION(c, n, o, d)					\
+	if ((c)->o == d && (n)->o != d) {				\
+		(c)->o = (n)->o;					\
+		changed = true;						\
+	}
+#define MERGE_CFG_OPTION_STR(c, n, o, d)				\
+	if ((c)->o == d && (n)->o) {					\
+		(c)->o = strdup((n)->o);				\
+		changed = true;						\
+	}
 static struct nvme_fabrics_config *merge_config(nvme_ctrl_t c,
 		const struct nvme_fabrics_config *cfg)
 {
 	struct nvme_fabrics_config *ctrl_cfg = nvme_ctrl_get_config(c);
+	bool changed = false;
+
+	/* nothing to merge in; the controller's own config stands */
+	if (!cfg)
+		return ctrl_cfg;
 
 	MERGE_CFG_OPTION_STR(ctrl_cfg, cfg, host_traddr, NULL);
 	MERGE_CFG_OPTION_STR(ctrl_cfg, cfg, host_iface, NULL);
@@ -262,14 +278,23 @@ static struct nvme_fabrics_config *merge_config(nvme_ctrl_t c,
 	MERGE_CFG_OPTION(ctrl_cfg, cfg, tls, false);
 	MERGE_CFG_OPTION(ctrl_cfg, cfg, concat, false);
 
+	if (changed)
+		c->cfg_dirty = true;
+
 	return ctrl_cfg;
 }
 
-#define UPDATE_CFG_OPTION(c, n, o, d)			\
-	if ((n)->o != d) (c)->o = (n)->o
+/* only fields that actually change value are written, so an update with an
+ * unchanged effective config leaves the controller clean */
+#define UPDATE_CFG_OPTION(c, n, o, d)					\
+	if ((n)->o != d && (c)->o != (n)->o) {				\
+		(c)->o = (n)->o;					\
+		changed = true;						\
+	}
 void nvmf_update_config(nvme_ctrl_t c, const struct nvme_fabrics_config *cfg)
 {
 	struct nvme_fabrics_config *ctrl_cfg = nvme_ctrl_get_config(c);
+	bool changed = false;
 
 	UPDATE_CFG_OPTION(ctrl_cfg, cfg, host_traddr, NULL);
 	UPDATE_CFG_OPTION(ctrl_cfg, cfg, host_iface, NULL);
@@ -291,70 +316,69 @@ void nvmf_update_config(nvme_ctrl_t c, const struct nvme_fabrics_config *cfg)
 	UPDATE_CFG_OPTION(ctrl_cfg, cfg, data_digest, false);
 	UPDATE_CFG_OPTION(ctrl_cfg, cfg, tls, false);
 	UPDATE_CFG_OPTION(ctrl_cfg, cfg, concat, false);
+
+	if (changed)
+		c->cfg_dirty = true;
 }
 
-static int __add_bool_argument(char **argstr, char *tok, bool arg)
+/*
+ * The fabrics device parses at most a page of options, so the argument
+ * string is assembled in a fixed-size buffer and duplicated once at the
+ * end instead of being reallocated for every key/value pair.
+ */
+struct nvmf_arg_builder {
+	size_t len;
+	char buf[0x1000];
+};
+
+__attribute__((format(printf, 2, 3)))
+static int nvmf_arg_append(struct nvmf_arg_builder *b, const char *fmt, ...)
 {
-	char *nstr;
+	va_list ap;
+	int ret;
 
-	if (!arg)
-		return 0;
-	if (asprintf(&nstr, "%s,%s", *argstr, tok) < 0) {
-		errno = ENOMEM;
+	va_start(ap, fmt);
+	ret = vsnprintf(b->buf + b->len, sizeof(b->buf) - b->len, fmt, ap);
+	va_end(ap);
+	if (ret < 0 || (size_t)ret >= sizeof(b->buf) - b->len) {
+		errno = EINVAL;
 		return -1;
 	}
-	free(*argstr);
-	*argstr = nstr;
+	b->len += ret;
 
 	return 0;
 }
 
-static int __add_int_argument(char **argstr, char *tok, int arg, bool allow_zero)
+static int __add_bool_argument(struct nvmf_arg_builder *argstr, char *tok,
+			       bool arg)
 {
-	char *nstr;
+	if (!arg)
+		return 0;
+	return nvmf_arg_append(argstr, ",%s", tok);
+}
 
+static int __add_int_argument(struct nvmf_arg_builder *argstr, char *tok,
+			      int arg, bool allow_zero)
+{
 	if (arg < 0 || (!arg && !allow_zero))
 		return 0;
-	if (asprintf(&nstr, "%s,%s=%d", *argstr, tok, arg) < 0) {
-		errno = ENOMEM;
-		return -1;
-	}
-	free(*argstr);
-	*argstr = nstr;
-
-	return 0;
+	return nvmf_arg_append(argstr, ",%s=%d", tok, arg);
 }
 
-static int __add_int_or_minus_one_argument(char **argstr, char *tok, int arg)
+static int __add_int_or_minus_one_argument(struct nvmf_arg_builder *argstr,
+					   char *tok, int arg)
 {
-	char *nstr;
-
 	if (arg < -1)
 		return 0;
-	if (asprintf(&nstr, "%s,%s=%d", *argstr, tok, arg) < 0) {
-		errno = ENOMEM;
-		return -1;
-	}
-	free(*argstr);
-	*argstr = nstr;
-
-	return 0;
+	return nvmf_arg_append(argstr, ",%s=%d", tok, arg);
 }
 
-static int __add_argument(char **argstr, const char *tok, const char *arg)
+static int __add_argument(struct nvmf_arg_builder *argstr, const char *tok,
+			  const char *arg)
 {
-	char *nstr;
-
 	if (!arg || arg[0] == '\0' || !strcmp(arg, "none"))
 		return 0;
-	if (asprintf(&nstr, "%s,%s=%s", *argstr, tok, arg) < 0) {
-		errno = ENOMEM;
-		return -1;
-	}
-	free(*argstr);
-	*argstr = nstr;
-
-	return 0;
+	return nvmf_arg_append(argstr, ",%s=%s", tok, arg);
 }
 
 static int __nvmf_supported_options(nvme_root_t r);
@@ -545,9 +569,11 @@ static bool traddr_is_hostname(nvme_root_t r, nvme_ctrl_t c)
 	return true;
 }
 
-static int build_options(nvme_host_t h, nvme_ctrl_t c, char **argstr)
+int build_options(nvme_host_t h, nvme_ctrl_t c, char **out)
 {
 	struct nvme_fabrics_config *cfg = nvme_ctrl_get_config(c);
+	struct nvmf_arg_builder b = { .len = 0 };
+	struct nvmf_arg_builder *argstr = &b;
 	const char *transport = nvme_ctrl_get_transport(c);
 	const char *hostnqn, *hostid, *hostkey, *ctrlkey;
 	bool discover = false, discovery_nqn = false;
@@ -568,11 +594,9 @@ static int build_options(nvme_host_t h, nvme_ctrl_t c, char **argstr)
 	}
 
 	/* always specify nqn as first arg - this will init the string */
-	if (asprintf(argstr, "nqn=%s",
-		     nvme_ctrl_get_subsysnqn(c)) < 0) {
-		errno = ENOMEM;
+	if (nvmf_arg_append(argstr, "nqn=%s",
+			    nvme_ctrl_get_subsysnqn(c)) < 0)
 		return -1;
-	}
 	if (!strcmp(nvme_ctrl_get_subsysnqn(c), NVME_DISC_SUBSYS_NAME)) {
 		nvme_ctrl_set_discovery_ctrl(c, true);
 		nvme_ctrl_set_unique_discovery_ctrl(c, false);
@@ -641,8 +665,12 @@ static int build_options(nvme_host_t h, nvme_ctrl_t c, char **argstr)
 	    (!strcmp(transport, "tcp") &&
 	     add_bool_argument(r, argstr, tls, cfg->tls)) ||
 	    (!strcmp(transport, "tcp") &&
-	     add_bool_argument(r, argstr, concat, cfg->concat))) {
-		free(*argstr);
+	     add_bool_argument(r, argstr, concat, cfg->concat)))
+		return -1;
+
+	*out = strdup(b.buf);
+	if (!*out) {
+		errno = ENOMEM;
 		return -1;
 	}
 
@@ -743,7 +771,7 @@ static  int __nvmf_supported_options(nvme_root_t r)
 	return 0;
 }
 
-static int __nvmf_add_ctrl(nvme_root_t r, const char *argstr)
+static int __nvmf_add_ctrl_dev(nvme_root_t r, const char *argstr)
 {
 	_cleanup_fd_ int fd = -1;
 	int ret, len = strlen(argstr);
@@ -804,6 +832,17 @@ static int __nvmf_add_ctrl(nvme_root_t r, const char *argstr)
 	return -ENVME_CONNECT_PARSE;
 }
 
+static int __nvmf_add_ctrl(nvme_root_t r, const char *argstr)
+{
+	int ret;
+
+	nvme_count(&r->counters.connect_attempts);
+	ret = __nvmf_add_ctrl_dev(r, argstr);
+	if (ret < 0)
+		nvme_count(&r->counters.connect_errors);
+	return ret;
+}
+
 static const char *lookup_context(nvme_root_t r, nvme_ctrl_t c)
 {
 
@@ -826,12 +865,12 @@ static const char *lookup_context(nvme_root_t r, nvme_ctrl_t c)
 	return NULL;
 }
 
-int nvmf_add_ctrl(nvme_host_t h, nvme_ctrl_t c,
-		  const struct nvme_fabrics_config *cfg)
+static int nvmf_prep_ctrl(nvme_host_t h, nvme_ctrl_t c,
+			  const struct nvme_fabrics_config *cfg,
+			  char **argstr)
 {
 	nvme_subsystem_t s;
 	const char *root_app, *app;
-	_cleanup_free_ char *argstr = NULL;
 	int ret;
 
 	/* highest prio have configs from command line */
@@ -898,10 +937,28 @@ int nvmf_add_ctrl(nvme_host_t h, nvme_ctrl_t c,
 			errno = ENVME_CONNECT_TRADDR;
 			return -1;
 		}
-		free(traddr);
+		/* the original traddr may live in the root's arena */
+		nvme_tree_free(traddr);
 	}
 
-	ret = build_options(h, c, &argstr);
+	ret = build_options(h, c, argstr);
+	if (ret)
+		return ret;
+
+	/* remember the built options for nvmf_reconnect_ctrl() */
+	free(c->connect_args);
+	c->connect_args = strdup(*argstr);
+
+	return 0;
+}
+
+int nvmf_add_ctrl(nvme_host_t h, nvme_ctrl_t c,
+		  const struct nvme_fabrics_config *cfg)
+{
+	_cleanup_free_ char *argstr = NULL;
+	int ret;
+
+	ret = nvmf_prep_ctrl(h, c, cfg, &argstr);
 	if (ret)
 		return ret;
 
@@ -916,15 +973,667 @@ int nvmf_add_ctrl(nvme_host_t h, nvme_ctrl_t c,
 	return nvme_init_ctrl(h, c, ret);
 }
 
-nvme_ctrl_t nvmf_connect_disc_entry(nvme_host_t h,
-				    struct nvmf_disc_log_entry *e,
-				    const struct nvme_fabrics_config *cfg,
-				    bool *discover)
+int nvmf_reconnect_ctrl(nvme_host_t h, nvme_ctrl_t c)
+{
+	int ret;
+
+	if (!c->connect_args)
+		return nvmf_add_ctrl(h, c, NULL);
+
+	ret = __nvmf_add_ctrl(h->r, c->connect_args);
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	nvme_msg(h->r, LOG_INFO, "nvme%d: %s connected\n", ret,
+		 nvme_ctrl_get_subsysnqn(c));
+	return nvme_init_ctrl(h, c, ret);
+}
+
+/*
+ * Concurrent connect engine. A write to /dev/nvme-fabrics blocks until
+ * the kernel has finished (or failed) the connect, so connecting many
+ * controllers one nvmf_add_ctrl() call at a time takes the sum of the
+ * individual connect times. The engine distributes the blocking writes
+ * over a pool of worker threads; the option strings are built when a
+ * connect is queued and the controllers are initialized from the thread
+ * calling nvmf_connect_engine_wait(), so the library's topology
+ * structures are never touched concurrently.
+ */
+#define NVMF_CONNECT_ENGINE_PARALLEL	8
+
+struct nvmf_connect_entry {
+	nvme_ctrl_t c;
+	char *argstr;
+	nvmf_connect_cb_t cb;
+	void *data;
+	int result;
+};
+
+struct nvmf_connect_engine {
+	nvme_host_t h;
+	struct nvmf_connect_entry *entries;
+	unsigned int nr;
+	unsigned int next;
+	unsigned int max_parallel;
+	pthread_mutex_t lock;
+};
+
+nvmf_connect_engine_t nvmf_connect_engine_create(nvme_host_t h,
+						 unsigned int max_parallel)
+{
+	struct nvmf_connect_engine *e;
+
+	if (!h) {
+		errno = EINVAL;
+		return NULL;
+	}
+	e = calloc(1, sizeof(*e));
+	if (!e) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	e->h = h;
+	e->max_parallel = max_parallel ? max_parallel :
+		NVMF_CONNECT_ENGINE_PARALLEL;
+	pthread_mutex_init(&e->lock, NULL);
+	return e;
+}
+
+int nvmf_connect_engine_add(nvmf_connect_engine_t e, nvme_ctrl_t c,
+			    const struct nvme_fabrics_config *cfg,
+			    nvmf_connect_cb_t cb, void *data)
+{
+	struct nvmf_connect_entry *entry, *tmp;
+	char *argstr = NULL;
+	int ret;
+
+	ret = nvmf_prep_ctrl(e->h, c, cfg, &argstr);
+	if (ret)
+		return ret;
+
+	tmp = realloc(e->entries, (e->nr + 1) * sizeof(*tmp));
+	if (!tmp) {
+		free(argstr);
+		errno = ENOMEM;
+		return -1;
+	}
+	e->entries = tmp;
+	entry = &e->entries[e->nr++];
+	memset(entry, 0, sizeof(*entry));
+	entry->c = c;
+	entry->argstr = argstr;
+	entry->cb = cb;
+	entry->data = data;
+	return 0;
+}
+
+static void *nvmf_connect_worker(void *arg)
+{
+	struct nvmf_connect_engine *e = arg;
+
+	for (;;) {
+		struct nvmf_connect_entry *entry;
+		unsigned int i;
+
+		pthread_mutex_lock(&e->lock);
+		i = e->next++;
+		pthread_mutex_unlock(&e->lock);
+		if (i >= e->nr)
+			break;
+		entry = &e->entries[i];
+		entry->result = __nvmf_add_ctrl(e->h->r, entry->argstr);
+	}
+	return NULL;
+}
+
+int nvmf_connect_engine_wait(nvmf_connect_engine_t e)
+{
+	_cleanup_free_ pthread_t *workers = NULL;
+	unsigned int i, nr_workers, started = 0;
+	int nr_failed = 0;
+
+	if (!e->nr)
+		return 0;
+
+	nr_workers = e->max_parallel < e->nr ? e->max_parallel : e->nr;
+	workers = calloc(nr_workers, sizeof(*workers));
+	if (workers) {
+		for (i = 0; i < nr_workers; i++) {
+			if (pthread_create(&workers[i], NULL,
+					   nvmf_connect_worker, e))
+				break;
+			started++;
+		}
+		for (i = 0; i < started; i++)
+			pthread_join(workers[i], NULL);
+	}
+	if (!started) {
+		/* no worker threads, connect serially on this thread */
+		nvmf_connect_worker(e);
+	}
+
+	for (i = 0; i < e->nr; i++) {
+		struct nvmf_connect_entry *entry = &e->entries[i];
+		int ret = entry->result;
+
+		if (ret >= 0) {
+			nvme_msg(e->h->r, LOG_INFO, "nvme%d: %s connected\n",
+				 ret, nvme_ctrl_get_subsysnqn(entry->c));
+			ret = nvme_init_ctrl(e->h, entry->c, ret);
+			if (ret)
+				ret = -errno;
+		} else {
+			errno = -ret;
+		}
+		if (ret)
+			nr_failed++;
+		if (entry->cb)
+			entry->cb(entry->c, ret < 0 ? ret : 0, entry->data);
+		free(entry->argstr);
+	}
+
+	free(e->entries);
+	e->entries = NULL;
+	e->nr = 0;
+	e->next = 0;
+	return nr_failed;
+}
+
+void nvmf_connect_engine_free(nvmf_connect_engine_t e)
+{
+	unsigned int i;
+
+	if (!e)
+		return;
+	for (i = 0; i < e->nr; i++)
+		free(e->entries[i].argstr);
+	free(e->entries);
+	pthread_mutex_destroy(&e->lock);
+	free(e);
+}
+
+/*
+ * AEN-driven discovery updates. The kernel arms the Asynchronous Event
+ * Request on a persistent discovery controller and reports a discovery
+ * log page change as a uevent (NVME_EVENT=discovery), so instead of
+ * polling the monitor sleeps on the kernel uevent netlink socket in
+ * epoll, refetches the log of the controller named in the event, and
+ * reports only the entries that differ from the previous log.
+ */
+#define NVMF_DISC_MONITOR_RETRIES	4
+
+struct nvmf_disc_monitor {
+	nvme_root_t r;
+	int epoll_fd;
+	int uevent_fd;
+	nvmf_disc_monitor_cb_t cb;
+	void *data;
+	nvme_ctrl_t *ctrls;
+	unsigned int nr_ctrls;
+};
+
+nvmf_disc_monitor_t nvmf_disc_monitor_create(nvme_root_t r,
+					     nvmf_disc_monitor_cb_t cb,
+					     void *data)
+{
+	struct nvmf_disc_monitor *m;
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1, /* kernel uevent multicast group */
+	};
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	m = calloc(1, sizeof(*m));
+	if (!m) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	m->r = r;
+	m->cb = cb;
+	m->data = data;
+	m->epoll_fd = -1;
+
+	m->uevent_fd = socket(AF_NETLINK,
+			      SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			      NETLINK_KOBJECT_UEVENT);
+	if (m->uevent_fd < 0)
+		goto free_monitor;
+	if (bind(m->uevent_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto close_uevent;
+
+	m->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (m->epoll_fd < 0)
+		goto close_uevent;
+	if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->uevent_fd, &ev) < 0)
+		goto close_epoll;
+
+	return m;
+
+close_epoll:
+	close(m->epoll_fd);
+close_uevent:
+	close(m->uevent_fd);
+free_monitor:
+	free(m);
+	return NULL;
+}
+
+int nvmf_disc_monitor_get_fd(nvmf_disc_monitor_t m)
+{
+	return m->epoll_fd;
+}
+
+int nvmf_disc_monitor_add_ctrl(nvmf_disc_monitor_t m, nvme_ctrl_t c)
+{
+	nvme_ctrl_t *tmp;
+	int fd;
+
+	if (!nvme_ctrl_is_discovery_ctrl(c)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	tmp = realloc(m->ctrls, (m->nr_ctrls + 1) * sizeof(*tmp));
+	if (!tmp) {
+		errno = ENOMEM;
+		return -1;
+	}
+	m->ctrls = tmp;
+	m->ctrls[m->nr_ctrls++] = c;
+
+	/*
+	 * The kernel enables the discovery log change notice itself for
+	 * discovery controllers; re-arm explicitly in case the target
+	 * reset the AEN configuration. Failure is not fatal.
+	 */
+	fd = nvme_ctrl_get_fd(c);
+	if (fd >= 0)
+		nvme_set_features_async_event(fd,
+			NVME_FEATURE_AENCFG_NOTICE_DISCOVERY_CHANGE,
+			false, NULL);
+
+	/* baseline for the first diff */
+	if (!c->disc_log) {
+		struct nvmf_discovery_log *log = NULL;
+
+		if (!nvmf_get_discovery_log(c, &log, 1))
+			free(log);
+	}
+
+	return 0;
+}
+
+static bool nvmf_disc_entry_eq(const struct nvmf_disc_log_entry *a,
+			       const struct nvmf_disc_log_entry *b)
+{
+	return a->trtype == b->trtype && a->adrfam == b->adrfam &&
+		a->subtype == b->subtype &&
+		!strncmp(a->subnqn, b->subnqn, sizeof(a->subnqn)) &&
+		!strncmp(a->traddr, b->traddr, sizeof(a->traddr)) &&
+		!strncmp(a->trsvcid, b->trsvcid, sizeof(a->trsvcid));
+}
+
+static unsigned int nvmf_disc_log_diff(struct nvmf_discovery_log *from,
+				       struct nvmf_discovery_log *to,
+				       struct nvmf_disc_log_entry *out)
+{
+	unsigned int nr = 0;
+	uint64_t i, j, from_nr, to_nr;
+
+	from_nr = from ? le64_to_cpu(from->numrec) : 0;
+	to_nr = to ? le64_to_cpu(to->numrec) : 0;
+
+	for (i = 0; i < to_nr; i++) {
+		for (j = 0; j < from_nr; j++)
+			if (nvmf_disc_entry_eq(&to->entries[i],
+					       &from->entries[j]))
+				break;
+		if (j == from_nr)
+			out[nr++] = to->entries[i];
+	}
+	return nr;
+}
+
+static int nvmf_disc_monitor_refresh(nvmf_disc_monitor_t m, nvme_ctrl_t c)
+{
+	struct nvmf_discovery_log *old, *log = NULL;
+	_cleanup_free_ struct nvmf_disc_log_entry *added = NULL;
+	_cleanup_free_ struct nvmf_disc_log_entry *removed = NULL;
+	unsigned int nr_added, nr_removed;
+	uint64_t old_nr, new_nr;
+
+	/* steal the cached log so the fetch cannot serve it back */
+	old = c->disc_log;
+	c->disc_log = NULL;
+
+	if (nvmf_get_discovery_log(c, &log, NVMF_DISC_MONITOR_RETRIES)) {
+		c->disc_log = old;
+		return -1;
+	}
+
+	old_nr = old ? le64_to_cpu(old->numrec) : 0;
+	new_nr = le64_to_cpu(log->numrec);
+
+	if (new_nr)
+		added = calloc(new_nr, sizeof(*added));
+	if (old_nr)
+		removed = calloc(old_nr, sizeof(*removed));
+	if ((new_nr && !added) || (old_nr && !removed)) {
+		free(old);
+		free(log);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	nr_added = nvmf_disc_log_diff(old, log, added);
+	nr_removed = nvmf_disc_log_diff(log, old, removed);
+	free(old);
+	free(log);
+
+	if ((nr_added || nr_removed) && m->cb)
+		m->cb(c, added, nr_added, removed, nr_removed, m->data);
+
+	return nr_added || nr_removed ? 1 : 0;
+}
+
+static nvme_ctrl_t nvmf_disc_monitor_parse_uevent(nvmf_disc_monitor_t m,
+						  const char *buf, size_t len)
+{
+	const char *p = buf, *name = NULL;
+	bool discovery = false;
+	unsigned int i;
+
+	while (p < buf + len) {
+		if (!strcmp(p, "NVME_EVENT=discovery"))
+			discovery = true;
+		else if (!strncmp(p, "NVME_CTRL_NAME=", 15))
+			name = p + 15;
+		p += strlen(p) + 1;
+	}
+	if (!discovery || !name)
+		return NULL;
+	for (i = 0; i < m->nr_ctrls; i++)
+		if (!strcmp(nvme_ctrl_get_name(m->ctrls[i]), name))
+			return m->ctrls[i];
+	return NULL;
+}
+
+int nvmf_disc_monitor_run(nvmf_disc_monitor_t m, int timeout_ms)
+{
+	struct epoll_event ev;
+	int nr_updates = 0, ret;
+
+	ret = epoll_wait(m->epoll_fd, &ev, 1, timeout_ms);
+	if (ret < 0)
+		return -1;
+	if (!ret)
+		return 0;
+
+	for (;;) {
+		char buf[8192];
+		ssize_t len;
+		nvme_ctrl_t c;
+
+		len = recv(m->uevent_fd, buf, sizeof(buf) - 1, 0);
+		if (len <= 0)
+			break;
+		buf[len] = '\0';
+		c = nvmf_disc_monitor_parse_uevent(m, buf, len);
+		if (!c)
+			continue;
+		if (nvmf_disc_monitor_refresh(m, c) > 0)
+			nr_updates++;
+	}
+
+	return nr_updates;
+}
+
+void nvmf_disc_monitor_free(nvmf_disc_monitor_t m)
+{
+	if (!m)
+		return;
+	close(m->epoll_fd);
+	close(m->uevent_fd);
+	free(m->ctrls);
+	free(m);
+}
+
+/*
+ * Reconnect scheduler. Retrying failed controllers in hand-rolled loops
+ * tends to synchronize across controllers after a fabric event, hammering
+ * /dev/nvme-fabrics and the target in bursts. The scheduler spreads the
+ * attempts instead: one timerfd drives per-controller exponential backoff
+ * with +-25% jitter, bounded by the controller's ctrl_loss_tmo.
+ */
+#define NVMF_RECONNECT_DEF_DELAY_MS	10000
+#define NVMF_RECONNECT_MAX_DELAY_MS	60000
+#define NVMF_RECONNECT_COALESCE_MS	100
+
+struct nvmf_reconnect_entry {
+	struct list_node entry;
+	nvme_ctrl_t c;
+	/* next attempt and end of the retry window, monotonic ms;
+	 * a zero give_up means retry indefinitely */
+	uint64_t deadline;
+	uint64_t give_up;
+	unsigned int delay_ms;
+};
+
+struct nvmf_reconnect_sched {
+	nvme_root_t r;
+	nvmf_reconnect_cb_t cb;
+	void *data;
+	struct list_head entries;
+	int timer_fd;
+	unsigned int seed;
+};
+
+/* spread a delay over +-25%, so controllers that failed together don't
+ * retry together */
+static uint64_t nvmf_reconnect_jitter(struct nvmf_reconnect_sched *s,
+				      uint64_t delay)
+{
+	uint64_t spread = delay / 2;
+
+	if (!spread)
+		return delay;
+	return delay - delay / 4 + rand_r(&s->seed) % (spread + 1);
+}
+
+static void nvmf_reconnect_arm_timer(struct nvmf_reconnect_sched *s)
+{
+	struct itimerspec its = { };
+	struct nvmf_reconnect_entry *e;
+	uint64_t next = 0, now;
+
+	list_for_each(&s->entries, e, entry)
+		if (!next || e->deadline < next)
+			next = e->deadline;
+
+	/* an all-zero itimerspec disarms the timer */
+	if (next) {
+		now = nvme_now_ms();
+		if (next <= now)
+			next = now + 1;
+		its.it_value.tv_sec = (next - now) / 1000;
+		its.it_value.tv_nsec = ((next - now) % 1000) * 1000000L;
+	}
+
+	timerfd_settime(s->timer_fd, 0, &its, NULL);
+}
+
+nvmf_reconnect_sched_t nvmf_reconnect_sched_create(nvme_root_t r,
+						   nvmf_reconnect_cb_t cb,
+						   void *data)
+{
+	struct nvmf_reconnect_sched *s;
+
+	if (!cb) {
+		errno = EINVAL;
+		return NULL;
+	}
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	s->r = r;
+	s->cb = cb;
+	s->data = data;
+	list_head_init(&s->entries);
+	s->seed = nvme_now_ms() ^ getpid();
+
+	s->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				     TFD_NONBLOCK | TFD_CLOEXEC);
+	if (s->timer_fd < 0) {
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+int nvmf_reconnect_sched_get_fd(nvmf_reconnect_sched_t s)
+{
+	return s->timer_fd;
+}
+
+int nvmf_reconnect_sched_add(nvmf_reconnect_sched_t s, nvme_ctrl_t c)
+{
+	struct nvmf_reconnect_entry *e;
+	uint64_t now = nvme_now_ms();
+
+	list_for_each(&s->entries, e, entry) {
+		if (e->c == c) {
+			errno = EEXIST;
+			return -1;
+		}
+	}
+
+	e = calloc(1, sizeof(*e));
+	if (!e) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	e->c = c;
+	e->delay_ms = c->cfg.reconnect_delay > 0 ?
+		c->cfg.reconnect_delay * 1000 : NVMF_RECONNECT_DEF_DELAY_MS;
+	e->deadline = now + nvmf_reconnect_jitter(s, e->delay_ms);
+	/* negative ctrl_loss_tmo retries indefinitely; zero allows a
+	 * single attempt */
+	if (c->cfg.ctrl_loss_tmo >= 0)
+		e->give_up = now + (uint64_t)c->cfg.ctrl_loss_tmo * 1000;
+
+	list_add_tail(&s->entries, &e->entry);
+	nvmf_reconnect_arm_timer(s);
+
+	return 0;
+}
+
+int nvmf_reconnect_sched_remove(nvmf_reconnect_sched_t s, nvme_ctrl_t c)
+{
+	struct nvmf_reconnect_entry *e;
+
+	list_for_each(&s->entries, e, entry) {
+		if (e->c != c)
+			continue;
+		list_del(&e->entry);
+		free(e);
+		nvmf_reconnect_arm_timer(s);
+		return 0;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+int nvmf_reconnect_sched_run(nvmf_reconnect_sched_t s, int timeout_ms)
+{
+	struct nvmf_reconnect_entry *e, *tmp;
+	struct pollfd pfd;
+	uint64_t now, expirations;
+	int rc, nr_done = 0;
+
+	pfd.fd = s->timer_fd;
+	pfd.events = POLLIN;
+	do {
+		rc = poll(&pfd, 1, timeout_ms);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0)
+		return -1;
+	if (rc > 0 && read(s->timer_fd, &expirations,
+			   sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		return -1;
+
+	now = nvme_now_ms();
+	list_for_each_safe(&s->entries, e, tmp, entry) {
+		nvme_ctrl_t c = e->c;
+		nvme_host_t h;
+		int errno_save;
+
+		/* take attempts due shortly along with this wakeup */
+		if (e->deadline > now + NVMF_RECONNECT_COALESCE_MS)
+			continue;
+
+		h = nvme_subsystem_get_host(nvme_ctrl_get_subsystem(c));
+		if (!nvmf_reconnect_ctrl(h, c)) {
+			list_del(&e->entry);
+			free(e);
+			s->cb(c, 0, s->data);
+			nr_done++;
+			continue;
+		}
+		errno_save = errno;
+
+		nvme_msg(s->r, LOG_DEBUG,
+			 "reconnect of %s failed (%s), next attempt in %ums\n",
+			 nvme_ctrl_get_subsysnqn(c), strerror(errno_save),
+			 e->delay_ms);
+
+		/* back off exponentially, bounded by the retry window */
+		e->delay_ms = e->delay_ms * 2 < NVMF_RECONNECT_MAX_DELAY_MS ?
+			e->delay_ms * 2 : NVMF_RECONNECT_MAX_DELAY_MS;
+		e->deadline = now + nvmf_reconnect_jitter(s, e->delay_ms);
+
+		if (e->give_up && e->deadline >= e->give_up) {
+			list_del(&e->entry);
+			free(e);
+			s->cb(c, -errno_save, s->data);
+			nr_done++;
+		}
+	}
+
+	nvmf_reconnect_arm_timer(s);
+
+	return nr_done;
+}
+
+void nvmf_reconnect_sched_free(nvmf_reconnect_sched_t s)
+{
+	struct nvmf_reconnect_entry *e, *tmp;
+
+	if (!s)
+		return;
+	list_for_each_safe(&s->entries, e, tmp, entry) {
+		list_del(&e->entry);
+		free(e);
+	}
+	close(s->timer_fd);
+	free(s);
+}
+
+static nvme_ctrl_t nvmf_disc_entry_to_ctrl(nvme_host_t h,
+					   struct nvmf_disc_log_entry *e,
+					   const struct nvme_fabrics_config *cfg,
+					   bool *discover)
 {
 	const char *transport;
 	char *traddr = NULL, *trsvcid = NULL;
 	nvme_ctrl_t c;
-	int ret;
 
 	switch (e->trtype) {
 	case NVMF_TRTYPE_RDMA:
@@ -1018,6 +1727,21 @@ nvme_ctrl_t nvmf_connect_disc_entry(nvme_host_t h,
 	    e->tsas.tcp.sectype != NVMF_TCP_SECTYPE_NONE)
 		c->cfg.tls = true;
 
+	return c;
+}
+
+nvme_ctrl_t nvmf_connect_disc_entry(nvme_host_t h,
+				    struct nvmf_disc_log_entry *e,
+				    const struct nvme_fabrics_config *cfg,
+				    bool *discover)
+{
+	nvme_ctrl_t c;
+	int ret;
+
+	c = nvmf_disc_entry_to_ctrl(h, e, cfg, discover);
+	if (!c)
+		return NULL;
+
 	ret = nvmf_add_ctrl(h, c, cfg);
 	if (!ret)
 		return c;
@@ -1036,6 +1760,118 @@ nvme_ctrl_t nvmf_connect_disc_entry(nvme_host_t h,
 	return NULL;
 }
 
+struct nvmf_disc_conn {
+	nvme_ctrl_t c;
+	uint64_t idx;
+	int status;
+};
+
+static void nvmf_disc_conn_done(nvme_ctrl_t c, int status, void *data)
+{
+	struct nvmf_disc_conn *conn = data;
+
+	conn->status = status;
+}
+
+int nvmf_connect_disc_entries(nvme_host_t h, struct nvmf_discovery_log *log,
+			      const struct nvme_fabrics_config *cfg,
+			      nvmf_disc_filter_t filter, void *filter_data,
+			      int *results, unsigned int n_parallel)
+{
+	_cleanup_free_ struct nvmf_disc_conn *conns = NULL;
+	nvmf_connect_engine_t engine;
+	unsigned int nr_conns = 0, k;
+	uint64_t numrec, i;
+	int nr_connected = 0;
+
+	if (!log) {
+		errno = EINVAL;
+		return -1;
+	}
+	numrec = le64_to_cpu(log->numrec);
+	if (!numrec)
+		return 0;
+
+	conns = calloc(numrec, sizeof(*conns));
+	engine = nvmf_connect_engine_create(h, n_parallel);
+	if (!conns || !engine) {
+		nvmf_connect_engine_free(engine);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < numrec; i++) {
+		struct nvmf_disc_log_entry *e = &log->entries[i];
+		nvme_subsystem_t s;
+		nvme_ctrl_t c;
+
+		if (results)
+			results[i] = 0;
+		if (filter && !filter(e, filter_data)) {
+			if (results)
+				results[i] = -ENVME_CONNECT_IGNORED;
+			continue;
+		}
+
+		c = nvmf_disc_entry_to_ctrl(h, e, cfg, NULL);
+		if (!c) {
+			if (results)
+				results[i] = -errno;
+			continue;
+		}
+
+		/* don't bother the kernel with known duplicates */
+		s = nvme_lookup_subsystem(h, NULL, nvme_ctrl_get_subsysnqn(c));
+		if (s) {
+			nvme_ctrl_t fc;
+
+			fc = __nvme_lookup_ctrl(s, c->transport, c->traddr,
+						NULL, NULL, c->trsvcid,
+						NULL, NULL);
+			if (fc && nvme_ctrl_get_name(fc)) {
+				nvme_free_ctrl(c);
+				if (results)
+					results[i] = -ENVME_CONNECT_ALREADY;
+				continue;
+			}
+		}
+
+		if (nvmf_connect_engine_add(engine, c, cfg,
+					    nvmf_disc_conn_done,
+					    &conns[nr_conns])) {
+			if (results)
+				results[i] = -errno;
+			nvme_free_ctrl(c);
+			continue;
+		}
+		conns[nr_conns].c = c;
+		conns[nr_conns].idx = i;
+		nr_conns++;
+	}
+
+	nvmf_connect_engine_wait(engine);
+	nvmf_connect_engine_free(engine);
+
+	for (k = 0; k < nr_conns; k++) {
+		struct nvmf_disc_conn *conn = &conns[k];
+		nvme_ctrl_t c = conn->c;
+
+		if (conn->status == -EINVAL && c->cfg.disable_sqflow) {
+			/* disable_sqflow is unrecognized on older kernels */
+			c->cfg.disable_sqflow = false;
+			conn->status = nvmf_add_ctrl(h, c, cfg) ? -errno : 0;
+		}
+		if (conn->status)
+			nvme_free_ctrl(c);
+		else
+			nr_connected++;
+		if (results)
+			results[conn->idx] = conn->status;
+	}
+
+	return nr_connected;
+}
+
 /*
  * Most of nvmf_discovery_log is reserved, so only fetch the initial bytes.
  * 8 bytes for GENCTR, 8 for NUMREC, and 2 for RECFMT.
@@ -1043,6 +1879,46 @@ nvme_ctrl_t nvmf_connect_disc_entry(nvme_host_t h,
  */
 #define DISCOVERY_HEADER_LEN 20
 
+/*
+ * The discovery log can only change together with GENCTR, so the last
+ * fetched log is kept on the controller. A poll then only needs the
+ * header read: when GENCTR is unchanged the cached payload is returned
+ * instead of transferring hundreds of entries again.
+ */
+static void nvmf_cache_discovery_log(nvme_ctrl_t c,
+				     struct nvmf_discovery_log *log)
+{
+	struct nvmf_discovery_log *copy;
+	size_t log_size = sizeof(*log) +
+		sizeof(*log->entries) * le64_to_cpu(log->numrec);
+
+	copy = __nvme_alloc(log_size);
+	if (!copy)
+		return;
+	memcpy(copy, log, log_size);
+	free(c->disc_log);
+	c->disc_log = copy;
+}
+
+static struct nvmf_discovery_log *
+nvmf_cached_discovery_log(nvme_ctrl_t c, uint64_t genctr, uint64_t numrec)
+{
+	struct nvmf_discovery_log *copy;
+	size_t log_size;
+
+	if (!c->disc_log ||
+	    genctr != le64_to_cpu(c->disc_log->genctr) ||
+	    numrec != le64_to_cpu(c->disc_log->numrec))
+		return NULL;
+
+	log_size = sizeof(*copy) + sizeof(*copy->entries) * numrec;
+	copy = __nvme_alloc(log_size);
+	if (!copy)
+		return NULL;
+	memcpy(copy, c->disc_log, log_size);
+	return copy;
+}
+
 static struct nvmf_discovery_log *nvme_discovery_log(
 	const struct nvme_get_discovery_args *args)
 {
@@ -1084,6 +1960,7 @@ static struct nvmf_discovery_log *nvme_discovery_log(
 	}
 
 	do {
+		struct nvmf_discovery_log *cached;
 		size_t entries_size;
 
 		numrec = le64_to_cpu(log->numrec);
@@ -1092,6 +1969,16 @@ static struct nvmf_discovery_log *nvme_discovery_log(
 		if (numrec == 0)
 			break;
 
+		cached = nvmf_cached_discovery_log(args->c, genctr, numrec);
+		if (cached) {
+			nvme_msg(r, LOG_DEBUG,
+				 "%s: genctr %" PRIu64 " unchanged, "
+				 "using cached discovery log\n",
+				 name, genctr);
+			free(log);
+			return cached;
+		}
+
 		free(log);
 		entries_size = sizeof(*log->entries) * numrec;
 		log = __nvme_alloc(sizeof(*log) + entries_size);
@@ -1144,6 +2031,7 @@ static struct nvmf_discovery_log *nvme_discovery_log(
 			 name, numrec, le64_to_cpu(log->numrec));
 		errno = EBADSLT;
 	} else {
+		nvmf_cache_discovery_log(args->c, log);
 		return log;
 	}
 
@@ -1863,3 +2751,161 @@ void nvme_free_uri(struct nvme_fabrics_uri *uri)
 	free(uri->fragment);
 	free(uri);
 }
+
+static void nvme_uri_span(struct nvme_uri_view *v, const char *start,
+			  const char *end)
+{
+	v->str = start;
+	v->len = end - start;
+}
+
+static int nvme_uri_parse_port(const char *p, const char *end)
+{
+	int port = 0;
+
+	while (p < end && *p >= '0' && *p <= '9')
+		port = port * 10 + *p++ - '0';
+	return port;
+}
+
+int nvme_parse_uri_view(struct nvme_fabrics_uri_view *uri, const char *str)
+{
+	const char *sep, *auth, *auth_end, *host, *rest, *path_end;
+	const char *p, *e;
+
+	memset(uri, 0, sizeof(*uri));
+	if (!str) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* scheme[+protocol]:// */
+	sep = strstr(str, "://");
+	if (!sep || sep == str)
+		goto invalid;
+	for (p = str; p < sep; p++)
+		if (*p == ':' || *p == '/')
+			goto invalid;
+	e = memchr(str, '+', sep - str);
+	if (e) {
+		if (e == str)
+			goto invalid;
+		nvme_uri_span(&uri->scheme, str, e);
+		if (e + 1 < sep)
+			nvme_uri_span(&uri->protocol, e + 1, sep);
+	} else {
+		nvme_uri_span(&uri->scheme, str, sep);
+	}
+
+	auth = sep + 3;
+	auth_end = auth + strcspn(auth, "/?#");
+	if (auth_end == auth)
+		goto invalid;
+
+	/* userinfo runs up to the last '@' of the authority */
+	e = memrchr(auth, '@', auth_end - auth);
+	if (e) {
+		nvme_uri_span(&uri->userinfo, auth, e);
+		host = e + 1;
+	} else {
+		host = auth;
+	}
+
+	/* try matching IPv6 address first */
+	e = *host == '[' ? memchr(host, ']', auth_end - host) : NULL;
+	if (e) {
+		nvme_uri_span(&uri->host, host + 1, e);
+		if (e + 1 < auth_end && e[1] == ':')
+			uri->port = nvme_uri_parse_port(e + 2, auth_end);
+	} else {
+		/* treat it as IPv4/hostname */
+		e = memchr(host, ':', auth_end - host);
+		if (e) {
+			nvme_uri_span(&uri->host, host, e);
+			uri->port = nvme_uri_parse_port(e + 1, auth_end);
+		} else {
+			nvme_uri_span(&uri->host, host, auth_end);
+		}
+	}
+	if (!uri->host.len)
+		goto invalid;
+
+	/* fragment after the last '#', query after the last '?' */
+	rest = auth_end;
+	e = strrchr(rest, '#');
+	path_end = e ? e : rest + strlen(rest);
+	if (e)
+		nvme_uri_span(&uri->fragment, e + 1, e + 1 + strlen(e + 1));
+	e = memrchr(rest, '?', path_end - rest);
+	if (e) {
+		nvme_uri_span(&uri->query, e + 1, path_end);
+		path_end = e;
+	}
+
+	/* split the path into elements, collapsing repeated '/' */
+	for (p = rest; p < path_end; p = e) {
+		while (p < path_end && *p == '/')
+			p++;
+		e = p;
+		while (e < path_end && *e != '/')
+			e++;
+		if (e == p)
+			continue;
+		if (uri->nr_path_segments >= NVME_URI_VIEW_SEGMENTS) {
+			memset(uri, 0, sizeof(*uri));
+			errno = E2BIG;
+			return -1;
+		}
+		nvme_uri_span(&uri->path_segments[uri->nr_path_segments++],
+			      p, e);
+	}
+
+	return 0;
+
+invalid:
+	memset(uri, 0, sizeof(*uri));
+	errno = EINVAL;
+	return -1;
+}
+
+int nvme_parse_uri_batch(struct nvme_fabrics_uri_view *uris,
+			 const char *const *strs, unsigned int n)
+{
+	unsigned int i, parsed = 0;
+
+	if (!uris || (n && !strs)) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		if (!nvme_parse_uri_view(&uris[i], strs[i]))
+			parsed++;
+	return parsed;
+}
+
+int nvme_uri_view_decode(const struct nvme_uri_view *view, char *buf,
+			 size_t size)
+{
+	size_t i, j;
+
+	for (i = 0, j = 0; view->str && i < view->len; i++, j++) {
+		if (j + 1 >= size) {
+			errno = ENOBUFS;
+			return -1;
+		}
+		if (view->str[i] == '%' && i + 2 < view->len &&
+		    IS_XDIGIT(view->str[i + 1]) && IS_XDIGIT(view->str[i + 2])) {
+			buf[j] = (XDIGIT_VAL(view->str[i + 1]) << 4) +
+				  XDIGIT_VAL(view->str[i + 2]);
+			i += 2;
+		} else {
+			buf[j] = view->str[i];
+		}
+	}
+	if (!size) {
+		errno = ENOBUFS;
+		return -1;
+	}
+	buf[j] = '\0';
+	return j;
+}
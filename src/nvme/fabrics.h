@@ -89,6 +89,54 @@ struct nvme_fabrics_uri {
 	char *fragment;
 };
 
+/**
+ * struct nvme_uri_view - Borrowed slice of a URI component
+ * @str:	Start of the component inside the parsed string
+ * @len:	Length of the component in bytes
+ *
+ * A view borrows from the caller's URI string: nothing is copied or
+ * unescaped, and the view is only valid as long as that string.
+ * Percent-escapes are left in place; use nvme_uri_view_decode() to
+ * unescape into a caller-provided buffer. An absent component has
+ * @str set to NULL.
+ */
+struct nvme_uri_view {
+	const char *str;
+	size_t len;
+};
+
+/**
+ * NVME_URI_VIEW_SEGMENTS - Maximum path segments of a parsed URI view
+ */
+#define NVME_URI_VIEW_SEGMENTS 8
+
+/**
+ * struct nvme_fabrics_uri_view - Zero-allocation parsed URI
+ * @scheme:		Scheme name (typically 'nvme')
+ * @protocol:		Optional protocol/transport (e.g. 'tcp')
+ * @userinfo:		Optional user information component
+ * @host:		Host transport address
+ * @port:		The port subcomponent or 0 if not specified
+ * @path_segments:	Path segments, @nr_path_segments entries used
+ * @nr_path_segments:	Number of parsed path segments
+ * @query:		Optional query string component (separated by '?')
+ * @fragment:		Optional fragment identifier (separated by '#')
+ *
+ * Offsets-and-lengths counterpart of &struct nvme_fabrics_uri for
+ * callers parsing URIs in bulk; see nvme_parse_uri_view().
+ */
+struct nvme_fabrics_uri_view {
+	struct nvme_uri_view scheme;
+	struct nvme_uri_view protocol;
+	struct nvme_uri_view userinfo;
+	struct nvme_uri_view host;
+	int port;
+	struct nvme_uri_view path_segments[NVME_URI_VIEW_SEGMENTS];
+	unsigned int nr_path_segments;
+	struct nvme_uri_view query;
+	struct nvme_uri_view fragment;
+};
+
 /**
  * nvmf_trtype_str() - Decode TRTYPE field
  * @trtype: value to be decoded
@@ -221,6 +269,281 @@ void nvmf_update_config(nvme_ctrl_t c, const struct nvme_fabrics_config *cfg);
 int nvmf_add_ctrl(nvme_host_t h, nvme_ctrl_t c,
 		  const struct nvme_fabrics_config *cfg);
 
+/**
+ * nvmf_reconnect_ctrl() - Reconnect a previously connected controller
+ * @h:		Host to which the controller should be attached
+ * @c:		Controller to be connected
+ *
+ * Re-issues the 'connect' command for @c using the option string built
+ * on the previous connect, skipping configuration merging and string
+ * construction entirely. When no previous option string is cached this
+ * is equivalent to nvmf_add_ctrl() with a default configuration.
+ *
+ * Return: 0 on success; on failure errno is set and -1 is returned.
+ */
+int nvmf_reconnect_ctrl(nvme_host_t h, nvme_ctrl_t c);
+
+/**
+ * typedef nvmf_connect_cb_t - Connect engine completion callback
+ * @c:		Controller the connect attempt was made for
+ * @status:	0 on success or a negative errno value on failure
+ * @data:	Context pointer passed to nvmf_connect_engine_add()
+ *
+ * Invoked once per queued connect from the thread calling
+ * nvmf_connect_engine_wait().
+ */
+typedef void (*nvmf_connect_cb_t)(nvme_ctrl_t c, int status, void *data);
+
+typedef struct nvmf_connect_engine *nvmf_connect_engine_t;
+
+/**
+ * nvmf_connect_engine_create() - Create a concurrent connect engine
+ * @h:			Host to which the controllers should be attached
+ * @max_parallel:	Maximum number of connects in flight, 0 for the
+ *			built-in default
+ *
+ * A write to the fabrics device blocks until the kernel has finished
+ * the connect attempt, so connecting many controllers one
+ * nvmf_add_ctrl() call at a time takes the sum of the individual
+ * connect times. The connect engine issues the blocking connect
+ * commands from a pool of worker threads so that bring-up time is
+ * bounded by the slowest target instead.
+ *
+ * Return: an engine handle to be freed with nvmf_connect_engine_free(),
+ * or NULL on failure with errno set.
+ */
+nvmf_connect_engine_t nvmf_connect_engine_create(nvme_host_t h,
+						 unsigned int max_parallel);
+
+/**
+ * nvmf_connect_engine_add() - Queue a controller connect
+ * @e:		Connect engine
+ * @c:		Controller to be connected
+ * @cfg:	Default configuration for the controller
+ * @cb:		Completion callback, may be NULL
+ * @data:	Context pointer handed to @cb
+ *
+ * Merges the configuration and builds the connect options for @c as
+ * nvmf_add_ctrl() does, and queues the connect for execution by
+ * nvmf_connect_engine_wait(). @c must be initialized and not connected
+ * to the topology, and must stay valid until @cb has been invoked.
+ *
+ * Return: 0 on success; on failure errno is set and -1 is returned.
+ */
+int nvmf_connect_engine_add(nvmf_connect_engine_t e, nvme_ctrl_t c,
+			    const struct nvme_fabrics_config *cfg,
+			    nvmf_connect_cb_t cb, void *data);
+
+/**
+ * nvmf_connect_engine_wait() - Run all queued connects and wait
+ * @e:		Connect engine
+ *
+ * Issues all queued connects in parallel and blocks until every
+ * attempt has completed. Successfully connected controllers are
+ * inserted into the topology and each completion callback is invoked
+ * from the calling thread. Afterwards the queue is empty and the
+ * engine can be reused.
+ *
+ * Return: the number of failed connects, i.e. 0 if all succeeded.
+ */
+int nvmf_connect_engine_wait(nvmf_connect_engine_t e);
+
+/**
+ * nvmf_connect_engine_free() - Release a connect engine
+ * @e:		Connect engine
+ *
+ * Frees @e and any connects still queued; queued but unissued
+ * connects are dropped without their callbacks being invoked.
+ */
+void nvmf_connect_engine_free(nvmf_connect_engine_t e);
+
+/**
+ * typedef nvmf_disc_monitor_cb_t - Discovery monitor update callback
+ * @c:			Discovery controller whose log changed
+ * @added:		Entries present now but not in the previous log
+ * @nr_added:		Number of entries in @added
+ * @removed:		Entries present in the previous log but gone now
+ * @nr_removed:		Number of entries in @removed
+ * @data:		Context pointer passed to nvmf_disc_monitor_create()
+ *
+ * Invoked from nvmf_disc_monitor_run() whenever a refetched discovery
+ * log differs from the previous one. The entry arrays are only valid
+ * for the duration of the callback.
+ */
+typedef void (*nvmf_disc_monitor_cb_t)(nvme_ctrl_t c,
+				       struct nvmf_disc_log_entry *added,
+				       unsigned int nr_added,
+				       struct nvmf_disc_log_entry *removed,
+				       unsigned int nr_removed,
+				       void *data);
+
+typedef struct nvmf_disc_monitor *nvmf_disc_monitor_t;
+
+/**
+ * nvmf_disc_monitor_create() - Create an AEN-driven discovery monitor
+ * @r:		&nvme_root_t object
+ * @cb:		Callback invoked with the changed discovery log entries
+ * @data:	Context pointer handed to @cb
+ *
+ * Instead of polling discovery controllers, the monitor listens on the
+ * kernel uevent socket for the discovery log change notification that
+ * the kernel raises when a persistent discovery controller signals the
+ * AEN, refetches the log of the affected controller only, and reports
+ * the difference to the previous log through @cb.
+ *
+ * Return: a monitor handle to be freed with nvmf_disc_monitor_free(),
+ * or NULL on failure with errno set.
+ */
+nvmf_disc_monitor_t nvmf_disc_monitor_create(nvme_root_t r,
+					     nvmf_disc_monitor_cb_t cb,
+					     void *data);
+
+/**
+ * nvmf_disc_monitor_get_fd() - File descriptor to wait on
+ * @m:		Discovery monitor
+ *
+ * Return: a pollable file descriptor which becomes readable when a
+ * discovery event is pending, for embedding the monitor into an
+ * existing event loop; call nvmf_disc_monitor_run() with a zero
+ * timeout once it is readable.
+ */
+int nvmf_disc_monitor_get_fd(nvmf_disc_monitor_t m);
+
+/**
+ * nvmf_disc_monitor_add_ctrl() - Monitor a discovery controller
+ * @m:		Discovery monitor
+ * @c:		Connected persistent discovery controller
+ *
+ * Adds @c to the set of monitored controllers, re-arms the discovery
+ * log change notice in the controller's Asynchronous Event
+ * Configuration, and fetches the current log as the baseline for the
+ * first diff. @c must stay valid until the monitor is freed.
+ *
+ * Return: 0 on success; on failure errno is set and -1 is returned.
+ */
+int nvmf_disc_monitor_add_ctrl(nvmf_disc_monitor_t m, nvme_ctrl_t c);
+
+/**
+ * nvmf_disc_monitor_run() - Wait for and process discovery events
+ * @m:			Discovery monitor
+ * @timeout_ms:		Maximum time to sleep, -1 to block indefinitely
+ *
+ * Sleeps until a discovery log change event arrives or the timeout
+ * expires, refetches the log of each controller named in the pending
+ * events and invokes the callback for every log that actually changed.
+ *
+ * Return: the number of changed logs processed, 0 on timeout, or -1
+ * on failure with errno set.
+ */
+int nvmf_disc_monitor_run(nvmf_disc_monitor_t m, int timeout_ms);
+
+/**
+ * nvmf_disc_monitor_free() - Release a discovery monitor
+ * @m:		Discovery monitor
+ *
+ * Closes the event file descriptors and frees @m; the monitored
+ * controllers themselves are left untouched.
+ */
+void nvmf_disc_monitor_free(nvmf_disc_monitor_t m);
+
+/**
+ * typedef nvmf_reconnect_cb_t - Reconnect scheduler completion callback
+ * @c:		Controller the attempt was for
+ * @status:	0 when the controller reconnected; otherwise the negative
+ *		errno of the last failed attempt, reported when the retry
+ *		window is exhausted
+ * @data:	Context pointer passed to nvmf_reconnect_sched_create()
+ *
+ * Invoked from nvmf_reconnect_sched_run() when a controller either
+ * reconnects or runs out of its ctrl_loss_tmo retry window; in both
+ * cases the controller has been dropped from the scheduler.
+ */
+typedef void (*nvmf_reconnect_cb_t)(nvme_ctrl_t c, int status, void *data);
+
+typedef struct nvmf_reconnect_sched *nvmf_reconnect_sched_t;
+
+/**
+ * nvmf_reconnect_sched_create() - Create a reconnect scheduler
+ * @r:		&nvme_root_t object, for logging
+ * @cb:		Callback invoked on reconnect or final failure
+ * @data:	Context pointer handed to @cb
+ *
+ * Retrying failed controllers in independent loops synchronizes their
+ * attempts after a fabric event. The scheduler retries each registered
+ * controller with exponential backoff and +-25% jitter from a single
+ * timer, honoring the reconnect_delay and ctrl_loss_tmo of the
+ * controller's fabrics configuration, so recovery proceeds as a
+ * bounded-rate trickle instead of a thundering herd.
+ *
+ * Return: a scheduler handle to be freed with
+ * nvmf_reconnect_sched_free(), or NULL on failure with errno set.
+ */
+nvmf_reconnect_sched_t nvmf_reconnect_sched_create(nvme_root_t r,
+						   nvmf_reconnect_cb_t cb,
+						   void *data);
+
+/**
+ * nvmf_reconnect_sched_get_fd() - File descriptor to wait on
+ * @s:		Reconnect scheduler
+ *
+ * Return: a pollable file descriptor which becomes readable when a
+ * retry is due, for embedding the scheduler into an existing event
+ * loop; call nvmf_reconnect_sched_run() with a zero timeout once it
+ * is readable.
+ */
+int nvmf_reconnect_sched_get_fd(nvmf_reconnect_sched_t s);
+
+/**
+ * nvmf_reconnect_sched_add() - Register a failed controller for retries
+ * @s:		Reconnect scheduler
+ * @c:		Disconnected controller
+ *
+ * Schedules the first attempt after the controller's reconnect_delay
+ * (with jitter); each failed attempt doubles the delay up to a cap. A
+ * negative ctrl_loss_tmo retries indefinitely, zero allows a single
+ * attempt. @c must stay valid until the callback reports it or it is
+ * removed.
+ *
+ * Return: 0 on success; on failure errno is set and -1 is returned.
+ */
+int nvmf_reconnect_sched_add(nvmf_reconnect_sched_t s, nvme_ctrl_t c);
+
+/**
+ * nvmf_reconnect_sched_remove() - Stop retrying a controller
+ * @s:		Reconnect scheduler
+ * @c:		Registered controller
+ *
+ * Drops @c from the scheduler without invoking the callback.
+ *
+ * Return: 0 on success; -1 with errno set to ENOENT when @c is not
+ * registered.
+ */
+int nvmf_reconnect_sched_remove(nvmf_reconnect_sched_t s, nvme_ctrl_t c);
+
+/**
+ * nvmf_reconnect_sched_run() - Wait for and perform due reconnects
+ * @s:			Reconnect scheduler
+ * @timeout_ms:		Maximum time to sleep, -1 to block indefinitely
+ *
+ * Sleeps until a retry is due or the timeout expires, then attempts
+ * every due controller. Controllers that reconnect, and controllers
+ * whose retry window is exhausted, are reported through the callback
+ * and dropped.
+ *
+ * Return: the number of controllers reported through the callback, 0
+ * on timeout, or -1 on failure with errno set.
+ */
+int nvmf_reconnect_sched_run(nvmf_reconnect_sched_t s, int timeout_ms);
+
+/**
+ * nvmf_reconnect_sched_free() - Release a reconnect scheduler
+ * @s:		Reconnect scheduler
+ *
+ * Closes the timer and frees @s; registered controllers themselves are
+ * left untouched.
+ */
+void nvmf_reconnect_sched_free(nvmf_reconnect_sched_t s);
+
 /**
  * nvmf_get_discovery_log() - Return the discovery log page
  * @c:			Discovery controller to use
@@ -336,6 +659,42 @@ nvme_ctrl_t nvmf_connect_disc_entry(nvme_host_t h,
 	struct nvmf_disc_log_entry *e,
 	const struct nvme_fabrics_config *defcfg, bool *discover);
 
+/**
+ * typedef nvmf_disc_filter_t - Discovery log entry filter
+ * @e:		Discovery log page entry
+ * @data:	Context pointer passed to nvmf_connect_disc_entries()
+ *
+ * Return: true if the entry should be connected, false to skip it.
+ */
+typedef bool (*nvmf_disc_filter_t)(struct nvmf_disc_log_entry *e, void *data);
+
+/**
+ * nvmf_connect_disc_entries() - Connect all discovery log entries in parallel
+ * @h:			Host to which the controllers should be connected
+ * @log:		Discovery log page
+ * @defcfg:		Default configuration for the new controllers
+ * @filter:		Optional filter to skip entries, may be NULL
+ * @filter_data:	Context pointer handed to @filter
+ * @results:		Optional array of at least NUMREC elements receiving
+ *			the per-entry result, may be NULL
+ * @n_parallel:		Maximum number of connects in flight, 0 for the
+ *			built-in default
+ *
+ * Fans the entries of @log out to a pool of worker threads so the time
+ * for a full-mesh connect is bounded by the slowest target rather than
+ * the sum of all connects. Entries whose controller is already
+ * connected are skipped without touching the fabrics device and
+ * reported as -ENVME_CONNECT_ALREADY; filtered entries are reported as
+ * -ENVME_CONNECT_IGNORED. A successful entry reports 0.
+ *
+ * Return: the number of newly connected controllers, or -1 on failure
+ * with errno set.
+ */
+int nvmf_connect_disc_entries(nvme_host_t h, struct nvmf_discovery_log *log,
+			      const struct nvme_fabrics_config *defcfg,
+			      nvmf_disc_filter_t filter, void *filter_data,
+			      int *results, unsigned int n_parallel);
+
 /**
  * nvmf_is_registration_supported - check whether registration can be performed.
  * @c:	Controller instance
@@ -388,4 +747,50 @@ struct nvme_fabrics_uri *nvme_parse_uri(const char *str);
  */
 void nvme_free_uri(struct nvme_fabrics_uri *uri);
 
+/**
+ * nvme_parse_uri_view() - Parse a URI string without allocating
+ * @uri:	Filled with views into @str
+ * @str:	URI string
+ *
+ * Zero-allocation counterpart of nvme_parse_uri(): accepts the same
+ * URI format, but @uri only borrows offsets and lengths from @str, so
+ * parsing tens of thousands of URIs is purely computational. The
+ * views are valid as long as @str; components are not unescaped, see
+ * nvme_uri_view_decode().
+ *
+ * Return: 0 on success; -1 on failure with errno set (E2BIG when the
+ * path has more than NVME_URI_VIEW_SEGMENTS segments).
+ */
+int nvme_parse_uri_view(struct nvme_fabrics_uri_view *uri, const char *str);
+
+/**
+ * nvme_parse_uri_batch() - Parse a list of URI strings
+ * @uris:	Array of at least @n entries, filled with parsed views
+ * @strs:	Array of @n URI strings
+ * @n:		Number of URIs to parse
+ *
+ * Runs nvme_parse_uri_view() over @strs. Entries that fail to parse
+ * are zeroed, recognizable by a NULL scheme view.
+ *
+ * Return: the number of successfully parsed URIs, or -1 on failure
+ * with errno set.
+ */
+int nvme_parse_uri_batch(struct nvme_fabrics_uri_view *uris,
+			 const char *const *strs, unsigned int n);
+
+/**
+ * nvme_uri_view_decode() - Unescape a URI component into a buffer
+ * @view:	Parsed URI component
+ * @buf:	Destination buffer
+ * @size:	Size of @buf in bytes
+ *
+ * Copies @view into @buf, resolving percent-escapes, and terminates
+ * it. An absent component (NULL @view->str) yields an empty string.
+ *
+ * Return: the decoded length excluding the terminator, or -1 with
+ * errno set to ENOBUFS if @buf is too small.
+ */
+int nvme_uri_view_decode(const struct nvme_uri_view *view, char *buf,
+			 size_t size);
+
 #endif /* _LIBNVME_FABRICS_H */
@@ -6,7 +6,9 @@
  * Authors: Keith Busch <keith.busch@wdc.com>
  * 	    Chaitanya Kulkarni <chaitanya.kulkarni@wdc.com>
  */
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
 
@@ -105,3 +107,180 @@ int nvme_scan_ctrl_namespaces(nvme_ctrl_t c, struct dirent ***ns)
 	return scandir(nvme_ctrl_get_sysfs_dir(c), ns,
 		       nvme_namespace_filter, alphasort);
 }
+
+/*
+ * Compiled tree filters
+ *
+ * A filter gathers the caller's criteria once: string criteria are
+ * duplicated and their lengths precomputed, the set of active criteria
+ * is kept as a bitmask, and the nsid bounds are plain integers. The
+ * match functions then cost one bit test per absent criterion and at
+ * most one compare per present one, instead of a chain of per-object
+ * helper calls.
+ */
+enum {
+	NVME_FILTER_TRANSPORT	= 1 << 0,
+	NVME_FILTER_NQN_PREFIX	= 1 << 1,
+	NVME_FILTER_STATE	= 1 << 2,
+	NVME_FILTER_NSID_RANGE	= 1 << 3,
+};
+
+struct nvme_filter {
+	unsigned int criteria;
+	char *transport;
+	char *nqn_prefix;
+	size_t nqn_prefix_len;
+	char *state;
+	__u32 nsid_min;
+	__u32 nsid_max;
+};
+
+nvme_filter_t nvme_filter_create(void)
+{
+	return calloc(1, sizeof(struct nvme_filter));
+}
+
+void nvme_filter_free(nvme_filter_t f)
+{
+	if (!f)
+		return;
+	free(f->transport);
+	free(f->nqn_prefix);
+	free(f->state);
+	free(f);
+}
+
+static int nvme_filter_set_str(char **dst, const char *src)
+{
+	char *v = NULL;
+
+	if (src) {
+		v = strdup(src);
+		if (!v) {
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	free(*dst);
+	*dst = v;
+	return 0;
+}
+
+int nvme_filter_set_transport(nvme_filter_t f, const char *transport)
+{
+	if (nvme_filter_set_str(&f->transport, transport))
+		return -1;
+	if (transport)
+		f->criteria |= NVME_FILTER_TRANSPORT;
+	else
+		f->criteria &= ~NVME_FILTER_TRANSPORT;
+	return 0;
+}
+
+int nvme_filter_set_nqn_prefix(nvme_filter_t f, const char *prefix)
+{
+	if (nvme_filter_set_str(&f->nqn_prefix, prefix))
+		return -1;
+	if (prefix) {
+		f->nqn_prefix_len = strlen(prefix);
+		f->criteria |= NVME_FILTER_NQN_PREFIX;
+	} else {
+		f->nqn_prefix_len = 0;
+		f->criteria &= ~NVME_FILTER_NQN_PREFIX;
+	}
+	return 0;
+}
+
+int nvme_filter_set_state(nvme_filter_t f, const char *state)
+{
+	if (nvme_filter_set_str(&f->state, state))
+		return -1;
+	if (state)
+		f->criteria |= NVME_FILTER_STATE;
+	else
+		f->criteria &= ~NVME_FILTER_STATE;
+	return 0;
+}
+
+void nvme_filter_set_nsid_range(nvme_filter_t f, __u32 nsid_min,
+				__u32 nsid_max)
+{
+	f->nsid_min = nsid_min;
+	f->nsid_max = nsid_max;
+	if (nsid_min || nsid_max)
+		f->criteria |= NVME_FILTER_NSID_RANGE;
+	else
+		f->criteria &= ~NVME_FILTER_NSID_RANGE;
+}
+
+static bool nvme_filter_nqn_match(nvme_filter_t f, nvme_subsystem_t s)
+{
+	const char *nqn;
+
+	if (!s)
+		return false;
+	nqn = nvme_subsystem_get_nqn(s);
+	/* strncmp, not memcmp: the subsystem NQN may be shorter than the prefix */
+	return nqn && !strncmp(nqn, f->nqn_prefix, f->nqn_prefix_len);
+}
+
+bool nvme_filter_match_subsystem(nvme_filter_t f, nvme_subsystem_t s)
+{
+	if ((f->criteria & NVME_FILTER_NQN_PREFIX) &&
+	    !nvme_filter_nqn_match(f, s))
+		return false;
+	return true;
+}
+
+bool nvme_filter_match_ctrl(nvme_filter_t f, nvme_ctrl_t c)
+{
+	const char *v;
+
+	if (f->criteria & NVME_FILTER_TRANSPORT) {
+		v = nvme_ctrl_get_transport(c);
+		if (!v || strcmp(v, f->transport))
+			return false;
+	}
+	if ((f->criteria & NVME_FILTER_NQN_PREFIX) &&
+	    !nvme_filter_nqn_match(f, nvme_ctrl_get_subsystem(c)))
+		return false;
+	if (f->criteria & NVME_FILTER_STATE) {
+		v = nvme_ctrl_get_state(c);
+		if (!v || strcmp(v, f->state))
+			return false;
+	}
+	return true;
+}
+
+bool nvme_filter_match_ns(nvme_filter_t f, nvme_ns_t n)
+{
+	if (f->criteria & NVME_FILTER_NSID_RANGE) {
+		__u32 nsid = nvme_ns_get_nsid(n);
+
+		if (nsid < f->nsid_min || nsid > f->nsid_max)
+			return false;
+	}
+	if ((f->criteria & NVME_FILTER_NQN_PREFIX) &&
+	    !nvme_filter_nqn_match(f, nvme_ns_get_subsystem(n)))
+		return false;
+	return true;
+}
+
+bool nvme_filter_scan_fn(nvme_subsystem_t s, nvme_ctrl_t c, nvme_ns_t n,
+			 void *f_args)
+{
+	nvme_filter_t f = f_args;
+
+	if (s)
+		return nvme_filter_match_subsystem(f, s);
+	if (c)
+		return nvme_filter_match_ctrl(f, c);
+	if (n)
+		return nvme_filter_match_ns(f, n);
+	return true;
+}
+
+void nvme_filter_install_scan_match(nvme_filter_t f, nvme_root_t r)
+{
+	nvme_root_set_scan_match(r, NULL, f->nqn_prefix, f->transport);
+}
@@ -93,4 +93,127 @@ int nvme_scan_ctrl_namespace_paths(nvme_ctrl_t c, struct dirent ***paths);
  */
 int nvme_scan_ctrl_namespaces(nvme_ctrl_t c, struct dirent ***ns);
 
+/**
+ * typedef nvme_filter_t - Compiled tree filter
+ *
+ * Collects filtering criteria (transport, subsystem NQN prefix,
+ * controller state, nsid range) into one object compiled once up
+ * front, so that evaluating it against a tree object costs a bitmask
+ * test per absent criterion and at most one compare per present one,
+ * instead of a chain of per-object helper calls and string compares.
+ */
+typedef struct nvme_filter *nvme_filter_t;
+
+/**
+ * nvme_filter_create() - Allocate an empty filter
+ *
+ * An empty filter matches every object; add criteria with the
+ * nvme_filter_set_*() functions.
+ *
+ * Return: filter object, or NULL on allocation failure.
+ */
+nvme_filter_t nvme_filter_create(void);
+
+/**
+ * nvme_filter_free() - Release a filter
+ * @f: Filter to free, may be NULL
+ */
+void nvme_filter_free(nvme_filter_t f);
+
+/**
+ * nvme_filter_set_transport() - Match controllers by transport
+ * @f:		Filter to modify
+ * @transport:	Transport name ("pcie", "tcp", ...), NULL to clear
+ *
+ * Return: 0 on success, -1 with errno set otherwise.
+ */
+int nvme_filter_set_transport(nvme_filter_t f, const char *transport);
+
+/**
+ * nvme_filter_set_nqn_prefix() - Match objects by subsystem NQN prefix
+ * @f:		Filter to modify
+ * @prefix:	NQN prefix to require, NULL to clear
+ *
+ * Applies to subsystems and, through their subsystem, to controllers
+ * and namespaces.
+ *
+ * Return: 0 on success, -1 with errno set otherwise.
+ */
+int nvme_filter_set_nqn_prefix(nvme_filter_t f, const char *prefix);
+
+/**
+ * nvme_filter_set_state() - Match controllers by running state
+ * @f:		Filter to modify
+ * @state:	State string ("live", "connecting", ...), NULL to clear
+ *
+ * Return: 0 on success, -1 with errno set otherwise.
+ */
+int nvme_filter_set_state(nvme_filter_t f, const char *state);
+
+/**
+ * nvme_filter_set_nsid_range() - Match namespaces by nsid range
+ * @f:		Filter to modify
+ * @nsid_min:	Lowest nsid to match, inclusive
+ * @nsid_max:	Highest nsid to match, inclusive
+ *
+ * Pass 0 for both bounds to clear the criterion.
+ */
+void nvme_filter_set_nsid_range(nvme_filter_t f, __u32 nsid_min,
+				__u32 nsid_max);
+
+/**
+ * nvme_filter_match_subsystem() - Evaluate a filter against a subsystem
+ * @f: Filter to evaluate
+ * @s: Subsystem to check
+ *
+ * Return: true if @s passes every subsystem-level criterion of @f
+ */
+bool nvme_filter_match_subsystem(nvme_filter_t f, nvme_subsystem_t s);
+
+/**
+ * nvme_filter_match_ctrl() - Evaluate a filter against a controller
+ * @f: Filter to evaluate
+ * @c: Controller to check
+ *
+ * Return: true if @c passes every controller-level criterion of @f
+ */
+bool nvme_filter_match_ctrl(nvme_filter_t f, nvme_ctrl_t c);
+
+/**
+ * nvme_filter_match_ns() - Evaluate a filter against a namespace
+ * @f: Filter to evaluate
+ * @n: Namespace to check
+ *
+ * Return: true if @n passes every namespace-level criterion of @f
+ */
+bool nvme_filter_match_ns(nvme_filter_t f, nvme_ns_t n);
+
+/**
+ * nvme_filter_scan_fn() - Scan filter adapter
+ * @s:		Subsystem being scanned, or NULL
+ * @c:		Controller being scanned, or NULL
+ * @n:		Namespace being scanned, or NULL
+ * @f_args:	The &nvme_filter_t to evaluate
+ *
+ * Pass this as the &nvme_scan_filter_t of nvme_scan_topology() with
+ * the filter object as the filter argument to prune the scanned tree
+ * with a compiled filter.
+ *
+ * Return: true if the scanned object passes the filter
+ */
+bool nvme_filter_scan_fn(nvme_subsystem_t s, nvme_ctrl_t c, nvme_ns_t n,
+			 void *f_args);
+
+/**
+ * nvme_filter_install_scan_match() - Install pre-scan criteria on a root
+ * @f: Filter to install
+ * @r: &nvme_root_t object
+ *
+ * Installs the filter's NQN prefix and transport criteria as the
+ * root's pre-scan match (see nvme_root_set_scan_match()), so that
+ * non-matching sysfs entries are skipped before they are scanned at
+ * all. Complements nvme_filter_scan_fn(), which runs after the scan.
+ */
+void nvme_filter_install_scan_match(nvme_filter_t f, nvme_root_t r);
+
 #endif /* _LIBNVME_FILTERS_H */
@@ -18,6 +18,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include <ccan/build_assert/build_assert.h>
 #include <ccan/endian/endian.h>
@@ -25,6 +26,11 @@
 #include "ioctl.h"
 #include "util.h"
 #include "log.h"
+#include "cleanup.h"
+#include "private.h"
+#include "trace.h"
+
+struct nvme_counters nvme_ioctl_counters;
 
 static int nvme_verify_chr(int fd)
 {
@@ -85,6 +91,12 @@ int nvme_submit_passthru64(int fd, unsigned long ioctl_cmd,
 {
 	int err = ioctl(fd, ioctl_cmd, cmd);
 
+	nvme_count(&nvme_ioctl_counters.ioctls);
+	if (err < 0)
+		nvme_count(&nvme_ioctl_counters.ioctl_errors);
+	else
+		nvme_count_add(&nvme_ioctl_counters.bytes_transferred,
+			       cmd->data_len);
 	if (err >= 0 && result)
 		*result = cmd->result;
 	return err;
@@ -96,6 +108,12 @@ int nvme_submit_passthru(int fd, unsigned long ioctl_cmd,
 {
 	int err = ioctl(fd, ioctl_cmd, cmd);
 
+	nvme_count(&nvme_ioctl_counters.ioctls);
+	if (err < 0)
+		nvme_count(&nvme_ioctl_counters.ioctl_errors);
+	else
+		nvme_count_add(&nvme_ioctl_counters.bytes_transferred,
+			       cmd->data_len);
 	if (err >= 0 && result)
 		*result = cmd->result;
 	return err;
@@ -164,7 +182,12 @@ static int nvme_passthru(int fd, unsigned long ioctl_cmd, __u8 opcode,
 int nvme_submit_admin_passthru64(int fd, struct nvme_passthru_cmd64 *cmd,
 				 __u64 *result)
 {
-	return nvme_submit_passthru64(fd, NVME_IOCTL_ADMIN64_CMD, cmd, result);
+	int err;
+
+	nvme_trace3(admin_cmd_start, cmd->opcode, cmd->nsid, cmd->data_len);
+	err = nvme_submit_passthru64(fd, NVME_IOCTL_ADMIN64_CMD, cmd, result);
+	nvme_trace4(admin_cmd_done, cmd->opcode, cmd->nsid, cmd->data_len, err);
+	return err;
 }
 
 int nvme_admin_passthru64(int fd, __u8 opcode, __u8 flags, __u16 rsvd,
@@ -182,7 +205,12 @@ int nvme_admin_passthru64(int fd, __u8 opcode, __u8 flags, __u16 rsvd,
 
 int nvme_submit_admin_passthru(int fd, struct nvme_passthru_cmd *cmd, __u32 *result)
 {
-	return nvme_submit_passthru(fd, NVME_IOCTL_ADMIN_CMD, cmd, result);
+	int err;
+
+	nvme_trace3(admin_cmd_start, cmd->opcode, cmd->nsid, cmd->data_len);
+	err = nvme_submit_passthru(fd, NVME_IOCTL_ADMIN_CMD, cmd, result);
+	nvme_trace4(admin_cmd_done, cmd->opcode, cmd->nsid, cmd->data_len, err);
+	return err;
 }
 
 int nvme_admin_passthru(int fd, __u8 opcode, __u8 flags, __u16 rsvd,
@@ -253,6 +281,27 @@ enum features {
 	NVME_FEATURES_IOCSP_IOCSCI_MASK				= 0xff,
 };
 
+void nvme_init_identify_cmd(struct nvme_uring_cmd *cmd,
+			    struct nvme_identify_args *args)
+{
+	__u32 cdw10 = NVME_SET(args->cntid, IDENTIFY_CDW10_CNTID) |
+			NVME_SET(args->cns, IDENTIFY_CDW10_CNS);
+	__u32 cdw11 = NVME_SET(args->cns_specific_id, IDENTIFY_CDW11_CNSSPECID) |
+			NVME_SET(args->csi, IDENTIFY_CDW11_CSI);
+	__u32 cdw14 = NVME_SET(args->uuidx, IDENTIFY_CDW14_UUID);
+
+	*cmd = (struct nvme_uring_cmd) {
+		.opcode		= nvme_admin_identify,
+		.nsid		= args->nsid,
+		.addr		= (__u64)(uintptr_t)args->data,
+		.data_len	= NVME_IDENTIFY_DATA_SIZE,
+		.cdw10		= cdw10,
+		.cdw11		= cdw11,
+		.cdw14		= cdw14,
+		.timeout_ms	= args->timeout,
+	};
+}
+
 int nvme_identify(struct nvme_identify_args *args)
 {
 	__u32 cdw10 = NVME_SET(args->cntid, IDENTIFY_CDW10_CNTID) |
@@ -279,6 +328,38 @@ int nvme_identify(struct nvme_identify_args *args)
 	return nvme_submit_admin_passthru(args->fd, &cmd, args->result);
 }
 
+void nvme_init_get_log_cmd(struct nvme_uring_cmd *cmd,
+			   struct nvme_get_log_args *args)
+{
+	__u32 numd = (args->len >> 2) - 1;
+	__u16 numdu = numd >> 16, numdl = numd & 0xffff;
+
+	__u32 cdw10 = NVME_SET(args->lid, LOG_CDW10_LID) |
+			NVME_SET(args->lsp, LOG_CDW10_LSP) |
+			NVME_SET(!!args->rae, LOG_CDW10_RAE) |
+			NVME_SET(numdl, LOG_CDW10_NUMDL);
+	__u32 cdw11 = NVME_SET(numdu, LOG_CDW11_NUMDU) |
+			NVME_SET(args->lsi, LOG_CDW11_LSI);
+	__u32 cdw12 = args->lpo & 0xffffffff;
+	__u32 cdw13 = args->lpo >> 32;
+	__u32 cdw14 = NVME_SET(args->uuidx, LOG_CDW14_UUID) |
+			NVME_SET(!!args->ot, LOG_CDW14_OT) |
+			NVME_SET(args->csi, LOG_CDW14_CSI);
+
+	*cmd = (struct nvme_uring_cmd) {
+		.opcode		= nvme_admin_get_log_page,
+		.nsid		= args->nsid,
+		.addr		= (__u64)(uintptr_t)args->log,
+		.data_len	= args->len,
+		.cdw10		= cdw10,
+		.cdw11		= cdw11,
+		.cdw12		= cdw12,
+		.cdw13		= cdw13,
+		.cdw14		= cdw14,
+		.timeout_ms	= args->timeout,
+	};
+}
+
 int nvme_get_log(struct nvme_get_log_args *args)
 {
 	__u32 numd = (args->len >> 2) - 1;
@@ -309,13 +390,73 @@ int nvme_get_log(struct nvme_get_log_args *args)
 		.timeout_ms	= args->timeout,
 	};
 
-	if (args->args_size < sizeof(struct nvme_get_log_args)) {
+	const size_t size_v1 = sizeof_args(struct nvme_get_log_args, ot, __u64);
+	const size_t size_v3 = sizeof_args(struct nvme_get_log_args, deadline, __u64);
+
+	if (args->args_size < size_v1 || args->args_size > size_v3) {
 		errno = EINVAL;
 		return -1;
 	}
+
+	if (args->args_size >= size_v3 && args->deadline) {
+		int remain = nvme_deadline_remaining(args->deadline);
+
+		if (!remain) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		if (remain > 0 &&
+		    (!cmd.timeout_ms || cmd.timeout_ms > (__u32)remain))
+			cmd.timeout_ms = remain;
+	}
 	return nvme_submit_admin_passthru(args->fd, &cmd, args->result);
 }
 
+/*
+ * Issue all chunks but the last concurrently; offsets of RAE-safe logs
+ * are independent. The final chunk is sent on its own afterwards so the
+ * caller's RAE setting only takes effect once the rest of the page has
+ * been fetched.
+ */
+static int nvme_get_log_page_parallel(int fd, __u32 xfer_len,
+				      struct nvme_get_log_args *args)
+{
+	__u64 data_len = args->len, start = args->lpo;
+	void *ptr = args->log;
+	bool retain = args->rae;
+	__u32 nr_chunks = (data_len + xfer_len - 1) / xfer_len;
+	_cleanup_free_ struct nvme_get_log_args *chunks = NULL;
+	__u32 i;
+	int ret;
+
+	chunks = calloc(nr_chunks - 1, sizeof(*chunks));
+	if (!chunks) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < nr_chunks - 1; i++) {
+		/* only args_size bytes of the caller's struct are valid */
+		memcpy(&chunks[i], args, args->args_size);
+		chunks[i].args_size = sizeof(chunks[i]);
+		chunks[i].fd = fd;
+		chunks[i].lpo = start + (__u64)i * xfer_len;
+		chunks[i].len = xfer_len;
+		chunks[i].log = ptr + (__u64)i * xfer_len;
+		chunks[i].rae = true;
+		chunks[i].result = NULL;
+	}
+	ret = __nvme_get_log_batch(chunks, NULL, nr_chunks - 1, args->qdepth);
+	if (ret)
+		return ret;
+
+	args->lpo = start + (__u64)(nr_chunks - 1) * xfer_len;
+	args->len = data_len - (__u64)(nr_chunks - 1) * xfer_len;
+	args->log = ptr + (__u64)(nr_chunks - 1) * xfer_len;
+	args->rae = retain;
+	return nvme_get_log(args);
+}
+
 int nvme_get_log_page(int fd, __u32 xfer_len, struct nvme_get_log_args *args)
 {
 	__u64 offset = 0, xfer, data_len = args->len;
@@ -326,6 +467,10 @@ int nvme_get_log_page(int fd, __u32 xfer_len, struct nvme_get_log_args *args)
 
 	args->fd = fd;
 
+	if (args->args_size >= sizeof_args(struct nvme_get_log_args, qdepth, __u64) &&
+	    args->qdepth > 1 && data_len > xfer_len)
+		return nvme_get_log_page_parallel(fd, xfer_len, args);
+
 	/*
 	 * 4k is the smallest possible transfer unit, so restricting to 4k
 	 * avoids having to check the MDTS value of the controller.
@@ -355,8 +500,154 @@ int nvme_get_log_page(int fd, __u32 xfer_len, struct nvme_get_log_args *args)
 	return 0;
 }
 
+int nvme_get_log_page_iov(int fd, __u32 xfer_len,
+			  struct nvme_get_log_args *args,
+			  const struct iovec *iov, int iovcnt)
+{
+	__u64 start, offset = 0, total = 0;
+	bool retain;
+	int i, ret;
+
+	if (!args || !iov || iovcnt <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/*
+	 * The log page offset and transfer length are expressed in
+	 * dwords, so each segment boundary must fall on one.
+	 */
+	for (i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_base || !iov[i].iov_len ||
+		    iov[i].iov_len & 3) {
+			errno = EINVAL;
+			return -1;
+		}
+		total += iov[i].iov_len;
+	}
+
+	start = args->lpo;
+	retain = args->rae;
+	for (i = 0; i < iovcnt; i++) {
+		args->lpo = start + offset;
+		args->len = iov[i].iov_len;
+		args->log = iov[i].iov_base;
+		/*
+		 * As in nvme_get_log_page(), retain the event until the
+		 * final segment so the data stays latched throughout.
+		 */
+		args->rae = offset + iov[i].iov_len < total || retain;
+		ret = nvme_get_log_page(fd, xfer_len, args);
+		if (ret)
+			return ret;
+
+		offset += iov[i].iov_len;
+	}
+
+	return 0;
+}
+
+int nvme_get_log_page_sink(int fd, __u32 xfer_len,
+			   struct nvme_get_log_args *args,
+			   nvme_log_sink_cb sink, void *userdata)
+{
+	_cleanup_free_ void *buf = NULL;
+	__u64 offset = 0, xfer, data_len;
+	__u64 start;
+	bool retain;
+	int ret;
+
+	if (!args || !sink || !xfer_len) {
+		errno = EINVAL;
+		return -1;
+	}
+	data_len = args->len;
+	start = args->lpo;
+	retain = args->rae;
+
+	if (xfer_len > data_len)
+		xfer_len = data_len;
+	buf = malloc(xfer_len);
+	if (!buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	args->fd = fd;
+	do {
+		xfer = data_len - offset;
+		if (xfer > xfer_len)
+			xfer = xfer_len;
+
+		args->lpo = start + offset;
+		args->len = xfer;
+		args->log = buf;
+		/* as in nvme_get_log_page(), retain until the last chunk */
+		args->rae = offset + xfer < data_len || retain;
+		ret = nvme_get_log(args);
+		if (ret)
+			return ret;
+
+		if (sink(userdata, buf, xfer, start + offset)) {
+			errno = ECANCELED;
+			return -1;
+		}
+		offset += xfer;
+	} while (offset < data_len);
+
+	return 0;
+}
+
+int nvme_identify_iov(struct nvme_identify_args *args,
+		      const struct iovec *iov, int iovcnt)
+{
+	__u8 page[NVME_IDENTIFY_DATA_SIZE];
+	void *data;
+	size_t total = 0, off = 0;
+	int i, ret;
+
+	if (!args || !iov || iovcnt <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_base && iov[i].iov_len) {
+			errno = EINVAL;
+			return -1;
+		}
+		total += iov[i].iov_len;
+	}
+	if (total < sizeof(page)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/*
+	 * Identify has no offset field, so the payload cannot be split
+	 * across per-segment commands the way a log page can; bounce it
+	 * through one on-stack page instead.
+	 */
+	data = args->data;
+	args->data = page;
+	ret = nvme_identify(args);
+	args->data = data;
+	if (ret)
+		return ret;
+
+	for (i = 0; i < iovcnt && off < sizeof(page); i++) {
+		size_t n = min(iov[i].iov_len, sizeof(page) - off);
+
+		memcpy(iov[i].iov_base, page + off, n);
+		off += n;
+	}
+
+	return 0;
+}
+
 static int read_ana_chunk(int fd, enum nvme_log_ana_lsp lsp, bool rae,
-			  __u8 *log, __u8 **read, __u8 *to_read, __u8 *log_end)
+			  __u64 deadline, __u8 *log, __u8 **read,
+			  __u8 *to_read, __u8 *log_end)
 {
 	if (to_read > log_end) {
 		errno = ENOSPC;
@@ -367,6 +658,11 @@ static int read_ana_chunk(int fd, enum nvme_log_ana_lsp lsp, bool rae,
 		__u32 len = min(log_end - *read, NVME_LOG_PAGE_PDU_SIZE);
 		int ret;
 
+		if (!nvme_deadline_remaining(deadline)) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
 		ret = nvme_get_log_ana(fd, lsp, rae, *read - log, len, *read);
 		if (ret)
 			return ret;
@@ -377,8 +673,9 @@ static int read_ana_chunk(int fd, enum nvme_log_ana_lsp lsp, bool rae,
 }
 
 static int try_read_ana(int fd, enum nvme_log_ana_lsp lsp, bool rae,
-			struct nvme_ana_log *log, __u8 *log_end,
-			__u8 *read, __u8 **to_read, bool *may_retry)
+			__u64 deadline, struct nvme_ana_log *log,
+			__u8 *log_end, __u8 *read, __u8 **to_read,
+			bool *may_retry)
 {
 	__u16 ngrps = le16_to_cpu(log->ngrps);
 
@@ -388,7 +685,7 @@ static int try_read_ana(int fd, enum nvme_log_ana_lsp lsp, bool rae,
 		__le32 nnsids;
 
 		*to_read += sizeof(*log->descs);
-		ret = read_ana_chunk(fd, lsp, rae,
+		ret = read_ana_chunk(fd, lsp, rae, deadline,
 				     (__u8 *)log, &read, *to_read, log_end);
 		if (ret) {
 			/*
@@ -410,7 +707,7 @@ static int try_read_ana(int fd, enum nvme_log_ana_lsp lsp, bool rae,
 		       group + offsetof(struct nvme_ana_group_desc, nnsids),
 		       sizeof(nnsids));
 		*to_read += le32_to_cpu(nnsids) * sizeof(__le32);
-		ret = read_ana_chunk(fd, lsp, rae,
+		ret = read_ana_chunk(fd, lsp, rae, deadline,
 				     (__u8 *)log, &read, *to_read, log_end);
 		if (ret) {
 			*may_retry = errno == ENOSPC;
@@ -422,8 +719,9 @@ static int try_read_ana(int fd, enum nvme_log_ana_lsp lsp, bool rae,
 	return 0;
 }
 
-int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
-			    struct nvme_ana_log *log, __u32 *len)
+int nvme_get_ana_log_atomic2(int fd, bool rgo, bool rae, unsigned int retries,
+			     __u64 deadline, struct nvme_ana_log *log,
+			     __u32 *len)
 {
 	const enum nvme_log_ana_lsp lsp =
 		rgo ? NVME_LOG_ANA_LSP_RGO_GROUPS_ONLY : 0;
@@ -439,7 +737,7 @@ int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
 	}
 
 	to_read = (__u8 *)log->descs;
-	ret = read_ana_chunk(fd, lsp, rae,
+	ret = read_ana_chunk(fd, lsp, rae, deadline,
 			     (__u8 *)log, &read, to_read, log_end);
 	if (ret)
 		return ret;
@@ -450,7 +748,7 @@ int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
 		int saved_errno;
 		__le64 chgcnt;
 
-		saved_ret = try_read_ana(fd, lsp, rae, log, log_end,
+		saved_ret = try_read_ana(fd, lsp, rae, deadline, log, log_end,
 					 read, &to_read, &may_retry);
 		/*
 		 * If the log page was read with multiple Get Log Page commands,
@@ -464,7 +762,7 @@ int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
 		chgcnt = log->chgcnt;
 		read = (__u8 *)log;
 		to_read = (__u8 *)log->descs;
-		ret = read_ana_chunk(fd, lsp, rae,
+		ret = read_ana_chunk(fd, lsp, rae, deadline,
 				     (__u8 *)log, &read, to_read, log_end);
 		if (ret)
 			return ret;
@@ -480,6 +778,124 @@ int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
 	return -1;
 }
 
+int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
+			    struct nvme_ana_log *log, __u32 *len)
+{
+	return nvme_get_ana_log_atomic2(fd, rgo, rae, retries, 0, log, len);
+}
+
+static int nvme_pel_read(int fd, enum nvme_pevent_log_action action,
+			 __u64 lpo, __u32 len, void *log)
+{
+	struct nvme_get_log_args args = {
+		.lpo = lpo,
+		.result = NULL,
+		.log = log,
+		.args_size = sizeof(args),
+		.fd = fd,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.lid = NVME_LOG_LID_PERSISTENT_EVENT,
+		.len = len,
+		.nsid = NVME_NSID_ALL,
+		.csi = NVME_CSI_NVM,
+		.lsi = NVME_LOG_LSI_NONE,
+		.lsp = (__u8)action,
+		.uuidx = NVME_UUID_NONE,
+		.rae = false,
+		.ot = false,
+	};
+
+	return nvme_get_log_page(fd, NVME_LOG_PAGE_PDU_SIZE, &args);
+}
+
+int nvme_pel_read_new(int fd, struct nvme_pel_cursor *cursor, void *buf,
+		      __u32 len, __u32 *read_len)
+{
+	struct nvme_persistent_event_log hdr;
+	__u64 tll, avail;
+	__u16 gen, lhl;
+	__u32 n;
+	int ret;
+
+	if (!cursor || !buf || !read_len || len < 4) {
+		errno = EINVAL;
+		return -1;
+	}
+	*read_len = 0;
+
+	ret = nvme_pel_read(fd, NVME_PEVENT_LOG_EST_CTX_AND_READ,
+			    0, sizeof(hdr), &hdr);
+	if (ret)
+		return ret;
+
+	gen = le16_to_cpu(hdr.gen_number);
+	lhl = le16_to_cpu(hdr.lhl);
+	tll = le64_to_cpu(hdr.tll);
+	if (!lhl)
+		lhl = sizeof(hdr);
+
+	/*
+	 * A fresh cursor, a generation bump or an offset past the end
+	 * all mean the remembered position no longer names the same
+	 * events; restart at the first event past the header.
+	 */
+	if (!cursor->offset || cursor->gen != gen || cursor->offset > tll) {
+		cursor->gen = gen;
+		/*
+		 * Defend against bogus devices reporting a total log
+		 * length smaller than the header: clamp so the
+		 * available-length math below cannot underflow.
+		 */
+		cursor->offset = lhl < tll ? lhl : tll;
+	}
+
+	avail = tll - cursor->offset;
+	n = avail > len ? len : avail;
+	/* Get Log Page can only fetch multiples of dwords */
+	n &= -4;
+	if (n) {
+		ret = nvme_pel_read(fd, NVME_PEVENT_LOG_READ,
+				    cursor->offset, n, buf);
+		if (ret)
+			goto release;
+
+		cursor->offset += n;
+		*read_len = n;
+	}
+
+release:
+	/*
+	 * Best effort; the context is re-established on the next call
+	 * either way, so a failed release only loses the latch early.
+	 */
+	if (nvme_pel_read(fd, NVME_PEVENT_LOG_RELEASE_CTX,
+			  0, sizeof(hdr), &hdr) && !ret)
+		ret = -1;
+	return ret;
+}
+
+void nvme_init_set_features_cmd(struct nvme_uring_cmd *cmd,
+				struct nvme_set_features_args *args)
+{
+	__u32 cdw10 = NVME_SET(args->fid, FEATURES_CDW10_FID) |
+			NVME_SET(!!args->save, SET_FEATURES_CDW10_SAVE);
+	__u32 cdw14 = NVME_SET(args->uuidx, FEATURES_CDW14_UUID);
+
+	*cmd = (struct nvme_uring_cmd) {
+		.opcode		= nvme_admin_set_features,
+		.nsid		= args->nsid,
+		.addr		= (__u64)(uintptr_t)args->data,
+		.data_len	= args->data_len,
+		.cdw10		= cdw10,
+		.cdw11		= args->cdw11,
+		.cdw12		= args->cdw12,
+		.cdw13		= args->cdw13,
+		.cdw14		= cdw14,
+		.cdw15		= args->cdw15,
+		.timeout_ms	= args->timeout,
+	};
+}
+
 int nvme_set_features(struct nvme_set_features_args *args)
 {
 	__u32 cdw10 = NVME_SET(args->fid, FEATURES_CDW10_FID) |
@@ -877,6 +1293,25 @@ int nvme_set_features_iocs_profile(int fd, __u16 iocsi, bool save)
 				   save, NULL);
 }
 
+void nvme_init_get_features_cmd(struct nvme_uring_cmd *cmd,
+				struct nvme_get_features_args *args)
+{
+	__u32 cdw10 = NVME_SET(args->fid, FEATURES_CDW10_FID) |
+			NVME_SET(args->sel, GET_FEATURES_CDW10_SEL);
+	__u32 cdw14 = NVME_SET(args->uuidx, FEATURES_CDW14_UUID);
+
+	*cmd = (struct nvme_uring_cmd) {
+		.opcode		= nvme_admin_get_features,
+		.nsid		= args->nsid,
+		.addr		= (__u64)(uintptr_t)args->data,
+		.data_len	= args->data_len,
+		.cdw10		= cdw10,
+		.cdw11		= args->cdw11,
+		.cdw14		= cdw14,
+		.timeout_ms	= args->timeout,
+	};
+}
+
 int nvme_get_features(struct nvme_get_features_args *args)
 {
 	__u32 cdw10 = NVME_SET(args->fid, FEATURES_CDW10_FID) |
@@ -1424,6 +1859,22 @@ int nvme_ns_attach(struct nvme_ns_attach_args *args)
 	return nvme_submit_admin_passthru(args->fd, &cmd, args->result);
 }
 
+void nvme_init_fw_download_cmd(struct nvme_uring_cmd *cmd,
+			       struct nvme_fw_download_args *args)
+{
+	__u32 cdw10 = (args->data_len >> 2) - 1;
+	__u32 cdw11 = args->offset >> 2;
+
+	*cmd = (struct nvme_uring_cmd) {
+		.opcode		= nvme_admin_fw_download,
+		.cdw10		= cdw10,
+		.cdw11		= cdw11,
+		.data_len	= args->data_len,
+		.addr		= (__u64)(uintptr_t)args->data,
+		.timeout_ms	= args->timeout,
+	};
+}
+
 int nvme_fw_download(struct nvme_fw_download_args *args)
 {
 	__u32 cdw10 = (args->data_len >> 2) - 1;
@@ -1759,7 +2210,12 @@ int nvme_virtual_mgmt(struct nvme_virtual_mgmt_args *args)
 int nvme_submit_io_passthru64(int fd, struct nvme_passthru_cmd64 *cmd,
 			      __u64 *result)
 {
-	return nvme_submit_passthru64(fd, NVME_IOCTL_IO64_CMD, cmd, result);
+	int err;
+
+	nvme_trace3(io_cmd_start, cmd->opcode, cmd->nsid, cmd->data_len);
+	err = nvme_submit_passthru64(fd, NVME_IOCTL_IO64_CMD, cmd, result);
+	nvme_trace4(io_cmd_done, cmd->opcode, cmd->nsid, cmd->data_len, err);
+	return err;
 }
 
 int nvme_io_passthru64(int fd, __u8 opcode, __u8 flags, __u16 rsvd,
@@ -1776,7 +2232,12 @@ int nvme_io_passthru64(int fd, __u8 opcode, __u8 flags, __u16 rsvd,
 
 int nvme_submit_io_passthru(int fd, struct nvme_passthru_cmd *cmd, __u32 *result)
 {
-	return nvme_submit_passthru(fd, NVME_IOCTL_IO_CMD, cmd, result);
+	int err;
+
+	nvme_trace3(io_cmd_start, cmd->opcode, cmd->nsid, cmd->data_len);
+	err = nvme_submit_passthru(fd, NVME_IOCTL_IO_CMD, cmd, result);
+	nvme_trace4(io_cmd_done, cmd->opcode, cmd->nsid, cmd->data_len, err);
+	return err;
 }
 
 int nvme_io_passthru(int fd, __u8 opcode, __u8 flags, __u16 rsvd,
@@ -2119,6 +2580,29 @@ int nvme_zns_mgmt_send(struct nvme_zns_mgmt_send_args *args)
 	return nvme_submit_io_passthru(args->fd, &cmd, args->result);
 }
 
+void nvme_init_zns_mgmt_recv_cmd(struct nvme_uring_cmd *cmd,
+				 struct nvme_zns_mgmt_recv_args *args)
+{
+	__u32 cdw10 = args->slba & 0xffffffff;
+	__u32 cdw11 = args->slba >> 32;
+	__u32 cdw12 = (args->data_len >> 2) - 1;
+	__u32 cdw13 = NVME_SET(args->zra, ZNS_MGMT_RECV_ZRA) |
+			NVME_SET(args->zrasf, ZNS_MGMT_RECV_ZRASF) |
+			NVME_SET(args->zras_feat, ZNS_MGMT_RECV_ZRAS_FEAT);
+
+	*cmd = (struct nvme_uring_cmd) {
+		.opcode		= nvme_zns_cmd_mgmt_recv,
+		.nsid		= args->nsid,
+		.cdw10		= cdw10,
+		.cdw11		= cdw11,
+		.cdw12		= cdw12,
+		.cdw13		= cdw13,
+		.addr		= (__u64)(uintptr_t)args->data,
+		.data_len	= args->data_len,
+		.timeout_ms	= args->timeout,
+	};
+}
+
 int nvme_zns_mgmt_recv(struct nvme_zns_mgmt_recv_args *args)
 {
 	__u32 cdw10 = args->slba & 0xffffffff;
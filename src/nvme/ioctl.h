@@ -12,6 +12,7 @@
 
 #include <stddef.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include "types.h"
 #include "api-types.h"
 
@@ -39,6 +40,7 @@
  * avoids having to check the MDTS value of the controller.
  */
 #define NVME_LOG_PAGE_PDU_SIZE 4096
+#define NVME_LOG_PAGE_MAX_XFER (1024 * 1024)
 
 /**
  * struct nvme_passthru_cmd - nvme passthrough command structure
@@ -180,6 +182,8 @@ struct nvme_uring_cmd {
 /* io_uring async commands: */
 #define NVME_URING_CMD_IO	_IOWR('N', 0x80, struct nvme_uring_cmd)
 #define NVME_URING_CMD_IO_VEC	_IOWR('N', 0x81, struct nvme_uring_cmd)
+#define NVME_URING_CMD_ADMIN	_IOWR('N', 0x82, struct nvme_uring_cmd)
+#define NVME_URING_CMD_ADMIN_VEC _IOWR('N', 0x83, struct nvme_uring_cmd)
 
 #endif /* _UAPI_LINUX_NVME_IOCTL_H */
 
@@ -577,6 +581,24 @@ int nvme_get_nsid(int fd, __u32 *nsid);
  */
 int nvme_identify(struct nvme_identify_args *args);
 
+/**
+ * nvme_identify_iov() - Send the NVMe Identify command into an iovec
+ * @args:	&struct nvme_identify_args argument structure
+ * @iov:	Array of @iovcnt segments receiving the payload
+ * @iovcnt:	Number of segments in @iov
+ *
+ * As nvme_identify(), but scatters the payload across @iov instead of
+ * the contiguous @args->data buffer, which is ignored. The segments
+ * must add up to at least %NVME_IDENTIFY_DATA_SIZE. Identify has no
+ * offset field, so the payload cannot be split across per-segment
+ * commands; it is bounced through one internal page.
+ *
+ * Return: The nvme command status if a response was received (see
+ * &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_identify_iov(struct nvme_identify_args *args,
+		      const struct iovec *iov, int iovcnt);
+
 static inline int nvme_identify_cns_nsid(int fd, enum nvme_identify_cns cns,
 					 __u32 nsid, void *data)
 {
@@ -1336,6 +1358,62 @@ int nvme_get_log(struct nvme_get_log_args *args);
  */
 int nvme_get_log_page(int fd, __u32 xfer_len, struct nvme_get_log_args *args);
 
+/**
+ * nvme_get_log_page_iov() - Get log page data into an iovec
+ * @fd:		File descriptor of nvme device
+ * @xfer_len:	Max log transfer size per request to split the total.
+ * @args:	&struct nvme_get_log_args argument structure
+ * @iov:	Array of @iovcnt segments receiving the log data
+ * @iovcnt:	Number of segments in @iov
+ *
+ * As nvme_get_log_page(), but scatters the log data across @iov instead
+ * of the contiguous @args->log buffer, which is ignored along with
+ * @args->len; the total length is the sum of the segment lengths. Each
+ * segment is fetched with its own command sequence at the matching log
+ * page offset, so no staging copy is involved. Segment lengths must be
+ * multiples of four bytes. When @args->rae is clear, the event is still
+ * retained until the final transfer of the final segment.
+ *
+ * Return: The nvme command status if a response was received (see
+ * &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_get_log_page_iov(int fd, __u32 xfer_len,
+			  struct nvme_get_log_args *args,
+			  const struct iovec *iov, int iovcnt);
+
+/**
+ * typedef nvme_log_sink_cb - Consumer of streamed log page chunks
+ * @userdata:	Cookie passed alongside the callback
+ * @data:	Fetched chunk, valid for the duration of the call
+ * @len:	Number of bytes in @data
+ * @offset:	Log page offset the chunk was fetched from
+ *
+ * Return: 0 to continue the fetch sequence, nonzero to abort it.
+ */
+typedef int (*nvme_log_sink_cb)(void *userdata, const void *data, __u32 len,
+				__u64 offset);
+
+/**
+ * nvme_get_log_page_sink() - Stream log page data to a callback
+ * @fd:		File descriptor of nvme device
+ * @xfer_len:	Max log transfer size per request to split the total.
+ * @args:	&struct nvme_get_log_args argument structure
+ * @sink:	Invoked with each fetched chunk in offset order
+ * @userdata:	Cookie passed through to @sink
+ *
+ * As nvme_get_log_page(), but hands each chunk to @sink as soon as it
+ * arrives instead of assembling the whole page in @args->log, which is
+ * ignored; memory use is bounded by @xfer_len regardless of the total
+ * length. When @sink returns nonzero the sequence stops with errno set
+ * to ECANCELED.
+ *
+ * Return: The nvme command status if a response was received (see
+ * &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_get_log_page_sink(int fd, __u32 xfer_len,
+			   struct nvme_get_log_args *args,
+			   nvme_log_sink_cb sink, void *userdata);
+
 static inline int nvme_get_nsid_log(int fd, bool rae,
 			enum nvme_cmd_get_log_lid lid,
 			__u32 nsid, __u32 len, void *log)
@@ -1935,6 +2013,32 @@ static inline int nvme_get_log_ana_groups(int fd, bool rae, __u32 len,
 int nvme_get_ana_log_atomic(int fd, bool rgo, bool rae, unsigned int retries,
 			    struct nvme_ana_log *log, __u32 *len);
 
+/**
+ * nvme_get_ana_log_atomic2() - Retrieve ANA log page atomically, with a deadline
+ * @fd:		File descriptor of nvme device
+ * @rgo:	Whether to retrieve ANA groups only (no NSIDs)
+ * @rae:	Whether to retain asynchronous events
+ * @retries:	The maximum number of times to retry on log page changes
+ * @deadline:	Absolute CLOCK_MONOTONIC time in milliseconds (see
+ *		nvme_deadline_after()) bounding the whole operation,
+ *		including all chunk reads and retries; zero for no deadline
+ * @log:	Pointer to a buffer to receive the ANA log page
+ * @len:	Input: the length of the log page buffer.
+ * 		Output: the actual length of the ANA log page.
+ *
+ * As nvme_get_ana_log_atomic(), but with an overall time budget: the
+ * retry and chunk loops stop with errno set to ETIMEDOUT once @deadline
+ * passes, rather than retrying until @retries is exhausted. The buffer
+ * may then hold partial log data.
+ *
+ * Return: If successful, returns 0 and sets *len to the actual log page length.
+ * If unsuccessful, returns the nvme command status if a response was received
+ * (see &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_get_ana_log_atomic2(int fd, bool rgo, bool rae, unsigned int retries,
+			     __u64 deadline, struct nvme_ana_log *log,
+			     __u32 *len);
+
 /**
  * nvme_get_log_lba_status() - Retrieve LBA Status
  * @fd:		File descriptor of nvme device
@@ -2310,6 +2414,45 @@ static inline int nvme_get_log_persistent_event(int fd,
 	return nvme_get_log_page(fd, NVME_LOG_PAGE_PDU_SIZE, &args);
 }
 
+/**
+ * struct nvme_pel_cursor - Read position within the Persistent Event Log
+ * @offset:	Byte offset of the next unread event data, 0 for a fresh
+ *		cursor
+ * @gen:	Generation number of the log the offset belongs to
+ * @rsvd:	Reserved, must be zero
+ *
+ * Plain data with a fixed layout: a consumer may persist the cursor to
+ * disk between runs and resume where it left off. Zero-initialize for
+ * the first read.
+ */
+struct nvme_pel_cursor {
+	__u64	offset;
+	__u16	gen;
+	__u8	rsvd[6];
+};
+
+/**
+ * nvme_pel_read_new() - Read only new Persistent Event Log events
+ * @fd:		File descriptor of nvme device
+ * @cursor:	Read position, advanced past the returned data
+ * @buf:	Buffer receiving the event data
+ * @len:	Capacity of @buf in bytes, at least four
+ * @read_len:	Receives the number of bytes placed in @buf
+ *
+ * Establishes a reporting context, fetches the log header and returns
+ * the event data that arrived since the last call with this @cursor,
+ * releasing the context again afterwards. When the generation number
+ * shows the log was reinitialized the cursor restarts at the first
+ * event, so steady-state collection transfers data proportional to the
+ * event arrival rate rather than the log size. @read_len may come back
+ * smaller than the new data when @buf is full; call again to continue.
+ *
+ * Return: The nvme command status if a response was received (see
+ * &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_pel_read_new(int fd, struct nvme_pel_cursor *cursor, void *buf,
+		      __u32 len, __u32 *read_len);
+
 /**
  * nvme_set_features() - Set a feature attribute
  * @args:	&struct nvme_set_features_args argument structure
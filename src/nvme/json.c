@@ -7,6 +7,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -20,10 +21,18 @@
 #include "private.h"
 #include "linux.h"
 
+/* options only apply to still-unset fields, so an assignment is by
+ * definition a change of the effective config */
 #define JSON_UPDATE_INT_OPTION(c, k, a, o)				\
-	if (!strcmp(# a, k ) && !c->a) c->a = json_object_get_int(o);
+	if (!strcmp(# a, k ) && !c->a) {				\
+		c->a = json_object_get_int(o);				\
+		dirty = true;						\
+	}
 #define JSON_UPDATE_BOOL_OPTION(c, k, a, o)				\
-	if (!strcmp(# a, k ) && !c->a) c->a = json_object_get_boolean(o);
+	if (!strcmp(# a, k ) && !c->a) {				\
+		c->a = json_object_get_boolean(o);			\
+		dirty = true;						\
+	}
 
 static void json_import_nvme_tls_key(nvme_ctrl_t c, const char *keyring_str,
 				     const char *encoded_key)
@@ -59,28 +68,12 @@ static void json_import_nvme_tls_key(nvme_ctrl_t c, const char *keyring_str,
 	}
 }
 
-static void json_export_nvme_tls_key(long keyring_id, long tls_key,
-				     struct json_object *obj)
-{
-	int key_len;
-	_cleanup_free_ unsigned char *key_data = NULL;
-
-	key_data = nvme_read_key(keyring_id, tls_key, &key_len);
-	if (key_data) {
-		_cleanup_free_ char *tls_str = NULL;
-
-		tls_str = nvme_export_tls_key(key_data, key_len);
-		if (tls_str)
-			json_object_object_add(obj, "tls_key",
-					       json_object_new_string(tls_str));
-	}
-}
-
 static void json_update_attributes(nvme_ctrl_t c,
 				   struct json_object *ctrl_obj)
 {
 	struct nvme_fabrics_config *cfg = nvme_ctrl_get_config(c);
 	const char *keyring_str = NULL, *encoded_key = NULL;
+	bool dirty = false;
 
 	json_object_object_foreach(ctrl_obj, key_str, val_obj) {
 		JSON_UPDATE_INT_OPTION(cfg, key_str,
@@ -96,12 +89,24 @@ static void json_update_attributes(nvme_ctrl_t c,
 		JSON_UPDATE_INT_OPTION(cfg, key_str,
 				       reconnect_delay, val_obj);
 		if (!strcmp("ctrl_loss_tmo", key_str) &&
-		    cfg->ctrl_loss_tmo != NVMF_DEF_CTRL_LOSS_TMO)
-			cfg->ctrl_loss_tmo = json_object_get_int(val_obj);
+		    cfg->ctrl_loss_tmo != NVMF_DEF_CTRL_LOSS_TMO) {
+			int v = json_object_get_int(val_obj);
+
+			if (cfg->ctrl_loss_tmo != v) {
+				cfg->ctrl_loss_tmo = v;
+				dirty = true;
+			}
+		}
 		JSON_UPDATE_INT_OPTION(cfg, key_str,
 				       fast_io_fail_tmo, val_obj);
-		if (!strcmp("tos", key_str) && cfg->tos != -1)
-			cfg->tos = json_object_get_int(val_obj);
+		if (!strcmp("tos", key_str) && cfg->tos != -1) {
+			int v = json_object_get_int(val_obj);
+
+			if (cfg->tos != v) {
+				cfg->tos = v;
+				dirty = true;
+			}
+		}
 		JSON_UPDATE_BOOL_OPTION(cfg, key_str,
 					duplicate_connect, val_obj);
 		JSON_UPDATE_BOOL_OPTION(cfg, key_str,
@@ -132,6 +137,7 @@ static void json_update_attributes(nvme_ctrl_t c,
 			if (keyring) {
 				cfg->keyring = keyring;
 				nvme_set_keyring(cfg->keyring);
+				dirty = true;
 			}
 		}
 		if (!strcmp("tls_key", key_str) && cfg->tls_key == 0)
@@ -143,8 +149,15 @@ static void json_update_attributes(nvme_ctrl_t c,
 	 * so we can only import the TLS key once all entries are
 	 * processed.
 	 */
-	if (encoded_key)
+	if (encoded_key) {
 		json_import_nvme_tls_key(c, keyring_str, encoded_key);
+		/* only attempted while tls_key was unset */
+		if (cfg->tls_key)
+			dirty = true;
+	}
+
+	if (dirty)
+		c->cfg_dirty = true;
 }
 
 static void json_parse_port(nvme_subsystem_t s, struct json_object *port_obj)
@@ -183,23 +196,35 @@ static void json_parse_port(nvme_subsystem_t s, struct json_object *port_obj)
 		nvme_ctrl_set_dhchap_key(c, json_object_get_string(attr_obj));
 }
 
-static void json_parse_subsys(nvme_host_t h, struct json_object *subsys_obj)
+static nvme_subsystem_t json_get_subsys(nvme_host_t h,
+					struct json_object *subsys_obj)
 {
-	struct json_object *nqn_obj, *app_obj, *port_array;
+	struct json_object *nqn_obj, *app_obj;
 	nvme_subsystem_t s;
 	const char *nqn;
-	int p;
 
 	nqn_obj = json_object_object_get(subsys_obj, "nqn");
 	if (!nqn_obj)
-		return;
+		return NULL;
 	nqn = json_object_get_string(nqn_obj);
 	s = nvme_lookup_subsystem(h, NULL, nqn);
 	if (!s)
-		return;
+		return NULL;
 	app_obj = json_object_object_get(subsys_obj, "application");
 	if (app_obj)
 		nvme_subsystem_set_application(s, json_object_get_string(app_obj));
+	return s;
+}
+
+static void json_parse_subsys(nvme_host_t h, struct json_object *subsys_obj)
+{
+	struct json_object *port_array;
+	nvme_subsystem_t s;
+	int p;
+
+	s = json_get_subsys(h, subsys_obj);
+	if (!s)
+		return;
 
 	port_array = json_object_object_get(subsys_obj, "ports");
 	if (!port_array)
@@ -213,16 +238,15 @@ static void json_parse_subsys(nvme_host_t h, struct json_object *subsys_obj)
 	}
 }
 
-static void json_parse_host(nvme_root_t r, struct json_object *host_obj)
+static nvme_host_t json_get_host(nvme_root_t r, struct json_object *host_obj)
 {
-	struct json_object *attr_obj, *subsys_array, *subsys_obj;
+	struct json_object *attr_obj;
 	nvme_host_t h;
 	const char *hostnqn, *hostid = NULL;
-	int s;
 
 	attr_obj = json_object_object_get(host_obj, "hostnqn");
 	if (!attr_obj)
-		return;
+		return NULL;
 	hostnqn = json_object_get_string(attr_obj);
 	attr_obj = json_object_object_get(host_obj, "hostid");
 	if (attr_obj)
@@ -237,6 +261,18 @@ static void json_parse_host(nvme_root_t r, struct json_object *host_obj)
 	attr_obj = json_object_object_get(host_obj, "persistent_discovery_ctrl");
 	if (attr_obj)
 		nvme_host_set_pdc_enabled(h, json_object_get_boolean(attr_obj));
+	return h;
+}
+
+static void json_parse_host(nvme_root_t r, struct json_object *host_obj)
+{
+	struct json_object *subsys_array, *subsys_obj;
+	nvme_host_t h;
+	int s;
+
+	h = json_get_host(r, host_obj);
+	if (!h)
+		return;
 	subsys_array = json_object_object_get(host_obj, "subsystems");
 	if (!subsys_array)
 		return;
@@ -287,6 +323,367 @@ static struct json_object *parse_json(nvme_root_t r, int fd)
 	return obj;
 }
 
+/*
+ * Streaming configuration parse. The DOM path above materializes the
+ * whole file as json-c objects before walking it, which dominates boot
+ * time and peak RSS once the configuration carries thousands of
+ * controller entries. The scanner below reads the file in
+ * JSON_FILE_BUF_SIZE chunks and feeds nvme_lookup_host()/
+ * nvme_lookup_subsystem()/nvme_lookup_ctrl() as entries complete, so
+ * only the scalar attributes of the current entry are ever resident.
+ *
+ * The scanner relies on the member order json_update_config() writes:
+ * "hostnqn" precedes "subsystems" and "nqn" precedes "ports". Files
+ * that violate this, or use string escapes beyond the C ones, drop
+ * back to the DOM parse.
+ */
+struct json_stream {
+	int fd;
+	char buf[JSON_FILE_BUF_SIZE];
+	int pos, len;
+};
+
+static int json_stream_getc(struct json_stream *s)
+{
+	if (s->pos == s->len) {
+		int ret = read(s->fd, s->buf, sizeof(s->buf));
+
+		if (ret <= 0)
+			return -1;
+		s->len = ret;
+		s->pos = 0;
+	}
+	return (unsigned char)s->buf[s->pos++];
+}
+
+static int json_stream_next(struct json_stream *s)
+{
+	int c;
+
+	do {
+		c = json_stream_getc(s);
+	} while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+	return c;
+}
+
+static char *json_stream_string(struct json_stream *s)
+{
+	size_t len = 0, cap = 64;
+	char *str, *tmp;
+	int c;
+
+	str = malloc(cap);
+	if (!str)
+		return NULL;
+	for (;;) {
+		c = json_stream_getc(s);
+		if (c < 0)
+			goto err;
+		if (c == '"')
+			break;
+		if (c == '\\') {
+			c = json_stream_getc(s);
+			switch (c) {
+			case '"':
+			case '\\':
+			case '/':
+				break;
+			case 'b':
+				c = '\b';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			default:
+				/* \uXXXX etc. are left to the DOM parse */
+				goto err;
+			}
+		}
+		if (len + 2 > cap) {
+			tmp = realloc(str, cap * 2);
+			if (!tmp)
+				goto err;
+			str = tmp;
+			cap *= 2;
+		}
+		str[len++] = c;
+	}
+	str[len] = '\0';
+	return str;
+err:
+	free(str);
+	return NULL;
+}
+
+static int json_stream_literal(struct json_stream *s, const char *rest)
+{
+	while (*rest)
+		if (json_stream_getc(s) != *rest++)
+			return -1;
+	return 0;
+}
+
+static int json_stream_scalar(struct json_stream *s, int c,
+			      struct json_object **value)
+{
+	char num[32];
+	size_t len = 0;
+
+	*value = NULL;
+	switch (c) {
+	case '"': {
+		_cleanup_free_ char *str = json_stream_string(s);
+
+		if (!str)
+			return -1;
+		*value = json_object_new_string(str);
+		return *value ? 0 : -1;
+	}
+	case 't':
+		if (json_stream_literal(s, "rue"))
+			return -1;
+		*value = json_object_new_boolean(true);
+		return *value ? 0 : -1;
+	case 'f':
+		if (json_stream_literal(s, "alse"))
+			return -1;
+		*value = json_object_new_boolean(false);
+		return *value ? 0 : -1;
+	case 'n':
+		/* a null member is simply dropped */
+		return json_stream_literal(s, "ull");
+	default:
+		break;
+	}
+
+	while (c >= 0 && strchr("0123456789+-.eE", c)) {
+		if (len + 2 > sizeof(num))
+			return -1;
+		num[len++] = c;
+		c = json_stream_getc(s);
+	}
+	if (!len)
+		return -1;
+	if (c >= 0)
+		s->pos--;
+	num[len] = '\0';
+	if (strpbrk(num, ".eE"))
+		*value = json_object_new_double(strtod(num, NULL));
+	else
+		*value = json_object_new_int64(strtoll(num, NULL, 10));
+	return *value ? 0 : -1;
+}
+
+/* parse an object holding only scalar members; '{' is already consumed */
+static struct json_object *json_stream_flat_object(struct json_stream *s)
+{
+	struct json_object *obj;
+	int c;
+
+	obj = json_object_new_object();
+	if (!obj)
+		return NULL;
+	c = json_stream_next(s);
+	while (c != '}') {
+		_cleanup_free_ char *key = NULL;
+		struct json_object *val;
+
+		if (c != '"')
+			goto err;
+		key = json_stream_string(s);
+		if (!key)
+			goto err;
+		if (json_stream_next(s) != ':')
+			goto err;
+		c = json_stream_next(s);
+		if (c == '{' || c == '[')
+			goto err;
+		if (json_stream_scalar(s, c, &val))
+			goto err;
+		if (val)
+			json_object_object_add(obj, key, val);
+		c = json_stream_next(s);
+		if (c == ',')
+			c = json_stream_next(s);
+		else if (c != '}')
+			goto err;
+	}
+	return obj;
+err:
+	json_object_put(obj);
+	return NULL;
+}
+
+static int json_stream_subsys(struct json_stream *s, nvme_host_t h)
+{
+	struct json_object *attrs;
+	nvme_subsystem_t subsys = NULL;
+	int c, ret = -1;
+
+	attrs = json_object_new_object();
+	if (!attrs)
+		return -1;
+	c = json_stream_next(s);
+	while (c != '}') {
+		_cleanup_free_ char *key = NULL;
+
+		if (c != '"')
+			goto out;
+		key = json_stream_string(s);
+		if (!key)
+			goto out;
+		if (json_stream_next(s) != ':')
+			goto out;
+		c = json_stream_next(s);
+		if (!strcmp(key, "ports")) {
+			if (c != '[')
+				goto out;
+			if (!subsys) {
+				subsys = json_get_subsys(h, attrs);
+				if (!subsys)
+					goto out;
+			}
+			c = json_stream_next(s);
+			while (c != ']') {
+				struct json_object *port_obj;
+
+				if (c != '{')
+					goto out;
+				port_obj = json_stream_flat_object(s);
+				if (!port_obj)
+					goto out;
+				json_parse_port(subsys, port_obj);
+				json_object_put(port_obj);
+				c = json_stream_next(s);
+				if (c == ',')
+					c = json_stream_next(s);
+				else if (c != ']')
+					goto out;
+			}
+		} else {
+			struct json_object *val;
+
+			if (c == '{' || c == '[')
+				goto out;
+			if (json_stream_scalar(s, c, &val))
+				goto out;
+			if (val)
+				json_object_object_add(attrs, key, val);
+		}
+		c = json_stream_next(s);
+		if (c == ',')
+			c = json_stream_next(s);
+		else if (c != '}')
+			goto out;
+	}
+	/* apply attributes seen after "ports", e.g. "application" */
+	json_get_subsys(h, attrs);
+	ret = 0;
+out:
+	json_object_put(attrs);
+	return ret;
+}
+
+static int json_stream_host(struct json_stream *s, nvme_root_t r)
+{
+	struct json_object *attrs;
+	nvme_host_t h = NULL;
+	int c, ret = -1;
+
+	attrs = json_object_new_object();
+	if (!attrs)
+		return -1;
+	c = json_stream_next(s);
+	while (c != '}') {
+		_cleanup_free_ char *key = NULL;
+
+		if (c != '"')
+			goto out;
+		key = json_stream_string(s);
+		if (!key)
+			goto out;
+		if (json_stream_next(s) != ':')
+			goto out;
+		c = json_stream_next(s);
+		if (!strcmp(key, "subsystems")) {
+			if (c != '[')
+				goto out;
+			if (!h) {
+				h = json_get_host(r, attrs);
+				if (!h)
+					goto out;
+			}
+			c = json_stream_next(s);
+			while (c != ']') {
+				if (c != '{')
+					goto out;
+				if (json_stream_subsys(s, h))
+					goto out;
+				c = json_stream_next(s);
+				if (c == ',')
+					c = json_stream_next(s);
+				else if (c != ']')
+					goto out;
+			}
+		} else {
+			struct json_object *val;
+
+			if (c == '{' || c == '[')
+				goto out;
+			if (json_stream_scalar(s, c, &val))
+				goto out;
+			if (val)
+				json_object_object_add(attrs, key, val);
+		}
+		c = json_stream_next(s);
+		if (c == ',')
+			c = json_stream_next(s);
+		else if (c != '}')
+			goto out;
+	}
+	/* entries without a hostnqn are skipped, as in the DOM parse */
+	json_get_host(r, attrs);
+	ret = 0;
+out:
+	json_object_put(attrs);
+	return ret;
+}
+
+static int json_stream_config(nvme_root_t r, int fd)
+{
+	struct json_stream s = { .fd = fd };
+	int c;
+
+	c = json_stream_next(&s);
+	if (c != '[')
+		return -1;
+	c = json_stream_next(&s);
+	while (c != ']') {
+		if (c != '{')
+			return -1;
+		if (json_stream_host(&s, r))
+			return -1;
+		c = json_stream_next(&s);
+		if (c == ',')
+			c = json_stream_next(&s);
+		else if (c != ']')
+			return -1;
+	}
+	/* trailing garbage: let the strict DOM parse report it */
+	if (json_stream_next(&s) >= 0)
+		return -1;
+	return 0;
+}
+
 int json_read_config(nvme_root_t r, const char *config_file)
 {
 	struct json_object *json_root, *host_obj;
@@ -298,6 +695,20 @@ int json_read_config(nvme_root_t r, const char *config_file)
 			 config_file, strerror(errno));
 		return fd;
 	}
+	if (!json_stream_config(r, fd)) {
+		close(fd);
+		return 0;
+	}
+	/*
+	 * Unusual member order, escapes, or malformed input: reparse
+	 * through the DOM. The lookup functions are idempotent, so any
+	 * entries the scanner already applied converge to the same tree.
+	 */
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		close(fd);
+		errno = EPROTO;
+		return -1;
+	}
 	json_root = parse_json(r, fd);
 	close(fd);
 	if (!json_root) {
@@ -319,76 +730,196 @@ int json_read_config(nvme_root_t r, const char *config_file)
 	return 0;
 }
 
-#define JSON_STRING_OPTION(c, p, o)					\
-	if ((c)->o && strcmp((c)->o, "none"))				\
-		json_object_object_add((p), # o ,			\
-				       json_object_new_string((c)->o))
-#define JSON_INT_OPTION(c, p, o, d)					\
+/*
+ * Streaming emitter. json_update_config() and json_dump_tree() used to
+ * build the complete json-c object graph for the topology before
+ * printing it, allocating tens of MB of transient objects on large
+ * hosts for what is ultimately sequential output. The emitter below
+ * writes directly to the output stream while walking the tree, so the
+ * cost is proportional to the output size only. The output matches
+ * json-c's JSON_C_TO_STRING_PRETTY format.
+ */
+#define JSON_EMIT_MAX_DEPTH 8
+
+struct json_emit {
+	FILE *f;
+	int depth;
+	bool first[JSON_EMIT_MAX_DEPTH];
+};
+
+static void json_emit_sep(struct json_emit *e)
+{
+	int i;
+
+	if (!e->first[e->depth])
+		fputc(',', e->f);
+	e->first[e->depth] = false;
+	if (!e->depth)
+		return;
+	fputc('\n', e->f);
+	for (i = 0; i < e->depth; i++)
+		fputs("  ", e->f);
+}
+
+static void json_emit_raw_string(struct json_emit *e, const char *str)
+{
+	fputc('"', e->f);
+	for (; *str; str++) {
+		switch (*str) {
+		case '"':
+			fputs("\\\"", e->f);
+			break;
+		case '\\':
+			fputs("\\\\", e->f);
+			break;
+		case '\b':
+			fputs("\\b", e->f);
+			break;
+		case '\f':
+			fputs("\\f", e->f);
+			break;
+		case '\n':
+			fputs("\\n", e->f);
+			break;
+		case '\r':
+			fputs("\\r", e->f);
+			break;
+		case '\t':
+			fputs("\\t", e->f);
+			break;
+		default:
+			if ((unsigned char)*str < 0x20)
+				fprintf(e->f, "\\u%04x", *str);
+			else
+				fputc(*str, e->f);
+			break;
+		}
+	}
+	fputc('"', e->f);
+}
+
+static void json_emit_key(struct json_emit *e, const char *key)
+{
+	json_emit_sep(e);
+	if (key) {
+		json_emit_raw_string(e, key);
+		fputc(':', e->f);
+	}
+}
+
+static void json_emit_string(struct json_emit *e, const char *key,
+			     const char *val)
+{
+	json_emit_key(e, key);
+	json_emit_raw_string(e, val);
+}
+
+static void json_emit_int(struct json_emit *e, const char *key, long long val)
+{
+	json_emit_key(e, key);
+	fprintf(e->f, "%lld", val);
+}
+
+static void json_emit_bool(struct json_emit *e, const char *key, bool val)
+{
+	json_emit_key(e, key);
+	fputs(val ? "true" : "false", e->f);
+}
+
+/* open an object or array; pass key = NULL in value position */
+static void json_emit_begin(struct json_emit *e, const char *key, char bracket)
+{
+	json_emit_key(e, key);
+	fputc(bracket, e->f);
+	e->depth++;
+	e->first[e->depth] = true;
+}
+
+static void json_emit_end(struct json_emit *e, char bracket)
+{
+	bool empty = e->first[e->depth];
+	int i;
+
+	e->depth--;
+	if (!empty) {
+		fputc('\n', e->f);
+		for (i = 0; i < e->depth; i++)
+			fputs("  ", e->f);
+	}
+	fputc(bracket, e->f);
+}
+
+#define JSON_EMIT_INT_OPTION(c, e, o, d)				\
 	if ((c)->o != d)						\
-		json_object_object_add((p), # o ,			\
-				       json_object_new_int((c)->o))
-#define JSON_BOOL_OPTION(c, p, o)					\
+		json_emit_int((e), # o, (c)->o)
+#define JSON_EMIT_BOOL_OPTION(c, e, o)					\
 	if ((c)->o)							\
-		json_object_object_add((p), # o ,			\
-				       json_object_new_boolean((c)->o))
+		json_emit_bool((e), # o, (c)->o)
+
+static void json_emit_nvme_tls_key(struct json_emit *e, long keyring_id,
+				   long tls_key)
+{
+	int key_len;
+	_cleanup_free_ unsigned char *key_data = NULL;
+
+	key_data = nvme_read_key(keyring_id, tls_key, &key_len);
+	if (key_data) {
+		_cleanup_free_ char *tls_str = NULL;
+
+		tls_str = nvme_export_tls_key(key_data, key_len);
+		if (tls_str)
+			json_emit_string(e, "tls_key", tls_str);
+	}
+}
 
-static void json_update_port(struct json_object *ctrl_array, nvme_ctrl_t c)
+static void json_emit_port(struct json_emit *e, nvme_ctrl_t c)
 {
 	struct nvme_fabrics_config *cfg = nvme_ctrl_get_config(c);
-	struct json_object *port_obj = json_object_new_object();
 	const char *transport, *value;
 
+	json_emit_begin(e, NULL, '{');
 	transport = nvme_ctrl_get_transport(c);
-	json_object_object_add(port_obj, "transport",
-			       json_object_new_string(transport));
+	json_emit_string(e, "transport", transport);
 	value = nvme_ctrl_get_traddr(c);
 	if (value)
-		json_object_object_add(port_obj, "traddr",
-				       json_object_new_string(value));
+		json_emit_string(e, "traddr", value);
 	value = nvme_ctrl_get_host_traddr(c);
 	if (value)
-		json_object_object_add(port_obj, "host_traddr",
-				       json_object_new_string(value));
+		json_emit_string(e, "host_traddr", value);
 	value = nvme_ctrl_get_host_iface(c);
 	if (value)
-		json_object_object_add(port_obj, "host_iface",
-				       json_object_new_string(value));
+		json_emit_string(e, "host_iface", value);
 	value = nvme_ctrl_get_trsvcid(c);
 	if (value)
-		json_object_object_add(port_obj, "trsvcid",
-				       json_object_new_string(value));
+		json_emit_string(e, "trsvcid", value);
 	value = nvme_ctrl_get_dhchap_host_key(c);
 	if (value)
-		json_object_object_add(port_obj, "dhchap_key",
-				       json_object_new_string(value));
+		json_emit_string(e, "dhchap_key", value);
 	value = nvme_ctrl_get_dhchap_key(c);
 	if (value)
-		json_object_object_add(port_obj, "dhchap_ctrl_key",
-				       json_object_new_string(value));
-	JSON_INT_OPTION(cfg, port_obj, nr_io_queues, 0);
-	JSON_INT_OPTION(cfg, port_obj, nr_write_queues, 0);
-	JSON_INT_OPTION(cfg, port_obj, nr_poll_queues, 0);
-	JSON_INT_OPTION(cfg, port_obj, queue_size, 0);
-	JSON_INT_OPTION(cfg, port_obj, keep_alive_tmo, 0);
-	JSON_INT_OPTION(cfg, port_obj, reconnect_delay, 0);
+		json_emit_string(e, "dhchap_ctrl_key", value);
+	JSON_EMIT_INT_OPTION(cfg, e, nr_io_queues, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, nr_write_queues, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, nr_poll_queues, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, queue_size, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, keep_alive_tmo, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, reconnect_delay, 0);
 	if (strcmp(transport, "loop")) {
-		JSON_INT_OPTION(cfg, port_obj, ctrl_loss_tmo,
-				NVMF_DEF_CTRL_LOSS_TMO);
-		JSON_INT_OPTION(cfg, port_obj, fast_io_fail_tmo, 0);
-	}
-	JSON_INT_OPTION(cfg, port_obj, tos, -1);
-	JSON_BOOL_OPTION(cfg, port_obj, duplicate_connect);
-	JSON_BOOL_OPTION(cfg, port_obj, disable_sqflow);
-	JSON_BOOL_OPTION(cfg, port_obj, hdr_digest);
-	JSON_BOOL_OPTION(cfg, port_obj, data_digest);
-	JSON_BOOL_OPTION(cfg, port_obj, tls);
-	JSON_BOOL_OPTION(cfg, port_obj, concat);
+		JSON_EMIT_INT_OPTION(cfg, e, ctrl_loss_tmo,
+				     NVMF_DEF_CTRL_LOSS_TMO);
+		JSON_EMIT_INT_OPTION(cfg, e, fast_io_fail_tmo, 0);
+	}
+	JSON_EMIT_INT_OPTION(cfg, e, tos, -1);
+	JSON_EMIT_BOOL_OPTION(cfg, e, duplicate_connect);
+	JSON_EMIT_BOOL_OPTION(cfg, e, disable_sqflow);
+	JSON_EMIT_BOOL_OPTION(cfg, e, hdr_digest);
+	JSON_EMIT_BOOL_OPTION(cfg, e, data_digest);
+	JSON_EMIT_BOOL_OPTION(cfg, e, tls);
+	JSON_EMIT_BOOL_OPTION(cfg, e, concat);
 	if (nvme_ctrl_is_persistent(c))
-		json_object_object_add(port_obj, "persistent",
-				       json_object_new_boolean(true));
+		json_emit_bool(e, "persistent", true);
 	if (nvme_ctrl_is_discovery_ctrl(c))
-		json_object_object_add(port_obj, "discovery",
-				       json_object_new_boolean(true));
+		json_emit_bool(e, "discovery", true);
 	/*
 	 * Store the keyring description in the JSON config file.
 	 */
@@ -396,251 +927,242 @@ static void json_update_port(struct json_object *ctrl_array, nvme_ctrl_t c)
 		_cleanup_free_ char *desc =
 			nvme_describe_key_serial(cfg->keyring);
 
-		if (desc) {
-			json_object_object_add(port_obj, "keyring",
-					       json_object_new_string(desc));
-		}
+		if (desc)
+			json_emit_string(e, "keyring", desc);
 	}
 	/*
 	 * Store the TLS key in PSK interchange format
 	 */
 	if (cfg->tls_key)
-		json_export_nvme_tls_key(cfg->keyring, cfg->tls_key, port_obj);
-
-	json_object_array_add(ctrl_array, port_obj);
+		json_emit_nvme_tls_key(e, cfg->keyring, cfg->tls_key);
+	json_emit_end(e, '}');
 }
 
-static void json_update_subsys(struct json_object *subsys_array,
-			       nvme_subsystem_t s)
+static void json_update_subsys(struct json_emit *e, nvme_subsystem_t s)
 {
 	nvme_ctrl_t c;
-	const char *subsysnqn = nvme_subsystem_get_nqn(s), *app;
-	struct json_object *subsys_obj = json_object_new_object();
-	struct json_object *port_array;
-
-	/* Skip discovery subsystems as the nqn is not unique */
-	if (!strcmp(subsysnqn, NVME_DISC_SUBSYS_NAME))
-		return;
+	const char *app;
+	bool ports = false;
 
-	json_object_object_add(subsys_obj, "nqn",
-			       json_object_new_string(subsysnqn));
+	json_emit_begin(e, NULL, '{');
+	json_emit_string(e, "nqn", nvme_subsystem_get_nqn(s));
 	app = nvme_subsystem_get_application(s);
 	if (app)
-		json_object_object_add(subsys_obj, "application",
-				       json_object_new_string(app));
-	port_array = json_object_new_array();
+		json_emit_string(e, "application", app);
 	nvme_subsystem_for_each_ctrl(s, c) {
-		json_update_port(port_array, c);
+		if (!ports) {
+			json_emit_begin(e, "ports", '[');
+			ports = true;
+		}
+		json_emit_port(e, c);
 	}
-	if (json_object_array_length(port_array))
-		json_object_object_add(subsys_obj, "ports", port_array);
-	else
-		json_object_put(port_array);
-	json_object_array_add(subsys_array, subsys_obj);
+	if (ports)
+		json_emit_end(e, ']');
+	json_emit_end(e, '}');
 }
 
 int json_update_config(nvme_root_t r, const char *config_file)
 {
 	nvme_host_t h;
-	struct json_object *json_root, *host_obj;
-	struct json_object *subsys_array;
+	struct json_emit e = { .first = { true } };
 	int ret = 0;
 
-	json_root = json_object_new_array();
+	if (!config_file)
+		e.f = stdout;
+	else
+		e.f = fopen(config_file, "w");
+	if (!e.f) {
+		nvme_msg(r, LOG_ERR, "Failed to open %s, %s\n",
+			 config_file, strerror(errno));
+		return -1;
+	}
+
+	json_emit_begin(&e, NULL, '[');
 	nvme_for_each_host(r, h) {
 		nvme_subsystem_t s;
-		const char *hostnqn, *hostid, *dhchap_key, *hostsymname;
-
-		host_obj = json_object_new_object();
-		if (!host_obj)
-			continue;
-		hostnqn = nvme_host_get_hostnqn(h);
-		json_object_object_add(host_obj, "hostnqn",
-				       json_object_new_string(hostnqn));
-		hostid = nvme_host_get_hostid(h);
-		if (hostid)
-			json_object_object_add(host_obj, "hostid",
-					       json_object_new_string(hostid));
-		dhchap_key = nvme_host_get_dhchap_key(h);
-		if (dhchap_key)
-			json_object_object_add(host_obj, "dhchap_key",
-					       json_object_new_string(dhchap_key));
-		hostsymname = nvme_host_get_hostsymname(h);
-		if (hostsymname)
-			json_object_object_add(host_obj, "hostsymname",
-					       json_object_new_string(hostsymname));
+		const char *value;
+		bool subsys = false;
+
+		json_emit_begin(&e, NULL, '{');
+		json_emit_string(&e, "hostnqn", nvme_host_get_hostnqn(h));
+		value = nvme_host_get_hostid(h);
+		if (value)
+			json_emit_string(&e, "hostid", value);
+		value = nvme_host_get_dhchap_key(h);
+		if (value)
+			json_emit_string(&e, "dhchap_key", value);
+		value = nvme_host_get_hostsymname(h);
+		if (value)
+			json_emit_string(&e, "hostsymname", value);
 		if (h->pdc_enabled_valid)
-			json_object_object_add(host_obj, "persistent_discovery_ctrl",
-					       json_object_new_boolean(h->pdc_enabled));
-		subsys_array = json_object_new_array();
+			json_emit_bool(&e, "persistent_discovery_ctrl",
+				       h->pdc_enabled);
 		nvme_for_each_subsystem(h, s) {
-			json_update_subsys(subsys_array, s);
+			/* Skip discovery subsystems as the nqn is not unique */
+			if (!strcmp(nvme_subsystem_get_nqn(s),
+				    NVME_DISC_SUBSYS_NAME))
+				continue;
+			if (!subsys) {
+				json_emit_begin(&e, "subsystems", '[');
+				subsys = true;
+			}
+			json_update_subsys(&e, s);
 		}
-		if (json_object_array_length(subsys_array))
-			json_object_object_add(host_obj, "subsystems",
-						    subsys_array);
-		else
-			json_object_put(subsys_array);
-		json_object_array_add(json_root, host_obj);
-	}
-	if (!config_file) {
-		ret = json_object_to_fd(1, json_root, JSON_C_TO_STRING_PRETTY);
-		printf("\n");
-	} else
-		ret = json_object_to_file_ext(config_file, json_root,
-					      JSON_C_TO_STRING_PRETTY);
-	if (ret < 0) {
+		if (subsys)
+			json_emit_end(&e, ']');
+		json_emit_end(&e, '}');
+	}
+	json_emit_end(&e, ']');
+	if (!config_file)
+		fputc('\n', e.f);
+
+	if (fflush(e.f) || ferror(e.f)) {
 		nvme_msg(r, LOG_ERR, "Failed to write to %s, %s\n",
-			 config_file ? "stdout" : config_file,
-			 json_util_get_last_err());
+			 config_file ? config_file : "stdout",
+			 strerror(errno));
 		ret = -1;
 		errno = EIO;
 	}
-	json_object_put(json_root);
+	if (config_file)
+		fclose(e.f);
 
 	return ret;
 }
 
-static void json_dump_ctrl(struct json_object *ctrl_array, nvme_ctrl_t c)
+static void json_dump_ctrl(struct json_emit *e, nvme_ctrl_t c)
 {
 	struct nvme_fabrics_config *cfg = nvme_ctrl_get_config(c);
-	struct json_object *ctrl_obj = json_object_new_object();
 	const char *name, *transport, *value;
 
+	json_emit_begin(e, NULL, '{');
 	name = nvme_ctrl_get_name(c);
 	if (name && strlen(name))
-		json_object_object_add(ctrl_obj, "name",
-				       json_object_new_string(name));
+		json_emit_string(e, "name", name);
 	transport = nvme_ctrl_get_transport(c);
-	json_object_object_add(ctrl_obj, "transport",
-			       json_object_new_string(transport));
+	json_emit_string(e, "transport", transport);
 	value = nvme_ctrl_get_traddr(c);
 	if (value)
-		json_object_object_add(ctrl_obj, "traddr",
-				       json_object_new_string(value));
+		json_emit_string(e, "traddr", value);
 	value = nvme_ctrl_get_host_traddr(c);
 	if (value)
-		json_object_object_add(ctrl_obj, "host_traddr",
-				       json_object_new_string(value));
+		json_emit_string(e, "host_traddr", value);
 	value = nvme_ctrl_get_host_iface(c);
 	if (value)
-		json_object_object_add(ctrl_obj, "host_iface",
-				       json_object_new_string(value));
+		json_emit_string(e, "host_iface", value);
 	value = nvme_ctrl_get_trsvcid(c);
 	if (value)
-		json_object_object_add(ctrl_obj, "trsvcid",
-				       json_object_new_string(value));
+		json_emit_string(e, "trsvcid", value);
 	value = nvme_ctrl_get_dhchap_host_key(c);
 	if (value)
-		json_object_object_add(ctrl_obj, "dhchap_key",
-				       json_object_new_string(value));
+		json_emit_string(e, "dhchap_key", value);
 	value = nvme_ctrl_get_dhchap_key(c);
 	if (value)
-		json_object_object_add(ctrl_obj, "dhchap_ctrl_key",
-				       json_object_new_string(value));
-	JSON_INT_OPTION(cfg, ctrl_obj, nr_io_queues, 0);
-	JSON_INT_OPTION(cfg, ctrl_obj, nr_write_queues, 0);
-	JSON_INT_OPTION(cfg, ctrl_obj, nr_poll_queues, 0);
-	JSON_INT_OPTION(cfg, ctrl_obj, queue_size, 0);
-	JSON_INT_OPTION(cfg, ctrl_obj, keep_alive_tmo, 0);
-	JSON_INT_OPTION(cfg, ctrl_obj, reconnect_delay, 0);
+		json_emit_string(e, "dhchap_ctrl_key", value);
+	JSON_EMIT_INT_OPTION(cfg, e, nr_io_queues, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, nr_write_queues, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, nr_poll_queues, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, queue_size, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, keep_alive_tmo, 0);
+	JSON_EMIT_INT_OPTION(cfg, e, reconnect_delay, 0);
 	if (strcmp(transport, "loop")) {
-		JSON_INT_OPTION(cfg, ctrl_obj, ctrl_loss_tmo,
-				NVMF_DEF_CTRL_LOSS_TMO);
-		JSON_INT_OPTION(cfg, ctrl_obj, fast_io_fail_tmo, 0);
-	}
-	JSON_INT_OPTION(cfg, ctrl_obj, tos, -1);
-	JSON_BOOL_OPTION(cfg, ctrl_obj, duplicate_connect);
-	JSON_BOOL_OPTION(cfg, ctrl_obj, disable_sqflow);
-	JSON_BOOL_OPTION(cfg, ctrl_obj, hdr_digest);
-	JSON_BOOL_OPTION(cfg, ctrl_obj, data_digest);
+		JSON_EMIT_INT_OPTION(cfg, e, ctrl_loss_tmo,
+				     NVMF_DEF_CTRL_LOSS_TMO);
+		JSON_EMIT_INT_OPTION(cfg, e, fast_io_fail_tmo, 0);
+	}
+	JSON_EMIT_INT_OPTION(cfg, e, tos, -1);
+	JSON_EMIT_BOOL_OPTION(cfg, e, duplicate_connect);
+	JSON_EMIT_BOOL_OPTION(cfg, e, disable_sqflow);
+	JSON_EMIT_BOOL_OPTION(cfg, e, hdr_digest);
+	JSON_EMIT_BOOL_OPTION(cfg, e, data_digest);
 	if (!strcmp(transport, "tcp")) {
-		JSON_BOOL_OPTION(cfg, ctrl_obj, tls);
+		JSON_EMIT_BOOL_OPTION(cfg, e, tls);
 
 		if (cfg->tls_key)
-			json_export_nvme_tls_key(cfg->keyring, cfg->tls_key,
-						 ctrl_obj);
+			json_emit_nvme_tls_key(e, cfg->keyring, cfg->tls_key);
 	}
-	JSON_BOOL_OPTION(cfg, ctrl_obj, concat);
+	JSON_EMIT_BOOL_OPTION(cfg, e, concat);
 	if (nvme_ctrl_is_persistent(c))
-		json_object_object_add(ctrl_obj, "persistent",
-				       json_object_new_boolean(true));
+		json_emit_bool(e, "persistent", true);
 	if (nvme_ctrl_is_discovery_ctrl(c))
-		json_object_object_add(ctrl_obj, "discovery",
-				       json_object_new_boolean(true));
-	json_object_array_add(ctrl_array, ctrl_obj);
+		json_emit_bool(e, "discovery", true);
+	json_emit_end(e, '}');
 }
 
-static void json_dump_subsys(struct json_object *subsys_array,
-			       nvme_subsystem_t s)
+static void json_dump_subsys(struct json_emit *e, nvme_subsystem_t s)
 {
 	nvme_ctrl_t c;
-	struct json_object *subsys_obj = json_object_new_object();
-	struct json_object *ctrl_array;
-
-	json_object_object_add(subsys_obj, "name",
-			       json_object_new_string(nvme_subsystem_get_name(s)));
-	json_object_object_add(subsys_obj, "nqn",
-			       json_object_new_string(nvme_subsystem_get_nqn(s)));
-	ctrl_array = json_object_new_array();
+	bool ctrls = false;
+
+	json_emit_begin(e, NULL, '{');
+	json_emit_string(e, "name", nvme_subsystem_get_name(s));
+	json_emit_string(e, "nqn", nvme_subsystem_get_nqn(s));
 	nvme_subsystem_for_each_ctrl(s, c) {
-		json_dump_ctrl(ctrl_array, c);
+		if (!ctrls) {
+			json_emit_begin(e, "controllers", '[');
+			ctrls = true;
+		}
+		json_dump_ctrl(e, c);
 	}
-	if (json_object_array_length(ctrl_array))
-		json_object_object_add(subsys_obj, "controllers", ctrl_array);
-	else
-		json_object_put(ctrl_array);
-	json_object_array_add(subsys_array, subsys_obj);
+	if (ctrls)
+		json_emit_end(e, ']');
+	json_emit_end(e, '}');
 }
 
 int json_dump_tree(nvme_root_t r)
 {
 	nvme_host_t h;
-	struct json_object *json_root, *host_obj;
-	struct json_object *host_array, *subsys_array;
+	struct json_emit e = { .first = { true } };
 	int ret = 0;
+	int fd;
 
-	json_root = json_object_new_object();
-	host_array = json_object_new_array();
+	fd = dup(r->log.fd);
+	if (fd < 0)
+		return -1;
+	e.f = fdopen(fd, "w");
+	if (!e.f) {
+		close(fd);
+		return -1;
+	}
+
+	json_emit_begin(&e, NULL, '{');
+	json_emit_begin(&e, "hosts", '[');
 	nvme_for_each_host(r, h) {
 		nvme_subsystem_t s;
-		const char *hostid, *dhchap_key;
-
-		host_obj = json_object_new_object();
-		json_object_object_add(host_obj, "hostnqn",
-				       json_object_new_string(nvme_host_get_hostnqn(h)));
-		hostid = nvme_host_get_hostid(h);
-		if (hostid)
-			json_object_object_add(host_obj, "hostid",
-					       json_object_new_string(hostid));
-		dhchap_key = nvme_host_get_dhchap_key(h);
-		if (dhchap_key)
-			json_object_object_add(host_obj, "dhchap_key",
-					       json_object_new_string(dhchap_key));
+		const char *value;
+		bool subsys = false;
+
+		json_emit_begin(&e, NULL, '{');
+		json_emit_string(&e, "hostnqn", nvme_host_get_hostnqn(h));
+		value = nvme_host_get_hostid(h);
+		if (value)
+			json_emit_string(&e, "hostid", value);
+		value = nvme_host_get_dhchap_key(h);
+		if (value)
+			json_emit_string(&e, "dhchap_key", value);
 		if (h->pdc_enabled_valid)
-			json_object_object_add(host_obj, "persistent_discovery_ctrl",
-					       json_object_new_boolean(h->pdc_enabled));
-		subsys_array = json_object_new_array();
+			json_emit_bool(&e, "persistent_discovery_ctrl",
+				       h->pdc_enabled);
 		nvme_for_each_subsystem(h, s) {
-			json_dump_subsys(subsys_array, s);
+			if (!subsys) {
+				json_emit_begin(&e, "subsystems", '[');
+				subsys = true;
+			}
+			json_dump_subsys(&e, s);
 		}
-		if (json_object_array_length(subsys_array))
-			json_object_object_add(host_obj, "subsystems",
-					       subsys_array);
-		else
-			json_object_put(subsys_array);
-		json_object_array_add(host_array, host_obj);
+		if (subsys)
+			json_emit_end(&e, ']');
+		json_emit_end(&e, '}');
 	}
-	json_object_object_add(json_root, "hosts", host_array);
+	json_emit_end(&e, ']');
+	json_emit_end(&e, '}');
 
-	ret = json_object_to_fd(r->log.fd, json_root, JSON_C_TO_STRING_PRETTY);
-	if (ret < 0) {
+	if (fflush(e.f) || ferror(e.f)) {
 		nvme_msg(r, LOG_ERR, "Failed to write, %s\n",
-			 json_util_get_last_err());
+			 strerror(errno));
 		ret = -1;
 		errno = EIO;
 	}
-	json_object_put(json_root);
+	fclose(e.f);
 
 	return ret;
 }
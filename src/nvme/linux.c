@@ -7,11 +7,13 @@
  * 	    Chaitanya Kulkarni <chaitanya.kulkarni@wdc.com>
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+#include <sys/epoll.h>
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -29,13 +31,19 @@
 #endif
 #endif
 
+#ifdef CONFIG_ZLIB
+#include <zlib.h>
+#endif
+
 #ifdef CONFIG_KEYUTILS
 #include <keyutils.h>
 
 #define NVME_TLS_DEFAULT_KEYRING ".nvme"
 #endif
 
+#include <ccan/array_size/array_size.h>
 #include <ccan/endian/endian.h>
+#include <ccan/list/list.h>
 
 #include "cleanup.h"
 #include "linux.h"
@@ -158,6 +166,33 @@ int nvme_get_telemetry_max(int fd, enum nvme_telemetry_da *da, size_t *data_tx)
 	return err;
 }
 
+/*
+ * Keep MDTS-derived transfer sizes within what the passthrough
+ * interface reliably accepts; an unset MDTS means no limit is
+ * advertised and we stay with the single page default.
+ */
+static __u32 nvme_log_xfer_clamp(size_t max_data_tx)
+{
+	if (max_data_tx < NVME_LOG_PAGE_PDU_SIZE)
+		return NVME_LOG_PAGE_PDU_SIZE;
+	if (max_data_tx > NVME_LOG_PAGE_MAX_XFER)
+		return NVME_LOG_PAGE_MAX_XFER;
+	return max_data_tx;
+}
+
+int nvme_get_log_page_max(int fd, __u32 *xfer_len)
+{
+	size_t max_data_tx = 0;
+	int err;
+
+	err = nvme_get_telemetry_max(fd, NULL, &max_data_tx);
+	if (err)
+		return err;
+
+	*xfer_len = nvme_log_xfer_clamp(max_data_tx);
+	return 0;
+}
+
 int nvme_get_telemetry_log(int fd, bool create, bool ctrl, bool rae, size_t max_data_tx,
 			   enum nvme_telemetry_da da, struct nvme_telemetry_log **buf,
 			   size_t *size)
@@ -264,7 +299,8 @@ static int nvme_check_get_telemetry_log(int fd, bool create, bool ctrl, bool rae
 					size_t *size)
 {
 	enum nvme_telemetry_da max_da = 0;
-	int err = nvme_get_telemetry_max(fd, &max_da, NULL);
+	size_t max_data_tx = 0;
+	int err = nvme_get_telemetry_max(fd, &max_da, &max_data_tx);
 
 	if (err)
 		return err;
@@ -272,7 +308,9 @@ static int nvme_check_get_telemetry_log(int fd, bool create, bool ctrl, bool rae
 		errno = ENOENT;
 		return -1;
 	}
-	return nvme_get_telemetry_log(fd, create, ctrl, rae, 4096, da, log, size);
+	return nvme_get_telemetry_log(fd, create, ctrl, rae,
+				      nvme_log_xfer_clamp(max_data_tx), da,
+				      log, size);
 }
 
 
@@ -294,6 +332,329 @@ int nvme_get_new_host_telemetry(int fd, struct nvme_telemetry_log **log,
 	return nvme_check_get_telemetry_log(fd, true, false, false, log, da, size);
 }
 
+struct nvme_telemetry_stream {
+	int fd;
+	bool ctrl;
+	__u32 xfer;
+	/* most recently fetched log header */
+	struct nvme_telemetry_log *hdr;
+	bool hdr_valid;
+	/* generation number of the last fully streamed payload */
+	__u8 last_dgn;
+	bool last_dgn_valid;
+	/* reused for every chunk fetch */
+	void *chunk;
+};
+
+nvme_telemetry_stream_t nvme_telemetry_stream_open(int fd, bool ctrl)
+{
+	struct nvme_telemetry_stream *stream;
+	size_t max_data_tx = 0;
+
+	if (nvme_get_telemetry_max(fd, NULL, &max_data_tx))
+		return NULL;
+
+	stream = calloc(1, sizeof(*stream));
+	if (!stream) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	stream->fd = fd;
+	stream->ctrl = ctrl;
+	stream->xfer = nvme_log_xfer_clamp(max_data_tx);
+	stream->hdr = __nvme_alloc(NVME_LOG_TELEM_BLOCK_SIZE);
+	stream->chunk = __nvme_alloc(stream->xfer);
+	if (!stream->hdr || !stream->chunk) {
+		nvme_telemetry_stream_close(stream);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return stream;
+}
+
+void nvme_telemetry_stream_close(nvme_telemetry_stream_t stream)
+{
+	if (!stream)
+		return;
+	free(stream->chunk);
+	free(stream->hdr);
+	free(stream);
+}
+
+int nvme_telemetry_stream_check(nvme_telemetry_stream_t stream, bool create,
+				bool rae, bool *changed)
+{
+	int err;
+
+	if (stream->ctrl)
+		err = nvme_get_log_telemetry_ctrl(stream->fd, rae, 0,
+						  NVME_LOG_TELEM_BLOCK_SIZE,
+						  stream->hdr);
+	else if (create)
+		err = nvme_get_log_create_telemetry_host(stream->fd,
+							 stream->hdr);
+	else
+		err = nvme_get_log_telemetry_host(stream->fd, 0,
+						  NVME_LOG_TELEM_BLOCK_SIZE,
+						  stream->hdr);
+	if (err) {
+		stream->hdr_valid = false;
+		return err;
+	}
+	stream->hdr_valid = true;
+
+	if (changed) {
+		__u8 dgn = stream->ctrl ? stream->hdr->ctrldgn :
+			stream->hdr->hostdgn;
+
+		*changed = !stream->last_dgn_valid ||
+			dgn != stream->last_dgn;
+	}
+	return 0;
+}
+
+const struct nvme_telemetry_log *
+nvme_telemetry_stream_header(nvme_telemetry_stream_t stream)
+{
+	return stream->hdr_valid ? stream->hdr : NULL;
+}
+
+/* first and last telemetry data block of @da; data area N starts right
+ * after the last block of data area N - 1 */
+static int nvme_telemetry_da_blocks(const struct nvme_telemetry_log *hdr,
+				    enum nvme_telemetry_da da,
+				    size_t *first, size_t *last)
+{
+	switch (da) {
+	case NVME_TELEMETRY_DA_1:
+		*first = 1;
+		*last = le16_to_cpu(hdr->dalb1);
+		break;
+	case NVME_TELEMETRY_DA_2:
+		*first = le16_to_cpu(hdr->dalb1) + 1;
+		*last = le16_to_cpu(hdr->dalb2);
+		break;
+	case NVME_TELEMETRY_DA_3:
+		*first = le16_to_cpu(hdr->dalb2) + 1;
+		*last = le16_to_cpu(hdr->dalb3);
+		break;
+	case NVME_TELEMETRY_DA_4:
+		*first = le16_to_cpu(hdr->dalb3) + 1;
+		*last = le32_to_cpu(hdr->dalb4);
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int nvme_telemetry_stream_read_da(nvme_telemetry_stream_t stream,
+				  enum nvme_telemetry_da da,
+				  nvme_telemetry_chunk_cb_t cb, void *cb_data)
+{
+	size_t first, last, offset, end;
+	int err;
+
+	if (!stream->hdr_valid || !cb) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	err = nvme_telemetry_da_blocks(stream->hdr, da, &first, &last);
+	if (err)
+		return err;
+	if (last < first)
+		return 0;
+
+	offset = first * NVME_LOG_TELEM_BLOCK_SIZE;
+	end = (last + 1) * NVME_LOG_TELEM_BLOCK_SIZE;
+
+	while (offset < end) {
+		size_t len = end - offset;
+
+		if (len > stream->xfer)
+			len = stream->xfer;
+
+		if (stream->ctrl)
+			err = nvme_get_log_telemetry_ctrl(stream->fd, true,
+							  offset, len,
+							  stream->chunk);
+		else
+			err = nvme_get_log_telemetry_host(stream->fd, offset,
+							  len, stream->chunk);
+		if (err)
+			return err;
+
+		err = cb(da, offset, stream->chunk, len, cb_data);
+		if (err)
+			return err;
+
+		offset += len;
+	}
+
+	/* the payload up to @da is now consistent with the header */
+	stream->last_dgn = stream->ctrl ? stream->hdr->ctrldgn :
+		stream->hdr->hostdgn;
+	stream->last_dgn_valid = true;
+
+	return 0;
+}
+
+#ifdef CONFIG_ZLIB
+struct nvme_log_deflate {
+	z_stream strm;
+	nvme_log_sink_cb sink;
+	void *userdata;
+	/* byte offset within the compressed output stream */
+	__u64 offset;
+	unsigned char buf[4 * NVME_LOG_TELEM_BLOCK_SIZE];
+};
+
+int nvme_log_deflate_create(nvme_log_deflate_t *stage, int level,
+			    nvme_log_sink_cb sink, void *userdata)
+{
+	struct nvme_log_deflate *d;
+
+	if (!stage || !sink) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (level <= 0)
+		level = Z_DEFAULT_COMPRESSION;
+	/* windowBits 15 + 16 selects the gzip wrapper */
+	if (deflateInit2(&d->strm, level, Z_DEFLATED, 15 + 16, 8,
+			 Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(d);
+		errno = ENOMEM;
+		return -1;
+	}
+	d->sink = sink;
+	d->userdata = userdata;
+
+	*stage = d;
+	return 0;
+}
+
+static int nvme_log_deflate_run(struct nvme_log_deflate *d, int flush)
+{
+	do {
+		size_t produced;
+		int ret;
+
+		d->strm.next_out = d->buf;
+		d->strm.avail_out = sizeof(d->buf);
+		ret = deflate(&d->strm, flush);
+		if (ret == Z_STREAM_ERROR) {
+			errno = EIO;
+			return -1;
+		}
+		produced = sizeof(d->buf) - d->strm.avail_out;
+		if (produced) {
+			if (d->sink(d->userdata, d->buf, produced, d->offset))
+				return 1;
+			d->offset += produced;
+		}
+		if (flush == Z_FINISH && ret == Z_STREAM_END)
+			break;
+	} while (d->strm.avail_in || !d->strm.avail_out);
+
+	return 0;
+}
+
+int nvme_log_deflate_push(nvme_log_deflate_t stage, const void *data,
+			  size_t len)
+{
+	if (!stage) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stage->strm.next_in = (unsigned char *)data;
+	stage->strm.avail_in = len;
+	return nvme_log_deflate_run(stage, Z_NO_FLUSH);
+}
+
+int nvme_log_deflate_sink(void *userdata, const void *data, __u32 len,
+			  __u64 offset)
+{
+	return nvme_log_deflate_push(userdata, data, len);
+}
+
+int nvme_log_deflate_chunk_cb(enum nvme_telemetry_da da, size_t offset,
+			      const void *data, size_t len, void *cb_data)
+{
+	return nvme_log_deflate_push(cb_data, data, len);
+}
+
+int nvme_log_deflate_finish(nvme_log_deflate_t stage)
+{
+	if (!stage) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stage->strm.next_in = NULL;
+	stage->strm.avail_in = 0;
+	return nvme_log_deflate_run(stage, Z_FINISH);
+}
+
+void nvme_log_deflate_free(nvme_log_deflate_t stage)
+{
+	if (!stage)
+		return;
+	deflateEnd(&stage->strm);
+	free(stage);
+}
+#else /* !CONFIG_ZLIB */
+int nvme_log_deflate_create(nvme_log_deflate_t *stage, int level,
+			    nvme_log_sink_cb sink, void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_log_deflate_push(nvme_log_deflate_t stage, const void *data,
+			  size_t len)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_log_deflate_sink(void *userdata, const void *data, __u32 len,
+			  __u64 offset)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_log_deflate_chunk_cb(enum nvme_telemetry_da da, size_t offset,
+			      const void *data, size_t len, void *cb_data)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_log_deflate_finish(nvme_log_deflate_t stage)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+void nvme_log_deflate_free(nvme_log_deflate_t stage)
+{
+}
+#endif /* CONFIG_ZLIB */
+
 int nvme_get_lba_status_log(int fd, bool rae, struct nvme_lba_status_log **log)
 {
 	_cleanup_free_ struct nvme_lba_status_log *buf = NULL;
@@ -462,16 +823,12 @@ int nvme_set_attr(const char *dir, const char *attr, const char *value)
 	return __nvme_set_attr(path, value);
 }
 
-static char *__nvme_get_attr(const char *path)
+static char *__nvme_get_attr_fd(int fd)
 {
 	char value[4096] = { 0 };
-	int ret, fd;
+	int ret;
 	int saved_errno;
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0)
-		return NULL;
-
 	ret = read(fd, value, sizeof(value) - 1);
 	saved_errno = errno;
 	close(fd);
@@ -491,6 +848,47 @@ static char *__nvme_get_attr(const char *path)
 	return strlen(value) ? strdup(value) : NULL;
 }
 
+static char *__nvme_get_attr(const char *path)
+{
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	return __nvme_get_attr_fd(fd);
+}
+
+char *nvme_get_attr_at(int dirfd, const char *attr)
+{
+	int fd;
+
+	fd = openat(dirfd, attr, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	return __nvme_get_attr_fd(fd);
+}
+
+int nvme_get_attrs(const char *dir, const char *const *attrs,
+		   char **values, unsigned int n)
+{
+	unsigned int i;
+	int dfd, found = 0;
+
+	dfd = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (dfd < 0)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		values[i] = nvme_get_attr_at(dfd, attrs[i]);
+		if (values[i])
+			found++;
+	}
+	close(dfd);
+	return found;
+}
+
 char *nvme_get_attr(const char *dir, const char *attr)
 {
 	_cleanup_free_ char *path = NULL;
@@ -507,21 +905,37 @@ char *nvme_get_attr(const char *dir, const char *attr)
 
 char *nvme_get_subsys_attr(nvme_subsystem_t s, const char *attr)
 {
+	int dfd = nvme_subsystem_sysfs_fd(s);
+
+	if (dfd >= 0)
+		return nvme_get_attr_at(dfd, attr);
 	return nvme_get_attr(nvme_subsystem_get_sysfs_dir(s), attr);
 }
 
 char *nvme_get_ctrl_attr(nvme_ctrl_t c, const char *attr)
 {
+	int dfd = nvme_ctrl_sysfs_fd(c);
+
+	if (dfd >= 0)
+		return nvme_get_attr_at(dfd, attr);
 	return nvme_get_attr(nvme_ctrl_get_sysfs_dir(c), attr);
 }
 
 char *nvme_get_ns_attr(nvme_ns_t n, const char *attr)
 {
+	int dfd = nvme_ns_sysfs_fd(n);
+
+	if (dfd >= 0)
+		return nvme_get_attr_at(dfd, attr);
 	return nvme_get_attr(nvme_ns_get_sysfs_dir(n), attr);
 }
 
 char *nvme_get_path_attr(nvme_path_t p, const char *attr)
 {
+	int dfd = nvme_path_sysfs_fd(p);
+
+	if (dfd >= 0)
+		return nvme_get_attr_at(dfd, attr);
 	return nvme_get_attr(nvme_path_get_sysfs_dir(p), attr);
 }
 
@@ -731,6 +1145,14 @@ static int derive_tls_key(int hmac, const char *identity,
 static DEFINE_CLEANUP_FUNC(cleanup_hmac_ctx, HMAC_CTX *, HMAC_CTX_free)
 #define _cleanup_hmac_ctx_ __cleanup__(cleanup_hmac_ctx)
 
+static pthread_once_t engine_load_once = PTHREAD_ONCE_INIT;
+
+static void nvme_load_engines(void)
+{
+	ENGINE_load_builtin_engines();
+	ENGINE_register_all_complete();
+}
+
 int nvme_gen_dhchap_key(char *hostnqn, enum nvme_hmac_alg hmac,
 			unsigned int key_len, unsigned char *secret,
 			unsigned char *key)
@@ -739,8 +1161,7 @@ int nvme_gen_dhchap_key(char *hostnqn, enum nvme_hmac_alg hmac,
 	_cleanup_hmac_ctx_ HMAC_CTX *hmac_ctx = NULL;
 	const EVP_MD *md;
 
-	ENGINE_load_builtin_engines();
-	ENGINE_register_all_complete();
+	pthread_once(&engine_load_once, nvme_load_engines);
 
 	hmac_ctx = HMAC_CTX_new();
 	if (!hmac_ctx) {
@@ -878,13 +1299,32 @@ static int gen_tls_identity(const char *hostnqn, const char *subsysnqn,
 #endif /* !CONFIG_OPENSSL_1 */
 
 #ifdef CONFIG_OPENSSL_3
-static DEFINE_CLEANUP_FUNC(
-	cleanup_ossl_lib_ctx, OSSL_LIB_CTX *, OSSL_LIB_CTX_free)
-#define _cleanup_ossl_lib_ctx_ __cleanup__(cleanup_ossl_lib_ctx)
 static DEFINE_CLEANUP_FUNC(cleanup_evp_mac_ctx, EVP_MAC_CTX *, EVP_MAC_CTX_free)
 #define _cleanup_evp_mac_ctx_ __cleanup__(cleanup_evp_mac_ctx)
-static DEFINE_CLEANUP_FUNC(cleanup_evp_mac, EVP_MAC *, EVP_MAC_free)
-#define _cleanup_evp_mac_ __cleanup__(cleanup_evp_mac)
+
+/* Library context and fetched HMAC implementation, shared by all
+ * derivations; creating a library context loads the providers, which is
+ * by far the most expensive part of a single key derivation. Both are
+ * only read after the one-time setup and are safe to share; the
+ * per-derivation EVP_MAC_CTX stays local to each caller.
+ */
+static OSSL_LIB_CTX *hmac_lib_ctx;
+static EVP_MAC *hmac_impl;
+static pthread_once_t hmac_impl_once = PTHREAD_ONCE_INIT;
+
+static void hmac_impl_init(void)
+{
+	hmac_lib_ctx = OSSL_LIB_CTX_new();
+	if (!hmac_lib_ctx)
+		return;
+	hmac_impl = EVP_MAC_fetch(hmac_lib_ctx, OSSL_MAC_NAME_HMAC, NULL);
+}
+
+static EVP_MAC *nvme_fetch_hmac(void)
+{
+	pthread_once(&hmac_impl_once, hmac_impl_init);
+	return hmac_impl;
+}
 
 int nvme_gen_dhchap_key(char *hostnqn, enum nvme_hmac_alg hmac,
 			unsigned int key_len, unsigned char *secret,
@@ -892,20 +1332,12 @@ int nvme_gen_dhchap_key(char *hostnqn, enum nvme_hmac_alg hmac,
 {
 	const char hmac_seed[] = "NVMe-over-Fabrics";
 	OSSL_PARAM params[2], *p = params;
-	_cleanup_ossl_lib_ctx_ OSSL_LIB_CTX *lib_ctx = NULL;
 	_cleanup_evp_mac_ctx_ EVP_MAC_CTX *mac_ctx = NULL;
-	_cleanup_evp_mac_ EVP_MAC *mac = NULL;
-	char *progq = NULL;
+	EVP_MAC *mac;
 	char *digest;
 	size_t len;
 
-	lib_ctx = OSSL_LIB_CTX_new();
-	if (!lib_ctx) {
-		errno = ENOMEM;
-		return -1;
-	}
-
-	mac = EVP_MAC_fetch(lib_ctx, OSSL_MAC_NAME_HMAC, progq);
+	mac = nvme_fetch_hmac();
 	if (!mac) {
 		errno = ENOMEM;
 		return -1;
@@ -976,10 +1408,8 @@ static int gen_tls_identity(const char *hostnqn, const char *subsysnqn,
 	static const char hmac_seed[] = "NVMe-over-Fabrics";
 	size_t hmac_len;
 	OSSL_PARAM params[2], *p = params;
-	_cleanup_ossl_lib_ctx_ OSSL_LIB_CTX *lib_ctx = NULL;
 	_cleanup_evp_mac_ctx_ EVP_MAC_CTX *mac_ctx = NULL;
-	_cleanup_evp_mac_ EVP_MAC *mac = NULL;
-	char *progq = NULL;
+	EVP_MAC *mac;
 	char *digest = NULL;
 	_cleanup_free_ unsigned char *psk_ctx = NULL;
 	_cleanup_free_ char *enc_ctx = NULL;
@@ -995,12 +1425,7 @@ static int gen_tls_identity(const char *hostnqn, const char *subsysnqn,
 		return -1;
 	}
 
-	lib_ctx = OSSL_LIB_CTX_new();
-	if (!lib_ctx) {
-		errno = ENOMEM;
-		return -1;
-	}
-	mac = EVP_MAC_fetch(lib_ctx, OSSL_MAC_NAME_HMAC, progq);
+	mac = nvme_fetch_hmac();
 	if (!mac) {
 		errno = ENOMEM;
 		return -1;
@@ -1082,6 +1507,179 @@ static int gen_tls_identity(const char *hostnqn, const char *subsysnqn,
 }
 #endif /* !CONFIG_OPENSSL_3 */
 
+/* identity generation and TLS key derivation from an already-derived
+ * retained key; the retained key only depends on the host, so callers
+ * deriving keys for several subsystems can reuse it */
+static int derive_psk_from_retained(const char *hostnqn, const char *subsysnqn,
+				    char *identity, int version, int hmac,
+				    unsigned char *retained,
+				    unsigned char *psk, int key_len)
+{
+	int ret;
+
+	ret = gen_tls_identity(hostnqn, subsysnqn, version, hmac,
+			       identity, retained, key_len);
+	if (ret < 0)
+		return ret;
+	return derive_tls_key(hmac, identity, retained, psk, key_len);
+}
+
+/* Cache of derived TLS PSKs, keyed by the identity inputs. A fabric-wide
+ * reconnect re-derives the same key for every controller of a subsystem,
+ * and the HKDF chain is expensive; remember recent results instead. The
+ * configured key is part of the comparison, so a rotated key misses and
+ * replaces the stale entry rather than being served from the cache;
+ * nvme_tls_key_cache_flush() additionally discards everything, for
+ * rotations where the old material shouldn't stay in memory.
+ */
+struct nvme_tls_key_cache_entry {
+	struct list_node entry;
+	char *hostnqn;
+	char *subsysnqn;
+	int version;
+	int hmac;
+	int key_len;
+	unsigned char *configured;
+	char *identity;
+	unsigned char *psk;
+};
+
+#define NVME_TLS_KEY_CACHE_MAX	128
+
+static LIST_HEAD(nvme_tls_key_cache);
+static unsigned int nvme_tls_key_cache_count;
+static pthread_mutex_t nvme_tls_key_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void nvme_tls_key_cache_entry_free(struct nvme_tls_key_cache_entry *ce)
+{
+	/* don't leave key material behind */
+	memset(ce->configured, 0, ce->key_len);
+	memset(ce->psk, 0, ce->key_len);
+	free(ce->hostnqn);
+	free(ce->subsysnqn);
+	free(ce->configured);
+	free(ce->identity);
+	free(ce->psk);
+	free(ce);
+}
+
+static bool nvme_tls_key_cache_match(struct nvme_tls_key_cache_entry *ce,
+				     const char *hostnqn,
+				     const char *subsysnqn,
+				     int version, int hmac, int key_len)
+{
+	return ce->version == version && ce->hmac == hmac &&
+		ce->key_len == key_len &&
+		!strcmp(ce->hostnqn, hostnqn) &&
+		!strcmp(ce->subsysnqn, subsysnqn);
+}
+
+/* on a hit, fills @identity and @psk and returns @key_len */
+static int nvme_tls_key_cache_lookup(const char *hostnqn,
+				     const char *subsysnqn,
+				     char *identity, int version, int hmac,
+				     unsigned char *configured,
+				     unsigned char *psk, int key_len)
+{
+	struct nvme_tls_key_cache_entry *ce;
+	int ret = -1;
+
+	pthread_mutex_lock(&nvme_tls_key_cache_lock);
+	list_for_each(&nvme_tls_key_cache, ce, entry) {
+		if (!nvme_tls_key_cache_match(ce, hostnqn, subsysnqn,
+					      version, hmac, key_len) ||
+		    memcmp(ce->configured, configured, key_len))
+			continue;
+
+		strcpy(identity, ce->identity);
+		memcpy(psk, ce->psk, key_len);
+
+		/* keep recently-used entries away from eviction */
+		list_del(&ce->entry);
+		list_add(&nvme_tls_key_cache, &ce->entry);
+		ret = key_len;
+		break;
+	}
+	pthread_mutex_unlock(&nvme_tls_key_cache_lock);
+
+	return ret;
+}
+
+static void nvme_tls_key_cache_store(const char *hostnqn,
+				     const char *subsysnqn,
+				     const char *identity, int version,
+				     int hmac, unsigned char *configured,
+				     unsigned char *psk, int key_len)
+{
+	struct nvme_tls_key_cache_entry *ce, *old, *tmp;
+
+	ce = calloc(1, sizeof(*ce));
+	if (!ce)
+		return;
+
+	ce->hostnqn = strdup(hostnqn);
+	ce->subsysnqn = strdup(subsysnqn);
+	ce->identity = strdup(identity);
+	ce->configured = malloc(key_len);
+	ce->psk = malloc(key_len);
+	ce->version = version;
+	ce->hmac = hmac;
+	ce->key_len = key_len;
+	if (!ce->hostnqn || !ce->subsysnqn || !ce->identity ||
+	    !ce->configured || !ce->psk) {
+		free(ce->hostnqn);
+		free(ce->subsysnqn);
+		free(ce->identity);
+		free(ce->configured);
+		free(ce->psk);
+		free(ce);
+		return;
+	}
+	memcpy(ce->configured, configured, key_len);
+	memcpy(ce->psk, psk, key_len);
+
+	pthread_mutex_lock(&nvme_tls_key_cache_lock);
+
+	/* a rotated configured key replaces the stale entry */
+	list_for_each_safe(&nvme_tls_key_cache, old, tmp, entry) {
+		if (nvme_tls_key_cache_match(old, hostnqn, subsysnqn,
+					     version, hmac, key_len)) {
+			list_del(&old->entry);
+			nvme_tls_key_cache_entry_free(old);
+			nvme_tls_key_cache_count--;
+			break;
+		}
+	}
+
+	if (nvme_tls_key_cache_count >= NVME_TLS_KEY_CACHE_MAX) {
+		old = list_tail(&nvme_tls_key_cache,
+				struct nvme_tls_key_cache_entry, entry);
+		if (old) {
+			list_del(&old->entry);
+			nvme_tls_key_cache_entry_free(old);
+			nvme_tls_key_cache_count--;
+		}
+	}
+
+	list_add(&nvme_tls_key_cache, &ce->entry);
+	nvme_tls_key_cache_count++;
+
+	pthread_mutex_unlock(&nvme_tls_key_cache_lock);
+}
+
+void nvme_tls_key_cache_flush(void)
+{
+	struct nvme_tls_key_cache_entry *ce, *tmp;
+
+	pthread_mutex_lock(&nvme_tls_key_cache_lock);
+	list_for_each_safe(&nvme_tls_key_cache, ce, tmp, entry) {
+		list_del(&ce->entry);
+		nvme_tls_key_cache_entry_free(ce);
+	}
+	nvme_tls_key_cache_count = 0;
+	pthread_mutex_unlock(&nvme_tls_key_cache_lock);
+}
+
 static int derive_nvme_keys(const char *hostnqn, const char *subsysnqn,
 			    char *identity, int version,
 			    int hmac, unsigned char *configured,
@@ -1095,6 +1693,12 @@ static int derive_nvme_keys(const char *hostnqn, const char *subsysnqn,
 		return -1;
 	}
 
+	ret = nvme_tls_key_cache_lookup(hostnqn, subsysnqn, identity,
+					version, hmac, configured,
+					psk, key_len);
+	if (ret == key_len)
+		return ret;
+
 	retained = malloc(key_len);
 	if (!retained) {
 		errno = ENOMEM;
@@ -1103,11 +1707,13 @@ static int derive_nvme_keys(const char *hostnqn, const char *subsysnqn,
 	ret = derive_retained_key(hmac, hostnqn, configured, retained, key_len);
 	if (ret < 0)
 		return ret;
-	ret = gen_tls_identity(hostnqn, subsysnqn, version, hmac,
-			       identity, retained, key_len);
-	if (ret < 0)
-		return ret;
-	return derive_tls_key(hmac, identity, retained, psk, key_len);
+	ret = derive_psk_from_retained(hostnqn, subsysnqn, identity, version,
+				       hmac, retained, psk, key_len);
+	if (ret == key_len)
+		nvme_tls_key_cache_store(hostnqn, subsysnqn, identity,
+					 version, hmac, configured,
+					 psk, key_len);
+	return ret;
 }
 
 static size_t nvme_identity_len(int hmac, int version, const char *hostnqn,
@@ -1363,6 +1969,81 @@ long nvme_insert_tls_key_versioned(const char *keyring, const char *key_type,
 	return key;
 }
 
+int nvme_insert_tls_keys_versioned(const char *keyring, const char *key_type,
+				   const char *hostnqn,
+				   const char * const *subsysnqns, int nsubsys,
+				   int version, int hmac,
+				   unsigned char *configured_key, int key_len,
+				   long *keys)
+{
+	key_serial_t keyring_id;
+	_cleanup_free_ unsigned char *retained = NULL;
+	_cleanup_free_ unsigned char *psk = NULL;
+	int i, ret, inserted = 0;
+
+	if (!hostnqn || !subsysnqns || nsubsys < 0 || !keys) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	keyring_id = nvme_lookup_keyring(keyring);
+	if (keyring_id == 0) {
+		errno = ENOKEY;
+		return -1;
+	}
+
+	ret = nvme_set_keyring(keyring_id);
+	if (ret < 0)
+		return -1;
+
+	retained = malloc(key_len);
+	psk = malloc(key_len);
+	if (!retained || !psk) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* the retained key only depends on the host; derive it once */
+	ret = derive_retained_key(hmac, hostnqn, configured_key,
+				  retained, key_len);
+	if (ret < 0)
+		return -1;
+
+	for (i = 0; i < nsubsys; i++) {
+		_cleanup_free_ char *identity = NULL;
+		ssize_t identity_len;
+
+		keys[i] = 0;
+		identity_len = nvme_identity_len(hmac, version, hostnqn,
+						 subsysnqns[i]);
+		if (identity_len < 0)
+			continue;
+		identity = calloc(1, identity_len);
+		if (!identity)
+			continue;
+		memset(psk, 0, key_len);
+		ret = nvme_tls_key_cache_lookup(hostnqn, subsysnqns[i],
+						identity, version, hmac,
+						configured_key, psk, key_len);
+		if (ret != key_len) {
+			ret = derive_psk_from_retained(hostnqn, subsysnqns[i],
+						       identity, version, hmac,
+						       retained, psk, key_len);
+			if (ret != key_len)
+				continue;
+			nvme_tls_key_cache_store(hostnqn, subsysnqns[i],
+						 identity, version, hmac,
+						 configured_key, psk, key_len);
+		}
+		keys[i] = nvme_update_key(keyring_id, key_type, identity,
+					  psk, key_len);
+		if (keys[i])
+			inserted++;
+	}
+
+	return inserted;
+}
+
 #else
 long nvme_lookup_keyring(const char *keyring)
 {
@@ -1427,6 +2108,19 @@ long nvme_insert_tls_key_versioned(const char *keyring, const char *key_type,
 	errno = ENOTSUP;
 	return -1;
 }
+
+int nvme_insert_tls_keys_versioned(const char *keyring, const char *key_type,
+				   const char *hostnqn,
+				   const char * const *subsysnqns, int nsubsys,
+				   int version, int hmac,
+				   unsigned char *configured_key, int key_len,
+				   long *keys)
+{
+	nvme_msg(NULL, LOG_ERR, "key operations not supported; "
+		 "recompile with keyutils support.\n");
+	errno = ENOTSUP;
+	return -1;
+}
 #endif
 
 long nvme_insert_tls_key(const char *keyring, const char *key_type,
@@ -1443,7 +2137,7 @@ char *nvme_export_tls_key(const unsigned char *key_data, int key_len)
 	unsigned char raw_secret[52];
 	char *encoded_key;
 	unsigned int raw_len, encoded_len, len;
-	unsigned long crc = crc32(0L, NULL, 0);
+	unsigned long crc = nvme_crc32(0L, NULL, 0);
 
 	if (key_len == 32) {
 		raw_len = 32;
@@ -1455,7 +2149,7 @@ char *nvme_export_tls_key(const unsigned char *key_data, int key_len)
 	}
 
 	memcpy(raw_secret, key_data, raw_len);
-	crc = crc32(crc, raw_secret, raw_len);
+	crc = nvme_crc32(crc, raw_secret, raw_len);
 	raw_secret[raw_len++] = crc & 0xff;
 	raw_secret[raw_len++] = (crc >> 8) & 0xff;
 	raw_secret[raw_len++] = (crc >> 16) & 0xff;
@@ -1481,7 +2175,7 @@ unsigned char *nvme_import_tls_key(const char *encoded_key, int *key_len,
 				   unsigned int *hmac)
 {
 	unsigned char decoded_key[128], *key_data;
-	unsigned int crc = crc32(0L, NULL, 0);
+	unsigned int crc = nvme_crc32(0L, NULL, 0);
 	unsigned int key_crc;
 	int err, decoded_len;
 
@@ -1520,7 +2214,7 @@ unsigned char *nvme_import_tls_key(const char *encoded_key, int *key_len,
 		errno = ENOKEY;
 		return NULL;
 	}
-	crc = crc32(crc, decoded_key, decoded_len);
+	crc = nvme_crc32(crc, decoded_key, decoded_len);
 	key_crc = ((uint32_t)decoded_key[decoded_len]) |
 		((uint32_t)decoded_key[decoded_len + 1] << 8) |
 		((uint32_t)decoded_key[decoded_len + 2] << 16) |
@@ -1542,3 +2236,235 @@ unsigned char *nvme_import_tls_key(const char *encoded_key, int *key_len,
 	*key_len = decoded_len;
 	return key_data;
 }
+
+/*
+ * AEN multiplexer
+ *
+ * The kernel reports completed Asynchronous Event Requests through the
+ * controller's sysfs uevent file as NVME_AEN=0x<result> lines.  The
+ * multiplexer keeps one uevent fd per registered controller in a single
+ * epoll instance, decodes the AEN result dwords and dispatches typed
+ * callbacks, so applications get an event path instead of polling log
+ * pages on timers.
+ */
+struct nvme_aen_mux_entry {
+	struct list_node entry;
+	nvme_ctrl_t c;
+	int uevent_fd;
+};
+
+struct nvme_aen_mux {
+	nvme_root_t r;
+	struct nvme_aen_handlers handlers;
+	void *handlers_data;
+	struct list_head ctrls;
+	int epoll_fd;
+};
+
+nvme_aen_mux_t nvme_aen_mux_create(nvme_root_t r,
+				   const struct nvme_aen_handlers *handlers,
+				   void *data)
+{
+	struct nvme_aen_mux *m;
+
+	if (!handlers) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+
+	m->r = r;
+	m->handlers = *handlers;
+	m->handlers_data = data;
+	list_head_init(&m->ctrls);
+
+	m->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (m->epoll_fd < 0) {
+		free(m);
+		return NULL;
+	}
+
+	return m;
+}
+
+int nvme_aen_mux_get_fd(nvme_aen_mux_t m)
+{
+	return m->epoll_fd;
+}
+
+static struct nvme_aen_mux_entry *nvme_aen_mux_find(nvme_aen_mux_t m,
+						    nvme_ctrl_t c)
+{
+	struct nvme_aen_mux_entry *e;
+
+	list_for_each(&m->ctrls, e, entry)
+		if (e->c == c)
+			return e;
+	return NULL;
+}
+
+int nvme_aen_mux_add_ctrl(nvme_aen_mux_t m, nvme_ctrl_t c, __u32 aen_mask)
+{
+	struct nvme_aen_mux_entry *e;
+	struct epoll_event ev = { 0 };
+	_cleanup_free_ char *path = NULL;
+	int ret;
+
+	if (nvme_aen_mux_find(m, c)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return -1;
+
+	ret = asprintf(&path, "%s/uevent", nvme_ctrl_get_sysfs_dir(c));
+	if (ret < 0) {
+		errno = ENOMEM;
+		goto free_entry;
+	}
+
+	e->c = c;
+	e->uevent_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (e->uevent_fd < 0)
+		goto free_entry;
+
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.ptr = e;
+	if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, e->uevent_fd, &ev) < 0)
+		goto close_uevent;
+
+	/*
+	 * Enable the requested event classes on the controller; a failure
+	 * here (old kernel, unsupported feature) is not fatal, the default
+	 * event configuration still reports the mandatory events.
+	 */
+	if (aen_mask &&
+	    nvme_set_features_async_event(nvme_ctrl_get_fd(c), aen_mask,
+					  false, NULL))
+		nvme_msg(m->r, LOG_INFO,
+			 "%s: failed to set AEN config 0x%08x\n",
+			 nvme_ctrl_get_name(c), aen_mask);
+
+	list_add_tail(&m->ctrls, &e->entry);
+	return 0;
+
+close_uevent:
+	close(e->uevent_fd);
+free_entry:
+	free(e);
+	return -1;
+}
+
+int nvme_aen_mux_remove_ctrl(nvme_aen_mux_t m, nvme_ctrl_t c)
+{
+	struct nvme_aen_mux_entry *e;
+
+	e = nvme_aen_mux_find(m, c);
+	if (!e) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, e->uevent_fd, NULL);
+	close(e->uevent_fd);
+	list_del(&e->entry);
+	free(e);
+	return 0;
+}
+
+static void nvme_aen_mux_dispatch(nvme_aen_mux_t m, nvme_ctrl_t c, __u32 aen)
+{
+	const struct nvme_aen_handlers *h = &m->handlers;
+	void (*cb)(nvme_ctrl_t c, void *data) = NULL;
+	__u32 type, info;
+
+	type = aen & 0x07;
+	info = (aen >> 8) & 0xff;
+
+	if (type == NVME_AER_NOTICE) {
+		switch (info) {
+		case NVME_AER_NOTICE_ANA:
+			cb = h->ana_change;
+			break;
+		case NVME_AER_NOTICE_DISC_CHANGED:
+			cb = h->disc_log_change;
+			break;
+		case NVME_AER_NOTICE_FW_ACT_STARTING:
+			cb = h->fw_activation;
+			break;
+		case NVME_AER_NOTICE_TELEMETRY:
+			cb = h->telemetry;
+			break;
+		}
+	}
+
+	if (cb) {
+		cb(c, m->handlers_data);
+		return;
+	}
+	if (h->other)
+		h->other(c, aen, m->handlers_data);
+}
+
+static int nvme_aen_mux_read(nvme_aen_mux_t m, struct nvme_aen_mux_entry *e)
+{
+	char buf[0x1000] = { 0 };
+	char *p, *ptr;
+	int nr = 0, len;
+
+	lseek(e->uevent_fd, 0, SEEK_SET);
+	len = read(e->uevent_fd, buf, sizeof(buf) - 1);
+	if (len < 0)
+		return 0;
+
+	ptr = buf;
+	while ((p = strsep(&ptr, "\n")) != NULL) {
+		__u32 aen;
+
+		if (sscanf(p, "NVME_AEN=0x%08x", &aen) != 1)
+			continue;
+
+		nvme_aen_mux_dispatch(m, e->c, aen);
+		nr++;
+	}
+
+	return nr;
+}
+
+int nvme_aen_mux_run(nvme_aen_mux_t m, int timeout_ms)
+{
+	struct epoll_event evs[8];
+	int i, ret, nr = 0;
+
+	do {
+		ret = epoll_wait(m->epoll_fd, evs, ARRAY_SIZE(evs),
+				 timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -1;
+
+	for (i = 0; i < ret; i++)
+		nr += nvme_aen_mux_read(m, evs[i].data.ptr);
+
+	return nr;
+}
+
+void nvme_aen_mux_free(nvme_aen_mux_t m)
+{
+	struct nvme_aen_mux_entry *e;
+
+	if (!m)
+		return;
+
+	while ((e = list_pop(&m->ctrls, struct nvme_aen_mux_entry, entry))) {
+		close(e->uevent_fd);
+		free(e);
+	}
+	close(m->epoll_fd);
+	free(m);
+}
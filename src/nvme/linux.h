@@ -12,6 +12,7 @@
 #include <stddef.h>
 
 #include "ioctl.h"
+#include "tree.h"
 #include "types.h"
 
 /**
@@ -59,6 +60,21 @@ enum nvme_telemetry_da {
  */
 int nvme_get_telemetry_max(int fd, enum nvme_telemetry_da *da, size_t *max_data_tx);
 
+/**
+ * nvme_get_log_page_max() - Get largest safe log page transfer size
+ * @fd:		File descriptor of nvme device
+ * @xfer_len:	On success set to the maximal chunk size for chunked
+ *		log page reads, derived from the controller's MDTS
+ *
+ * The result is clamped between %NVME_LOG_PAGE_PDU_SIZE and
+ * %NVME_LOG_PAGE_MAX_XFER and is suitable as the xfer_len argument of
+ * nvme_get_log_page().
+ *
+ * Return: The nvme command status if a response was received (see
+ * &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_get_log_page_max(int fd, __u32 *xfer_len);
+
 /**
  * nvme_get_telemetry_log() - Get specified telemetry log
  * @fd:		File descriptor of nvme device
@@ -128,6 +144,184 @@ int nvme_get_host_telemetry(int fd,  struct nvme_telemetry_log **log,
 int nvme_get_new_host_telemetry(int fd,  struct nvme_telemetry_log **log,
 		enum nvme_telemetry_da da, size_t *size);
 
+/**
+ * typedef nvme_telemetry_stream_t - Incremental telemetry collection handle
+ *
+ * Tracks the telemetry data generation number of a controller across
+ * collections so that unchanged payloads can be skipped, and streams the
+ * payload in transfer-sized chunks instead of holding it resident.
+ */
+typedef struct nvme_telemetry_stream *nvme_telemetry_stream_t;
+
+/**
+ * typedef nvme_telemetry_chunk_cb_t - Telemetry payload chunk callback
+ * @da:		Data area the chunk belongs to
+ * @offset:	Byte offset of the chunk within the telemetry log
+ * @data:	Chunk data; only valid for the duration of the callback
+ * @len:	Length of @data in bytes
+ * @cb_data:	Caller context passed to nvme_telemetry_stream_read_da()
+ *
+ * Return: 0 to continue streaming, non-zero to abort; a non-zero value is
+ * passed through as the return value of nvme_telemetry_stream_read_da().
+ */
+typedef int (*nvme_telemetry_chunk_cb_t)(enum nvme_telemetry_da da,
+					 size_t offset, const void *data,
+					 size_t len, void *cb_data);
+
+/**
+ * nvme_telemetry_stream_open() - Create a telemetry collection handle
+ * @fd:		File descriptor of nvme device
+ * @ctrl:	If true, collect the controller-initiated telemetry log,
+ *		otherwise the host-initiated log
+ *
+ * Return: The handle, or NULL with errno set on error. The handle must be
+ * released with nvme_telemetry_stream_close().
+ */
+nvme_telemetry_stream_t nvme_telemetry_stream_open(int fd, bool ctrl);
+
+/**
+ * nvme_telemetry_stream_close() - Release a telemetry collection handle
+ * @stream:	Handle returned by nvme_telemetry_stream_open()
+ */
+void nvme_telemetry_stream_close(nvme_telemetry_stream_t stream);
+
+/**
+ * nvme_telemetry_stream_check() - Fetch the telemetry log header
+ * @stream:	Handle returned by nvme_telemetry_stream_open()
+ * @create:	Generate a new host-initiated capture; ignored for
+ *		controller-initiated logs
+ * @rae:	Retain asynchronous events
+ * @changed:	If non-NULL, set to true when the data generation number
+ *		differs from the last payload streamed through @stream
+ *
+ * Reads only the first telemetry data block. When @changed comes back
+ * false the payload is unchanged since the last complete
+ * nvme_telemetry_stream_read_da() and can be skipped.
+ *
+ * Return: The nvme command status if a response was received (see
+ * &enum nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_telemetry_stream_check(nvme_telemetry_stream_t stream, bool create,
+				bool rae, bool *changed);
+
+/**
+ * nvme_telemetry_stream_header() - Most recently fetched telemetry header
+ * @stream:	Handle returned by nvme_telemetry_stream_open()
+ *
+ * Return: The header read by the last successful
+ * nvme_telemetry_stream_check(), or NULL if none is available. The data
+ * is owned by @stream and stays valid until the next check or close.
+ */
+const struct nvme_telemetry_log *
+nvme_telemetry_stream_header(nvme_telemetry_stream_t stream);
+
+/**
+ * nvme_telemetry_stream_read_da() - Stream one telemetry data area
+ * @stream:	Handle returned by nvme_telemetry_stream_open()
+ * @da:		Data area to fetch, valid values: &enum nvme_telemetry_da
+ * @cb:		Invoked for each fetched chunk
+ * @cb_data:	Caller context passed to @cb
+ *
+ * Fetches the blocks belonging to @da - not the areas preceding it - in
+ * transfer-sized chunks into a buffer owned by @stream, invoking @cb for
+ * each. A successful read records the header's data generation number as
+ * collected, which subsequent nvme_telemetry_stream_check() calls compare
+ * against. Requires a prior successful nvme_telemetry_stream_check().
+ *
+ * Return: 0 on success, the first non-zero return value of @cb if the
+ * callback aborted the transfer, the nvme command status if a response
+ * was received (see &enum nvme_status_field) or -1 with errno set
+ * otherwise.
+ */
+int nvme_telemetry_stream_read_da(nvme_telemetry_stream_t stream,
+				  enum nvme_telemetry_da da,
+				  nvme_telemetry_chunk_cb_t cb, void *cb_data);
+
+/**
+ * typedef nvme_log_deflate_t - Streaming deflate stage for log pipelines
+ *
+ * Compresses log or telemetry chunks as they are fetched and hands the
+ * gzip-framed output to a downstream sink, so payloads leave the host
+ * compressed with memory bounded by the transfer size rather than the
+ * log size. Only available when the library is built with zlib; the
+ * calls fail with errno set to ENOTSUP otherwise.
+ */
+typedef struct nvme_log_deflate *nvme_log_deflate_t;
+
+/**
+ * nvme_log_deflate_create() - Create a streaming deflate stage
+ * @stage:	Receives the created stage
+ * @level:	zlib compression level 1-9, or 0 for the zlib default
+ * @sink:	Receives the compressed output in order; the offset
+ *		argument counts bytes within the compressed stream
+ * @userdata:	Cookie passed through to @sink
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_log_deflate_create(nvme_log_deflate_t *stage, int level,
+			    nvme_log_sink_cb sink, void *userdata);
+
+/**
+ * nvme_log_deflate_push() - Compress one chunk of log data
+ * @stage:	Stage created by nvme_log_deflate_create()
+ * @data:	Uncompressed chunk
+ * @len:	Length of @data in bytes
+ *
+ * Return: 0 on success, the downstream sink's non-zero return value if
+ * it aborted, or -1 with errno set otherwise.
+ */
+int nvme_log_deflate_push(nvme_log_deflate_t stage, const void *data,
+			  size_t len);
+
+/**
+ * nvme_log_deflate_sink() - Deflate stage adapter for log page sinks
+ * @userdata:	Stage created by nvme_log_deflate_create()
+ * @data:	Uncompressed chunk
+ * @len:	Length of @data in bytes
+ * @offset:	Ignored; compression is sequential
+ *
+ * Pass as the &nvme_log_sink_cb of nvme_get_log_page_sink() with the
+ * stage as userdata to fetch and compress in one pipeline.
+ *
+ * Return: As nvme_log_deflate_push().
+ */
+int nvme_log_deflate_sink(void *userdata, const void *data, __u32 len,
+			  __u64 offset);
+
+/**
+ * nvme_log_deflate_chunk_cb() - Deflate stage adapter for telemetry streams
+ * @da:		Ignored; compression is sequential
+ * @offset:	Ignored; compression is sequential
+ * @data:	Uncompressed chunk
+ * @len:	Length of @data in bytes
+ * @cb_data:	Stage created by nvme_log_deflate_create()
+ *
+ * Pass as the &nvme_telemetry_chunk_cb_t of
+ * nvme_telemetry_stream_read_da() with the stage as cb_data.
+ *
+ * Return: As nvme_log_deflate_push().
+ */
+int nvme_log_deflate_chunk_cb(enum nvme_telemetry_da da, size_t offset,
+			      const void *data, size_t len, void *cb_data);
+
+/**
+ * nvme_log_deflate_finish() - Flush and terminate the compressed stream
+ * @stage:	Stage created by nvme_log_deflate_create()
+ *
+ * Drains buffered data to the sink and writes the gzip trailer. The
+ * stage may not be pushed to afterwards.
+ *
+ * Return: 0 on success, the downstream sink's non-zero return value if
+ * it aborted, or -1 with errno set otherwise.
+ */
+int nvme_log_deflate_finish(nvme_log_deflate_t stage);
+
+/**
+ * nvme_log_deflate_free() - Release a streaming deflate stage
+ * @stage:	Stage created by nvme_log_deflate_create()
+ */
+void nvme_log_deflate_free(nvme_log_deflate_t stage);
+
 /**
  * nvme_get_ana_log_len_from_id_ctrl() - Retrieve maximum possible ANA log size
  * @id_ctrl:	Controller identify data
@@ -392,6 +586,35 @@ long nvme_insert_tls_key_versioned(const char *keyring, const char *key_type,
 				   int version, int hmac,
 				   unsigned char *configured_key, int key_len);
 
+/**
+ * nvme_insert_tls_keys_versioned() - Derive and insert TLS keys for a key set
+ * @keyring:    Keyring to use
+ * @key_type:	Type of the resulting keys
+ * @hostnqn:	Host NVMe Qualified Name
+ * @subsysnqns:	Array of Subsystem NVMe Qualified Names
+ * @nsubsys:	Number of entries in @subsysnqns
+ * @version:	Key version to use
+ * @hmac:	HMAC algorithm
+ * @configured_key:	Configured key data to derive the keys from
+ * @key_len:	Length of @configured_key
+ * @keys:	Array of @nsubsys elements receiving the key serial numbers
+ *
+ * Derives and inserts one TLS key per entry of @subsysnqns, equivalent to
+ * calling nvme_insert_tls_key_versioned() for each, but deriving the
+ * intermediate 'retained' key (which only depends on @hostnqn) once for
+ * the whole set. @keys[i] is set to the serial number of the inserted key
+ * for @subsysnqns[i], or 0 if the derivation or insertion failed.
+ *
+ * Return: The number of keys inserted, or -1 with errno set on errors
+ * affecting the whole set.
+ */
+int nvme_insert_tls_keys_versioned(const char *keyring, const char *key_type,
+				   const char *hostnqn,
+				   const char * const *subsysnqns, int nsubsys,
+				   int version, int hmac,
+				   unsigned char *configured_key, int key_len,
+				   long *keys);
+
 /**
  * nvme_generate_tls_key_identity() - Generate the TLS key identity
  * @hostnqn:	Host NVMe Qualified Name
@@ -440,6 +663,17 @@ char *nvme_export_tls_key(const unsigned char *key_data, int key_len);
 unsigned char *nvme_import_tls_key(const char *encoded_key, int *key_len,
 				   unsigned int *hmac);
 
+/**
+ * nvme_tls_key_cache_flush() - Discard all cached derived TLS keys
+ *
+ * Derived TLS PSKs are cached by their identity inputs, so reconnecting
+ * many controllers doesn't repeat the key derivation for each of them.
+ * A changed configured key replaces its cache entry on the next
+ * derivation; call this on key rotation to additionally remove the
+ * superseded key material from memory.
+ */
+void nvme_tls_key_cache_flush(void);
+
 /**
  * nvme_submit_passthru - Low level ioctl wrapper for passthru commands
  * @fd:		File descriptor of the nvme device
@@ -475,4 +709,110 @@ int nvme_submit_passthru64(int fd, unsigned long ioctl_cmd,
 			   struct nvme_passthru_cmd64 *cmd,
 			   __u64 *result);
 
+/**
+ * struct nvme_aen_handlers - callbacks for decoded asynchronous events
+ * @ana_change:		ANA (Asymmetric Namespace Access) change notice
+ * @disc_log_change:	Discovery log page change notice
+ * @fw_activation:	Firmware activation starting notice
+ * @telemetry:		Telemetry log changed notice
+ * @other:		Any event without a dedicated (or registered)
+ *			handler; @aen_result is the raw Asynchronous Event
+ *			Request completion dword 0
+ *
+ * Unused members may be left NULL; events without a handler are silently
+ * discarded unless @other is set.
+ */
+struct nvme_aen_handlers {
+	void (*ana_change)(nvme_ctrl_t c, void *data);
+	void (*disc_log_change)(nvme_ctrl_t c, void *data);
+	void (*fw_activation)(nvme_ctrl_t c, void *data);
+	void (*telemetry)(nvme_ctrl_t c, void *data);
+	void (*other)(nvme_ctrl_t c, __u32 aen_result, void *data);
+};
+
+/**
+ * typedef nvme_aen_mux_t - AEN multiplexer
+ *
+ * Dispatches asynchronous event notifications from any number of
+ * controllers to typed callbacks. The kernel reports completed AERs
+ * through the controller's sysfs uevent file; the multiplexer watches
+ * one uevent fd per registered controller from a single epoll instance,
+ * so an application needs neither a thread nor a log-page polling timer
+ * per controller.
+ */
+typedef struct nvme_aen_mux *nvme_aen_mux_t;
+
+/**
+ * nvme_aen_mux_create() - Create an AEN multiplexer
+ * @r:		&nvme_root_t object, used for logging
+ * @handlers:	callbacks to dispatch decoded events to, copied
+ * @data:	opaque pointer passed to every callback
+ *
+ * Return: multiplexer on success, NULL otherwise with errno set.
+ */
+nvme_aen_mux_t nvme_aen_mux_create(nvme_root_t r,
+				   const struct nvme_aen_handlers *handlers,
+				   void *data);
+
+/**
+ * nvme_aen_mux_get_fd() - File descriptor to poll for events
+ * @m:		multiplexer to query
+ *
+ * The returned epoll fd becomes readable whenever a registered
+ * controller posts an event; call nvme_aen_mux_run() to dispatch.
+ * It is owned by @m and must not be closed by the caller.
+ *
+ * Return: pollable file descriptor.
+ */
+int nvme_aen_mux_get_fd(nvme_aen_mux_t m);
+
+/**
+ * nvme_aen_mux_add_ctrl() - Register a controller with the multiplexer
+ * @m:		multiplexer to register with
+ * @c:		controller to watch; must stay valid until removed or
+ *		the multiplexer is freed
+ * @aen_mask:	&enum nvme_features_async_event_config_flags bits to enable on @c via
+ *		nvme_set_features_async_event(), 0 to keep the current
+ *		event configuration
+ *
+ * A failure to apply @aen_mask is logged but not fatal; the mandatory
+ * events are reported regardless of the configuration.
+ *
+ * Return: 0 on success, -1 otherwise with errno set (EEXIST if @c is
+ * already registered).
+ */
+int nvme_aen_mux_add_ctrl(nvme_aen_mux_t m, nvme_ctrl_t c, __u32 aen_mask);
+
+/**
+ * nvme_aen_mux_remove_ctrl() - Unregister a controller
+ * @m:		multiplexer to unregister from
+ * @c:		controller to stop watching
+ *
+ * Return: 0 on success, -1 with errno set to ENOENT if @c was not
+ * registered.
+ */
+int nvme_aen_mux_remove_ctrl(nvme_aen_mux_t m, nvme_ctrl_t c);
+
+/**
+ * nvme_aen_mux_run() - Wait for and dispatch asynchronous events
+ * @m:		multiplexer to run
+ * @timeout_ms:	maximum time to wait, -1 to block indefinitely
+ *
+ * Waits for any registered controller to post an event and invokes the
+ * matching handler for each decoded event.
+ *
+ * Return: the number of events dispatched (0 on timeout), -1 on error
+ * with errno set.
+ */
+int nvme_aen_mux_run(nvme_aen_mux_t m, int timeout_ms);
+
+/**
+ * nvme_aen_mux_free() - Release an AEN multiplexer
+ * @m:		multiplexer to free, may be NULL
+ *
+ * Unregisters all controllers and releases all resources; the
+ * controllers themselves are not modified.
+ */
+void nvme_aen_mux_free(nvme_aen_mux_t m);
+
 #endif /* _LIBNVME_LINUX_H */
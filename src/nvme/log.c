@@ -9,6 +9,9 @@
  */
 
 #include <sys/types.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -33,6 +36,161 @@ static struct nvme_log def_log = {
 	.timestamp = false,
 };
 
+/*
+ * Async logging backend: producers format into a slot of a bounded
+ * lock-free ring (Vyukov MPMC queue with a single consumer) and a
+ * drainer thread writes the records out, so hot paths never take the
+ * write() or syslog hit inline. When the ring is full records are
+ * dropped and counted instead of blocking the caller.
+ */
+#define NVME_LOG_REC_SIZE	256
+#define NVME_LOG_ASYNC_MIN_DEPTH 16
+
+struct nvme_log_rec {
+	atomic_uint seq;
+	unsigned short len;
+	char msg[NVME_LOG_REC_SIZE];
+};
+
+struct nvme_log_async {
+	struct nvme_log *log;
+	struct nvme_log_rec *ring;
+	unsigned int mask;
+	atomic_uint tail;
+	unsigned int head;
+	atomic_ullong drops;
+	atomic_bool stop;
+	pthread_t drainer;
+};
+
+static void nvme_log_async_enqueue(struct nvme_log_async *a, const char *rec,
+				   size_t len)
+{
+	struct nvme_log_rec *slot;
+	unsigned int pos;
+
+	pos = atomic_load_explicit(&a->tail, memory_order_relaxed);
+	for (;;) {
+		unsigned int seq;
+		int dif;
+
+		slot = &a->ring[pos & a->mask];
+		seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		dif = (int)(seq - pos);
+		if (dif == 0) {
+			if (atomic_compare_exchange_weak_explicit(&a->tail,
+					&pos, pos + 1,
+					memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		} else if (dif < 0) {
+			/* ring full: drop rather than block the caller */
+			atomic_fetch_add_explicit(&a->drops, 1,
+						  memory_order_relaxed);
+			return;
+		} else {
+			pos = atomic_load_explicit(&a->tail,
+						   memory_order_relaxed);
+		}
+	}
+	if (len > NVME_LOG_REC_SIZE)
+		len = NVME_LOG_REC_SIZE;
+	memcpy(slot->msg, rec, len);
+	slot->len = len;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+static bool nvme_log_async_flush(struct nvme_log_async *a)
+{
+	bool flushed = false;
+
+	for (;;) {
+		struct nvme_log_rec *slot = &a->ring[a->head & a->mask];
+		unsigned int seq;
+		ssize_t unused __attribute__((unused));
+
+		seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if ((int)(seq - (a->head + 1)) != 0)
+			break;
+		unused = write(a->log->fd, slot->msg, slot->len);
+		atomic_store_explicit(&slot->seq, a->head + a->mask + 1,
+				      memory_order_release);
+		a->head++;
+		flushed = true;
+	}
+	return flushed;
+}
+
+static void *nvme_log_async_drainer(void *arg)
+{
+	struct nvme_log_async *a = arg;
+	struct timespec ts = { .tv_nsec = 10 * 1000 * 1000 };
+
+	while (!atomic_load_explicit(&a->stop, memory_order_acquire)) {
+		if (!nvme_log_async_flush(a))
+			nanosleep(&ts, NULL);
+	}
+	/* flush whatever was published before the stop */
+	nvme_log_async_flush(a);
+	return NULL;
+}
+
+int nvme_init_async_logging(nvme_root_t r, unsigned int depth)
+{
+	struct nvme_log_async *a;
+	unsigned int n = NVME_LOG_ASYNC_MIN_DEPTH;
+	unsigned int i;
+
+	if (r->log.async)
+		return 0;
+	while (n < depth)
+		n <<= 1;
+	a = calloc(1, sizeof(*a));
+	if (!a) {
+		errno = ENOMEM;
+		return -1;
+	}
+	a->ring = calloc(n, sizeof(*a->ring));
+	if (!a->ring) {
+		free(a);
+		errno = ENOMEM;
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		atomic_init(&a->ring[i].seq, i);
+	a->mask = n - 1;
+	a->log = &r->log;
+	if (pthread_create(&a->drainer, NULL, nvme_log_async_drainer, a)) {
+		free(a->ring);
+		free(a);
+		errno = EAGAIN;
+		return -1;
+	}
+	r->log.async = a;
+	return 0;
+}
+
+void nvme_stop_async_logging(nvme_root_t r)
+{
+	struct nvme_log_async *a = r->log.async;
+
+	if (!a)
+		return;
+	r->log.async = NULL;
+	atomic_store_explicit(&a->stop, true, memory_order_release);
+	pthread_join(a->drainer, NULL);
+	free(a->ring);
+	free(a);
+}
+
+__u64 nvme_async_log_drops(nvme_root_t r)
+{
+	if (!r->log.async)
+		return 0;
+	return atomic_load_explicit(&r->log.async->drops,
+				    memory_order_relaxed);
+}
+
 void __attribute__((format(printf, 4, 5)))
 __nvme_msg(nvme_root_t r, int level,
 	   const char *func, const char *format, ...)
@@ -82,6 +240,29 @@ __nvme_msg(nvme_root_t r, int level,
 	if (func)
 		idx |= 1 << 0;
 
+	if (l->async) {
+		char rec[NVME_LOG_REC_SIZE];
+		int hlen, mlen;
+
+		/* format straight into a stack record; no allocations */
+		hlen = snprintf(rec, sizeof(rec), formats[idx],
+				timebuf, pidbuf, func ? func : "");
+		if (hlen < 0)
+			return;
+		if (hlen > (int)sizeof(rec) - 1)
+			hlen = sizeof(rec) - 1;
+		va_start(ap, format);
+		mlen = vsnprintf(rec + hlen, sizeof(rec) - hlen, format, ap);
+		va_end(ap);
+		if (mlen < 0)
+			return;
+		mlen += hlen;
+		if (mlen > (int)sizeof(rec) - 1)
+			mlen = sizeof(rec) - 1;
+		nvme_log_async_enqueue(l->async, rec, mlen);
+		return;
+	}
+
 	if (asprintf(&header, formats[idx],
 		     timebuf, pidbuf, func ? func : "") == -1)
 		header = NULL;
@@ -61,6 +61,41 @@ void nvme_init_default_logging(FILE *fp, int lvl, bool log_pid, bool log_tstamp)
  */
 int nvme_get_logging_level(nvme_root_t r, bool *log_pid, bool *log_tstamp);
 
+/**
+ * nvme_init_async_logging() - Switch a root to asynchronous logging
+ * @r:		nvme_root_t context
+ * @depth:	Number of log records buffered, rounded up to a power of two
+ *
+ * Routes messages logged through @r over a lock-free ring drained by a
+ * background thread, so callers only pay for formatting and an
+ * enqueue rather than the write() or syslog round trip. Records are
+ * truncated to an internal fixed size, and when the ring is full
+ * records are dropped rather than blocking the caller; the number of
+ * dropped records is reported by nvme_async_log_drops().
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_init_async_logging(nvme_root_t r, unsigned int depth);
+
+/**
+ * nvme_stop_async_logging() - Revert a root to synchronous logging
+ * @r:		nvme_root_t context
+ *
+ * Flushes and tears down the logging ring of @r, if any; called
+ * implicitly by nvme_free_tree(). No other thread may be logging
+ * through @r concurrently.
+ */
+void nvme_stop_async_logging(nvme_root_t r);
+
+/**
+ * nvme_async_log_drops() - Number of log records dropped
+ * @r:		nvme_root_t context
+ *
+ * Return: Number of records dropped because the logging ring of @r
+ * was full, or 0 when asynchronous logging is not enabled.
+ */
+__u64 nvme_async_log_drops(nvme_root_t r);
+
 /**
  * nvme_set_root() - Set nvme_root_t context
  * @r:		nvme_root_t context
@@ -13,6 +13,7 @@
 #include <unistd.h>
 
 #include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -86,6 +87,14 @@ struct nvme_mi_transport_mctp {
 	size_t	resp_buf_size;
 };
 
+/* Preallocated size of the reusable receive buffer: the largest response the
+ * admin transfer paths generate (header including the type byte, 4096 bytes
+ * of data, MIC), so steady-state polling never hits the allocator. Larger
+ * caller-specified responses still grow the buffer on demand.
+ */
+#define NVME_MI_MCTP_RESP_BUF_SIZE \
+	(sizeof(struct nvme_mi_admin_resp_hdr) + 4096 + sizeof(__le32))
+
 static int ioctl_tag(int sd, unsigned long req, struct mctp_ioc_tag_ctl *ctl)
 {
 	return ioctl(sd, req, ctl);
@@ -220,34 +229,21 @@ static bool nvme_mi_mctp_resp_is_mpr(void *buf, size_t len,
 	return true;
 }
 
-static int nvme_mi_mctp_submit(struct nvme_mi_ep *ep,
-			       struct nvme_mi_req *req,
-			       struct nvme_mi_resp *resp)
+/* Send a request message on the given tag; common to the sync and async
+ * submission paths.
+ */
+static int nvme_mi_mctp_send(struct nvme_mi_ep *ep, struct nvme_mi_req *req,
+			     __u8 tag)
 {
-	ssize_t len, resp_len, resp_hdr_len, resp_data_len;
 	struct nvme_mi_transport_mctp *mctp;
-	struct iovec req_iov[3], resp_iov[1];
-	struct msghdr req_msg, resp_msg;
-	int i, rc, errno_save, timeout;
 	struct sockaddr_mctp addr;
-	struct pollfd pollfds[1];
-	unsigned int mpr_time;
+	struct iovec req_iov[3];
+	struct msghdr req_msg;
+	int i, errno_save;
+	ssize_t len;
 	__le32 mic;
-	__u8 tag;
-
-	if (ep->transport != &nvme_mi_transport_mctp) {
-		errno = EINVAL;
-		return -1;
-	}
-
-	/* we need enough space for at least a generic (/error) response */
-	if (resp->hdr_len < sizeof(struct nvme_mi_msg_resp)) {
-		errno = EINVAL;
-		return -1;
-	}
 
 	mctp = ep->transport_data;
-	tag = nvme_mi_mctp_tag_alloc(ep);
 
 	memset(&addr, 0, sizeof(addr));
 	addr.smctp_family = AF_MCTP;
@@ -284,34 +280,97 @@ static int nvme_mi_mctp_submit(struct nvme_mi_ep *ep,
 		nvme_msg(ep->root, LOG_ERR,
 			 "Failure sending MCTP message: %m\n");
 		errno = errno_save;
-		rc = -1;
-		goto out;
+		return -1;
 	}
 
-	resp_len = resp->hdr_len + resp->data_len + sizeof(mic);
-	if (resp_len > mctp->resp_buf_size) {
-		void *tmp = realloc(mctp->resp_buf, resp_len);
-		if (!tmp) {
-			errno_save = errno;
-			nvme_msg(ep->root, LOG_ERR,
-				 "Failure allocating response buffer: %m\n");
-			errno = errno_save;
-			rc = -1;
-			goto out;
-		}
-		mctp->resp_buf = tmp;
-		mctp->resp_buf_size = resp_len;
+	return 0;
+}
+
+/* Read one byte out of the scattered response layout: header (type byte
+ * included), then data, then the MIC tail slot.
+ */
+static __u8 nvme_mi_mctp_scatter_byte(struct nvme_mi_resp *resp,
+				      const __u8 *tail, size_t off)
+{
+	if (off < resp->hdr_len)
+		return ((__u8 *)resp->hdr)[off];
+	off -= resp->hdr_len;
+	if (off < resp->data_len)
+		return ((__u8 *)resp->data)[off];
+	return tail[off - resp->data_len];
+}
+
+/* Build the receive iovecs for scattering a response straight into the
+ * caller's header and data buffers, with @tail holding the trailing MIC.
+ * The MCTP message type byte is excluded on the wire, hence the offset
+ * into the header. Returns the iovec count.
+ */
+static int nvme_mi_mctp_resp_iov(struct nvme_mi_resp *resp, __u8 *tail,
+				 struct iovec *iov)
+{
+	int iovcnt = 0;
+
+	iov[iovcnt].iov_base = ((__u8 *)resp->hdr) + 1;
+	iov[iovcnt].iov_len = resp->hdr_len - 1;
+	iovcnt++;
+	if (resp->data_len) {
+		iov[iovcnt].iov_base = resp->data;
+		iov[iovcnt].iov_len = resp->data_len;
+		iovcnt++;
+	}
+	iov[iovcnt].iov_base = tail;
+	iov[iovcnt].iov_len = sizeof(__le32);
+	iovcnt++;
+
+	return iovcnt;
+}
+
+static int nvme_mi_mctp_submit(struct nvme_mi_ep *ep,
+			       struct nvme_mi_req *req,
+			       struct nvme_mi_resp *resp)
+{
+	ssize_t len, resp_hdr_len, resp_data_len;
+	struct nvme_mi_transport_mctp *mctp;
+	__u8 mprbuf[sizeof(struct nvme_mi_admin_resp_hdr)];
+	__u8 tail[sizeof(__le32)], micb[sizeof(__le32)];
+	struct iovec resp_iov[3];
+	struct msghdr resp_msg;
+	int rc, errno_save, timeout, iovcnt, remain;
+	struct sockaddr_mctp addr;
+	struct pollfd pollfds[1];
+	unsigned int mpr_time;
+	size_t i;
+	__le32 mic;
+	__u8 tag;
+
+	if (ep->transport != &nvme_mi_transport_mctp) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* we need enough space for at least a generic (/error) response */
+	if (resp->hdr_len < sizeof(struct nvme_mi_msg_resp)) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	/* offset by one: the MCTP message type is excluded from the buffer */
-	resp_iov[0].iov_base = mctp->resp_buf + 1;
-	resp_iov[0].iov_len = resp_len - 1;
+	mctp = ep->transport_data;
+	tag = nvme_mi_mctp_tag_alloc(ep);
+
+	rc = nvme_mi_mctp_send(ep, req, tag);
+	if (rc)
+		goto out;
 
+	/* no intermediate assembly buffer; receive straight into the
+	 * caller's buffers */
+	iovcnt = nvme_mi_mctp_resp_iov(resp, tail, resp_iov);
+
+	memset(&addr, 0, sizeof(addr));
 	memset(&resp_msg, 0, sizeof(resp_msg));
 	resp_msg.msg_name = &addr;
 	resp_msg.msg_namelen = sizeof(addr);
 	resp_msg.msg_iov = resp_iov;
-	resp_msg.msg_iovlen = 1;
+	resp_msg.msg_iovlen = iovcnt;
 
 	pollfds[0].fd = mctp->sd;
 	pollfds[0].events = POLLIN;
@@ -353,8 +412,20 @@ retry:
 		goto out;
 	}
 
+	/* A datagram larger than the caller's buffers was truncated by the
+	 * socket, so its trailing MIC is lost; the old linear path would
+	 * have failed the integrity check on the same response.
+	 */
+	if (resp_msg.msg_flags & MSG_TRUNC) {
+		nvme_msg(ep->root, LOG_ERR,
+			 "Invalid MCTP response: larger than expected (%zd byte buffer)\n",
+			 resp->hdr_len + resp->data_len + sizeof(mic) - 1);
+		errno = EPROTO;
+		goto out;
+	}
+
 	/* Re-add the type byte, so we can work on aligned lengths from here */
-	((uint8_t *)mctp->resp_buf)[0] = MCTP_TYPE_NVME | MCTP_TYPE_MIC;
+	((uint8_t *)resp->hdr)[0] = MCTP_TYPE_NVME | MCTP_TYPE_MIC;
 	len += 1;
 
 	/* The smallest response data is 8 bytes: generic 4-byte message header
@@ -368,42 +439,306 @@ retry:
 		goto out;
 	}
 
-	/* Start unpacking the linear resp buffer into the split header + data
-	 * + MIC. We check for a MPR response before fully unpacking, as we'll
-	 * need to preserve the resp layout if we need to retry the receive.
+	/* The MIC is the last four message bytes, wherever the scatter
+	 * placed them; the payload split is only known now.
 	 */
-
-	/* MIC is always at the tail */
-	memcpy(&mic, mctp->resp_buf + len - sizeof(mic), sizeof(mic));
 	len -= 4;
+	for (i = 0; i < sizeof(micb); i++)
+		micb[i] = nvme_mi_mctp_scatter_byte(resp, tail, len + i);
+	memcpy(&mic, micb, sizeof(mic));
 
 	/* Check for a More Processing Required response. This is a slight
 	 * layering violation, as we're pre-checking the MIC and inspecting
 	 * header fields. However, we need to do this in the transport in order
-	 * to keep the tag allocated and retry the recvmsg
+	 * to keep the tag allocated and retry the recvmsg. MPR responses are
+	 * header-sized, so a short linearized copy covers the check.
+	 */
+	if ((size_t)len <= sizeof(mprbuf)) {
+		for (i = 0; i < (size_t)len; i++)
+			mprbuf[i] = nvme_mi_mctp_scatter_byte(resp, tail, i);
+
+		if (nvme_mi_mctp_resp_is_mpr(mprbuf, len, mic, &mpr_time)) {
+			nvme_msg(ep->root, LOG_DEBUG,
+				 "Received More Processing Required, waiting for response\n");
+
+			/* feeds the adaptive inter-command pacing */
+			ep->mpr_seen = true;
+
+			/* if the controller hasn't set MPRT, fall back to our
+			 * command/response timeout, or the largest possible
+			 * MPRT if none set */
+			if (!mpr_time)
+				mpr_time = ep->timeout ?: 0xffff;
+
+			/* clamp to the endpoint max */
+			if (ep->mprt_max && mpr_time > ep->mprt_max)
+				mpr_time = ep->mprt_max;
+
+			/* and to the remaining deadline budget */
+			remain = nvme_mi_ep_deadline_remaining(ep);
+			if (!remain) {
+				errno = ETIMEDOUT;
+				goto out;
+			}
+			if (remain > 0 && mpr_time > (unsigned int)remain)
+				mpr_time = remain;
+
+			timeout = mpr_time;
+			goto retry;
+		}
+	}
+
+	/* we expect resp->hdr_len bytes, but we may have less */
+	resp_hdr_len = resp->hdr_len;
+	if (resp_hdr_len > len)
+		resp_hdr_len = len;
+	resp->hdr_len = resp_hdr_len;
+	len -= resp_hdr_len;
+
+	/* any remaining bytes are the data payload */
+	resp_data_len = resp->data_len;
+	if (resp_data_len > len)
+		resp_data_len = len;
+	resp->data_len = resp_data_len;
+
+	resp->mic = le32_to_cpu(mic);
+
+	rc = 0;
+
+out:
+	nvme_mi_mctp_tag_drop(ep, tag);
+
+	return rc;
+}
+
+static int nvme_mi_mctp_submit_async(struct nvme_mi_ep *ep,
+				     struct nvme_mi_async_op *op)
+{
+	if (ep->transport != &nvme_mi_transport_mctp) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* we need enough space for at least a generic (/error) response */
+	if (op->resp->hdr_len < sizeof(struct nvme_mi_msg_resp)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* each outstanding command gets its own tag, so responses can be
+	 * matched to requests; see nvme_mi_mctp_recv_async() */
+	op->tag = nvme_mi_mctp_tag_alloc(ep);
+
+	return nvme_mi_mctp_send(ep, op->req, op->tag);
+}
+
+static int nvme_mi_mctp_get_fd(struct nvme_mi_ep *ep)
+{
+	struct nvme_mi_transport_mctp *mctp;
+
+	if (ep->transport != &nvme_mi_transport_mctp) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	mctp = ep->transport_data;
+
+	return mctp->sd;
+}
+
+/* Receive a single response for one of the outstanding async operations;
+ * returns 1 when an operation has been completed, 0 when no completion is
+ * pending (including MPR responses, which leave the operation in flight).
+ */
+static int nvme_mi_mctp_recv_async(struct nvme_mi_ep *ep)
+{
+	ssize_t len, resp_len, resp_hdr_len, resp_data_len;
+	struct nvme_mi_async_op *op, *single = NULL, *found = NULL;
+	struct nvme_mi_transport_mctp *mctp;
+	__u8 mprbuf[sizeof(struct nvme_mi_admin_resp_hdr)];
+	__u8 tail[sizeof(__le32)], micb[sizeof(__le32)];
+	struct nvme_mi_resp *resp;
+	struct sockaddr_mctp addr;
+	struct iovec resp_iov[3];
+	struct msghdr resp_msg;
+	unsigned int mpr_time;
+	unsigned int nr_ops = 0;
+	size_t max_len = 0, i;
+	bool is_mpr;
+	int iovcnt;
+	__le32 mic;
+
+	if (ep->transport != &nvme_mi_transport_mctp) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	mctp = ep->transport_data;
+
+	list_for_each(&ep->async_ops, op, entry) {
+		resp_len = op->resp->hdr_len + op->resp->data_len +
+			sizeof(mic);
+		if ((size_t)resp_len > max_len)
+			max_len = resp_len;
+		nr_ops++;
+		single = op;
+	}
+
+	if (!nr_ops)
+		return 0;
+
+	/* With a single operation outstanding the destination is known
+	 * before the datagram is consumed, so scatter it straight into the
+	 * caller's buffers. With several, the owner is only identified from
+	 * the MCTP tag afterwards; receive into the endpoint's reusable
+	 * scratch buffer, sized to hold the largest pending response.
+	 */
+	if (nr_ops == 1) {
+		iovcnt = nvme_mi_mctp_resp_iov(single->resp, tail, resp_iov);
+	} else {
+		single = NULL;
+
+		if (max_len > mctp->resp_buf_size) {
+			void *tmp = realloc(mctp->resp_buf, max_len);
+			if (!tmp)
+				return -1;
+			mctp->resp_buf = tmp;
+			mctp->resp_buf_size = max_len;
+		}
+
+		/* offset by one: the MCTP message type is excluded from the
+		 * buffer */
+		resp_iov[0].iov_base = mctp->resp_buf + 1;
+		resp_iov[0].iov_len = max_len - 1;
+		iovcnt = 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	memset(&resp_msg, 0, sizeof(resp_msg));
+	resp_msg.msg_name = &addr;
+	resp_msg.msg_namelen = sizeof(addr);
+	resp_msg.msg_iov = resp_iov;
+	resp_msg.msg_iovlen = iovcnt;
+
+	len = ops.recvmsg(mctp->sd, &resp_msg, MSG_DONTWAIT);
+	if (len < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		return -1;
+	}
+
+	if (len == 0)
+		return 0;
+
+	/* On the direct path the buffers are exactly response-sized, so a
+	 * truncated datagram is an oversized response; its MIC is lost. The
+	 * scratch path keeps relying on the MIC check for this. */
+	if (single && (resp_msg.msg_flags & MSG_TRUNC)) {
+		nvme_mi_mctp_tag_drop(ep, single->tag);
+		nvme_mi_async_complete(ep, single, -EPROTO);
+		return 1;
+	}
+
+	/* Re-add the type byte, so we can work on aligned lengths from here */
+	if (single)
+		((__u8 *)single->resp->hdr)[0] = MCTP_TYPE_NVME | MCTP_TYPE_MIC;
+	else
+		((uint8_t *)mctp->resp_buf)[0] = MCTP_TYPE_NVME | MCTP_TYPE_MIC;
+	len += 1;
+
+	if (len < 8 + (ssize_t)sizeof(mic)) {
+		nvme_msg(ep->root, LOG_ERR,
+			 "Invalid MCTP response: too short (%zd bytes, needed %zd)\n",
+			 len, 8 + sizeof(mic));
+		errno = EPROTO;
+		return -1;
+	}
+
+	/* MIC is always the last four message bytes */
+	len -= 4;
+	if (single) {
+		for (i = 0; i < sizeof(micb); i++)
+			micb[i] = nvme_mi_mctp_scatter_byte(single->resp,
+							    tail, len + i);
+		memcpy(&mic, micb, sizeof(mic));
+	} else {
+		memcpy(&mic, mctp->resp_buf + len, sizeof(mic));
+	}
+
+	/* Match the response to its request via the MCTP tag. Kernels
+	 * without explicit tag allocation send every request as
+	 * MCTP_TAG_OWNER, so fall back to the oldest outstanding operation.
+	 */
+	if (single) {
+		found = single;
+	} else {
+		list_for_each(&ep->async_ops, op, entry) {
+			if ((op->tag & MCTP_TAG_MASK) ==
+			    (addr.smctp_tag & MCTP_TAG_MASK)) {
+				found = op;
+				break;
+			}
+		}
+		if (!found)
+			found = list_top(&ep->async_ops,
+					 struct nvme_mi_async_op, entry);
+		if (!found)
+			return 0;
+	}
+
+	/* An MPR response leaves the command in flight; the endpoint will
+	 * send the real response when it's ready. Record when to expect it,
+	 * so callers can size their event-loop timeout via
+	 * nvme_mi_ep_get_mpr_wait(). MPR responses are header-sized, so the
+	 * direct path linearizes at most a header's worth for the check.
 	 */
-	if (nvme_mi_mctp_resp_is_mpr(mctp->resp_buf, len, mic, &mpr_time)) {
-		nvme_msg(ep->root, LOG_DEBUG,
-			 "Received More Processing Required, waiting for response\n");
+	if (single) {
+		is_mpr = false;
+		if ((size_t)len <= sizeof(mprbuf)) {
+			for (i = 0; i < (size_t)len; i++)
+				mprbuf[i] = nvme_mi_mctp_scatter_byte(
+						single->resp, tail, i);
+			is_mpr = nvme_mi_mctp_resp_is_mpr(mprbuf, len, mic,
+							  &mpr_time);
+		}
+	} else {
+		is_mpr = nvme_mi_mctp_resp_is_mpr(mctp->resp_buf, len, mic,
+						  &mpr_time);
+	}
 
-		/* if the controller hasn't set MPRT, fall back to our command/
-		 * response timeout, or the largest possible MPRT if none set */
+	if (is_mpr) {
+		ep->mpr_seen = true;
+
+		/* if the controller hasn't set MPRT, fall back to our
+		 * command/response timeout, or the largest possible MPRT if
+		 * none set; clamp to the endpoint max */
 		if (!mpr_time)
 			mpr_time = ep->timeout ?: 0xffff;
-
-		/* clamp to the endpoint max */
 		if (ep->mprt_max && mpr_time > ep->mprt_max)
 			mpr_time = ep->mprt_max;
 
-		timeout = mpr_time;
-		goto retry;
+		if (!clock_gettime(CLOCK_MONOTONIC, &found->mpr_expiry)) {
+			found->mpr_expiry.tv_sec += mpr_time / 1000;
+			found->mpr_expiry.tv_nsec +=
+				(long)(mpr_time % 1000) * 1000000L;
+			if (found->mpr_expiry.tv_nsec >= 1000000000L) {
+				found->mpr_expiry.tv_nsec -= 1000000000L;
+				found->mpr_expiry.tv_sec++;
+			}
+			found->mpr_pending = true;
+		}
+
+		return 0;
 	}
 
+	resp = found->resp;
+
 	/* we expect resp->hdr_len bytes, but we may have less */
 	resp_hdr_len = resp->hdr_len;
 	if (resp_hdr_len > len)
 		resp_hdr_len = len;
-	memcpy(resp->hdr, mctp->resp_buf, resp_hdr_len);
+	if (!single)
+		memcpy(resp->hdr, mctp->resp_buf, resp_hdr_len);
 	resp->hdr_len = resp_hdr_len;
 	len -= resp_hdr_len;
 
@@ -411,17 +746,17 @@ retry:
 	resp_data_len = resp->data_len;
 	if (resp_data_len > len)
 		resp_data_len = len;
-	memcpy(resp->data, mctp->resp_buf + resp_hdr_len, resp_data_len);
+	if (!single)
+		memcpy(resp->data, mctp->resp_buf + resp_hdr_len,
+		       resp_data_len);
 	resp->data_len = resp_data_len;
 
 	resp->mic = le32_to_cpu(mic);
 
-	rc = 0;
+	nvme_mi_mctp_tag_drop(ep, found->tag);
+	nvme_mi_async_complete(ep, found, 0);
 
-out:
-	nvme_mi_mctp_tag_drop(ep, tag);
-
-	return rc;
+	return 1;
 }
 
 static void nvme_mi_mctp_close(struct nvme_mi_ep *ep)
@@ -459,6 +794,9 @@ static const struct nvme_mi_transport nvme_mi_transport_mctp = {
 	.submit = nvme_mi_mctp_submit,
 	.close = nvme_mi_mctp_close,
 	.desc_ep = nvme_mi_mctp_desc_ep,
+	.submit_async = nvme_mi_mctp_submit_async,
+	.get_fd = nvme_mi_mctp_get_fd,
+	.recv_async = nvme_mi_mctp_recv_async,
 };
 
 nvme_mi_ep_t nvme_mi_open_mctp(nvme_root_t root, unsigned int netid, __u8 eid)
@@ -480,7 +818,7 @@ nvme_mi_ep_t nvme_mi_open_mctp(nvme_root_t root, unsigned int netid, __u8 eid)
 	memset(mctp, 0, sizeof(*mctp));
 	mctp->sd = -1;
 
-	mctp->resp_buf_size = 4096;
+	mctp->resp_buf_size = NVME_MI_MCTP_RESP_BUF_SIZE;
 	mctp->resp_buf = malloc(mctp->resp_buf_size);
 	if (!mctp->resp_buf) {
 		errno_save = errno;
@@ -720,29 +1058,28 @@ static int handle_mctp_obj(nvme_root_t root, DBusMessageIter *obj)
 	return 0;
 }
 
-nvme_root_t nvme_mi_scan_mctp(void)
+int nvme_mi_mctp_rescan(nvme_root_t root)
 {
 	DBusMessage *msg, *resp = NULL;
-	DBusConnection *bus = NULL;
+	DBusConnection *bus;
 	DBusMessageIter args, objs;
 	int errno_save, rc = -1;
-	nvme_root_t root;
 	dbus_bool_t drc;
 	DBusError berr;
 
-	root = nvme_mi_create_root(NULL, DEFAULT_LOGLEVEL);
-	if (!root) {
-		errno = ENOMEM;
-		return NULL;
-	}
-
 	dbus_error_init(&berr);
 
-	bus = dbus_bus_get(DBUS_BUS_SYSTEM, &berr);
+	/* reuse the connection from a previous scan on this root, if any */
+	bus = root->mctp_dbus;
 	if (!bus) {
-		nvme_msg(root, LOG_ERR, "Failed connecting to D-Bus: %s (%s)\n",
-			 berr.message, berr.name);
-		goto out;
+		bus = dbus_bus_get(DBUS_BUS_SYSTEM, &berr);
+		if (!bus) {
+			nvme_msg(root, LOG_ERR,
+				 "Failed connecting to D-Bus: %s (%s)\n",
+				 berr.message, berr.name);
+			goto out;
+		}
+		root->mctp_dbus = bus;
 	}
 
 	msg = dbus_message_new_method_call(MCTP_DBUS_IFACE,
@@ -794,26 +1131,60 @@ nvme_root_t nvme_mi_scan_mctp(void)
 			break;
 	}
 
+	if (!rc)
+		nvme_mi_probe_endpoints(root);
+
 out:
 	errno_save = errno;
 	if (resp)
 		dbus_message_unref(resp);
-	if (bus)
-		dbus_connection_unref(bus);
 	dbus_error_free(&berr);
+	errno = errno_save;
 
-	if (rc < 0) {
-		if (root) {
-			nvme_mi_free_root(root);
-		}
+	return rc;
+}
+
+void nvme_mi_mctp_cleanup_dbus(nvme_root_t root)
+{
+	if (root->mctp_dbus) {
+		dbus_connection_unref(root->mctp_dbus);
+		root->mctp_dbus = NULL;
+	}
+}
+
+nvme_root_t nvme_mi_scan_mctp(void)
+{
+	nvme_root_t root;
+
+	root = nvme_mi_create_root(NULL, DEFAULT_LOGLEVEL);
+	if (!root) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (nvme_mi_mctp_rescan(root) < 0) {
+		int errno_save = errno;
+
+		nvme_mi_free_root(root);
 		errno = errno_save;
-		root = NULL;
+		return NULL;
 	}
+
 	return root;
 }
 
 #else /* CONFIG_DBUS */
 
+int nvme_mi_mctp_rescan(nvme_root_t root)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+void nvme_mi_mctp_cleanup_dbus(nvme_root_t root)
+{
+}
+
 nvme_root_t nvme_mi_scan_mctp(void)
 {
 	return NULL;
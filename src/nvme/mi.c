@@ -7,6 +7,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,9 +17,19 @@
 #include <ccan/array_size/array_size.h>
 #include <ccan/endian/endian.h>
 
+#include "crc32.h"
 #include "log.h"
 #include "mi.h"
 #include "private.h"
+#include "trace.h"
+#include "util.h"
+
+/* adaptive timeouts: samples needed before the model is trusted, the
+ * margin applied over the estimated high percentile, and a floor so a
+ * run of fast responses cannot drive the timeout unreasonably low */
+#define NVME_MI_ADAPTIVE_MIN_SAMPLES	16
+#define NVME_MI_ADAPTIVE_MARGIN		2
+#define NVME_MI_ADAPTIVE_FLOOR_MS	50
 
 static const int default_timeout = 1000; /* milliseconds; endpoints may
 					    override */
@@ -64,6 +75,8 @@ nvme_root_t nvme_mi_create_root(FILE *fp, int log_level)
 	r->log.level = log_level;
 
 	r->mi_probe_enabled = nvme_mi_probe_enabled_default();
+	if (getenv("LIBNVME_MI_PROBE_CACHE"))
+		r->mi_probe_cache = strdup(getenv("LIBNVME_MI_PROBE_CACHE"));
 
 	list_head_init(&r->hosts);
 	list_head_init(&r->endpoints);
@@ -78,6 +91,8 @@ void nvme_mi_free_root(nvme_root_t root)
 	nvme_mi_for_each_endpoint_safe(root, ep, tmp)
 		nvme_mi_close(ep);
 
+	nvme_mi_mctp_cleanup_dbus(root);
+	free(root->mi_probe_cache);
 	free(root);
 }
 
@@ -86,6 +101,22 @@ void nvme_mi_set_probe_enabled(nvme_root_t root, bool enabled)
 	root->mi_probe_enabled = enabled;
 }
 
+int nvme_mi_set_probe_cache(nvme_root_t root, const char *path)
+{
+	char *tmp = NULL;
+
+	if (path) {
+		tmp = strdup(path);
+		if (!tmp)
+			return -1;
+	}
+
+	free(root->mi_probe_cache);
+	root->mi_probe_cache = tmp;
+
+	return 0;
+}
+
 static void nvme_mi_record_resp_time(struct nvme_mi_ep *ep)
 {
 	int rc;
@@ -136,6 +167,151 @@ static void __nvme_mi_format_mn(struct nvme_id_ctrl *id,
 
 #define nvme_mi_format_mn(id, m) __nvme_mi_format_mn(id, m, sizeof(m))
 
+#define NVME_MI_PROBE_CACHE_LINE_MAX	512
+
+/* Look up this endpoint in the probe cache, if one is configured. A hit
+ * restores the quirk set and timing profile recorded by a previous probe,
+ * letting us skip the identify round trips entirely.
+ */
+static bool nvme_mi_probe_cache_load(struct nvme_mi_ep *ep)
+{
+	char line[NVME_MI_PROBE_CACHE_LINE_MAX];
+	char desc[101];
+	bool hit = false;
+	FILE *fp;
+
+	if (!ep->root->mi_probe_cache || !ep->transport->desc_ep)
+		return false;
+
+	memset(desc, 0, sizeof(desc));
+	if (ep->transport->desc_ep(ep, desc, sizeof(desc) - 1))
+		return false;
+
+	fp = fopen(ep->root->mi_probe_cache, "r");
+	if (!fp)
+		return false;
+
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long quirks;
+		unsigned int inter_us;
+		char *tab;
+
+		tab = strchr(line, '\t');
+		if (!tab)
+			continue;
+		*tab = '\0';
+		if (strcmp(line, desc))
+			continue;
+
+		if (sscanf(tab + 1, "%lx\t%u", &quirks, &inter_us) != 2)
+			continue;
+
+		ep->quirks = quirks;
+		ep->inter_command_us = inter_us;
+		hit = true;
+		break;
+	}
+
+	fclose(fp);
+
+	if (hit)
+		nvme_msg(ep->root, LOG_DEBUG,
+			 "endpoint %s: quirks 0x%08lx from probe cache\n",
+			 desc, ep->quirks);
+
+	return hit;
+}
+
+/* Record the probe outcome for this endpoint, replacing any previous entry.
+ * Zero-quirk outcomes are stored too, so a clean device also skips the
+ * probe on its next open. The device identity is appended for debugging
+ * only; entries are keyed by the endpoint description, as the identity is
+ * only known after the identify this cache exists to avoid.
+ */
+static void nvme_mi_probe_cache_store(struct nvme_mi_ep *ep,
+				      struct nvme_id_ctrl *id)
+{
+	char line[NVME_MI_PROBE_CACHE_LINE_MAX];
+	char desc[101], mn[sizeof(id->mn) + 1];
+	const char *path = ep->root->mi_probe_cache;
+	char *tmp_path;
+	size_t desc_len;
+	FILE *in, *out;
+
+	if (!path || !ep->transport->desc_ep)
+		return;
+
+	memset(desc, 0, sizeof(desc));
+	if (ep->transport->desc_ep(ep, desc, sizeof(desc) - 1))
+		return;
+
+	if (asprintf(&tmp_path, "%s.new", path) < 0)
+		return;
+
+	out = fopen(tmp_path, "w");
+	if (!out) {
+		free(tmp_path);
+		return;
+	}
+
+	/* preserve entries for other endpoints */
+	desc_len = strlen(desc);
+	in = fopen(path, "r");
+	if (in) {
+		while (fgets(line, sizeof(line), in)) {
+			if (!strncmp(line, desc, desc_len) &&
+			    line[desc_len] == '\t')
+				continue;
+			fputs(line, out);
+		}
+		fclose(in);
+	}
+
+	nvme_mi_format_mn(id, mn);
+	/* persist the known-safe spacing, not a transiently-adapted one */
+	fprintf(out, "%s\t0x%lx\t%u\t%04x:%s\n", desc, ep->quirks,
+		ep->inter_command_max_us ?: ep->inter_command_us,
+		le16_to_cpu(id->vid), mn);
+
+	if (fclose(out) || rename(tmp_path, path))
+		nvme_msg(ep->root, LOG_DEBUG,
+			 "failed writing MI probe cache %s\n", path);
+
+	free(tmp_path);
+}
+
+/* apply model-specific quirks from a (partial) identify result; shared
+ * between the synchronous probe and the concurrent scan-time probe */
+static void nvme_mi_ep_apply_quirks(struct nvme_mi_ep *ep,
+				    struct nvme_id_ctrl *id)
+{
+	/* Samsung MZUL2512: cannot receive commands sent within ~1ms of
+	 * the previous response. Set an inter-command delay of 1.2ms for
+	 * a little extra tolerance.
+	 */
+	if (nvme_mi_compare_vid_mn(ep, id, 0x144d, "MZUL2512HCJQ")) {
+		ep->quirks |= NVME_QUIRK_MIN_INTER_COMMAND_TIME;
+		ep->inter_command_us = 1200;
+	}
+
+	/* If we're quirking for the inter-command time, record the last
+	 * command time now, so we don't conflict with the just-sent identify.
+	 */
+	if (ep->quirks & NVME_QUIRK_MIN_INTER_COMMAND_TIME)
+		nvme_mi_record_resp_time(ep);
+
+	if (ep->quirks) {
+		char tmp[sizeof(id->mn) + 1];
+
+		nvme_mi_format_mn(id, tmp);
+		nvme_msg(ep->root, LOG_DEBUG,
+			 "device %02x:%s: applying quirks 0x%08lx\n",
+			 id->vid, tmp, ep->quirks);
+	}
+
+	nvme_mi_probe_cache_store(ep, id);
+}
+
 void nvme_mi_ep_probe(struct nvme_mi_ep *ep)
 {
 	struct nvme_identify_args id_args = { 0 };
@@ -163,6 +339,9 @@ void nvme_mi_ep_probe(struct nvme_mi_ep *ep)
 	/* start with no quirks, detect as we go */
 	ep->quirks = 0;
 
+	if (nvme_mi_probe_cache_load(ep))
+		return;
+
 	ctrl = nvme_mi_init_ctrl(ep, 0);
 	if (!ctrl)
 		return;
@@ -194,29 +373,7 @@ void nvme_mi_ep_probe(struct nvme_mi_ep *ep)
 		goto out_close;
 	}
 
-	/* Samsung MZUL2512: cannot receive commands sent within ~1ms of
-	 * the previous response. Set an inter-command delay of 1.2ms for
-	 * a little extra tolerance.
-	 */
-	if (nvme_mi_compare_vid_mn(ep, &id, 0x144d, "MZUL2512HCJQ")) {
-		ep->quirks |= NVME_QUIRK_MIN_INTER_COMMAND_TIME;
-		ep->inter_command_us = 1200;
-	}
-
-	/* If we're quirking for the inter-command time, record the last
-	 * command time now, so we don't conflict with the just-sent identify.
-	 */
-	if (ep->quirks & NVME_QUIRK_MIN_INTER_COMMAND_TIME)
-		nvme_mi_record_resp_time(ep);
-
-	if (ep->quirks) {
-		char tmp[sizeof(id.mn) + 1];
-
-		nvme_mi_format_mn(&id, tmp);
-		nvme_msg(ep->root, LOG_DEBUG,
-			 "device %02x:%s: applying quirks 0x%08lx\n",
-			 id.vid, tmp, ep->quirks);
-	}
+	nvme_mi_ep_apply_quirks(ep, &id);
 
 out_close:
 	nvme_mi_close_ctrl(ctrl);
@@ -269,9 +426,62 @@ static void nvme_mi_insert_delay(struct nvme_mi_ep *ep)
 	nanosleep(&delay, NULL);
 }
 
+/* number of consecutive clean commands before we try a shorter spacing */
+#define NVME_MI_PACE_SHRINK_AFTER	16
+
+/* Adapt the inter-command spacing to the device's real tolerance, rather
+ * than paying the full quirk delay forever. After a run of clean commands
+ * we shave a quarter off the current spacing; a More Processing Required
+ * response or a transport failure means we pushed too hard, so we record
+ * the failing spacing as a floor and return to the known-safe maximum.
+ */
+static void nvme_mi_adapt_pacing(struct nvme_mi_ep *ep, int rc)
+{
+	unsigned int next;
+
+	if (!ep->inter_command_max_us) {
+		ep->inter_command_max_us = ep->inter_command_us;
+		ep->inter_command_floor_us = ep->inter_command_us / 8;
+	}
+
+	if (rc || ep->mpr_seen) {
+		if (ep->mpr_seen &&
+		    ep->inter_command_us < ep->inter_command_max_us) {
+			next = ep->inter_command_us + ep->inter_command_us / 2;
+			if (next > ep->inter_command_floor_us)
+				ep->inter_command_floor_us =
+					next < ep->inter_command_max_us ?
+					next : ep->inter_command_max_us;
+		}
+		ep->inter_command_us = ep->inter_command_max_us;
+		ep->pace_successes = 0;
+		ep->mpr_seen = false;
+		return;
+	}
+
+	if (++ep->pace_successes < NVME_MI_PACE_SHRINK_AFTER)
+		return;
+	ep->pace_successes = 0;
+
+	next = ep->inter_command_us - ep->inter_command_us / 4;
+	if (next < ep->inter_command_floor_us)
+		next = ep->inter_command_floor_us;
+
+	if (next != ep->inter_command_us) {
+		nvme_msg(ep->root, LOG_DEBUG,
+			 "inter-command spacing reduced to %uus\n", next);
+		ep->inter_command_us = next;
+	}
+}
+
+/* commands outstanding at the transport per endpoint; further submissions
+ * are queued by priority class, see nvme_mi_ep_pump() */
+#define NVME_MI_MAX_INFLIGHT	4
+
 struct nvme_mi_ep *nvme_mi_init_ep(nvme_root_t root)
 {
 	struct nvme_mi_ep *ep;
+	unsigned int i;
 
 	ep = calloc(1, sizeof(*ep));
 	if (!ep)
@@ -284,6 +494,10 @@ struct nvme_mi_ep *nvme_mi_init_ep(nvme_root_t root)
 	ep->timeout = default_timeout;
 	ep->mprt_max = 0;
 	list_head_init(&ep->controllers);
+	list_head_init(&ep->async_ops);
+	for (i = 0; i < NVME_MI_PRIO_MAX; i++)
+		list_head_init(&ep->queued_ops[i]);
+	ep->max_inflight = NVME_MI_MAX_INFLIGHT;
 
 	list_add(&root->endpoints, &ep->root_entry);
 
@@ -318,6 +532,132 @@ static bool nvme_mi_ep_has_quirk(nvme_mi_ep_t ep, unsigned long quirk)
 	return ep->quirks & quirk;
 }
 
+static struct nvme_mi_opcode_latency *
+nvme_mi_latency_entry(struct nvme_mi_ep *ep, __u8 type, __u8 opcode,
+		      bool alloc)
+{
+	if (!ep->latency) {
+		if (!alloc)
+			return NULL;
+		ep->latency = calloc(1, sizeof(*ep->latency));
+		if (!ep->latency)
+			return NULL;
+	}
+
+	if (type == NVME_MI_MT_ADMIN)
+		return &ep->latency->admin[opcode];
+	if (type == NVME_MI_MT_MI)
+		return &ep->latency->mi[opcode];
+	return NULL;
+}
+
+/* Fold one successful command's response time into the per-opcode
+ * estimator. The smoothed mean and deviation are kept with the classic
+ * retransmission-timer gains (7/8 and 3/4), which track drift in the
+ * endpoint's processing time without a sample history.
+ */
+static void nvme_mi_latency_record(struct nvme_mi_ep *ep, __u8 type,
+				   __u8 opcode, struct timespec *start)
+{
+	struct nvme_mi_opcode_latency *l;
+	struct timespec end;
+	__u64 us;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &end))
+		return;
+
+	l = nvme_mi_latency_entry(ep, type, opcode, true);
+	if (!l)
+		return;
+
+	us = (end.tv_sec - start->tv_sec) * 1000000ULL +
+		(end.tv_nsec - start->tv_nsec) / 1000;
+	if (us > UINT32_MAX)
+		us = UINT32_MAX;
+
+	if (!l->count) {
+		l->min_us = l->max_us = l->srtt_us = us;
+		l->rttvar_us = us / 2;
+	} else {
+		__u32 diff = us > l->srtt_us ? us - l->srtt_us :
+			l->srtt_us - us;
+
+		if (us < l->min_us)
+			l->min_us = us;
+		if (us > l->max_us)
+			l->max_us = us;
+		l->rttvar_us = (3 * l->rttvar_us + diff) / 4;
+		l->srtt_us = (7 * l->srtt_us + (__u32)us) / 8;
+	}
+	if (l->count != UINT32_MAX)
+		l->count++;
+}
+
+/* Derive a response timeout for one opcode from the recorded samples,
+ * or zero when there aren't enough samples to trust the model yet.
+ * srtt + 4 * rttvar approximates a high percentile of the observed
+ * distribution; we never undercut the worst case actually seen, apply
+ * a margin on top, and never exceed the configured static timeout.
+ */
+static unsigned int nvme_mi_latency_timeout(struct nvme_mi_ep *ep, __u8 type,
+					    __u8 opcode)
+{
+	struct nvme_mi_opcode_latency *l;
+	unsigned int ms;
+	__u64 us;
+
+	l = nvme_mi_latency_entry(ep, type, opcode, false);
+	if (!l || l->count < NVME_MI_ADAPTIVE_MIN_SAMPLES)
+		return 0;
+
+	us = l->srtt_us + 4ULL * l->rttvar_us;
+	if (us < l->max_us)
+		us = l->max_us;
+	us *= NVME_MI_ADAPTIVE_MARGIN;
+
+	ms = us / 1000 + 1;
+	if (ms < NVME_MI_ADAPTIVE_FLOOR_MS)
+		ms = NVME_MI_ADAPTIVE_FLOOR_MS;
+	if (ep->timeout && ms > ep->timeout)
+		ms = ep->timeout;
+	return ms;
+}
+
+int nvme_mi_ep_get_cmd_stats(nvme_mi_ep_t ep, bool admin, __u8 opcode,
+			     struct nvme_mi_cmd_stats *stats)
+{
+	__u8 type = admin ? NVME_MI_MT_ADMIN : NVME_MI_MT_MI;
+	struct nvme_mi_opcode_latency *l;
+
+	l = nvme_mi_latency_entry(ep, type, opcode, false);
+	if (!l || !l->count) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	stats->count = l->count;
+	stats->min_us = l->min_us;
+	stats->max_us = l->max_us;
+	stats->avg_us = l->srtt_us;
+	stats->timeout_ms = nvme_mi_latency_timeout(ep, type, opcode);
+	return 0;
+}
+
+void nvme_mi_ep_set_adaptive_timeout(nvme_mi_ep_t ep, bool enabled)
+{
+	ep->adaptive_timeout = enabled;
+}
+
+void nvme_mi_ep_set_deadline(nvme_mi_ep_t ep, __u64 deadline)
+{
+	ep->deadline = deadline;
+}
+
+int nvme_mi_ep_deadline_remaining(struct nvme_mi_ep *ep)
+{
+	return nvme_deadline_remaining(ep->deadline);
+}
+
 struct nvme_mi_ctrl *nvme_mi_init_ctrl(nvme_mi_ep_t ep, __u16 ctrl_id)
 {
 	struct nvme_mi_ctrl *ctrl;
@@ -345,15 +685,8 @@ int nvme_mi_scan_ep(nvme_mi_ep_t ep, bool force_rescan)
 	unsigned int i, n_ctrl;
 	int rc;
 
-	if (ep->controllers_scanned) {
-		if (force_rescan) {
-			struct nvme_mi_ctrl *ctrl, *tmp;
-			nvme_mi_for_each_ctrl_safe(ep, ctrl, tmp)
-				nvme_mi_close_ctrl(ctrl);
-		} else {
-			return 0;
-		}
-	}
+	if (ep->controllers_scanned && !force_rescan)
+		return 0;
 
 	rc = nvme_mi_mi_read_mi_data_ctrl_list(ep, 0, &list);
 	if (rc)
@@ -365,6 +698,28 @@ int nvme_mi_scan_ep(nvme_mi_ep_t ep, bool force_rescan)
 		return -1;
 	}
 
+	if (ep->controllers_scanned) {
+		struct nvme_mi_ctrl *ctrl, *tmp;
+
+		/*
+		 * A forced rescan that turns up the same controller list
+		 * keeps the existing controller objects (and whatever
+		 * state the caller holds against them) rather than
+		 * re-paying the teardown and re-population.
+		 */
+		if (n_ctrl == ep->nr_scanned_ctrl_ids) {
+			for (i = 0; i < n_ctrl; i++)
+				if (le16_to_cpu(list.identifier[i]) !=
+				    ep->scanned_ctrl_ids[i])
+					break;
+			if (i == n_ctrl)
+				return 0;
+		}
+
+		nvme_mi_for_each_ctrl_safe(ep, ctrl, tmp)
+			nvme_mi_close_ctrl(ctrl);
+	}
+
 	for (i = 0; i < n_ctrl; i++) {
 		struct nvme_mi_ctrl *ctrl;
 		__u16 id;
@@ -374,7 +729,10 @@ int nvme_mi_scan_ep(nvme_mi_ep_t ep, bool force_rescan)
 		ctrl = nvme_mi_init_ctrl(ep, id);
 		if (!ctrl)
 			break;
+
+		ep->scanned_ctrl_ids[i] = id;
 	}
+	ep->nr_scanned_ctrl_ids = i;
 
 	ep->controllers_scanned = true;
 	return 0;
@@ -382,14 +740,7 @@ int nvme_mi_scan_ep(nvme_mi_ep_t ep, bool force_rescan)
 
 __u32 nvme_mi_crc32_update(__u32 crc, void *data, size_t len)
 {
-	int i;
-
-	while (len--) {
-		crc ^= *(unsigned char *)(data++);
-		for (i = 0; i < 8; i++)
-			crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
-	}
-	return crc;
+	return nvme_crc32c(crc, data, len);
 }
 
 static void nvme_mi_calc_req_mic(struct nvme_mi_req *req)
@@ -413,10 +764,15 @@ static int nvme_mi_verify_resp_mic(struct nvme_mi_resp *resp)
 	return resp->mic != ~crc;
 }
 
-int nvme_mi_submit(nvme_mi_ep_t ep, struct nvme_mi_req *req,
-		   struct nvme_mi_resp *resp)
+static int __nvme_mi_submit(nvme_mi_ep_t ep, struct nvme_mi_req *req,
+			    struct nvme_mi_resp *resp)
 {
-	int rc;
+	unsigned int timeout_save = 0;
+	bool timeout_override = false;
+	struct timespec start;
+	__u8 opcode, type;
+	int remain, rc;
+	bool timed;
 
 	if (req->hdr_len < sizeof(struct nvme_mi_msg_hdr)) {
 		errno = EINVAL;
@@ -443,6 +799,21 @@ int nvme_mi_submit(nvme_mi_ep_t ep, struct nvme_mi_req *req,
 		return -1;
 	}
 
+	/*
+	 * Both the MI and the Admin request headers carry the opcode
+	 * directly after the generic message header.
+	 */
+	opcode = req->hdr_len > sizeof(struct nvme_mi_msg_hdr) ?
+		((__u8 *)req->hdr)[sizeof(struct nvme_mi_msg_hdr)] : 0;
+	type = (req->hdr->nmp >> 3) & 0xf;
+	nvme_trace3(mi_submit_start, type, opcode, req->data_len);
+
+	remain = nvme_mi_ep_deadline_remaining(ep);
+	if (!remain) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
 	nvme_mi_ep_probe(ep);
 
 	if (ep->transport->mic_enabled)
@@ -451,10 +822,40 @@ int nvme_mi_submit(nvme_mi_ep_t ep, struct nvme_mi_req *req,
 	if (nvme_mi_ep_has_quirk(ep, NVME_QUIRK_MIN_INTER_COMMAND_TIME))
 		nvme_mi_insert_delay(ep);
 
+	/* the derived timeout never exceeds the configured one, so it
+	 * needs no re-validation against the transport */
+	if (ep->adaptive_timeout) {
+		unsigned int t = nvme_mi_latency_timeout(ep, type, opcode);
+
+		if (t) {
+			timeout_save = ep->timeout;
+			ep->timeout = t;
+			timeout_override = true;
+		}
+	}
+
+	/* never wait for a response beyond the deadline */
+	if (remain > 0 &&
+	    (!ep->timeout || ep->timeout > (unsigned int)remain)) {
+		if (!timeout_override) {
+			timeout_save = ep->timeout;
+			timeout_override = true;
+		}
+		ep->timeout = remain;
+	}
+
+	timed = !clock_gettime(CLOCK_MONOTONIC, &start);
 	rc = ep->transport->submit(ep, req, resp);
+	if (timeout_override)
+		ep->timeout = timeout_save;
+	if (!rc && timed)
+		nvme_mi_latency_record(ep, type, opcode, &start);
+	nvme_trace4(mi_submit_done, type, opcode, req->data_len, rc);
 
-	if (nvme_mi_ep_has_quirk(ep, NVME_QUIRK_MIN_INTER_COMMAND_TIME))
+	if (nvme_mi_ep_has_quirk(ep, NVME_QUIRK_MIN_INTER_COMMAND_TIME)) {
 		nvme_mi_record_resp_time(ep);
+		nvme_mi_adapt_pacing(ep, rc);
+	}
 
 	if (rc) {
 		nvme_msg(ep->root, LOG_INFO, "transport failure\n");
@@ -504,6 +905,247 @@ int nvme_mi_submit(nvme_mi_ep_t ep, struct nvme_mi_req *req,
 	return 0;
 }
 
+int nvme_mi_submit(nvme_mi_ep_t ep, struct nvme_mi_req *req,
+		   struct nvme_mi_resp *resp)
+{
+	int rc;
+
+	nvme_count(&ep->root->counters.mi_submissions);
+	rc = __nvme_mi_submit(ep, req, resp);
+	if (rc)
+		nvme_count(&ep->root->counters.mi_errors);
+	return rc;
+}
+
+/* hand one op to the transport, and move it to the in-flight list */
+static int nvme_mi_ep_dispatch(struct nvme_mi_ep *ep,
+			       struct nvme_mi_async_op *op)
+{
+	int rc;
+
+	rc = ep->transport->submit_async(ep, op);
+	if (rc)
+		return rc;
+
+	op->queued = false;
+	ep->nr_inflight++;
+	list_add_tail(&ep->async_ops, &op->entry);
+
+	return 0;
+}
+
+/* Fill free submission slots from the priority queues. Normal-priority ops
+ * go first, but a bulk op is admitted after every few normal dispatches so
+ * that a stream of one-shot queries can't starve a chunked transfer.
+ */
+static void nvme_mi_ep_pump(struct nvme_mi_ep *ep)
+{
+	while (ep->nr_inflight < ep->max_inflight) {
+		struct nvme_mi_async_op *op;
+		enum nvme_mi_prio prio = NVME_MI_PRIO_NORMAL;
+
+		if (list_empty(&ep->queued_ops[NVME_MI_PRIO_NORMAL]) ||
+		    ep->bulk_wait_count >= NVME_MI_MAX_INFLIGHT - 1)
+			prio = NVME_MI_PRIO_BULK;
+		if (list_empty(&ep->queued_ops[prio]))
+			prio = prio == NVME_MI_PRIO_BULK ?
+				NVME_MI_PRIO_NORMAL : NVME_MI_PRIO_BULK;
+
+		op = list_pop(&ep->queued_ops[prio], struct nvme_mi_async_op,
+			      entry);
+		if (!op)
+			break;
+
+		if (prio == NVME_MI_PRIO_BULK)
+			ep->bulk_wait_count = 0;
+		else if (!list_empty(&ep->queued_ops[NVME_MI_PRIO_BULK]))
+			ep->bulk_wait_count++;
+
+		if (nvme_mi_ep_dispatch(ep, op)) {
+			/* fail the op as still-queued: no transport slot was
+			 * consumed, and completion won't re-enter the pump */
+			list_add(&ep->queued_ops[prio], &op->entry);
+			nvme_mi_async_complete(ep, op, -errno);
+		}
+	}
+}
+
+int nvme_mi_submit_async_prio(nvme_mi_ep_t ep, struct nvme_mi_req *req,
+			      struct nvme_mi_resp *resp,
+			      enum nvme_mi_prio prio,
+			      nvme_mi_submit_cb_t cb, void *cb_data)
+{
+	struct nvme_mi_async_op *op;
+	int rc;
+
+	if (req->hdr_len < sizeof(struct nvme_mi_msg_hdr) ||
+	    (req->hdr_len & 0x3) || (req->data_len & 0x3)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (resp->hdr_len < sizeof(struct nvme_mi_msg_hdr) ||
+	    (resp->hdr_len & 0x3)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!ep->transport->submit_async) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	nvme_mi_ep_probe(ep);
+
+	if (ep->transport->mic_enabled)
+		nvme_mi_calc_req_mic(req);
+
+	op = calloc(1, sizeof(*op));
+	if (!op) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	op->req = req;
+	op->resp = resp;
+	op->prio = prio;
+	op->cb = cb;
+	op->cb_data = cb_data;
+
+	/* queue behind earlier submissions of the same class when the
+	 * endpoint is at its in-flight limit */
+	if (ep->nr_inflight >= ep->max_inflight ||
+	    !list_empty(&ep->queued_ops[prio])) {
+		op->queued = true;
+		list_add_tail(&ep->queued_ops[prio], &op->entry);
+		return 0;
+	}
+
+	rc = nvme_mi_ep_dispatch(ep, op);
+	if (rc) {
+		free(op);
+		return rc;
+	}
+
+	return 0;
+}
+
+int nvme_mi_submit_async(nvme_mi_ep_t ep, struct nvme_mi_req *req,
+			 struct nvme_mi_resp *resp,
+			 nvme_mi_submit_cb_t cb, void *cb_data)
+{
+	return nvme_mi_submit_async_prio(ep, req, resp, NVME_MI_PRIO_NORMAL,
+					 cb, cb_data);
+}
+
+/* completion path for asynchronous submissions; performs the same MIC and
+ * response-header checks as the tail of nvme_mi_submit(), then invokes the
+ * submitter's callback */
+void nvme_mi_async_complete(struct nvme_mi_ep *ep, struct nvme_mi_async_op *op,
+			    int status)
+{
+	struct nvme_mi_resp *resp = op->resp;
+	bool was_inflight = !op->queued;
+	int rc = status;
+
+	list_del(&op->entry);
+
+	if (!rc && ep->transport->mic_enabled &&
+	    nvme_mi_verify_resp_mic(resp)) {
+		nvme_msg(ep->root, LOG_WARNING, "crc mismatch\n");
+		rc = -EBADMSG;
+	}
+
+	if (!rc) {
+		if (resp->hdr_len < sizeof(struct nvme_mi_msg_hdr)) {
+			nvme_msg(ep->root, LOG_DEBUG,
+				 "Bad response header len: %zd\n",
+				 resp->hdr_len);
+			rc = -EPROTO;
+		} else if (resp->hdr->type != NVME_MI_MSGTYPE_NVME) {
+			nvme_msg(ep->root, LOG_DEBUG,
+				 "Invalid message type 0x%02x\n",
+				 resp->hdr->type);
+			rc = -EPROTO;
+		} else if (!(resp->hdr->nmp & (NVME_MI_ROR_RSP << 7))) {
+			nvme_msg(ep->root, LOG_DEBUG,
+				 "ROR value in response indicates a request\n");
+			rc = -EIO;
+		}
+	}
+
+	if (op->cb)
+		op->cb(ep, op->req, resp, rc, op->cb_data);
+
+	free(op);
+
+	/* a transport slot was freed; dispatch queued work. Completing an op
+	 * that never left the queues frees no slot, and keeps cancellation
+	 * paths from dispatching work they're about to cancel */
+	if (was_inflight) {
+		ep->nr_inflight--;
+		nvme_mi_ep_pump(ep);
+	}
+}
+
+int nvme_mi_ep_get_fd(nvme_mi_ep_t ep)
+{
+	if (!ep->transport->get_fd) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	return ep->transport->get_fd(ep);
+}
+
+int nvme_mi_ep_process(nvme_mi_ep_t ep)
+{
+	int rc, n = 0;
+
+	if (!ep->transport->recv_async) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	while ((rc = ep->transport->recv_async(ep)) > 0)
+		n++;
+
+	if (rc < 0 && !n)
+		return -1;
+
+	return n;
+}
+
+int nvme_mi_ep_get_mpr_wait(nvme_mi_ep_t ep)
+{
+	struct nvme_mi_async_op *op;
+	struct timespec now, delta;
+	long long ms, max_ms = -1;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		return -1;
+
+	list_for_each(&ep->async_ops, op, entry) {
+		if (!op->mpr_pending)
+			continue;
+
+		if (timespec_cmp(&op->mpr_expiry, &now, <=)) {
+			ms = 0;
+		} else {
+			timespec_sub(&op->mpr_expiry, &now, &delta);
+			ms = delta.tv_sec * 1000 + delta.tv_nsec / 1000000;
+		}
+
+		if (ms > max_ms)
+			max_ms = ms;
+	}
+
+	if (max_ms > INT_MAX)
+		max_ms = INT_MAX;
+
+	return max_ms < 0 ? -1 : (int)max_ms;
+}
+
 static void nvme_mi_admin_init_req(struct nvme_mi_req *req,
 				   struct nvme_mi_admin_req_hdr *hdr,
 				   __u16 ctrl_id, __u8 opcode)
@@ -580,6 +1222,181 @@ static int nvme_mi_admin_parse_status(struct nvme_mi_resp *resp, __u32 *result)
 	return nvme_status;
 }
 
+/* in-flight state for one endpoint's scan-time quirk probe */
+struct nvme_mi_probe_op {
+	struct nvme_mi_ep *ep;
+	struct nvme_mi_ctrl *ctrl;
+	struct nvme_mi_admin_req_hdr req_hdr;
+	struct nvme_mi_admin_resp_hdr resp_hdr;
+	struct nvme_mi_req req;
+	struct nvme_mi_resp resp;
+	struct nvme_id_ctrl id;
+	int status;
+	bool done;
+};
+
+static void nvme_mi_probe_op_done(nvme_mi_ep_t ep, struct nvme_mi_req *req,
+				  struct nvme_mi_resp *resp, int status,
+				  void *cb_data)
+{
+	struct nvme_mi_probe_op *op = cb_data;
+
+	if (!status) {
+		status = nvme_mi_admin_parse_status(resp, NULL);
+		if (status < 0)
+			status = -errno;
+	}
+
+	op->status = status;
+	op->done = true;
+}
+
+static void nvme_mi_probe_cancel(struct nvme_mi_ep *ep)
+{
+	struct nvme_mi_async_op *op, *tmp;
+	unsigned int prio;
+
+	for (prio = 0; prio < NVME_MI_PRIO_MAX; prio++)
+		list_for_each_safe(&ep->queued_ops[prio], op, tmp, entry)
+			if (op->cb == nvme_mi_probe_op_done)
+				nvme_mi_async_complete(ep, op, -ETIMEDOUT);
+
+	list_for_each_safe(&ep->async_ops, op, tmp, entry)
+		if (op->cb == nvme_mi_probe_op_done)
+			nvme_mi_async_complete(ep, op, -ETIMEDOUT);
+}
+
+/* Run the quirk probes for any unprobed endpoints concurrently, one
+ * identify in flight per endpoint, so a scan of a populated chassis costs
+ * roughly one probe's latency rather than the sum of them. Endpoints whose
+ * transport lacks async support are left for the lazy synchronous probe on
+ * first use.
+ */
+void nvme_mi_probe_endpoints(nvme_root_t root)
+{
+	const size_t id_size = offsetof(struct nvme_id_ctrl, rab);
+	struct nvme_mi_probe_op **probe_ops;
+	unsigned int i, nr = 0, timeout = 0;
+	struct pollfd *pollfds;
+	struct nvme_mi_ep *ep;
+
+	if (!root->mi_probe_enabled)
+		return;
+
+	nvme_mi_for_each_endpoint(root, ep)
+		if (!ep->quirks_probed && ep->transport->submit_async)
+			nr++;
+
+	if (!nr)
+		return;
+
+	probe_ops = calloc(nr, sizeof(*probe_ops));
+	pollfds = calloc(nr, sizeof(*pollfds));
+	if (!probe_ops || !pollfds) {
+		free(probe_ops);
+		free(pollfds);
+		return;
+	}
+
+	nr = 0;
+	nvme_mi_for_each_endpoint(root, ep) {
+		struct nvme_mi_probe_op *op;
+
+		if (ep->quirks_probed || !ep->transport->submit_async)
+			continue;
+
+		ep->quirks_probed = true;
+		ep->quirks = 0;
+
+		if (nvme_mi_probe_cache_load(ep))
+			continue;
+
+		op = calloc(1, sizeof(*op));
+		if (!op)
+			continue;
+
+		op->ep = ep;
+		op->ctrl = nvme_mi_init_ctrl(ep, 0);
+		if (!op->ctrl) {
+			free(op);
+			continue;
+		}
+
+		/* the same partial identify the synchronous probe issues */
+		nvme_mi_admin_init_req(&op->req, &op->req_hdr, op->ctrl->id,
+				       nvme_admin_identify);
+		op->req_hdr.cdw10 = cpu_to_le32(NVME_IDENTIFY_CNS_CTRL);
+		op->req_hdr.cdw11 = cpu_to_le32((NVME_CSI_NVM & 0xff) << 24);
+		op->req_hdr.dlen = cpu_to_le32(id_size & 0xffffffff);
+		op->req_hdr.flags = 0x1;
+
+		nvme_mi_admin_init_resp(&op->resp, &op->resp_hdr);
+		op->resp.data = &op->id;
+		op->resp.data_len = id_size;
+
+		if (nvme_mi_submit_async(ep, &op->req, &op->resp,
+					 nvme_mi_probe_op_done, op)) {
+			nvme_mi_close_ctrl(op->ctrl);
+			free(op);
+			continue;
+		}
+
+		if (ep->timeout > timeout)
+			timeout = ep->timeout;
+
+		probe_ops[nr++] = op;
+	}
+
+	while (nr) {
+		unsigned int nfds = 0;
+		int rc;
+
+		for (i = 0; i < nr; i++) {
+			if (probe_ops[i]->done)
+				continue;
+			pollfds[nfds].fd =
+				nvme_mi_ep_get_fd(probe_ops[i]->ep);
+			pollfds[nfds].events = POLLIN;
+			nfds++;
+		}
+		if (!nfds)
+			break;
+
+		rc = poll(pollfds, nfds, timeout ?: -1);
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			/* timeout or hard failure: cancel what's pending */
+			for (i = 0; i < nr; i++)
+				if (!probe_ops[i]->done)
+					nvme_mi_probe_cancel(probe_ops[i]->ep);
+			break;
+		}
+
+		/* receives are non-blocking, so just drain every endpoint
+		 * with a probe still pending */
+		for (i = 0; i < nr; i++)
+			if (!probe_ops[i]->done)
+				nvme_mi_ep_process(probe_ops[i]->ep);
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct nvme_mi_probe_op *op = probe_ops[i];
+
+		if (!op->status)
+			nvme_mi_ep_apply_quirks(op->ep, &op->id);
+		else
+			nvme_msg(root, LOG_WARNING,
+				 "Identify Controller failed, no quirks applied\n");
+
+		nvme_mi_close_ctrl(op->ctrl);
+		free(op);
+	}
+
+	free(probe_ops);
+	free(pollfds);
+}
+
 int nvme_mi_admin_xfer(nvme_mi_ctrl_t ctrl,
 		       struct nvme_mi_admin_req_hdr *admin_req,
 		       size_t req_data_size,
@@ -659,6 +1476,110 @@ int nvme_mi_admin_xfer(nvme_mi_ctrl_t ctrl,
 	return 0;
 }
 
+/* state for an in-flight nvme_mi_admin_xfer_async(); the req/resp message
+ * descriptors must live until the submission completes, so they're kept here
+ * rather than on the submitter's stack */
+struct nvme_mi_admin_async_xfer {
+	struct nvme_mi_req req;
+	struct nvme_mi_resp resp;
+	nvme_mi_ctrl_t ctrl;
+	size_t *resp_data_size;
+	nvme_mi_admin_cb_t cb;
+	void *cb_data;
+};
+
+static void nvme_mi_admin_xfer_done(nvme_mi_ep_t ep, struct nvme_mi_req *req,
+				    struct nvme_mi_resp *resp, int status,
+				    void *cb_data)
+{
+	struct nvme_mi_admin_async_xfer *xfer = cb_data;
+
+	if (!status)
+		*xfer->resp_data_size = resp->data_len;
+
+	if (xfer->cb)
+		xfer->cb(xfer->ctrl, status, xfer->cb_data);
+
+	free(xfer);
+}
+
+int nvme_mi_admin_xfer_async(nvme_mi_ctrl_t ctrl,
+			     struct nvme_mi_admin_req_hdr *admin_req,
+			     size_t req_data_size,
+			     struct nvme_mi_admin_resp_hdr *admin_resp,
+			     off_t resp_data_offset,
+			     size_t *resp_data_size,
+			     nvme_mi_admin_cb_t cb, void *cb_data)
+{
+	struct nvme_mi_admin_async_xfer *xfer;
+	int rc;
+
+	/* same length/offset requirements as nvme_mi_admin_xfer() */
+	if (*resp_data_size > 4096) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (resp_data_offset > 0xffffffff) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((req_data_size & 0x3) ||
+	    (*resp_data_size & 0x3) ||
+	    (resp_data_offset & 0x3)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (req_data_size && *resp_data_size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!*resp_data_size && resp_data_offset) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xfer = calloc(1, sizeof(*xfer));
+	if (!xfer) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	xfer->ctrl = ctrl;
+	xfer->resp_data_size = resp_data_size;
+	xfer->cb = cb;
+	xfer->cb_data = cb_data;
+
+	admin_req->hdr.type = NVME_MI_MSGTYPE_NVME;
+	admin_req->hdr.nmp = (NVME_MI_ROR_REQ << 7) |
+				(NVME_MI_MT_ADMIN << 3);
+	admin_req->ctrl_id = cpu_to_le16(ctrl->id);
+	xfer->req.hdr = &admin_req->hdr;
+	xfer->req.hdr_len = sizeof(*admin_req);
+	xfer->req.data = admin_req + 1;
+	xfer->req.data_len = req_data_size;
+
+	xfer->resp.hdr = &admin_resp->hdr;
+	xfer->resp.hdr_len = sizeof(*admin_resp);
+	xfer->resp.data = admin_resp + 1;
+	xfer->resp.data_len = *resp_data_size;
+
+	/* limit the response size, specify offset */
+	admin_req->flags = 0x3;
+	admin_req->dlen = cpu_to_le32(xfer->resp.data_len & 0xffffffff);
+	admin_req->doff = cpu_to_le32(resp_data_offset & 0xffffffff);
+
+	rc = nvme_mi_submit_async(ctrl->ep, &xfer->req, &xfer->resp,
+				  nvme_mi_admin_xfer_done, xfer);
+	if (rc)
+		free(xfer);
+
+	return rc;
+}
+
 int nvme_mi_admin_admin_passthru(nvme_mi_ctrl_t ctrl, __u8 opcode, __u8 flags,
 				 __u16 rsvd, __u32 nsid, __u32 cdw2, __u32 cdw3,
 				 __u32 cdw10, __u32 cdw11, __u32 cdw12,
@@ -821,17 +1742,41 @@ int nvme_mi_admin_identify_partial(nvme_mi_ctrl_t ctrl,
  * this option seems to be supported better by devices.  For more information
  * about this option, please check https://github.com/linux-nvme/libnvme/pull/539
  * */
+static void nvme_mi_admin_get_log_req(nvme_mi_ctrl_t ctrl,
+				      const struct nvme_get_log_args *args,
+				      off_t offset, size_t len, bool final,
+				      struct nvme_mi_req *req,
+				      struct nvme_mi_admin_req_hdr *req_hdr)
+{
+	__u64 log_page_offset = args->lpo + offset;
+	__u32 ndw = (len >> 2) - 1;
+
+	nvme_mi_admin_init_req(req, req_hdr, ctrl->id, nvme_admin_get_log_page);
+	req_hdr->cdw1 = cpu_to_le32(args->nsid);
+	req_hdr->cdw10 = cpu_to_le32((ndw & 0xffff) << 16 |
+				     ((!final || args->rae) ? 1 : 0) << 15 |
+				     args->lsp << 8 |
+				     (args->lid & 0xff));
+	req_hdr->cdw11 = cpu_to_le32(args->lsi << 16 |
+				     ndw >> 16);
+	req_hdr->cdw12 = cpu_to_le32(log_page_offset & 0xffffffff);
+	req_hdr->cdw13 = cpu_to_le32(log_page_offset >> 32);
+	req_hdr->cdw14 = cpu_to_le32(args->csi << 24 |
+				     (args->ot ? 1 : 0) << 23 |
+				     args->uuidx);
+	req_hdr->flags = 0x1;
+	req_hdr->dlen = cpu_to_le32(len & 0xffffffff);
+}
+
 static int __nvme_mi_admin_get_log(nvme_mi_ctrl_t ctrl,
 				   const struct nvme_get_log_args *args,
 				   off_t offset, size_t *lenp, bool final)
 {
-	__u64 log_page_offset = args->lpo + offset;
 	struct nvme_mi_admin_resp_hdr resp_hdr;
 	struct nvme_mi_admin_req_hdr req_hdr;
 	struct nvme_mi_resp resp;
 	struct nvme_mi_req req;
 	size_t len;
-	__u32 ndw;
 	int rc;
 
 	/* MI spec requires that the data length field is less than or equal
@@ -847,23 +1792,8 @@ static int __nvme_mi_admin_get_log(nvme_mi_ctrl_t ctrl,
 		return -1;
 	}
 
-	ndw = (len >> 2) - 1;
-
-	nvme_mi_admin_init_req(&req, &req_hdr, ctrl->id, nvme_admin_get_log_page);
-	req_hdr.cdw1 = cpu_to_le32(args->nsid);
-	req_hdr.cdw10 = cpu_to_le32((ndw & 0xffff) << 16 |
-				    ((!final || args->rae) ? 1 : 0) << 15 |
-				    args->lsp << 8 |
-				    (args->lid & 0xff));
-	req_hdr.cdw11 = cpu_to_le32(args->lsi << 16 |
-				    ndw >> 16);
-	req_hdr.cdw12 = cpu_to_le32(log_page_offset & 0xffffffff);
-	req_hdr.cdw13 = cpu_to_le32(log_page_offset >> 32);
-	req_hdr.cdw14 = cpu_to_le32(args->csi << 24 |
-				    (args->ot ? 1 : 0) << 23 |
-				    args->uuidx);
-	req_hdr.flags = 0x1;
-	req_hdr.dlen = cpu_to_le32(len & 0xffffffff);
+	nvme_mi_admin_get_log_req(ctrl, args, offset, len, final,
+				  &req, &req_hdr);
 
 	nvme_mi_calc_req_mic(&req);
 
@@ -882,6 +1812,191 @@ static int __nvme_mi_admin_get_log(nvme_mi_ctrl_t ctrl,
 	return rc;
 }
 
+/* number of chunk requests kept in flight by the pipelined log-page path */
+#define NVME_MI_GET_LOG_MAX_OUTSTANDING	4
+
+struct nvme_mi_get_log_chunk {
+	struct nvme_mi_admin_req_hdr req_hdr;
+	struct nvme_mi_admin_resp_hdr resp_hdr;
+	struct nvme_mi_req req;
+	struct nvme_mi_resp resp;
+	size_t req_len;
+	size_t xfered;
+	__u32 *result;
+	int status;
+	int err;
+	bool done;
+};
+
+static void nvme_mi_get_log_chunk_done(nvme_mi_ep_t ep,
+				       struct nvme_mi_req *req,
+				       struct nvme_mi_resp *resp, int status,
+				       void *cb_data)
+{
+	struct nvme_mi_get_log_chunk *chunk = cb_data;
+
+	if (status) {
+		chunk->status = -1;
+		chunk->err = -status;
+	} else {
+		chunk->status = nvme_mi_admin_parse_status(resp,
+							   chunk->result);
+		if (chunk->status < 0)
+			chunk->err = errno;
+		else if (!chunk->status)
+			chunk->xfered = resp->data_len;
+	}
+
+	chunk->done = true;
+}
+
+/* cancel any of our chunk requests still outstanding; required before the
+ * chunk array goes out of scope */
+static void nvme_mi_get_log_cancel(nvme_mi_ep_t ep)
+{
+	struct nvme_mi_async_op *op, *tmp;
+	unsigned int prio;
+
+	/* drop queued chunks first, so completing the in-flight ones below
+	 * doesn't dispatch them to the wire */
+	for (prio = 0; prio < NVME_MI_PRIO_MAX; prio++)
+		list_for_each_safe(&ep->queued_ops[prio], op, tmp, entry)
+			if (op->cb == nvme_mi_get_log_chunk_done)
+				nvme_mi_async_complete(ep, op, -ECANCELED);
+
+	list_for_each_safe(&ep->async_ops, op, tmp, entry)
+		if (op->cb == nvme_mi_get_log_chunk_done)
+			nvme_mi_async_complete(ep, op, -ECANCELED);
+}
+
+/* Pipelined log page retrieval: keep a window of chunk requests in flight
+ * rather than waiting for each response before sending the next. Chunks
+ * land directly at their final offset in args->log, so completion order
+ * doesn't matter; short reads and errors are resolved in submission order
+ * once a window completes.
+ */
+static int nvme_mi_admin_get_log_pipelined(nvme_mi_ctrl_t ctrl,
+					   __u32 xfer_size,
+					   struct nvme_get_log_args *args)
+{
+	struct nvme_mi_get_log_chunk chunks[NVME_MI_GET_LOG_MAX_OUTSTANDING];
+	off_t xfer_offset = 0, done_len = 0;
+	bool stop = false;
+	unsigned int i, nr;
+	int rc = 0;
+
+	while (!rc && !stop && xfer_offset < args->len) {
+		/* issue a window of chunk requests */
+		for (nr = 0; nr < ARRAY_SIZE(chunks) &&
+			     xfer_offset < args->len; nr++) {
+			struct nvme_mi_get_log_chunk *chunk = &chunks[nr];
+			size_t len = xfer_size;
+			bool final;
+
+			if (xfer_offset + len > args->len)
+				len = args->len - xfer_offset;
+			final = xfer_offset + len >= args->len;
+
+			memset(chunk, 0, sizeof(*chunk));
+			chunk->req_len = len;
+			chunk->result = final ? args->result : NULL;
+
+			nvme_mi_admin_get_log_req(ctrl, args, xfer_offset,
+						  len, final, &chunk->req,
+						  &chunk->req_hdr);
+			nvme_mi_admin_init_resp(&chunk->resp,
+						&chunk->resp_hdr);
+			chunk->resp.data = args->log + xfer_offset;
+			chunk->resp.data_len = len;
+
+			if (nvme_mi_submit_async_prio(ctrl->ep, &chunk->req,
+						      &chunk->resp,
+						      NVME_MI_PRIO_BULK,
+						      nvme_mi_get_log_chunk_done,
+						      chunk)) {
+				rc = -1;
+				break;
+			}
+
+			xfer_offset += len;
+		}
+
+		if (!nr)
+			break;
+
+		/* wait for the window to complete */
+		while (!rc) {
+			struct pollfd pollfd;
+			bool pending = false;
+			int prc;
+
+			for (i = 0; i < nr; i++) {
+				if (!chunks[i].done) {
+					pending = true;
+					break;
+				}
+			}
+			if (!pending)
+				break;
+
+			pollfd.fd = nvme_mi_ep_get_fd(ctrl->ep);
+			pollfd.events = POLLIN;
+
+			prc = poll(&pollfd, 1, ctrl->ep->timeout ?: -1);
+			if (prc < 0) {
+				if (errno == EINTR)
+					continue;
+				rc = -1;
+				break;
+			}
+			if (prc == 0) {
+				errno = ETIMEDOUT;
+				rc = -1;
+				break;
+			}
+
+			if (nvme_mi_ep_process(ctrl->ep) < 0) {
+				rc = -1;
+				break;
+			}
+		}
+
+		if (rc) {
+			nvme_mi_get_log_cancel(ctrl->ep);
+			break;
+		}
+
+		/* resolve results in submission order */
+		for (i = 0; i < nr; i++) {
+			struct nvme_mi_get_log_chunk *chunk = &chunks[i];
+
+			if (chunk->status) {
+				rc = chunk->status;
+				if (rc < 0)
+					errno = chunk->err;
+				break;
+			}
+
+			done_len += chunk->xfered;
+
+			/* if we returned less data than expected, consider
+			 * that the end of the log page; any chunks beyond it
+			 * are discarded */
+			if (chunk->xfered != chunk->req_len) {
+				stop = true;
+				break;
+			}
+		}
+	}
+
+	if (rc)
+		return rc;
+
+	args->len = done_len;
+
+	return 0;
+}
+
 int nvme_mi_admin_get_log_page(nvme_mi_ctrl_t ctrl, __u32 xfer_size,
 			       struct nvme_get_log_args *args)
 {
@@ -899,6 +2014,17 @@ int nvme_mi_admin_get_log_page(nvme_mi_ctrl_t ctrl, __u32 xfer_size,
 		return -1;
 	}
 
+	/* Overlap chunk requests where the transport supports multiple
+	 * outstanding commands. Quirked endpoints that need inter-command
+	 * delays keep the sequential path.
+	 */
+	nvme_mi_ep_probe(ctrl->ep);
+	if (args->len > max_xfer_size && !args->ot &&
+	    xfer_size >= 4 && xfer_size <= 4096 &&
+	    ctrl->ep->transport->submit_async &&
+	    !nvme_mi_ep_has_quirk(ctrl->ep, NVME_QUIRK_MIN_INTER_COMMAND_TIME))
+		return nvme_mi_admin_get_log_pipelined(ctrl, xfer_size, args);
+
 	for (xfer_offset = 0; xfer_offset < args->len;) {
 		size_t xfered_size, cur_xfer_size = max_xfer_size;
 		bool final;
@@ -1726,17 +2852,28 @@ int nvme_mi_mi_config_set(nvme_mi_ep_t ep, __u32 dw0, __u32 dw1)
 
 void nvme_mi_close(nvme_mi_ep_t ep)
 {
+	struct nvme_mi_async_op *op, *op_tmp;
 	struct nvme_mi_ctrl *ctrl, *tmp;
+	unsigned int prio;
 
 	/* don't look for controllers during destruction */
 	ep->controllers_scanned = true;
 
+	/* cancel any outstanding async submissions; queued ones first, so
+	 * completing the in-flight set doesn't dispatch them */
+	for (prio = 0; prio < NVME_MI_PRIO_MAX; prio++)
+		list_for_each_safe(&ep->queued_ops[prio], op, op_tmp, entry)
+			nvme_mi_async_complete(ep, op, -ESHUTDOWN);
+	list_for_each_safe(&ep->async_ops, op, op_tmp, entry)
+		nvme_mi_async_complete(ep, op, -ESHUTDOWN);
+
 	nvme_mi_for_each_ctrl_safe(ep, ctrl, tmp)
 		nvme_mi_close_ctrl(ctrl);
 
 	if (ep->transport && ep->transport->close)
 		ep->transport->close(ep);
 	list_del(&ep->root_entry);
+	free(ep->latency);
 	free(ep);
 }
 
@@ -414,6 +414,25 @@ void nvme_mi_free_root(nvme_root_t root);
  */
 void nvme_mi_set_probe_enabled(nvme_root_t root, bool enabled);
 
+/**
+ * nvme_mi_set_probe_cache() - set a persistent cache for endpoint probes
+ * @root: &nvme_root_t object
+ * @path: cache file path, or NULL to disable
+ *
+ * Configures a small cache file recording the outcome of endpoint quirk
+ * probes. When an endpoint is found in the cache, its quirk set and timing
+ * profile are restored without re-issuing the probe's identify commands,
+ * which saves a couple of round trips per endpoint in short-lived
+ * processes. Entries are keyed by endpoint identity (for MCTP, the network
+ * and endpoint ID), and refreshed whenever a full probe runs.
+ *
+ * The cache may also be enabled by setting the LIBNVME_MI_PROBE_CACHE
+ * environment variable to the cache file path.
+ *
+ * Return: 0 on success, -1 on memory allocation failure.
+ */
+int nvme_mi_set_probe_cache(nvme_root_t root, const char *path);
+
 /* Top level management object: NVMe-MI Management Endpoint */
 struct nvme_mi_ep;
 
@@ -509,6 +528,71 @@ void nvme_mi_ep_set_mprt_max(nvme_mi_ep_t ep, unsigned int mprt_max_ms);
  */
 unsigned int nvme_mi_ep_get_timeout(nvme_mi_ep_t ep);
 
+/**
+ * struct nvme_mi_cmd_stats - response-time statistics for one opcode
+ * @count: number of successful commands sampled
+ * @min_us: fastest observed response, in microseconds
+ * @max_us: slowest observed response, in microseconds
+ * @avg_us: smoothed mean response time, in microseconds
+ * @timeout_ms: timeout the adaptive model would apply to this opcode,
+ *	in milliseconds, or zero while too few samples have been seen
+ */
+struct nvme_mi_cmd_stats {
+	__u32 count;
+	__u32 min_us;
+	__u32 max_us;
+	__u32 avg_us;
+	__u32 timeout_ms;
+};
+
+/**
+ * nvme_mi_ep_get_cmd_stats - retrieve response-time statistics for an opcode
+ * @ep: MI endpoint object
+ * @admin: true for an NVMe Admin opcode, false for an NVMe-MI opcode
+ * @opcode: opcode to query
+ * @stats: receives the statistics
+ *
+ * The library records the response time of every successful command per
+ * opcode; this returns the accumulated statistics for one of them.
+ *
+ * Return: 0 on success, -1 with errno set to ENOENT when no command
+ * with @opcode has completed on @ep yet.
+ */
+int nvme_mi_ep_get_cmd_stats(nvme_mi_ep_t ep, bool admin, __u8 opcode,
+			     struct nvme_mi_cmd_stats *stats);
+
+/**
+ * nvme_mi_ep_set_adaptive_timeout - derive response timeouts per opcode
+ * @ep: MI endpoint object
+ * @enabled: whether to enable adaptive timeouts
+ *
+ * When enabled, commands whose opcode has accumulated enough samples use
+ * a timeout derived from the observed response times (a high-percentile
+ * estimate with a safety margin) instead of the static endpoint timeout.
+ * Fast commands then fail fast even when the static timeout has been
+ * raised to accommodate slow ones (format, sanitize status). The derived
+ * timeout never exceeds the value set with nvme_mi_ep_set_timeout(),
+ * which remains the fallback for unsampled opcodes.
+ */
+void nvme_mi_ep_set_adaptive_timeout(nvme_mi_ep_t ep, bool enabled);
+
+/**
+ * nvme_mi_ep_set_deadline - bound all work on an endpoint by a deadline
+ * @ep: MI endpoint object
+ * @deadline: Absolute CLOCK_MONOTONIC time in milliseconds (see
+ *	nvme_deadline_after()), or zero to remove the deadline
+ *
+ * Sets an overall time budget for commands issued on @ep: response
+ * waits and More Processing Required waits are clamped to the time
+ * remaining, and once the deadline passes commands fail with errno set
+ * to ETIMEDOUT instead of starting. This bounds the worst-case duration
+ * of multi-command operations (chunked log page reads, retry loops)
+ * regardless of how many commands or retries they would issue.
+ *
+ * The deadline remains in effect until replaced or removed.
+ */
+void nvme_mi_ep_set_deadline(nvme_mi_ep_t ep, __u64 deadline);
+
 struct nvme_mi_ctrl;
 
 /**
@@ -612,6 +696,24 @@ void nvme_mi_close(nvme_mi_ep_t ep);
  */
 nvme_root_t nvme_mi_scan_mctp(void);
 
+/**
+ * nvme_mi_mctp_rescan - update a root with current MCTP endpoints.
+ * @root: &nvme_root_t object to scan into
+ *
+ * Description: Re-queries mctpd for MCTP endpoints supporting NVMe-MI,
+ * adding any endpoints not already present on @root; existing endpoints
+ * are retained. The D-Bus connection is cached on the root, so repeat
+ * scans (for example from a monitoring daemon) don't reconnect each time,
+ * and newly discovered endpoints are quirk-probed concurrently rather
+ * than one at a time.
+ *
+ * This requires libnvme-mi to be compiled with D-Bus support; if not, this
+ * will return -1 with errno set to ENOTSUP.
+ *
+ * Return: 0 on success, or -1 with errno set on failure.
+ */
+int nvme_mi_mctp_rescan(nvme_root_t root);
+
 /**
  * nvme_mi_scan_ep - query an endpoint for its NVMe controllers.
  * @ep: Endpoint to scan
@@ -980,6 +1082,99 @@ int nvme_mi_admin_xfer(nvme_mi_ctrl_t ctrl,
 		       off_t resp_data_offset,
 		       size_t *resp_data_size);
 
+/**
+ * typedef nvme_mi_admin_cb_t - Admin command completion callback.
+ * @ctrl: controller the command was sent to
+ * @status: 0 on success, or a negative errno value on failure
+ * @cb_data: callback data provided on submission
+ *
+ * Invoked from nvme_mi_ep_process() when an asynchronous admin command
+ * completes. A negative @status indicates a transport or protocol failure;
+ * on success, the submitter's response header holds the command status, as
+ * with nvme_mi_admin_xfer().
+ */
+typedef void (*nvme_mi_admin_cb_t)(nvme_mi_ctrl_t ctrl, int status,
+				   void *cb_data);
+
+/**
+ * nvme_mi_admin_xfer_async() - Raw asynchronous admin transfer interface.
+ * @ctrl: controller to send the admin command to
+ * @admin_req: request data
+ * @req_data_size: size of request data payload
+ * @admin_resp: buffer for response data
+ * @resp_data_offset: offset into request data to retrieve from controller
+ * @resp_data_size: size of response data buffer, updated to received size
+ * @cb: callback invoked on command completion
+ * @cb_data: callback data
+ *
+ * Asynchronous version of nvme_mi_admin_xfer(): submits the request and
+ * returns without waiting for the response. The caller polls the endpoint's
+ * file descriptor (from nvme_mi_ep_get_fd()) for readability, then calls
+ * nvme_mi_ep_process() to receive responses and invoke completion
+ * callbacks. Multiple commands may be outstanding on an endpoint at once,
+ * each sent on its own MCTP tag where the kernel supports tag allocation.
+ *
+ * The @admin_req and @admin_resp buffers, and the @resp_data_size pointer,
+ * must remain valid until @cb is invoked; @resp_data_size is updated with
+ * the received payload size before the callback runs.
+ *
+ * Return: 0 if the command was submitted, or -1 with errno set otherwise;
+ * in particular ENOTSUP if the endpoint's transport has no asynchronous
+ * support.
+ */
+int nvme_mi_admin_xfer_async(nvme_mi_ctrl_t ctrl,
+			     struct nvme_mi_admin_req_hdr *admin_req,
+			     size_t req_data_size,
+			     struct nvme_mi_admin_resp_hdr *admin_resp,
+			     off_t resp_data_offset,
+			     size_t *resp_data_size,
+			     nvme_mi_admin_cb_t cb, void *cb_data);
+
+/**
+ * nvme_mi_ep_get_fd() - File descriptor for polled endpoint I/O.
+ * @ep: endpoint object
+ *
+ * Returns a file descriptor that becomes readable when a response to an
+ * asynchronous command is available, suitable for poll() or epoll. Callers
+ * must not read from or write to the descriptor directly; use
+ * nvme_mi_ep_process() to handle incoming data.
+ *
+ * Return: the file descriptor, or -1 with errno set on failure.
+ */
+int nvme_mi_ep_get_fd(nvme_mi_ep_t ep);
+
+/**
+ * nvme_mi_ep_process() - Process pending asynchronous completions.
+ * @ep: endpoint object
+ *
+ * Receives any responses queued on the endpoint's transport without
+ * blocking, and invokes the corresponding completion callbacks. Intended to
+ * be called when the descriptor from nvme_mi_ep_get_fd() indicates
+ * readability.
+ *
+ * Return: the number of commands completed, or -1 with errno set on
+ * failure.
+ */
+int nvme_mi_ep_process(nvme_mi_ep_t ep);
+
+/**
+ * nvme_mi_ep_get_mpr_wait() - Expected wait for outstanding MPR responses.
+ * @ep: endpoint object
+ *
+ * When a device answers an asynchronous command with a More Processing
+ * Required response, the final response arrives later, within the
+ * device-requested processing time. This reports the number of
+ * milliseconds until the slowest such in-flight command should have
+ * completed, which is a suitable event-loop timeout: rather than blocking
+ * in the transport for the MPR wait, poll the endpoint's descriptor with
+ * this timeout and call nvme_mi_ep_process() when it fires or becomes
+ * readable.
+ *
+ * Return: milliseconds until the last expected MPR completion (0 if
+ * already due), or -1 if no MPR-deferred command is outstanding.
+ */
+int nvme_mi_ep_get_mpr_wait(nvme_mi_ep_t ep);
+
 /**
  * nvme_mi_admin_admin_passthru() - Submit an nvme admin passthrough command
  * @ctrl: Controller to send command to
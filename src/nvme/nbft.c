@@ -8,8 +8,12 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <arpa/inet.h>
 #include <ccan/endian/endian.h>
@@ -183,10 +187,9 @@ static int read_ssns_exended_info(struct nbft_info *nbft,
 
 static int read_ssns(struct nbft_info *nbft,
 		     struct nbft_ssns *raw_ssns,
-		     struct nbft_info_subsystem_ns **s)
+		     struct nbft_info_subsystem_ns *ssns)
 {
 	struct nbft_header *header = (struct nbft_header *)nbft->raw_nbft;
-	struct nbft_info_subsystem_ns *ssns;
 	__u8 *ss_hfi_indexes = NULL;
 	__u8 *tmp = NULL;
 	int i, ret;
@@ -201,10 +204,6 @@ static int read_ssns(struct nbft_info *nbft,
 	verify(raw_ssns->trtype == NBFT_TRTYPE_TCP,
 	       "invalid transport type in SSNS descriptor");
 
-	ssns = calloc(1, sizeof(*ssns));
-	if (!ssns)
-		return -ENOMEM;
-
 	ssns->index = le16_to_cpu(raw_ssns->index);
 	strncpy(ssns->transport, trtype_to_string(raw_ssns->trtype), sizeof(ssns->transport));
 
@@ -326,11 +325,11 @@ static int read_ssns(struct nbft_info *nbft,
 			read_ssns_exended_info(nbft, ssns, ssns_extended_info);
 	}
 
-	*s = ssns;
 	return 0;
 
 fail:
-	free(ssns);
+	free(ssns->hfis);
+	memset(ssns, 0, sizeof(*ssns));
 	return ret;
 }
 
@@ -384,10 +383,9 @@ static int read_hfi_info_tcp(struct nbft_info *nbft,
 
 static int read_hfi(struct nbft_info *nbft,
 		    struct nbft_hfi *raw_hfi,
-		    struct nbft_info_hfi **h)
+		    struct nbft_info_hfi *hfi)
 {
 	int ret;
-	struct nbft_info_hfi *hfi;
 	struct nbft_header *header = (struct nbft_header *)nbft->raw_nbft;
 
 	if (!(raw_hfi->flags & NBFT_HFI_VALID))
@@ -396,10 +394,6 @@ static int read_hfi(struct nbft_info *nbft,
 	verify(raw_hfi->structure_id == NBFT_DESC_HFI,
 	       "invalid ID in HFI descriptor");
 
-	hfi = calloc(1, sizeof(struct nbft_info_hfi));
-	if (!hfi)
-		return -ENOMEM;
-
 	hfi->index = raw_hfi->index;
 
 	/*
@@ -427,19 +421,17 @@ static int read_hfi(struct nbft_info *nbft,
 		goto fail;
 	}
 
-	*h = hfi;
 	return 0;
 
 fail:
-	free(hfi);
+	memset(hfi, 0, sizeof(*hfi));
 	return ret;
 }
 
 static int read_discovery(struct nbft_info *nbft,
 			  struct nbft_discovery *raw_discovery,
-			  struct nbft_info_discovery **d)
+			  struct nbft_info_discovery *discovery)
 {
-	struct nbft_info_discovery *discovery = NULL;
 	struct nbft_header *header = (struct nbft_header *)nbft->raw_nbft;
 	int r = -EINVAL;
 
@@ -449,12 +441,6 @@ static int read_discovery(struct nbft_info *nbft,
 	verify(raw_discovery->structure_id == NBFT_DESC_DISCOVERY,
 	       "invalid ID in discovery descriptor");
 
-	discovery = calloc(1, sizeof(struct nbft_info_discovery));
-	if (!discovery) {
-		r = -ENOMEM;
-		goto error;
-	}
-
 	discovery->index = raw_discovery->index;
 
 	if (get_heap_obj(raw_discovery, discovery_ctrl_addr_obj, 1, &discovery->uri))
@@ -475,67 +461,108 @@ static int read_discovery(struct nbft_info *nbft,
 			 "file %s: discovery %d security descriptor not found\n",
 			 nbft->filename, discovery->index);
 
-	*d = discovery;
 	r = 0;
 
 error:
 	if (r)
-		free(discovery);
+		memset(discovery, 0, sizeof(*discovery));
 	return r;
 }
 
 static int read_security(struct nbft_info *nbft,
 			 struct nbft_security *raw_security,
-			 struct nbft_info_security **s)
+			 struct nbft_info_security *s)
 {
 	return -EINVAL;
 }
 
+/*
+ * Each descriptor list is carved from one allocation: the NULL
+ * terminated pointer array callers iterate, followed by the descriptor
+ * storage itself.
+ */
+static void *__nbft_alloc_list(void *list, size_t num, size_t size)
+{
+	void **ptrs;
+
+	ptrs = calloc(1, (num + 1) * sizeof(void *) + num * size);
+	if (!ptrs)
+		return NULL;
+	*(void ***)list = ptrs;
+	return ptrs + num + 1;
+}
+
+#define nbft_alloc_list(list, type, num)				\
+	((type *)__nbft_alloc_list(&(list), (num), sizeof(type)))
+
 static void read_hfi_descriptors(struct nbft_info *nbft, int num_hfi,
 				 struct nbft_hfi *raw_hfi_array, int hfi_len)
 {
+	struct nbft_info_hfi *hfis;
 	int i, cnt;
 
-	nbft->hfi_list = calloc(num_hfi + 1, sizeof(struct nbft_info_hfi));
+	hfis = nbft_alloc_list(nbft->hfi_list, struct nbft_info_hfi, num_hfi);
+	if (!hfis)
+		return;
 	for (i = 0, cnt = 0; i < num_hfi; i++) {
-		if (read_hfi(nbft, &raw_hfi_array[i], &nbft->hfi_list[cnt]) == 0)
+		if (read_hfi(nbft, &raw_hfi_array[i], &hfis[cnt]) == 0) {
+			nbft->hfi_list[cnt] = &hfis[cnt];
 			cnt++;
+		}
 	}
 }
 
 static void read_security_descriptors(struct nbft_info *nbft, int num_sec,
 				      struct nbft_security *raw_sec_array, int sec_len)
 {
+	struct nbft_info_security *secs;
 	int i, cnt;
 
-	nbft->security_list = calloc(num_sec + 1, sizeof(struct nbft_info_security));
+	secs = nbft_alloc_list(nbft->security_list, struct nbft_info_security,
+			       num_sec);
+	if (!secs)
+		return;
 	for (i = 0, cnt = 0; i < num_sec; i++) {
-		if (read_security(nbft, &raw_sec_array[i], &nbft->security_list[cnt]) == 0)
+		if (read_security(nbft, &raw_sec_array[i], &secs[cnt]) == 0) {
+			nbft->security_list[cnt] = &secs[cnt];
 			cnt++;
+		}
 	}
 }
 
 static void read_discovery_descriptors(struct nbft_info *nbft, int num_disc,
 				       struct nbft_discovery *raw_disc_array, int disc_len)
 {
+	struct nbft_info_discovery *discs;
 	int i, cnt;
 
-	nbft->discovery_list = calloc(num_disc + 1, sizeof(struct nbft_info_discovery));
+	discs = nbft_alloc_list(nbft->discovery_list,
+				struct nbft_info_discovery, num_disc);
+	if (!discs)
+		return;
 	for (i = 0, cnt = 0; i < num_disc; i++) {
-		if (read_discovery(nbft, &raw_disc_array[i], &nbft->discovery_list[cnt]) == 0)
+		if (read_discovery(nbft, &raw_disc_array[i], &discs[cnt]) == 0) {
+			nbft->discovery_list[cnt] = &discs[cnt];
 			cnt++;
+		}
 	}
 }
 
 static void read_ssns_descriptors(struct nbft_info *nbft, int num_ssns,
 				  struct nbft_ssns *raw_ssns_array, int ssns_len)
 {
+	struct nbft_info_subsystem_ns *ssns;
 	int i, cnt;
 
-	nbft->subsystem_ns_list = calloc(num_ssns + 1, sizeof(struct nbft_info_subsystem_ns));
+	ssns = nbft_alloc_list(nbft->subsystem_ns_list,
+			       struct nbft_info_subsystem_ns, num_ssns);
+	if (!ssns)
+		return;
 	for (i = 0, cnt = 0; i < num_ssns; i++) {
-		if (read_ssns(nbft, &raw_ssns_array[i], &nbft->subsystem_ns_list[cnt]) == 0)
+		if (read_ssns(nbft, &raw_ssns_array[i], &ssns[cnt]) == 0) {
+			nbft->subsystem_ns_list[cnt] = &ssns[cnt];
 			cnt++;
+		}
 	}
 }
 
@@ -662,78 +689,81 @@ static int parse_raw_nbft(struct nbft_info *nbft)
 
 void nvme_nbft_free(struct nbft_info *nbft)
 {
-	struct nbft_info_hfi **hfi;
-	struct nbft_info_security **sec;
-	struct nbft_info_discovery **disc;
 	struct nbft_info_subsystem_ns **ns;
 
-	for (hfi = nbft->hfi_list; hfi && *hfi; hfi++)
-		free(*hfi);
 	free(nbft->hfi_list);
-	for (disc = nbft->discovery_list; disc && *disc; disc++)
-		free(*disc);
 	free(nbft->discovery_list);
-	for (sec = nbft->security_list; sec && *sec; sec++)
-		free(*sec);
 	free(nbft->security_list);
-	for (ns = nbft->subsystem_ns_list; ns && *ns; ns++) {
+	for (ns = nbft->subsystem_ns_list; ns && *ns; ns++)
 		free((*ns)->hfis);
-		free(*ns);
-	}
 	free(nbft->subsystem_ns_list);
-	free(nbft->raw_nbft);
+	if (nbft->raw_nbft)
+		munmap(nbft->raw_nbft, nbft->raw_nbft_size);
 	free(nbft->filename);
 	free(nbft);
 }
 
 int nvme_nbft_read(struct nbft_info **nbft, const char *filename)
 {
-	__u8 *raw_nbft = NULL;
+	__u8 *raw_nbft;
 	size_t raw_nbft_size;
-	FILE *raw_nbft_fp = NULL;
-	int i;
+	struct stat st;
+	int fd;
 
 	/*
-	 * read in raw nbft file
+	 * Map the table read-only and parse in place; heap strings and
+	 * blobs stay pointers into the mapping. ACPI table files
+	 * exported through sysfs do not implement mmap(), so fall back
+	 * to reading into an anonymous mapping; either way teardown is
+	 * a single munmap().
 	 */
-	raw_nbft_fp = fopen(filename, "rb");
-	if (raw_nbft_fp == NULL) {
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
 		nvme_msg(NULL, LOG_ERR, "Failed to open %s: %s\n",
 			 filename, strerror(errno));
 		errno = EINVAL;
 		return 1;
 	}
 
-	i = fseek(raw_nbft_fp, 0L, SEEK_END);
-	if (i) {
+	if (fstat(fd, &st) < 0 || !st.st_size) {
 		nvme_msg(NULL, LOG_ERR, "Failed to read from %s: %s\n",
 			 filename, strerror(errno));
-		fclose(raw_nbft_fp);
+		close(fd);
 		errno = EINVAL;
 		return 1;
 	}
-
-	raw_nbft_size = ftell(raw_nbft_fp);
-	rewind(raw_nbft_fp);
-
-	raw_nbft = malloc(raw_nbft_size);
-	if (!raw_nbft) {
-		nvme_msg(NULL, LOG_ERR, "Failed to allocate memory for NBFT table");
-		fclose(raw_nbft_fp);
-		errno = ENOMEM;
-		return 1;
-	}
-
-	i = fread(raw_nbft, sizeof(*raw_nbft), raw_nbft_size, raw_nbft_fp);
-	if (i != raw_nbft_size) {
-		nvme_msg(NULL, LOG_ERR, "Failed to read from %s: %s\n",
-			 filename, strerror(errno));
-		fclose(raw_nbft_fp);
-		free(raw_nbft);
-		errno = EINVAL;
-		return 1;
+	raw_nbft_size = st.st_size;
+
+	raw_nbft = mmap(NULL, raw_nbft_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (raw_nbft == MAP_FAILED) {
+		size_t off = 0;
+		ssize_t len;
+
+		raw_nbft = mmap(NULL, raw_nbft_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw_nbft == MAP_FAILED) {
+			nvme_msg(NULL, LOG_ERR,
+				 "Failed to allocate memory for NBFT table");
+			close(fd);
+			errno = ENOMEM;
+			return 1;
+		}
+		while (off < raw_nbft_size) {
+			len = read(fd, raw_nbft + off, raw_nbft_size - off);
+			if (len <= 0)
+				break;
+			off += len;
+		}
+		if (off != raw_nbft_size) {
+			nvme_msg(NULL, LOG_ERR, "Failed to read from %s: %s\n",
+				 filename, strerror(errno));
+			munmap(raw_nbft, raw_nbft_size);
+			close(fd);
+			errno = EINVAL;
+			return 1;
+		}
 	}
-	fclose(raw_nbft_fp);
+	close(fd);
 
 	/*
 	 * alloc new struct nbft_info, add raw nbft & filename to it, and add it to the list
@@ -741,7 +771,7 @@ int nvme_nbft_read(struct nbft_info **nbft, const char *filename)
 	*nbft = calloc(1, sizeof(struct nbft_info));
 	if (!*nbft) {
 		nvme_msg(NULL, LOG_ERR, "Could not allocate memory for NBFT\n");
-		free(raw_nbft);
+		munmap(raw_nbft, raw_nbft_size);
 		errno = ENOMEM;
 		return 1;
 	}
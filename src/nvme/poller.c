@@ -0,0 +1,438 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ * Copyright (c) 2026 Western Digital Corporation or its affiliates.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <ccan/list/list.h>
+
+#include "poller.h"
+#include "uring.h"
+#include "cleanup.h"
+#include "private.h"
+
+/*
+ * Registrations due within this window of the earliest deadline are
+ * pulled into the same burst, so drives on the same period share one
+ * wakeup and one overlapped submission instead of trickling in.
+ */
+#define NVME_POLL_COALESCE_MS	20
+
+struct nvme_poll_entry {
+	struct list_node entry;
+
+	int id;
+	int fd;
+	struct nvme_poll_log *logs;
+	unsigned int nr_logs;
+	unsigned int interval;
+	/* monotonic ms of the next poll */
+	uint64_t deadline;
+	nvme_poll_cb_t cb;
+	void *userdata;
+
+	/* per-registration fetch buffer, logs back to back */
+	void *buf;
+	size_t buf_len;
+
+	/* part of the burst currently in flight */
+	bool busy;
+	/* removed while busy; the poller thread frees it */
+	bool dead;
+};
+
+struct nvme_poller {
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	struct list_head entries;
+	int next_id;
+
+	int timer_fd;
+	int wake_fd;
+	pthread_t thread;
+	bool running;
+};
+
+int nvme_poller_create(nvme_poller_t *poller)
+{
+	struct nvme_poller *p;
+
+	if (!poller) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	p = calloc(1, sizeof(*p));
+	if (!p) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (p->timer_fd < 0)
+		goto free_poller;
+
+	p->wake_fd = eventfd(0, EFD_NONBLOCK);
+	if (p->wake_fd < 0)
+		goto close_timer;
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->idle, NULL);
+	list_head_init(&p->entries);
+
+	*poller = p;
+	return 0;
+
+close_timer:
+	close(p->timer_fd);
+free_poller:
+	free(p);
+	return -1;
+}
+
+static void nvme_poll_entry_free(struct nvme_poll_entry *e)
+{
+	free(e->logs);
+	free(e->buf);
+	free(e);
+}
+
+static void nvme_poller_wake(struct nvme_poller *p)
+{
+	uint64_t one = 1;
+
+	if (write(p->wake_fd, &one, sizeof(one)) < 0)
+		;	/* counter full; the thread is waking up anyway */
+}
+
+int nvme_poller_add(nvme_poller_t p, int fd,
+		    const struct nvme_poll_log *logs, unsigned int nr_logs,
+		    unsigned int interval_ms, nvme_poll_cb_t cb,
+		    void *userdata)
+{
+	struct nvme_poll_entry *e;
+	size_t buf_len = 0;
+	unsigned int i;
+
+	if (!p || fd < 0 || !logs || !nr_logs || !interval_ms || !cb) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < nr_logs; i++) {
+		if (!logs[i].len || logs[i].len & 3) {
+			errno = EINVAL;
+			return -1;
+		}
+		buf_len += logs[i].len;
+	}
+
+	e = calloc(1, sizeof(*e));
+	if (!e) {
+		errno = ENOMEM;
+		return -1;
+	}
+	e->logs = calloc(nr_logs, sizeof(*e->logs));
+	e->buf = malloc(buf_len);
+	if (!e->logs || !e->buf) {
+		nvme_poll_entry_free(e);
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(e->logs, logs, nr_logs * sizeof(*e->logs));
+	e->nr_logs = nr_logs;
+	e->buf_len = buf_len;
+	e->fd = fd;
+	e->interval = interval_ms;
+	e->cb = cb;
+	e->userdata = userdata;
+
+	pthread_mutex_lock(&p->lock);
+	e->id = p->next_id++;
+	/*
+	 * Spread first deadlines across the first interval so a fleet
+	 * of drives registered on the same period does not poll in
+	 * lockstep from then on.
+	 */
+	e->deadline = nvme_now_ms() +
+		(uint64_t)e->interval * ((e->id & 7) + 1) / 8;
+	list_add_tail(&p->entries, &e->entry);
+	pthread_mutex_unlock(&p->lock);
+
+	nvme_poller_wake(p);
+	return e->id;
+}
+
+int nvme_poller_remove(nvme_poller_t p, int id)
+{
+	struct nvme_poll_entry *e;
+
+	if (!p) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	list_for_each(&p->entries, e, entry) {
+		if (e->id != id)
+			continue;
+
+		if (e->busy) {
+			/*
+			 * From the poller thread (i.e. from a callback)
+			 * waiting would deadlock; let the burst loop
+			 * reap the entry instead.
+			 */
+			if (pthread_equal(p->thread, pthread_self())) {
+				e->dead = true;
+				pthread_mutex_unlock(&p->lock);
+				return 0;
+			}
+			while (e->busy)
+				pthread_cond_wait(&p->idle, &p->lock);
+		}
+		list_del(&e->entry);
+		pthread_mutex_unlock(&p->lock);
+		nvme_poll_entry_free(e);
+		return 0;
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	errno = ENOENT;
+	return -1;
+}
+
+/*
+ * Fetch every registration due within the coalescing window as one
+ * overlapped burst, then invoke the callbacks without the lock held.
+ */
+static void nvme_poller_burst(struct nvme_poller *p)
+{
+	_cleanup_free_ struct nvme_get_log_args *args = NULL;
+	_cleanup_free_ struct nvme_poll_entry **owner = NULL;
+	_cleanup_free_ int *status = NULL;
+	struct nvme_poll_entry *e, *next;
+	unsigned int n = 0, nr_cmds = 0;
+	uint64_t now = nvme_now_ms();
+	unsigned int i;
+
+	pthread_mutex_lock(&p->lock);
+	list_for_each(&p->entries, e, entry) {
+		if (e->deadline <= now + NVME_POLL_COALESCE_MS)
+			nr_cmds += e->nr_logs;
+	}
+	if (!nr_cmds) {
+		pthread_mutex_unlock(&p->lock);
+		return;
+	}
+
+	args = calloc(nr_cmds, sizeof(*args));
+	owner = calloc(nr_cmds, sizeof(*owner));
+	status = calloc(nr_cmds, sizeof(*status));
+	if (!args || !owner || !status) {
+		pthread_mutex_unlock(&p->lock);
+		return;
+	}
+
+	list_for_each(&p->entries, e, entry) {
+		void *buf = e->buf;
+
+		if (e->deadline > now + NVME_POLL_COALESCE_MS)
+			continue;
+
+		e->busy = true;
+		for (i = 0; i < e->nr_logs; i++) {
+			/*
+			 * Overwritten on completion; commands the batch
+			 * aborts before issuing keep this marker.
+			 */
+			status[n] = -ECANCELED;
+			args[n] = (struct nvme_get_log_args) {
+				.args_size	= sizeof(args[n]),
+				.fd		= e->fd,
+				.timeout	= NVME_DEFAULT_IOCTL_TIMEOUT,
+				.lid		= e->logs[i].lid,
+				.len		= e->logs[i].len,
+				.log		= buf,
+				.nsid		= NVME_NSID_ALL,
+				.csi		= NVME_CSI_NVM,
+				.lsi		= NVME_LOG_LSI_NONE,
+				.lsp		= NVME_LOG_LSP_NONE,
+				.uuidx		= NVME_UUID_NONE,
+				.rae		= true,
+			};
+			owner[n++] = e;
+			buf += e->logs[i].len;
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	nvme_get_log_batch(args, status, n);
+
+	for (i = 0; i < n; i++) {
+		e = owner[i];
+		e->cb(e->userdata, e->fd, args[i].lid, args[i].log,
+		      args[i].len, status[i]);
+	}
+
+	/* the burst itself took time; reschedule relative to completion */
+	now = nvme_now_ms();
+	pthread_mutex_lock(&p->lock);
+	list_for_each_safe(&p->entries, e, next, entry) {
+		if (!e->busy)
+			continue;
+
+		e->busy = false;
+		if (e->dead) {
+			list_del(&e->entry);
+			nvme_poll_entry_free(e);
+			continue;
+		}
+		do {
+			e->deadline += e->interval;
+		} while (e->deadline <= now);
+	}
+	pthread_cond_broadcast(&p->idle);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void nvme_poller_arm(struct nvme_poller *p)
+{
+	struct itimerspec its = { };
+	struct nvme_poll_entry *e;
+	uint64_t next = UINT64_MAX;
+	uint64_t now;
+
+	pthread_mutex_lock(&p->lock);
+	list_for_each(&p->entries, e, entry) {
+		if (e->deadline < next)
+			next = e->deadline;
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	if (next != UINT64_MAX) {
+		uint64_t delta = 1;
+
+		now = nvme_now_ms();
+		if (next > now)
+			delta = next - now;
+		its.it_value.tv_sec = delta / 1000;
+		its.it_value.tv_nsec = (delta % 1000) * 1000000;
+	}
+	/* an all-zero spec disarms the timer until the next wakeup */
+	timerfd_settime(p->timer_fd, 0, &its, NULL);
+}
+
+static void *nvme_poller_thread(void *arg)
+{
+	struct nvme_poller *p = arg;
+	struct pollfd pfds[2] = {
+		{ .fd = p->timer_fd, .events = POLLIN },
+		{ .fd = p->wake_fd, .events = POLLIN },
+	};
+	uint64_t junk;
+
+	for (;;) {
+		nvme_poller_arm(p);
+		if (poll(pfds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (pfds[1].revents & POLLIN) {
+			if (read(p->wake_fd, &junk, sizeof(junk)) < 0)
+				;	/* spurious; re-evaluate anyway */
+			pthread_mutex_lock(&p->lock);
+			if (!p->running) {
+				pthread_mutex_unlock(&p->lock);
+				break;
+			}
+			pthread_mutex_unlock(&p->lock);
+		}
+		if (pfds[0].revents & POLLIN) {
+			if (read(p->timer_fd, &junk, sizeof(junk)) < 0)
+				;	/* rearmed below either way */
+			nvme_poller_burst(p);
+		}
+	}
+	return NULL;
+}
+
+int nvme_poller_start(nvme_poller_t p)
+{
+	int ret;
+
+	if (!p) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	if (p->running) {
+		pthread_mutex_unlock(&p->lock);
+		errno = EBUSY;
+		return -1;
+	}
+	p->running = true;
+	pthread_mutex_unlock(&p->lock);
+
+	ret = pthread_create(&p->thread, NULL, nvme_poller_thread, p);
+	if (ret) {
+		pthread_mutex_lock(&p->lock);
+		p->running = false;
+		pthread_mutex_unlock(&p->lock);
+		errno = ret;
+		return -1;
+	}
+	return 0;
+}
+
+int nvme_poller_stop(nvme_poller_t p)
+{
+	if (!p) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	if (!p->running) {
+		pthread_mutex_unlock(&p->lock);
+		return 0;
+	}
+	p->running = false;
+	pthread_mutex_unlock(&p->lock);
+
+	nvme_poller_wake(p);
+	pthread_join(p->thread, NULL);
+	return 0;
+}
+
+void nvme_poller_free(nvme_poller_t p)
+{
+	struct nvme_poll_entry *e, *next;
+
+	if (!p)
+		return;
+
+	nvme_poller_stop(p);
+	list_for_each_safe(&p->entries, e, next, entry) {
+		list_del(&e->entry);
+		nvme_poll_entry_free(e);
+	}
+	pthread_cond_destroy(&p->idle);
+	pthread_mutex_destroy(&p->lock);
+	close(p->timer_fd);
+	close(p->wake_fd);
+	free(p);
+}
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ * Copyright (c) 2026 Western Digital Corporation or its affiliates.
+ */
+
+#ifndef _LIBNVME_POLLER_H
+#define _LIBNVME_POLLER_H
+
+#include "ioctl.h"
+
+/**
+ * DOC: poller.h
+ *
+ * Periodic health-poll scheduler.
+ *
+ * Monitoring agents typically run one loop per consumer: wake up, read
+ * a handful of log pages from every drive, sleep. This interface
+ * centralizes that loop in the library: registrations name a device, a
+ * set of log pages and an interval, and one timer-driven thread fetches
+ * everything that is due in a single overlapped burst over the batch
+ * helpers in uring.h. Registrations are staggered across their first
+ * interval so a fleet of drives on the same period does not wake and
+ * poll in lockstep.
+ *
+ * All log pages are fetched with RAE set so polling never clears
+ * pending asynchronous event state behind the consumer's back.
+ */
+
+typedef struct nvme_poller *nvme_poller_t;
+
+/**
+ * struct nvme_poll_log - One log page in a poll registration
+ * @lid:	Log page identifier to fetch, see &enum nvme_cmd_get_log_lid
+ * @len:	Number of bytes to fetch, a multiple of four
+ */
+struct nvme_poll_log {
+	enum nvme_cmd_get_log_lid lid;
+	__u32 len;
+};
+
+/**
+ * typedef nvme_poll_cb_t - Completion callback for a polled log page
+ * @userdata:	Cookie passed at registration time
+ * @fd:		File descriptor of the polled device
+ * @lid:	Log page identifier that was fetched
+ * @log:	Fetched log data, valid for the duration of the call
+ * @len:	Number of bytes in @log
+ * @status:	NVMe status code of the fetch, or negative errno
+ *
+ * Invoked from the poller thread once per registered log page and poll
+ * cycle. The callback may remove its own registration but must not
+ * block for long; every registration shares the one thread.
+ */
+typedef void (*nvme_poll_cb_t)(void *userdata, int fd,
+			       enum nvme_cmd_get_log_lid lid,
+			       const void *log, __u32 len, int status);
+
+/**
+ * nvme_poller_create() - Create a health-poll scheduler
+ * @poller:	Receives the created poller object
+ *
+ * The poller is created idle; registrations are only serviced after
+ * nvme_poller_start().
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_poller_create(nvme_poller_t *poller);
+
+/**
+ * nvme_poller_free() - Release a health-poll scheduler
+ * @poller:	Poller created by nvme_poller_create()
+ *
+ * Stops the poller thread if it is running and drops all
+ * registrations.
+ */
+void nvme_poller_free(nvme_poller_t poller);
+
+/**
+ * nvme_poller_add() - Register a device for periodic log polling
+ * @poller:	Poller to register with
+ * @fd:		File descriptor of the device to poll
+ * @logs:	Array of @nr_logs log pages to fetch each cycle
+ * @nr_logs:	Number of entries in @logs
+ * @interval_ms: Poll period in milliseconds
+ * @cb:		Invoked once per log page and cycle
+ * @userdata:	Cookie passed through to @cb
+ *
+ * The first cycle fires at a staggered offset within the first
+ * interval; subsequent cycles run every @interval_ms. Registrations
+ * due within the same coalescing window are fetched as one overlapped
+ * burst.
+ *
+ * Return: A non-negative registration id on success, -1 on failure
+ * with errno set.
+ */
+int nvme_poller_add(nvme_poller_t poller, int fd,
+		    const struct nvme_poll_log *logs, unsigned int nr_logs,
+		    unsigned int interval_ms, nvme_poll_cb_t cb,
+		    void *userdata);
+
+/**
+ * nvme_poller_remove() - Drop a poll registration
+ * @poller:	Poller the registration belongs to
+ * @id:		Registration id returned by nvme_poller_add()
+ *
+ * Waits for an in-flight poll of the registration to finish unless
+ * called from the poller thread itself, so on return no further
+ * callbacks are made for @id.
+ *
+ * Return: 0 on success, -1 with errno set to ENOENT when @id is not
+ * registered.
+ */
+int nvme_poller_remove(nvme_poller_t poller, int id);
+
+/**
+ * nvme_poller_start() - Start the poller thread
+ * @poller:	Poller to start
+ *
+ * Return: 0 on success, -1 on failure with errno set; EBUSY when the
+ * poller is already running.
+ */
+int nvme_poller_start(nvme_poller_t poller);
+
+/**
+ * nvme_poller_stop() - Stop the poller thread
+ * @poller:	Poller to stop
+ *
+ * Waits for an in-flight burst to finish and joins the thread.
+ * Registrations are kept and resume on the next nvme_poller_start().
+ *
+ * Return: 0 on success, -1 with errno set otherwise.
+ */
+int nvme_poller_stop(nvme_poller_t poller);
+
+#endif /* _LIBNVME_POLLER_H */
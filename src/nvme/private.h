@@ -11,12 +11,26 @@
 
 #include <ccan/list/list.h>
 #include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <sys/socket.h>
+#include <time.h>
 
 #include "fabrics.h"
 #include "mi.h"
 
 
+/* monotonic clock in milliseconds, 0 when unavailable */
+static inline uint64_t nvme_now_ms(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 const char *nvme_subsys_sysfs_dir(void);
 const char *nvme_ctrl_sysfs_dir(void);
 const char *nvme_ns_sysfs_dir(void);
@@ -31,6 +45,7 @@ struct nvme_path {
 	struct nvme_ctrl *c;
 	struct nvme_ns *n;
 
+	int sysfs_fd;
 	char *name;
 	char *sysfs_dir;
 	char *ana_state;
@@ -45,6 +60,7 @@ struct nvme_ns {
 	struct nvme_ctrl *c;
 
 	int fd;
+	int sysfs_fd;
 	__u32 nsid;
 	char *name;
 	char *generic_name;
@@ -53,22 +69,49 @@ struct nvme_ns {
 	int lba_shift;
 	int lba_size;
 	int meta_size;
-	uint64_t lba_count;
-	uint64_t lba_util;
+	/* in-use LBA format index, -1 until learned from identify data */
+	int lbaf_inuse;
+	__u64 lba_count;
+	__u64 lba_util;
 
 	uint8_t eui64[8];
 	uint8_t nguid[16];
 	unsigned char uuid[NVME_UUID_LEN];
 	enum nvme_csi csi;
+
+	/* lazily populated attribute groups */
+	bool ids_probed;
+	bool util_probed;
+};
+
+struct nvme_id_cache_entry {
+	struct list_node entry;
+	enum nvme_identify_cns cns;
+	enum nvme_csi csi;
+	__u32 nsid;
+	__u16 cns_specific_id;
+	__u16 cntid;
+	__u8 uuidx;
+	void *data;
 };
 
 struct nvme_ctrl {
 	struct list_node entry;
 	struct list_head paths;
 	struct list_head namespaces;
+	/* opt-in identify payload cache, see nvme_ctrl_identify_cached() */
+	struct list_head id_cache;
+	bool id_cache_enabled;
 	struct nvme_subsystem *s;
 
+	/* root-wide lookup index, see nvme_root_index_ctrl() */
+	struct list_node addr_hash_entry;
+	struct list_node name_hash_entry;
+	bool addr_hashed;
+	bool name_hashed;
+
 	int fd;
+	int sysfs_fd;
 	char *name;
 	char *sysfs_dir;
 	char *address;
@@ -89,11 +132,20 @@ struct nvme_ctrl {
 	char *cntlid;
 	char *dctype;
 	char *phy_slot;
+	char *connect_args;
+	/* last fetched discovery log, see nvmf_cached_discovery_log() */
+	struct nvmf_discovery_log *disc_log;
+	__u32 max_xfer_len;
 	bool discovery_ctrl;
 	bool unique_discovery_ctrl;
 	bool discovered;
 	bool persistent;
 	struct nvme_fabrics_config cfg;
+	/* set when a merge/update actually changed cfg, see
+	 * nvme_ctrl_config_is_dirty() */
+	bool cfg_dirty;
+	/* monotonic expiry of the cached state attribute, ms */
+	uint64_t state_expires;
 };
 
 struct nvme_subsystem {
@@ -102,6 +154,7 @@ struct nvme_subsystem {
 	struct list_head namespaces;
 	struct nvme_host *h;
 
+	int sysfs_fd;
 	char *name;
 	char *sysfs_dir;
 	char *subsysnqn;
@@ -160,30 +213,150 @@ struct nvme_fabric_options {
 	bool trsvcid;
 };
 
+struct nvme_log_async;
+
 struct nvme_log {
 	int fd;
 	int level;
 	bool pid;
 	bool timestamp;
+	struct nvme_log_async *async;
+};
+
+struct nvme_arena_block;
+
+struct nvme_fd_cache_entry {
+	struct list_node entry;
+	char *name;
+	int fd;
+};
+
+#define NVME_RESOLV_TTL_DEFAULT	60
+
+/* validity window of the cached controller state attribute, ms */
+#define NVME_STATE_TTL_DEFAULT	100
+
+struct nvme_resolv_cache_entry {
+	struct list_node entry;
+	char *hostname;
+	char *traddr;
+	time_t expires;
+};
+
+struct nvme_ctrl_index {
+	struct list_head *addr_buckets;
+	struct list_head *name_buckets;
+	unsigned int nr_buckets;
 };
 
+/* always-on activity counters, see nvme_root_get_stats() */
+struct nvme_counters {
+	atomic_ullong ioctls;
+	atomic_ullong ioctl_errors;
+	atomic_ullong bytes_transferred;
+	atomic_ullong connect_attempts;
+	atomic_ullong connect_errors;
+	atomic_ullong scans;
+	atomic_ullong mi_submissions;
+	atomic_ullong mi_errors;
+};
+
+static inline void nvme_count_add(atomic_ullong *c, unsigned long long n)
+{
+	atomic_fetch_add_explicit(c, n, memory_order_relaxed);
+}
+
+#define nvme_count(c) nvme_count_add((c), 1)
+
+/*
+ * The fd-based ioctl paths carry no root pointer, so their counters
+ * are kept process-wide and folded into every root's statistics.
+ */
+extern struct nvme_counters nvme_ioctl_counters;
+
 struct nvme_root {
 	char *config_file;
 	char *application;
 	struct list_head hosts;
 	struct list_head endpoints; /* MI endpoints */
+	void *mctp_dbus; /* cached D-Bus connection for MCTP scans */
 	struct nvme_log log;
 	bool modified;
 	bool mi_probe_enabled;
+	char *mi_probe_cache;
 	bool create_only;
+	unsigned int scan_threads;
+	bool bulk_scan;
+	struct {
+		char *subsys_name;
+		char *nqn_prefix;
+		char *transport;
+	} scan_match;
+	struct nvme_ctrl_index ctrl_index;
+	struct {
+		struct list_head entries;
+		unsigned int nr;
+		unsigned int cap;
+	} fd_cache;
+	struct {
+		struct list_head entries;
+		unsigned int ttl;
+	} resolv_cache;
+	/* see nvme_root_set_state_ttl() */
+	unsigned int state_ttl;
+	struct nvme_arena_block *arena;
+	struct nvme_buf_pool *buf_pool;
 	struct nvme_fabric_options *options;
+	struct nvme_counters counters;
+	/* topology lock, see nvme_root_read_lock() */
+	pthread_rwlock_t lock;
+	/* interned construction-time strings, see nvme_tree_intern() */
+	struct {
+		struct list_head *buckets;
+		unsigned int nr_buckets;
+	} intern;
+	/* contiguous iteration snapshot, see nvme_root_get_ns_array() */
+	struct {
+		nvme_ctrl_t *ctrls;
+		unsigned int nr_ctrls;
+		nvme_ns_t *namespaces;
+		unsigned int nr_namespaces;
+		unsigned long long gen;
+	} iter_cache;
+	unsigned long long topo_gen;
 };
 
+/*
+ * Topology generation, bumped whenever a controller or namespace joins
+ * or leaves the tree; the iteration snapshot is rebuilt when its
+ * generation no longer matches.
+ */
+static inline void nvme_topo_changed(nvme_root_t r)
+{
+	if (r)
+		r->topo_gen++;
+}
+
 int nvme_set_attr(const char *dir, const char *attr, const char *value);
 
+/* kernel connect argument string for a controller, exposed for benchmarks */
+int build_options(nvme_host_t h, nvme_ctrl_t c, char **out);
+
+/* free node/attribute storage that may live in the per-root arena */
+void nvme_tree_free(void *p);
+
+/* cached O_PATH sysfs directory fds, see nvme_get_attr_at() */
+int nvme_subsystem_sysfs_fd(nvme_subsystem_t s);
+int nvme_ctrl_sysfs_fd(nvme_ctrl_t c);
+int nvme_ns_sysfs_fd(nvme_ns_t n);
+int nvme_path_sysfs_fd(nvme_path_t p);
+
 int json_read_config(nvme_root_t r, const char *config_file);
 
 int json_update_config(nvme_root_t r, const char *config_file);
+bool nvme_config_is_binary(const char *config_file);
+int nvme_bincfg_read_config(nvme_root_t r, const char *config_file);
+int nvme_bincfg_update_config(nvme_root_t r, const char *config_file);
 
 int json_dump_tree(nvme_root_t r);
 
@@ -194,6 +367,27 @@ nvme_ctrl_t __nvme_lookup_ctrl(nvme_subsystem_t s, const char *transport,
 
 void *__nvme_alloc(size_t len);
 
+void nvme_init_identify_cmd(struct nvme_uring_cmd *cmd,
+			    struct nvme_identify_args *args);
+
+void nvme_init_get_log_cmd(struct nvme_uring_cmd *cmd,
+			   struct nvme_get_log_args *args);
+
+void nvme_init_fw_download_cmd(struct nvme_uring_cmd *cmd,
+			       struct nvme_fw_download_args *args);
+
+void nvme_init_set_features_cmd(struct nvme_uring_cmd *cmd,
+				struct nvme_set_features_args *args);
+
+void nvme_init_get_features_cmd(struct nvme_uring_cmd *cmd,
+				struct nvme_get_features_args *args);
+
+void nvme_init_zns_mgmt_recv_cmd(struct nvme_uring_cmd *cmd,
+				 struct nvme_zns_mgmt_recv_args *args);
+
+int __nvme_get_log_batch(struct nvme_get_log_args *args, int *status,
+			 unsigned int n, unsigned int depth);
+
 void *__nvme_realloc(void *p, size_t len);
 
 #if (LOG_FUNCNAME == 1)
@@ -232,6 +426,40 @@ struct nvme_mi_resp {
 	__u32 mic;
 };
 
+struct nvme_mi_async_op;
+
+/* internal submission callback; status is 0 or a negative errno */
+typedef void (*nvme_mi_submit_cb_t)(struct nvme_mi_ep *ep,
+				    struct nvme_mi_req *req,
+				    struct nvme_mi_resp *resp,
+				    int status, void *cb_data);
+
+/* submission priority classes, see nvme_mi_submit_async_prio(). Normal
+ * submissions are dispatched ahead of bulk ones, so a one-shot query isn't
+ * stuck behind the chunks of a long log page transfer */
+enum nvme_mi_prio {
+	NVME_MI_PRIO_NORMAL = 0,
+	NVME_MI_PRIO_BULK,
+	NVME_MI_PRIO_MAX,
+};
+
+/* a pending asynchronous submission, see nvme_mi_submit_async() */
+struct nvme_mi_async_op {
+	struct list_node entry;
+	struct nvme_mi_req *req;
+	struct nvme_mi_resp *resp;
+	nvme_mi_submit_cb_t cb;
+	void *cb_data;
+	enum nvme_mi_prio prio;
+	/* still waiting for a free submission slot, see nvme_mi_ep_pump() */
+	bool queued;
+	__u8 tag;
+	/* device sent More Processing Required; the final response is
+	 * expected by mpr_expiry. See nvme_mi_ep_get_mpr_wait() */
+	bool mpr_pending;
+	struct timespec mpr_expiry;
+};
+
 struct nvme_mi_transport {
 	const char *name;
 	bool mic_enabled;
@@ -241,6 +469,10 @@ struct nvme_mi_transport {
 	void (*close)(struct nvme_mi_ep *ep);
 	int (*desc_ep)(struct nvme_mi_ep *ep, char *buf, size_t len);
 	int (*check_timeout)(struct nvme_mi_ep *ep, unsigned int timeout);
+	/* optional async interface, see nvme_mi_submit_async() */
+	int (*submit_async)(struct nvme_mi_ep *ep, struct nvme_mi_async_op *op);
+	int (*get_fd)(struct nvme_mi_ep *ep);
+	int (*recv_async)(struct nvme_mi_ep *ep);
 };
 
 /* quirks */
@@ -251,22 +483,59 @@ struct nvme_mi_transport {
  */
 #define NVME_QUIRK_MIN_INTER_COMMAND_TIME	(1 << 0)
 
+/* per-opcode response-time estimator; srtt/rttvar smoothing in the
+ * style of a TCP retransmission timer, see nvme_mi_latency_record() */
+struct nvme_mi_opcode_latency {
+	__u32 count;
+	__u32 min_us;
+	__u32 max_us;
+	__u32 srtt_us;
+	__u32 rttvar_us;
+};
+
+struct nvme_mi_latency_model {
+	struct nvme_mi_opcode_latency mi[256];
+	struct nvme_mi_opcode_latency admin[256];
+};
+
 struct nvme_mi_ep {
 	struct nvme_root *root;
 	const struct nvme_mi_transport *transport;
 	void *transport_data;
 	struct list_node root_entry;
 	struct list_head controllers;
+	struct list_head async_ops;
+	/* ops waiting for a submission slot, per priority class */
+	struct list_head queued_ops[NVME_MI_PRIO_MAX];
+	unsigned int nr_inflight;
+	unsigned int max_inflight;
+	/* consecutive normal-priority dispatches while bulk work waited */
+	unsigned int bulk_wait_count;
 	bool quirks_probed;
 	bool controllers_scanned;
+	/* controller list of the last scan, to recognize no-op rescans */
+	__u16 scanned_ctrl_ids[NVME_ID_CTRL_LIST_MAX];
+	unsigned int nr_scanned_ctrl_ids;
 	unsigned int timeout;
 	unsigned int mprt_max;
 	unsigned long quirks;
 
 	/* inter-command delay, for NVME_QUIRK_MIN_INTER_COMMAND_TIME */
 	unsigned int inter_command_us;
+	/* adaptive pacing bounds and state, see nvme_mi_adapt_pacing() */
+	unsigned int inter_command_max_us;
+	unsigned int inter_command_floor_us;
+	unsigned int pace_successes;
+	bool mpr_seen;
 	struct timespec last_resp_time;
 	bool last_resp_time_valid;
+
+	/* per-opcode response times, allocated on first sample */
+	struct nvme_mi_latency_model *latency;
+	bool adaptive_timeout;
+
+	/* absolute CLOCK_MONOTONIC ms bounding in-flight work, 0 = none */
+	__u64 deadline;
 };
 
 struct nvme_mi_ctrl {
@@ -277,6 +546,20 @@ struct nvme_mi_ctrl {
 
 struct nvme_mi_ep *nvme_mi_init_ep(struct nvme_root *root);
 void nvme_mi_ep_probe(struct nvme_mi_ep *ep);
+/* ms left before the endpoint deadline: -1 unbounded, 0 expired */
+int nvme_mi_ep_deadline_remaining(struct nvme_mi_ep *ep);
+void nvme_mi_probe_endpoints(struct nvme_root *root);
+void nvme_mi_mctp_cleanup_dbus(struct nvme_root *root);
+
+int nvme_mi_submit_async(struct nvme_mi_ep *ep, struct nvme_mi_req *req,
+			 struct nvme_mi_resp *resp,
+			 nvme_mi_submit_cb_t cb, void *cb_data);
+int nvme_mi_submit_async_prio(struct nvme_mi_ep *ep, struct nvme_mi_req *req,
+			      struct nvme_mi_resp *resp,
+			      enum nvme_mi_prio prio,
+			      nvme_mi_submit_cb_t cb, void *cb_data);
+void nvme_mi_async_complete(struct nvme_mi_ep *ep, struct nvme_mi_async_op *op,
+			    int status);
 
 /* for tests, we need to calculate the correct MICs */
 __u32 nvme_mi_crc32_update(__u32 crc, void *data, size_t len);
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ * Copyright (c) 2026 SUSE Software Solutions
+ *
+ * Static tracepoints (USDT probes) on the command submission paths.
+ *
+ * The probes are compiled in only when the 'tracing' meson option is
+ * enabled and <sys/sdt.h> is available; otherwise they expand to
+ * nothing, so production builds pay no cost. When enabled, each probe
+ * site is a single nop instruction until a tracer (bpftrace, perf,
+ * systemtap) attaches to it, e.g.:
+ *
+ *   bpftrace -e 'usdt:libnvme.so:libnvme:io_cmd_done
+ *	{ @lat[arg0] = hist(nsecs - @t[tid]); }'
+ *
+ * Probes live in the 'libnvme' provider:
+ *
+ *   admin_cmd_start(opcode, nsid, data_len)
+ *   admin_cmd_done(opcode, nsid, data_len, status)
+ *   io_cmd_start(opcode, nsid, data_len)
+ *   io_cmd_done(opcode, nsid, data_len, status)
+ *   mi_submit_start(msg_type, opcode, data_len)
+ *   mi_submit_done(msg_type, opcode, data_len, status)
+ */
+#ifndef _LIBNVME_TRACE_H
+#define _LIBNVME_TRACE_H
+
+#ifdef CONFIG_TRACEPOINTS
+#include <sys/sdt.h>
+
+#define nvme_trace3(name, a1, a2, a3) \
+	DTRACE_PROBE3(libnvme, name, a1, a2, a3)
+#define nvme_trace4(name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(libnvme, name, a1, a2, a3, a4)
+#else /* CONFIG_TRACEPOINTS */
+#define nvme_trace3(name, a1, a2, a3) do { } while (0)
+#define nvme_trace4(name, a1, a2, a3, a4) do { } while (0)
+#endif /* CONFIG_TRACEPOINTS */
+
+#endif /* _LIBNVME_TRACE_H */
@@ -6,6 +6,7 @@
  * Authors: Keith Busch <keith.busch@wdc.com>
  * 	    Chaitanya Kulkarni <chaitanya.kulkarni@wdc.com>
  */
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <stdint.h>
@@ -16,8 +17,13 @@
 #include <libgen.h>
 #include <unistd.h>
 #include <ifaddrs.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -30,8 +36,8 @@
 #include "linux.h"
 #include "filters.h"
 #include "tree.h"
-#include "filters.h"
 #include "util.h"
+#include "uring.h"
 #include "fabrics.h"
 #include "log.h"
 #include "private.h"
@@ -65,6 +71,10 @@ static struct nvme_host *default_host;
 
 static void __nvme_free_host(nvme_host_t h);
 static void __nvme_free_ctrl(nvme_ctrl_t c);
+static void __nvme_free_ns(struct nvme_ns *n);
+void nvme_free_path(struct nvme_path *p);
+static void nvme_ns_probe_ids(struct nvme_ns *ns);
+static int nvme_ns_probe_util(struct nvme_ns *ns);
 static int nvme_subsystem_scan_namespace(nvme_root_t r,
 		struct nvme_subsystem *s, char *name,
 		nvme_scan_filter_t f, void *f_args);
@@ -74,2672 +84,5305 @@ static int nvme_scan_subsystem(nvme_root_t r, const char *name,
 static int nvme_ctrl_scan_namespace(nvme_root_t r, struct nvme_ctrl *c,
 				    char *name);
 static int nvme_ctrl_scan_path(nvme_root_t r, struct nvme_ctrl *c, char *name);
+static void nvme_ns_set_generic_name(struct nvme_ns *n, const char *name);
+static char *nvme_ns_generic_to_blkdev(const char *generic);
+static int nvme_strtou32(const char *str, void *res);
+static char *nvme_ctrl_lookup_subsystem_name(nvme_root_t r,
+					     const char *ctrl_name);
 
-/**
- * Compare two C strings and handle NULL pointers gracefully.
- * Return true if both pointers are equal (including both set to NULL).
- * Return false if one and only one of the two pointers is NULL.
- * Perform string comparisong only if both pointers are not NULL and
- * return true if both strings are the same, false otherwise.
+/*
+ * Root-wide controller lookup index. Controllers are hashed by their
+ * (subsysnqn, transport, traddr, trsvcid) tuple and by device name so
+ * that repeated lookups on large hosts don't degenerate into linear
+ * list walks. The index is a pure accelerator: probes that miss fall
+ * back to the list walk, so fuzzy matches (wildcards, equivalent
+ * address spellings) keep working.
  */
-static bool streq0(const char *s1, const char *s2)
-{
-	if (s1 == s2)
-		return true;
-	if (!s1 || !s2)
-		return false;
-	return !strcmp(s1, s2);
-}
+#define NVME_CTRL_INDEX_BUCKETS 512
 
-/**
- * Same as streq0() but ignore the case of the characters.
- */
-static bool streqcase0(const char *s1, const char *s2)
+static __u32 nvme_index_strhash(__u32 h, const char *s)
 {
-	if (s1 == s2)
-		return true;
-	if (!s1 || !s2)
-		return false;
-	return !strcasecmp(s1, s2);
+	for (; s && *s; s++) {
+		h ^= (unsigned char)tolower(*s);
+		h *= 16777619U;
+	}
+	h ^= 0xff;
+	h *= 16777619U;
+	return h;
 }
 
-struct dirents {
-	struct dirent **ents;
-	int num;
-};
-
-static void cleanup_dirents(struct dirents *ents)
+static __u32 nvme_ctrl_addr_hash(const char *subsysnqn, const char *transport,
+				 const char *traddr, const char *trsvcid)
 {
-	while (ents->num > 0)
-		free(ents->ents[--ents->num]);
-	free(ents->ents);
-}
+	__u32 h = 2166136261U;
 
-#define _cleanup_dirents_ __cleanup__(cleanup_dirents)
+	h = nvme_index_strhash(h, subsysnqn);
+	h = nvme_index_strhash(h, transport);
+	h = nvme_index_strhash(h, traddr);
+	return nvme_index_strhash(h, trsvcid);
+}
 
-nvme_host_t nvme_default_host(nvme_root_t r)
+static struct nvme_ctrl_index *nvme_ctrl_index_get(nvme_root_t r)
 {
-	struct nvme_host *h;
-	_cleanup_free_ char *hostnqn = NULL;
-	_cleanup_free_ char *hostid = NULL;
+	struct nvme_ctrl_index *idx = &r->ctrl_index;
+	unsigned int i;
 
-	hostnqn = nvmf_hostnqn_from_file();
-	if (!hostnqn)
-		hostnqn = nvmf_hostnqn_generate();
-	hostid = nvmf_hostid_from_file();
+	if (idx->nr_buckets)
+		return idx;
 
-	h = nvme_lookup_host(r, hostnqn, hostid);
+	idx->addr_buckets = calloc(NVME_CTRL_INDEX_BUCKETS,
+				   sizeof(*idx->addr_buckets));
+	idx->name_buckets = calloc(NVME_CTRL_INDEX_BUCKETS,
+				   sizeof(*idx->name_buckets));
+	if (!idx->addr_buckets || !idx->name_buckets) {
+		free(idx->addr_buckets);
+		free(idx->name_buckets);
+		idx->addr_buckets = NULL;
+		idx->name_buckets = NULL;
+		return NULL;
+	}
+	for (i = 0; i < NVME_CTRL_INDEX_BUCKETS; i++) {
+		list_head_init(&idx->addr_buckets[i]);
+		list_head_init(&idx->name_buckets[i]);
+	}
+	idx->nr_buckets = NVME_CTRL_INDEX_BUCKETS;
+	return idx;
+}
 
-	nvme_host_set_hostsymname(h, NULL);
+static void nvme_ctrl_index_free(struct nvme_ctrl_index *idx)
+{
+	free(idx->addr_buckets);
+	free(idx->name_buckets);
+	memset(idx, 0, sizeof(*idx));
+}
 
-	default_host = h;
-	return h;
+/*
+ * Read-all-and-report loops visit every controller and namespace each
+ * polling cycle, and chasing list_node pointers across the heap costs
+ * a cache miss per object. The iteration snapshot lays the object
+ * pointers out in contiguous arrays so the walk is cache-linear; it is
+ * rebuilt lazily once the topology generation moves on.
+ */
+static void nvme_iter_cache_clear(nvme_root_t r)
+{
+	free(r->iter_cache.ctrls);
+	free(r->iter_cache.namespaces);
+	memset(&r->iter_cache, 0, sizeof(r->iter_cache));
 }
 
-int nvme_scan_topology(struct nvme_root *r, nvme_scan_filter_t f, void *f_args)
+static int nvme_iter_cache_update(nvme_root_t r)
 {
-	_cleanup_dirents_ struct dirents subsys = {}, ctrls = {};
-	int i, ret;
+	unsigned int nr_ctrls = 0, nr_ns = 0;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	nvme_host_t h;
+	nvme_ns_t n;
 
-	if (!r)
+	if (r->iter_cache.gen == r->topo_gen)
 		return 0;
 
-	ctrls.num = nvme_scan_ctrls(&ctrls.ents);
-	if (ctrls.num < 0) {
-		nvme_msg(r, LOG_DEBUG, "failed to scan ctrls: %s\n",
-			 strerror(errno));
-		return ctrls.num;
+	nvme_iter_cache_clear(r);
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			nvme_subsystem_for_each_ns(s, n)
+				nr_ns++;
+			nvme_subsystem_for_each_ctrl(s, c) {
+				nr_ctrls++;
+				nvme_ctrl_for_each_ns(c, n)
+					nr_ns++;
+			}
+		}
 	}
 
-	for (i = 0; i < ctrls.num; i++) {
-		nvme_ctrl_t c = nvme_scan_ctrl(r, ctrls.ents[i]->d_name);
-		if (!c) {
-			nvme_msg(r, LOG_DEBUG, "failed to scan ctrl %s: %s\n",
-				 ctrls.ents[i]->d_name, strerror(errno));
-			continue;
-		}
-		if ((f) && !f(NULL, c, NULL, f_args)) {
-			nvme_msg(r, LOG_DEBUG, "filter out controller %s\n",
-				 ctrls.ents[i]->d_name);
-			nvme_free_ctrl(c);
+	if (nr_ctrls) {
+		r->iter_cache.ctrls = calloc(nr_ctrls,
+					     sizeof(*r->iter_cache.ctrls));
+		if (!r->iter_cache.ctrls) {
+			errno = ENOMEM;
+			return -1;
 		}
 	}
-
-	subsys.num = nvme_scan_subsystems(&subsys.ents);
-	if (subsys.num < 0) {
-		nvme_msg(r, LOG_DEBUG, "failed to scan subsystems: %s\n",
-			 strerror(errno));
-		return subsys.num;
+	if (nr_ns) {
+		r->iter_cache.namespaces =
+			calloc(nr_ns, sizeof(*r->iter_cache.namespaces));
+		if (!r->iter_cache.namespaces) {
+			nvme_iter_cache_clear(r);
+			errno = ENOMEM;
+			return -1;
+		}
 	}
 
-	for (i = 0; i < subsys.num; i++) {
-		ret = nvme_scan_subsystem(
-			r, subsys.ents[i]->d_name, f, f_args);
-		if (ret < 0) {
-			nvme_msg(r, LOG_DEBUG,
-				 "failed to scan subsystem %s: %s\n",
-				 subsys.ents[i]->d_name, strerror(errno));
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			nvme_subsystem_for_each_ns(s, n)
+				r->iter_cache.namespaces[r->iter_cache.nr_namespaces++] = n;
+			nvme_subsystem_for_each_ctrl(s, c) {
+				r->iter_cache.ctrls[r->iter_cache.nr_ctrls++] = c;
+				nvme_ctrl_for_each_ns(c, n)
+					r->iter_cache.namespaces[r->iter_cache.nr_namespaces++] = n;
+			}
 		}
 	}
-
+	r->iter_cache.gen = r->topo_gen;
 	return 0;
 }
 
-nvme_root_t nvme_create_root(FILE *fp, int log_level)
+nvme_ctrl_t *nvme_root_get_ctrl_array(nvme_root_t r, unsigned int *nr)
 {
-	struct nvme_root *r;
-	int fd;
+	if (!r || !nr) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (nvme_iter_cache_update(r)) {
+		*nr = 0;
+		return NULL;
+	}
+	*nr = r->iter_cache.nr_ctrls;
+	return r->iter_cache.ctrls;
+}
 
-	r = calloc(1, sizeof(*r));
-	if (!r) {
-		errno = ENOMEM;
+nvme_ns_t *nvme_root_get_ns_array(nvme_root_t r, unsigned int *nr)
+{
+	if (!r || !nr) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (nvme_iter_cache_update(r)) {
+		*nr = 0;
 		return NULL;
 	}
+	*nr = r->iter_cache.nr_namespaces;
+	return r->iter_cache.namespaces;
+}
 
-	if (fp) {
-		fd = fileno(fp);
-		if (fd < 0) {
-			free(r);
+/*
+ * Tree nodes and their construction-time strings are carved out of a
+ * per-root bump allocator so that nvme_free_tree() releases them with
+ * a few munmap() calls instead of thousands of individual free()s.
+ * Attributes that are (re)loaded during the lifetime of a node keep
+ * using the heap; nvme_tree_free() tells the two apart, so both kinds
+ * can flow through the same teardown paths. Arena memory of nodes
+ * removed before the root goes away is only reclaimed with the root.
+ */
+#define NVME_ARENA_BLOCK_SIZE	(256 * 1024)
+#define NVME_ARENA_ALIGN	16
+
+struct nvme_arena_block {
+	struct nvme_arena_block *next;	/* per-root chain */
+	struct nvme_arena_block *gnext;	/* global chain, for containment */
+	size_t size;
+	size_t used;
+};
+
+static struct nvme_arena_block *nvme_arena_block_list;
+static pthread_mutex_t nvme_arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *nvme_arena_alloc(nvme_root_t r, size_t len)
+{
+	struct nvme_arena_block *b;
+	void *p;
+
+	len = round_up(len, NVME_ARENA_ALIGN);
+
+	pthread_mutex_lock(&nvme_arena_mutex);
+	b = r->arena;
+	if (!b || b->size - b->used < len) {
+		size_t hdr = round_up(sizeof(*b), NVME_ARENA_ALIGN);
+		size_t size = NVME_ARENA_BLOCK_SIZE;
+
+		if (size < hdr + len)
+			size = round_up(hdr + len, (size_t)getpagesize());
+		b = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (b == MAP_FAILED) {
+			pthread_mutex_unlock(&nvme_arena_mutex);
 			return NULL;
 		}
-	} else
-		fd = STDERR_FILENO;
+		b->size = size;
+		b->used = hdr;
+		b->next = r->arena;
+		r->arena = b;
+		b->gnext = nvme_arena_block_list;
+		nvme_arena_block_list = b;
+	}
+	p = (char *)b + b->used;
+	b->used += len;
+	pthread_mutex_unlock(&nvme_arena_mutex);
 
-	r->log.fd = fd;
-	r->log.level = log_level;
+	/* fresh anonymous mappings are already zeroed */
+	return p;
+}
 
-	list_head_init(&r->hosts);
-	list_head_init(&r->endpoints);
+static bool nvme_arena_contains(const void *p)
+{
+	struct nvme_arena_block *b;
+	bool found = false;
 
-	return r;
+	pthread_mutex_lock(&nvme_arena_mutex);
+	for (b = nvme_arena_block_list; b; b = b->gnext) {
+		if ((const char *)p >= (const char *)b &&
+		    (const char *)p < (const char *)b + b->size) {
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&nvme_arena_mutex);
+	return found;
 }
 
-int nvme_read_config(nvme_root_t r, const char *config_file)
+void nvme_tree_free(void *p)
 {
-	int err = -1;
+	if (p && !nvme_arena_contains(p))
+		free(p);
+}
 
-	if (!r || !config_file) {
-		errno = ENODEV;
-		return err;
-	}
+static void nvme_arena_free(nvme_root_t r)
+{
+	struct nvme_arena_block *b, **gp;
 
-	r->config_file = strdup(config_file);
-	if (!r->config_file) {
-		errno = ENOMEM;
-		return err;
+	while ((b = r->arena)) {
+		r->arena = b->next;
+		pthread_mutex_lock(&nvme_arena_mutex);
+		for (gp = &nvme_arena_block_list; *gp; gp = &(*gp)->gnext) {
+			if (*gp == b) {
+				*gp = b->gnext;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&nvme_arena_mutex);
+		munmap(b, b->size);
 	}
-	err = json_read_config(r, config_file);
-	/*
-	 * The json configuration file is optional,
-	 * so ignore errors when opening the file.
-	 */
-	if (err < 0 && errno != EPROTO)
-		err = 0;
-
-	return err;
 }
 
-nvme_root_t nvme_scan(const char *config_file)
+static void *nvme_tree_calloc(nvme_root_t r, size_t len)
 {
-	nvme_root_t r = nvme_create_root(NULL, DEFAULT_LOGLEVEL);
+	void *p = r ? nvme_arena_alloc(r, len) : NULL;
 
-	nvme_scan_topology(r, NULL, NULL);
-	nvme_read_config(r, config_file);
-	return r;
+	if (!p)
+		p = calloc(1, len);
+	return p;
 }
 
-int nvme_update_config(nvme_root_t r)
+static char *nvme_tree_strdup(nvme_root_t r, const char *str)
 {
-	if (!r->modified || !r->config_file)
-		return 0;
+	size_t len;
+	char *p;
 
-	return json_update_config(r, r->config_file);
+	if (!str)
+		return NULL;
+	len = strlen(str) + 1;
+	p = r ? nvme_arena_alloc(r, len) : NULL;
+	if (!p)
+		return strdup(str);
+	memcpy(p, str, len);
+	return p;
 }
 
-int nvme_dump_config(nvme_root_t r)
+/*
+ * Dense hosts duplicate the same subsysnqn, transport, model and
+ * firmware strings into hundreds of tree nodes, and streq0() then
+ * re-walks those long strings on every nvme_lookup_ctrl() probe.
+ * Construction-time strings with few distinct values are therefore
+ * interned in a small per-root hash table backed by the arena:
+ * duplicates share one copy and a comparison of two interned values
+ * takes the pointer fast path in streq0(). Interned strings live until
+ * the root goes away; nvme_tree_free() treats arena memory as a no-op,
+ * so they pass through the normal teardown paths unharmed.
+ */
+#define NVME_INTERN_BUCKETS 64
+
+struct nvme_intern_entry {
+	struct list_node entry;
+	char str[];
+};
+
+static char *nvme_tree_intern(nvme_root_t r, const char *str)
 {
-	return json_update_config(r, NULL);
+	struct nvme_intern_entry *e;
+	struct list_head *bucket;
+	size_t len;
+
+	if (!r || !str)
+		return nvme_tree_strdup(r, str);
+
+	if (!r->intern.buckets) {
+		unsigned int i;
+
+		r->intern.buckets = calloc(NVME_INTERN_BUCKETS,
+					   sizeof(*r->intern.buckets));
+		if (!r->intern.buckets)
+			return nvme_tree_strdup(r, str);
+		for (i = 0; i < NVME_INTERN_BUCKETS; i++)
+			list_head_init(&r->intern.buckets[i]);
+		r->intern.nr_buckets = NVME_INTERN_BUCKETS;
+	}
+
+	bucket = &r->intern.buckets[nvme_index_strhash(2166136261U, str) %
+				    r->intern.nr_buckets];
+	list_for_each(bucket, e, entry)
+		if (!strcmp(e->str, str))
+			return e->str;
+
+	len = strlen(str) + 1;
+	e = nvme_arena_alloc(r, sizeof(*e) + len);
+	if (!e)
+		/* not shared, but still a valid construction-time copy */
+		return nvme_tree_strdup(r, str);
+	memcpy(e->str, str, len);
+	list_add(bucket, &e->entry);
+	return e->str;
 }
 
-int nvme_dump_tree(nvme_root_t r)
+/*
+ * Accessors that populate a cache on first use run on read-side paths,
+ * so readers holding only the read lock (see nvme_root_read_lock())
+ * may race to fill the same cache. One process-wide mutex makes those
+ * first-use fills safe: string attributes are read outside the mutex
+ * and committed under it, while namespace utilization probing, which
+ * may issue an Identify command, is serialized wholesale.
+ */
+static pthread_mutex_t nvme_lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Tree nodes keep an O_PATH fd on their sysfs directory so attribute
+ * reads resolve relative to it with openat() instead of re-walking the
+ * full path for every attribute.
+ *
+ * The cached fds share the process fd pool with scandir() and device
+ * handles, so they are capped at half the soft RLIMIT_NOFILE; beyond
+ * that, huge topologies degrade to path-based attribute reads instead
+ * of starving the scan of fds.
+ */
+static unsigned int nvme_sysfs_fd_count;
+static unsigned int nvme_sysfs_fd_max;
+
+static int nvme_sysfs_dirfd(int *fdp, const char *dir)
 {
-	return json_dump_tree(r);
+	int fd;
+
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (*fdp < 0 && dir) {
+		if (!nvme_sysfs_fd_max) {
+			struct rlimit rl;
+
+			if (getrlimit(RLIMIT_NOFILE, &rl))
+				rl.rlim_cur = 1024;
+			nvme_sysfs_fd_max = rl.rlim_cur / 2;
+		}
+		if (nvme_sysfs_fd_count < nvme_sysfs_fd_max) {
+			*fdp = open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+			if (*fdp >= 0)
+				nvme_sysfs_fd_count++;
+		}
+	}
+	fd = *fdp;
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	return fd;
 }
 
-const char *nvme_root_get_application(nvme_root_t r)
+static void nvme_sysfs_dirfd_close(int *fdp)
 {
-	return r->application;
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (*fdp >= 0) {
+		close(*fdp);
+		*fdp = -1;
+		nvme_sysfs_fd_count--;
+	}
+	pthread_mutex_unlock(&nvme_lazy_lock);
 }
 
-void nvme_root_set_application(nvme_root_t r, const char *a)
+int nvme_subsystem_sysfs_fd(nvme_subsystem_t s)
 {
-	if (r->application) {
-		free(r->application);
-		r->application = NULL;
-	}
-	if (a)
-		r->application = strdup(a);
+	return nvme_sysfs_dirfd(&s->sysfs_fd, s->sysfs_dir);
 }
 
-void nvme_root_skip_namespaces(nvme_root_t r)
+int nvme_ctrl_sysfs_fd(nvme_ctrl_t c)
 {
-	r->create_only = true;
+	return nvme_sysfs_dirfd(&c->sysfs_fd, c->sysfs_dir);
 }
 
-nvme_host_t nvme_first_host(nvme_root_t r)
+int nvme_ns_sysfs_fd(nvme_ns_t n)
 {
-	return list_top(&r->hosts, struct nvme_host, entry);
+	return nvme_sysfs_dirfd(&n->sysfs_fd, n->sysfs_dir);
 }
 
-nvme_host_t nvme_next_host(nvme_root_t r, nvme_host_t h)
+int nvme_path_sysfs_fd(nvme_path_t p)
 {
-	return h ? list_next(&r->hosts, h, entry) : NULL;
+	return nvme_sysfs_dirfd(&p->sysfs_fd, p->sysfs_dir);
 }
 
-nvme_root_t nvme_host_get_root(nvme_host_t h)
+/*
+ * Device fd cache: keeps devices opened by name across calls with LRU
+ * eviction, most recently used first. Entries are dropped when the
+ * topology changes underneath them.
+ */
+#define NVME_FD_CACHE_DEFAULT 32
+
+static void nvme_fd_cache_remove(nvme_root_t r, struct nvme_fd_cache_entry *e)
 {
-	return h->r;
+	list_del(&e->entry);
+	close(e->fd);
+	free(e->name);
+	free(e);
+	r->fd_cache.nr--;
 }
 
-const char *nvme_host_get_hostnqn(nvme_host_t h)
+void nvme_root_fd_cache_clear(nvme_root_t r)
 {
-	return h->hostnqn;
+	struct nvme_fd_cache_entry *e, *_e;
+
+	list_for_each_safe(&r->fd_cache.entries, e, _e, entry)
+		nvme_fd_cache_remove(r, e);
 }
 
-const char *nvme_host_get_hostid(nvme_host_t h)
+static void nvme_fd_cache_invalidate(nvme_root_t r, const char *name)
 {
-	return h->hostid;
+	struct nvme_fd_cache_entry *e, *_e;
+
+	list_for_each_safe(&r->fd_cache.entries, e, _e, entry)
+		if (!strcmp(e->name, name))
+			nvme_fd_cache_remove(r, e);
 }
 
-const char *nvme_host_get_hostsymname(nvme_host_t h)
+static void nvme_fd_cache_shrink(nvme_root_t r)
 {
-	return h->hostsymname;
+	while (r->fd_cache.nr > r->fd_cache.cap)
+		nvme_fd_cache_remove(r, list_tail(&r->fd_cache.entries,
+						  struct nvme_fd_cache_entry,
+						  entry));
 }
 
-void nvme_host_set_hostsymname(nvme_host_t h, const char *hostsymname)
+void nvme_root_set_fd_cache_size(nvme_root_t r, unsigned int max_fds)
 {
-	if (h->hostsymname) {
-		free(h->hostsymname);
-		h->hostsymname = NULL;
-	}
-	if (hostsymname)
-		h->hostsymname = strdup(hostsymname);
+	r->fd_cache.cap = max_fds;
+	nvme_fd_cache_shrink(r);
 }
 
-const char *nvme_host_get_dhchap_key(nvme_host_t h)
+void nvme_root_set_state_ttl(nvme_root_t r, unsigned int millis)
 {
-	return h->dhchap_key;
+	r->state_ttl = millis;
 }
 
-void nvme_host_set_dhchap_key(nvme_host_t h, const char *key)
+#define nvme_counter_read(c) \
+	atomic_load_explicit((c), memory_order_relaxed)
+
+void nvme_root_get_stats(nvme_root_t r, struct nvme_root_stats *stats)
 {
-	if (h->dhchap_key) {
-		free(h->dhchap_key);
-		h->dhchap_key = NULL;
-	}
-	if (key)
-		h->dhchap_key = strdup(key);
-}
-
-void nvme_host_set_pdc_enabled(nvme_host_t h, bool enabled)
-{
-	h->pdc_enabled_valid = true;
-	h->pdc_enabled = enabled;
-}
+	struct nvme_counters *c = &r->counters;
 
-bool nvme_host_is_pdc_enabled(nvme_host_t h, bool fallback)
-{
-	if (h->pdc_enabled_valid)
-		return h->pdc_enabled;
-	return fallback;
+	stats->ioctls = nvme_counter_read(&nvme_ioctl_counters.ioctls);
+	stats->ioctl_errors =
+		nvme_counter_read(&nvme_ioctl_counters.ioctl_errors);
+	stats->bytes_transferred =
+		nvme_counter_read(&nvme_ioctl_counters.bytes_transferred);
+	stats->connect_attempts = nvme_counter_read(&c->connect_attempts);
+	stats->connect_errors = nvme_counter_read(&c->connect_errors);
+	stats->scans = nvme_counter_read(&c->scans);
+	stats->mi_submissions = nvme_counter_read(&c->mi_submissions);
+	stats->mi_errors = nvme_counter_read(&c->mi_errors);
 }
 
-nvme_subsystem_t nvme_first_subsystem(nvme_host_t h)
+void nvme_root_reset_stats(nvme_root_t r)
 {
-	return list_top(&h->subsystems, struct nvme_subsystem, entry);
-}
+	struct nvme_counters *c = &r->counters;
 
-nvme_subsystem_t nvme_next_subsystem(nvme_host_t h, nvme_subsystem_t s)
-{
-	return s ? list_next(&h->subsystems, s, entry) : NULL;
+	atomic_store_explicit(&nvme_ioctl_counters.ioctls, 0,
+			      memory_order_relaxed);
+	atomic_store_explicit(&nvme_ioctl_counters.ioctl_errors, 0,
+			      memory_order_relaxed);
+	atomic_store_explicit(&nvme_ioctl_counters.bytes_transferred, 0,
+			      memory_order_relaxed);
+	atomic_store_explicit(&c->connect_attempts, 0, memory_order_relaxed);
+	atomic_store_explicit(&c->connect_errors, 0, memory_order_relaxed);
+	atomic_store_explicit(&c->scans, 0, memory_order_relaxed);
+	atomic_store_explicit(&c->mi_submissions, 0, memory_order_relaxed);
+	atomic_store_explicit(&c->mi_errors, 0, memory_order_relaxed);
 }
 
-void nvme_refresh_topology(nvme_root_t r)
+void nvme_root_read_lock(nvme_root_t r)
 {
-	struct nvme_host *h, *_h;
-
-	nvme_for_each_host_safe(r, h, _h)
-		__nvme_free_host(h);
-	nvme_scan_topology(r, NULL, NULL);
+	pthread_rwlock_rdlock(&r->lock);
 }
 
-void nvme_free_tree(nvme_root_t r)
+void nvme_root_read_unlock(nvme_root_t r)
 {
-	struct nvme_host *h, *_h;
-
-	free(r->options);
-	nvme_for_each_host_safe(r, h, _h)
-		__nvme_free_host(h);
-	if (r->config_file)
-		free(r->config_file);
-	if (r->application)
-		free(r->application);
-	free(r);
+	pthread_rwlock_unlock(&r->lock);
 }
 
-void nvme_root_release_fds(nvme_root_t r)
+void nvme_root_write_lock(nvme_root_t r)
 {
-	struct nvme_host *h, *_h;
-
-	nvme_for_each_host_safe(r, h, _h)
-		nvme_host_release_fds(h);
+	pthread_rwlock_wrlock(&r->lock);
 }
 
-const char *nvme_subsystem_get_nqn(nvme_subsystem_t s)
+void nvme_root_write_unlock(nvme_root_t r)
 {
-	return s->subsysnqn;
+	pthread_rwlock_unlock(&r->lock);
 }
 
-const char *nvme_subsystem_get_sysfs_dir(nvme_subsystem_t s)
+int nvme_root_open(nvme_root_t r, const char *name)
 {
-	return s->sysfs_dir;
-}
+	struct nvme_fd_cache_entry *e;
+	int fd;
 
-const char *nvme_subsystem_get_name(nvme_subsystem_t s)
-{
-	return s->name;
-}
+	list_for_each(&r->fd_cache.entries, e, entry) {
+		if (!strcmp(e->name, name)) {
+			list_del(&e->entry);
+			list_add(&r->fd_cache.entries, &e->entry);
+			return e->fd;
+		}
+	}
 
-const char *nvme_subsystem_get_type(nvme_subsystem_t s)
-{
-	return s->subsystype;
-}
+	fd = nvme_open(name);
+	if (fd < 0 || !r->fd_cache.cap)
+		return fd;
 
-const char *nvme_subsystem_get_application(nvme_subsystem_t s)
-{
-	return s->application;
+	e = calloc(1, sizeof(*e));
+	if (e)
+		e->name = strdup(name);
+	if (!e || !e->name) {
+		free(e);
+		close(fd);
+		errno = ENOMEM;
+		return -1;
+	}
+	e->fd = fd;
+	list_add(&r->fd_cache.entries, &e->entry);
+	r->fd_cache.nr++;
+	nvme_fd_cache_shrink(r);
+	return fd;
 }
 
-void nvme_subsystem_set_application(nvme_subsystem_t s, const char *a)
+static void nvme_root_unindex_ctrl_name(struct nvme_ctrl *c)
 {
-	if (s->application) {
-		free(s->application);
-		s->application = NULL;
+	if (c->name_hashed) {
+		list_del(&c->name_hash_entry);
+		c->name_hashed = false;
 	}
-	if (a)
-		s->application = strdup(a);
 }
 
-const char *nvme_subsystem_get_iopolicy(nvme_subsystem_t s)
+static void nvme_root_unindex_ctrl(struct nvme_ctrl *c)
 {
-	return s->iopolicy;
+	if (c->addr_hashed) {
+		list_del(&c->addr_hash_entry);
+		c->addr_hashed = false;
+	}
+	nvme_root_unindex_ctrl_name(c);
 }
 
-nvme_ctrl_t nvme_subsystem_first_ctrl(nvme_subsystem_t s)
+static void nvme_root_index_ctrl(struct nvme_ctrl *c)
 {
-	return list_top(&s->ctrls, struct nvme_ctrl, entry);
-}
+	nvme_root_t r = root_from_ctrl(c);
+	struct nvme_ctrl_index *idx;
+	__u32 h;
 
-nvme_ctrl_t nvme_subsystem_next_ctrl(nvme_subsystem_t s, nvme_ctrl_t c)
-{
-	return c ? list_next(&s->ctrls, c, entry) : NULL;
-}
+	if (!r)
+		return;
+	idx = nvme_ctrl_index_get(r);
+	if (!idx)
+		return;
 
-nvme_host_t nvme_subsystem_get_host(nvme_subsystem_t s)
-{
-	return s->h;
+	if (!c->addr_hashed) {
+		h = nvme_ctrl_addr_hash(c->subsysnqn, c->transport,
+					c->traddr, c->trsvcid);
+		list_add(&idx->addr_buckets[h % idx->nr_buckets],
+			 &c->addr_hash_entry);
+		c->addr_hashed = true;
+	}
+	if (!c->name_hashed && c->name) {
+		h = nvme_ctrl_addr_hash(c->name, NULL, NULL, NULL);
+		list_add(&idx->name_buckets[h % idx->nr_buckets],
+			 &c->name_hash_entry);
+		c->name_hashed = true;
+	}
 }
+static char *nvme_ctrl_lookup_phy_slot(nvme_root_t r, const char *address);
+static struct nvme_ns *__nvme_scan_namespace(const char *sysfs_dir,
+					     const char *name);
+static int nvme_subsystem_link_namespace(nvme_root_t r, nvme_subsystem_t s,
+		struct nvme_ns *n, nvme_scan_filter_t f, void *f_args);
+static int nvme_ctrl_link_namespace(nvme_root_t r, struct nvme_ctrl *c,
+				    struct nvme_ns *n);
 
-nvme_ns_t nvme_subsystem_first_ns(nvme_subsystem_t s)
+/**
+ * Compare two C strings and handle NULL pointers gracefully.
+ * Return true if both pointers are equal (including both set to NULL).
+ * Return false if one and only one of the two pointers is NULL.
+ * Perform string comparisong only if both pointers are not NULL and
+ * return true if both strings are the same, false otherwise.
+ */
+static bool streq0(const char *s1, const char *s2)
 {
-	return list_top(&s->namespaces, struct nvme_ns, entry);
+	if (s1 == s2)
+		return true;
+	if (!s1 || !s2)
+		return false;
+	return !strcmp(s1, s2);
 }
 
-nvme_ns_t nvme_subsystem_next_ns(nvme_subsystem_t s, nvme_ns_t n)
+/**
+ * Same as streq0() but ignore the case of the characters.
+ */
+static bool streqcase0(const char *s1, const char *s2)
 {
-	return n ? list_next(&s->namespaces, n, entry) : NULL;
+	if (s1 == s2)
+		return true;
+	if (!s1 || !s2)
+		return false;
+	return !strcasecmp(s1, s2);
 }
 
-nvme_path_t nvme_namespace_first_path(nvme_ns_t ns)
-{
-	return list_top(&ns->paths, struct nvme_path, nentry);
-}
+struct dirents {
+	struct dirent **ents;
+	int num;
+};
 
-nvme_path_t nvme_namespace_next_path(nvme_ns_t ns, nvme_path_t p)
+static void cleanup_dirents(struct dirents *ents)
 {
-	return p ? list_next(&ns->paths, p, nentry) : NULL;
+	while (ents->num > 0)
+		free(ents->ents[--ents->num]);
+	free(ents->ents);
 }
 
-static void __nvme_free_ns(struct nvme_ns *n)
-{
-	list_del_init(&n->entry);
-	nvme_ns_release_fd(n);
-	free(n->generic_name);
-	free(n->name);
-	free(n->sysfs_dir);
-	free(n);
-}
+#define _cleanup_dirents_ __cleanup__(cleanup_dirents)
 
-/* Stub for SWIG */
-void nvme_free_ns(struct nvme_ns *n)
+nvme_host_t nvme_default_host(nvme_root_t r)
 {
-	__nvme_free_ns(n);
-}
+	struct nvme_host *h;
+	_cleanup_free_ char *hostnqn = NULL;
+	_cleanup_free_ char *hostid = NULL;
 
-static void __nvme_free_subsystem(struct nvme_subsystem *s)
-{
-	struct nvme_ctrl *c, *_c;
-	struct nvme_ns *n, *_n;
+	hostnqn = nvmf_hostnqn_from_file();
+	if (!hostnqn)
+		hostnqn = nvmf_hostnqn_generate();
+	hostid = nvmf_hostid_from_file();
 
-	list_del_init(&s->entry);
-	nvme_subsystem_for_each_ctrl_safe(s, c, _c)
-		__nvme_free_ctrl(c);
+	h = nvme_lookup_host(r, hostnqn, hostid);
 
-	nvme_subsystem_for_each_ns_safe(s, n, _n)
-		__nvme_free_ns(n);
+	nvme_host_set_hostsymname(h, NULL);
 
-	if (s->name)
-		free(s->name);
-	free(s->sysfs_dir);
-	free(s->subsysnqn);
-	if (s->model)
-		free(s->model);
-	if (s->serial)
-		free(s->serial);
-	if (s->firmware)
-		free(s->firmware);
-	if (s->subsystype)
-		free(s->subsystype);
-	if (s->application)
-		free(s->application);
-	if (s->iopolicy)
-		free(s->iopolicy);
-	free(s);
+	default_host = h;
+	return h;
 }
 
-void nvme_subsystem_release_fds(struct nvme_subsystem *s)
+void nvme_root_set_scan_match(nvme_root_t r, const char *subsys_name,
+			      const char *nqn_prefix, const char *transport)
 {
-	struct nvme_ctrl *c, *_c;
-	struct nvme_ns *n, *_n;
+	nvme_root_fd_cache_clear(r);
+	nvme_root_resolv_cache_clear(r);
+	free(r->scan_match.subsys_name);
+	free(r->scan_match.nqn_prefix);
+	free(r->scan_match.transport);
+	r->scan_match.subsys_name = subsys_name ? strdup(subsys_name) : NULL;
+	r->scan_match.nqn_prefix = nqn_prefix ? strdup(nqn_prefix) : NULL;
+	r->scan_match.transport = transport ? strdup(transport) : NULL;
+}
 
-	nvme_subsystem_for_each_ctrl_safe(s, c, _c)
-		nvme_ctrl_release_fd(c);
+static bool nvme_scan_match_transport(const char *ctrl_path,
+				      const char *transport)
+{
+	_cleanup_free_ char *t = NULL;
 
-	nvme_subsystem_for_each_ns_safe(s, n, _n)
-		nvme_ns_release_fd(n);
+	t = nvme_get_attr(ctrl_path, "transport");
+	return t && !strcmp(t, transport);
 }
 
 /*
- * Stub for SWIG
+ * Pre-scan predicates: decide from a single attribute read whether a
+ * sysfs entry can match the configured criteria, before the full scan
+ * descends into it.
  */
-void nvme_free_subsystem(nvme_subsystem_t s)
+static bool nvme_scan_match_ctrl(nvme_root_t r, const char *name)
 {
+	_cleanup_free_ char *path = NULL;
+
+	if (r->scan_match.transport) {
+		if (asprintf(&path, "%s/%s", nvme_ctrl_sysfs_dir(), name) < 0)
+			return true;
+		if (!nvme_scan_match_transport(path, r->scan_match.transport))
+			return false;
+	}
+	if (r->scan_match.subsys_name) {
+		_cleanup_free_ char *subsys = NULL;
+
+		subsys = nvme_ctrl_lookup_subsystem_name(r, name);
+		if (!subsys || strcmp(subsys, r->scan_match.subsys_name))
+			return false;
+	}
+	return true;
 }
 
-struct nvme_subsystem *nvme_alloc_subsystem(struct nvme_host *h,
-					    const char *name,
-					    const char *subsysnqn)
+static bool nvme_scan_match_subsys(nvme_root_t r, const char *name)
 {
-	struct nvme_subsystem *s;
+	_cleanup_free_ char *path = NULL;
 
-	s = calloc(1, sizeof(*s));
-	if (!s)
-		return NULL;
+	if (r->scan_match.subsys_name &&
+	    strcmp(r->scan_match.subsys_name, name))
+		return false;
 
-	s->h = h;
-	s->subsysnqn = strdup(subsysnqn);
-	if (name)
-		nvme_init_subsystem(s, name);
-	list_head_init(&s->ctrls);
-	list_head_init(&s->namespaces);
-	list_node_init(&s->entry);
-	list_add(&h->subsystems, &s->entry);
-	h->r->modified = true;
-	return s;
-}
+	if (!r->scan_match.nqn_prefix && !r->scan_match.transport)
+		return true;
 
-struct nvme_subsystem *nvme_lookup_subsystem(struct nvme_host *h,
-					     const char *name,
-					     const char *subsysnqn)
-{
-	struct nvme_subsystem *s;
+	if (asprintf(&path, "%s/%s", nvme_subsys_sysfs_dir(), name) < 0)
+		return true;
 
-	nvme_for_each_subsystem(h, s) {
-		if (subsysnqn && s->subsysnqn &&
-		    strcmp(s->subsysnqn, subsysnqn))
-			continue;
-		if (name && s->name &&
-		    strcmp(s->name, name))
-			continue;
-		if (h->r->application) {
-			if (!s->application)
+	if (r->scan_match.nqn_prefix) {
+		_cleanup_free_ char *subsysnqn = NULL;
+
+		subsysnqn = nvme_get_attr(path, "subsysnqn");
+		if (!subsysnqn ||
+		    strncmp(subsysnqn, r->scan_match.nqn_prefix,
+			    strlen(r->scan_match.nqn_prefix)))
+			return false;
+	}
+
+	if (r->scan_match.transport) {
+		_cleanup_dirents_ struct dirents ents = {};
+		bool found = false;
+		int i;
+
+		/* any controller link with a matching transport will do */
+		ents.num = scandir(path, &ents.ents, NULL, alphasort);
+		if (ents.num < 0)
+			return true;
+		for (i = 0; i < ents.num && !found; i++) {
+			_cleanup_free_ char *ctrl_path = NULL;
+			int inst;
+			char dummy;
+
+			if (sscanf(ents.ents[i]->d_name, "nvme%d%c",
+				   &inst, &dummy) != 1)
 				continue;
-			if (strcmp(h->r->application, s->application))
+			if (asprintf(&ctrl_path, "%s/%s", path,
+				     ents.ents[i]->d_name) < 0)
 				continue;
+			found = nvme_scan_match_transport(ctrl_path,
+						r->scan_match.transport);
 		}
-		return s;
+		if (!found)
+			return false;
 	}
-	return nvme_alloc_subsystem(h, name, subsysnqn);
+	return true;
 }
 
-static void __nvme_free_host(struct nvme_host *h)
+int nvme_scan_topology(struct nvme_root *r, nvme_scan_filter_t f, void *f_args)
 {
-	struct nvme_subsystem *s, *_s;
-
-	list_del_init(&h->entry);
-	nvme_for_each_subsystem_safe(h, s, _s)
-		__nvme_free_subsystem(s);
-	free(h->hostnqn);
-	if (h->hostid)
-		free(h->hostid);
-	if (h->dhchap_key)
-		free(h->dhchap_key);
-	nvme_host_set_hostsymname(h, NULL);
-	h->r->modified = true;
-	free(h);
-}
+	_cleanup_dirents_ struct dirents subsys = {}, ctrls = {};
+	int i, ret;
 
-void nvme_host_release_fds(struct nvme_host *h)
-{
-	struct nvme_subsystem *s, *_s;
+	if (!r)
+		return 0;
 
-	nvme_for_each_subsystem_safe(h, s, _s)
-		nvme_subsystem_release_fds(s);
-}
+	nvme_count(&r->counters.scans);
 
-/* Stub for SWIG */
-void nvme_free_host(struct nvme_host *h)
-{
-	__nvme_free_host(h);
-}
+	ctrls.num = nvme_scan_ctrls(&ctrls.ents);
+	if (ctrls.num < 0) {
+		nvme_msg(r, LOG_DEBUG, "failed to scan ctrls: %s\n",
+			 strerror(errno));
+		return ctrls.num;
+	}
 
-struct nvme_host *nvme_lookup_host(nvme_root_t r, const char *hostnqn,
-				   const char *hostid)
-{
-	struct nvme_host *h;
+	for (i = 0; i < ctrls.num; i++) {
+		nvme_ctrl_t c;
 
-	if (!hostnqn)
-		return NULL;
-	nvme_for_each_host(r, h) {
-		if (strcmp(h->hostnqn, hostnqn))
+		if (!nvme_scan_match_ctrl(r, ctrls.ents[i]->d_name)) {
+			nvme_msg(r, LOG_DEBUG, "skipping controller %s\n",
+				 ctrls.ents[i]->d_name);
 			continue;
-		if (hostid && (!h->hostid ||
-		    strcmp(h->hostid, hostid)))
+		}
+		c = nvme_scan_ctrl(r, ctrls.ents[i]->d_name);
+		if (!c) {
+			nvme_msg(r, LOG_DEBUG, "failed to scan ctrl %s: %s\n",
+				 ctrls.ents[i]->d_name, strerror(errno));
 			continue;
-		return h;
+		}
+		if ((f) && !f(NULL, c, NULL, f_args)) {
+			nvme_msg(r, LOG_DEBUG, "filter out controller %s\n",
+				 ctrls.ents[i]->d_name);
+			nvme_free_ctrl(c);
+		}
 	}
-	h = calloc(1,sizeof(*h));
-	if (!h)
-		return NULL;
-	h->hostnqn = strdup(hostnqn);
-	if (hostid)
-		h->hostid = strdup(hostid);
-	list_head_init(&h->subsystems);
-	list_node_init(&h->entry);
-	h->r = r;
-	list_add(&r->hosts, &h->entry);
-	r->modified = true;
-
-	return h;
-}
-
-static int nvme_subsystem_scan_namespaces(nvme_root_t r, nvme_subsystem_t s,
-		nvme_scan_filter_t f, void *f_args)
-{
-	_cleanup_dirents_ struct dirents namespaces = {};
-	int i, ret;
 
-	if (r->create_only) {
-		nvme_msg(r, LOG_DEBUG,
-			 "skipping namespace scan for subsys %s\n",
-			 s->subsysnqn);
-		return 0;
-	}
-	namespaces.num = nvme_scan_subsystem_namespaces(s, &namespaces.ents);
-	if (namespaces.num < 0) {
-		nvme_msg(r, LOG_DEBUG,
-			 "failed to scan namespaces for subsys %s: %s\n",
-			 s->subsysnqn, strerror(errno));
-		return namespaces.num;
+	subsys.num = nvme_scan_subsystems(&subsys.ents);
+	if (subsys.num < 0) {
+		nvme_msg(r, LOG_DEBUG, "failed to scan subsystems: %s\n",
+			 strerror(errno));
+		return subsys.num;
 	}
 
-	for (i = 0; i < namespaces.num; i++) {
-		ret = nvme_subsystem_scan_namespace(r, s,
-				namespaces.ents[i]->d_name, f, f_args);
-		if (ret < 0)
+	for (i = 0; i < subsys.num; i++) {
+		if (!nvme_scan_match_subsys(r, subsys.ents[i]->d_name)) {
+			nvme_msg(r, LOG_DEBUG, "skipping subsystem %s\n",
+				 subsys.ents[i]->d_name);
+			continue;
+		}
+		ret = nvme_scan_subsystem(
+			r, subsys.ents[i]->d_name, f, f_args);
+		if (ret < 0) {
 			nvme_msg(r, LOG_DEBUG,
-				 "failed to scan namespace %s: %s\n",
-				 namespaces.ents[i]->d_name, strerror(errno));
+				 "failed to scan subsystem %s: %s\n",
+				 subsys.ents[i]->d_name, strerror(errno));
+		}
 	}
 
 	return 0;
 }
 
-static int nvme_init_subsystem(nvme_subsystem_t s, const char *name)
+nvme_root_t nvme_create_root(FILE *fp, int log_level)
 {
-	char *path;
+	struct nvme_root *r;
+	int fd;
 
-	if (asprintf(&path, "%s/%s", nvme_subsys_sysfs_dir(), name) < 0)
-		return -1;
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		errno = ENOMEM;
+		return NULL;
+	}
 
-	s->model = nvme_get_attr(path, "model");
-	if (!s->model)
-		s->model = strdup("undefined");
-	s->serial = nvme_get_attr(path, "serial");
-	s->firmware = nvme_get_attr(path, "firmware_rev");
-	s->subsystype = nvme_get_attr(path, "subsystype");
-	if (!s->subsystype) {
-		if (!strcmp(s->subsysnqn, NVME_DISC_SUBSYS_NAME))
-			s->subsystype = strdup("discovery");
-		else
-			s->subsystype = strdup("nvm");
-	}
-	s->name = strdup(name);
-	s->sysfs_dir = (char *)path;
-	if (s->h->r->application)
-		s->application = strdup(s->h->r->application);
-	s->iopolicy = nvme_get_attr(path, "iopolicy");
+	if (fp) {
+		fd = fileno(fp);
+		if (fd < 0) {
+			free(r);
+			return NULL;
+		}
+	} else
+		fd = STDERR_FILENO;
 
-	return 0;
-}
+	r->log.fd = fd;
+	r->log.level = log_level;
 
-static bool __nvme_scan_subsystem(struct nvme_root *r, nvme_subsystem_t s,
-				  nvme_scan_filter_t f, void *f_args)
-{
-	if (f && !f(s, NULL, NULL, f_args)) {
-		nvme_msg(r, LOG_DEBUG, "filter out subsystem %s\n", s->name);
-		__nvme_free_subsystem(s);
-		return false;
-	}
-	nvme_subsystem_scan_namespaces(r, s, f, f_args);
-	return true;
+	list_head_init(&r->hosts);
+	list_head_init(&r->endpoints);
+	list_head_init(&r->fd_cache.entries);
+	r->fd_cache.cap = NVME_FD_CACHE_DEFAULT;
+	list_head_init(&r->resolv_cache.entries);
+	r->resolv_cache.ttl = NVME_RESOLV_TTL_DEFAULT;
+	r->state_ttl = NVME_STATE_TTL_DEFAULT;
+	pthread_rwlock_init(&r->lock, NULL);
+
+	return r;
 }
 
-static int nvme_scan_subsystem(struct nvme_root *r, const char *name,
-		nvme_scan_filter_t f, void *f_args)
+int nvme_read_config(nvme_root_t r, const char *config_file)
 {
-	struct nvme_subsystem *s = NULL, *_s;
-	_cleanup_free_ char *path = NULL, *subsysnqn = NULL;
-	nvme_host_t h = NULL;
-	int ret;
-
-	nvme_msg(r, LOG_DEBUG, "scan subsystem %s\n", name);
-	ret = asprintf(&path, "%s/%s", nvme_subsys_sysfs_dir(), name);
-	if (ret < 0)
-		return ret;
+	int err = -1;
 
-	subsysnqn = nvme_get_attr(path, "subsysnqn");
-	if (!subsysnqn) {
+	if (!r || !config_file) {
 		errno = ENODEV;
-		return -1;
-	}
-	nvme_for_each_host(r, h) {
-		nvme_for_each_subsystem(h, _s) {
-			/*
-			 * We are always called after nvme_scan_ctrl(),
-			 * so any subsystem we're interested at _must_
-			 * have a name.
-			 */
-			if (!_s->name)
-				continue;
-			if (strcmp(_s->name, name))
-				continue;
-			if (!__nvme_scan_subsystem(r, _s, f, f_args)) {
-				errno = EINVAL;
-				return -1;
-			}
-			s = _s;
-		}
+		return err;
 	}
-	if (!s) {
-		/*
-		 * Subsystem with non-matching controller. odd.
-		 * Create a subsystem with the default host
-		 * and hope for the best.
-		 */
-		nvme_msg(r, LOG_DEBUG, "creating detached subsystem '%s'\n",
-			 name);
-		h = nvme_default_host(r);
-		s = nvme_alloc_subsystem(h, name, subsysnqn);
-		if (!s) {
-			errno = ENOMEM;
-			return -1;
-		}
-		if (!__nvme_scan_subsystem(r, s, f, f_args)) {
-			errno = EINVAL;
-			return -1;
-		}
-	} else if (strcmp(s->subsysnqn, subsysnqn)) {
-		nvme_msg(r, LOG_DEBUG, "NQN mismatch for subsystem '%s'\n",
-			 name);
-		errno = EINVAL;
-		return -1;
+
+	r->config_file = strdup(config_file);
+	if (!r->config_file) {
+		errno = ENOMEM;
+		return err;
 	}
+	if (nvme_config_is_binary(config_file))
+		err = nvme_bincfg_read_config(r, config_file);
+	else
+		err = json_read_config(r, config_file);
+	/*
+	 * The json configuration file is optional,
+	 * so ignore errors when opening the file.
+	 */
+	if (err < 0 && errno != EPROTO)
+		err = 0;
 
-	return 0;
+	return err;
 }
 
-nvme_ctrl_t nvme_path_get_ctrl(nvme_path_t p)
+nvme_root_t nvme_scan(const char *config_file)
 {
-	return p->c;
+	nvme_root_t r = nvme_create_root(NULL, DEFAULT_LOGLEVEL);
+
+	nvme_scan_topology(r, NULL, NULL);
+	nvme_read_config(r, config_file);
+	return r;
 }
 
-nvme_ns_t nvme_path_get_ns(nvme_path_t p)
+int nvme_update_config(nvme_root_t r)
 {
-	return p->n;
+	if (!r->modified || !r->config_file)
+		return 0;
+
+	if (nvme_config_is_binary(r->config_file))
+		return nvme_bincfg_update_config(r, r->config_file);
+	return json_update_config(r, r->config_file);
 }
 
-const char *nvme_path_get_sysfs_dir(nvme_path_t p)
+int nvme_dump_config(nvme_root_t r)
 {
-	return p->sysfs_dir;
+	return json_update_config(r, NULL);
 }
 
-const char *nvme_path_get_name(nvme_path_t p)
+int nvme_dump_tree(nvme_root_t r)
 {
-	return p->name;
+	return json_dump_tree(r);
 }
 
-const char *nvme_path_get_ana_state(nvme_path_t p)
+const char *nvme_root_get_application(nvme_root_t r)
 {
-	return p->ana_state;
+	return r->application;
 }
 
-void nvme_free_path(struct nvme_path *p)
+void nvme_root_set_application(nvme_root_t r, const char *a)
 {
-	list_del_init(&p->entry);
-	list_del_init(&p->nentry);
-	free(p->name);
-	free(p->sysfs_dir);
-	free(p->ana_state);
-	free(p);
+	if (r->application) {
+		free(r->application);
+		r->application = NULL;
+	}
+	if (a)
+		r->application = strdup(a);
 }
 
-static void nvme_subsystem_set_path_ns(nvme_subsystem_t s, nvme_path_t p)
+void nvme_root_skip_namespaces(nvme_root_t r)
 {
-	char n_name[32] = { };
-	int i, c, nsid, ret;
-	nvme_ns_t n;
-
-	ret = sscanf(nvme_path_get_name(p), "nvme%dc%dn%d", &i, &c, &nsid);
-	if (ret != 3)
-		return;
+	r->create_only = true;
+}
 
-	sprintf(n_name, "nvme%dn%d", i, nsid);
-	nvme_subsystem_for_each_ns(s, n) {
-		if (!strcmp(n_name, nvme_ns_get_name(n))) {
-			list_add(&n->paths, &p->nentry);
-			p->n = n;
-		}
-	}
+void nvme_root_set_scan_threads(nvme_root_t r, unsigned int threads)
+{
+	r->scan_threads = threads;
 }
 
-static int nvme_ctrl_scan_path(nvme_root_t r, struct nvme_ctrl *c, char *name)
+void nvme_root_set_bulk_scan(nvme_root_t r, bool enabled)
 {
-	struct nvme_path *p;
-	_cleanup_free_ char *path = NULL, *grpid = NULL;
-	int ret;
+	r->bulk_scan = enabled;
+}
 
-	nvme_msg(r, LOG_DEBUG, "scan controller %s path %s\n",
-		 c->name, name);
-	if (!c->s) {
-		errno = ENXIO;
-		return -1;
-	}
-	ret = asprintf(&path, "%s/%s", c->sysfs_dir, name);
-	if (ret < 0) {
-		errno = ENOMEM;
-		return -1;
-	}
+struct nvme_ns_scan_queue {
+	const char *sysfs_dir;
+	struct dirent **ents;
+	struct nvme_ns **namespaces;
+	int num;
+	int next;
+	pthread_mutex_t lock;
+};
 
-	p = calloc(1, sizeof(*p));
-	if (!p) {
-		errno = ENOMEM;
-		return -1;
-	}
+static void *nvme_ns_scan_worker(void *arg)
+{
+	struct nvme_ns_scan_queue *queue = arg;
 
-	p->c = c;
-	p->name = strdup(name);
-	p->sysfs_dir = path;
-	path = NULL;
-	p->ana_state = nvme_get_path_attr(p, "ana_state");
-	if (!p->ana_state)
-		p->ana_state = strdup("optimized");
+	for (;;) {
+		int i;
 
-	grpid = nvme_get_path_attr(p, "ana_grpid");
-	if (grpid) {
-		sscanf(grpid, "%d", &p->grpid);
+		pthread_mutex_lock(&queue->lock);
+		i = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+		if (i >= queue->num)
+			break;
+		queue->namespaces[i] =
+			__nvme_scan_namespace(queue->sysfs_dir,
+					      queue->ents[i]->d_name);
 	}
-
-	list_node_init(&p->nentry);
-	nvme_subsystem_set_path_ns(c->s, p);
-	list_node_init(&p->entry);
-	list_add(&c->paths, &p->entry);
-	return 0;
+	return NULL;
 }
 
-int nvme_ctrl_get_fd(nvme_ctrl_t c)
+/*
+ * Open all namespaces below @sysfs_dir concurrently. The returned array
+ * parallels @ents; entries which failed to open are NULL. Only the sysfs
+ * attribute reads run on the worker threads, linking the opened objects
+ * into the tree is left to the calling thread.
+ */
+static struct nvme_ns **nvme_open_namespaces_threaded(nvme_root_t r,
+		const char *sysfs_dir, struct dirents *ents)
 {
-	if (c->fd < 0) {
-		c->fd = nvme_open(c->name);
-		if (c->fd < 0)
-			nvme_msg(root_from_ctrl(c), LOG_ERR,
-				 "Failed to open ctrl %s, errno %d\n",
-				 c->name, errno);
+	struct nvme_ns_scan_queue queue = {
+		.sysfs_dir = sysfs_dir,
+		.ents = ents->ents,
+		.num = ents->num,
+	};
+	_cleanup_free_ pthread_t *workers = NULL;
+	unsigned int nr_workers, nr_started = 0, i;
+
+	queue.namespaces = calloc(ents->num, sizeof(*queue.namespaces));
+	if (!queue.namespaces)
+		return NULL;
+
+	nr_workers = r->scan_threads;
+	if (nr_workers > (unsigned int)ents->num)
+		nr_workers = ents->num;
+
+	pthread_mutex_init(&queue.lock, NULL);
+	/* The calling thread acts as one of the workers */
+	workers = calloc(nr_workers - 1, sizeof(*workers));
+	if (workers) {
+		for (i = 0; i < nr_workers - 1; i++) {
+			if (pthread_create(&workers[i], NULL,
+					   nvme_ns_scan_worker, &queue))
+				break;
+			nr_started++;
+		}
 	}
-	return c->fd;
+	nvme_ns_scan_worker(&queue);
+	for (i = 0; i < nr_started; i++)
+		pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&queue.lock);
+
+	return queue.namespaces;
 }
 
-void nvme_ctrl_release_fd(nvme_ctrl_t c)
+nvme_host_t nvme_first_host(nvme_root_t r)
 {
-	if (c->fd < 0)
-		return;
-
-	close(c->fd);
-	c->fd = -1;
+	return list_top(&r->hosts, struct nvme_host, entry);
 }
 
-nvme_subsystem_t nvme_ctrl_get_subsystem(nvme_ctrl_t c)
+nvme_host_t nvme_next_host(nvme_root_t r, nvme_host_t h)
 {
-	return c->s;
+	return h ? list_next(&r->hosts, h, entry) : NULL;
 }
 
-const char *nvme_ctrl_get_name(nvme_ctrl_t c)
+nvme_root_t nvme_host_get_root(nvme_host_t h)
 {
-	return c->name;
+	return h->r;
 }
 
-const char *nvme_ctrl_get_sysfs_dir(nvme_ctrl_t c)
+const char *nvme_host_get_hostnqn(nvme_host_t h)
 {
-	return c->sysfs_dir;
+	return h->hostnqn;
 }
 
-const char *nvme_ctrl_get_subsysnqn(nvme_ctrl_t c)
+const char *nvme_host_get_hostid(nvme_host_t h)
 {
-	return c->s ? c->s->subsysnqn : c->subsysnqn;
+	return h->hostid;
 }
 
-const char *nvme_ctrl_get_address(nvme_ctrl_t c)
+const char *nvme_host_get_hostsymname(nvme_host_t h)
 {
-	return c->address ? c->address : "";
+	return h->hostsymname;
 }
 
-char *nvme_ctrl_get_src_addr(nvme_ctrl_t c, char *src_addr, size_t src_addr_len)
+void nvme_host_set_hostsymname(nvme_host_t h, const char *hostsymname)
 {
-	size_t l;
-	char *p;
-
-	if (!c->address)
-		return NULL;
+	if (h->hostsymname) {
+		free(h->hostsymname);
+		h->hostsymname = NULL;
+	}
+	if (hostsymname)
+		h->hostsymname = strdup(hostsymname);
+}
 
-	p = strstr(c->address, "src_addr=");
-	if (!p)
-		return NULL;
+const char *nvme_host_get_dhchap_key(nvme_host_t h)
+{
+	return h->dhchap_key;
+}
 
-	p += strlen("src_addr=");
-	l = strcspn(p, ",%"); /* % to eliminate IPv6 scope (if present) */
-	if (l >= src_addr_len) {
-		nvme_msg(root_from_ctrl(c), LOG_ERR,
-			 "Buffer for src_addr is too small (%zu must be > %zu)\n",
-			 src_addr_len, l);
-		return NULL;
+void nvme_host_set_dhchap_key(nvme_host_t h, const char *key)
+{
+	if (h->dhchap_key) {
+		free(h->dhchap_key);
+		h->dhchap_key = NULL;
 	}
+	if (key)
+		h->dhchap_key = strdup(key);
+}
 
-	strncpy(src_addr, p, l);
-	src_addr[l] = '\0';
-	return src_addr;
+void nvme_host_set_pdc_enabled(nvme_host_t h, bool enabled)
+{
+	h->pdc_enabled_valid = true;
+	h->pdc_enabled = enabled;
 }
 
-const char *nvme_ctrl_get_phy_slot(nvme_ctrl_t c)
+bool nvme_host_is_pdc_enabled(nvme_host_t h, bool fallback)
 {
-	return c->phy_slot ? c->phy_slot : "";
+	if (h->pdc_enabled_valid)
+		return h->pdc_enabled;
+	return fallback;
 }
 
-const char *nvme_ctrl_get_firmware(nvme_ctrl_t c)
+nvme_subsystem_t nvme_first_subsystem(nvme_host_t h)
 {
-	return c->firmware;
+	return list_top(&h->subsystems, struct nvme_subsystem, entry);
 }
 
-const char *nvme_ctrl_get_model(nvme_ctrl_t c)
+nvme_subsystem_t nvme_next_subsystem(nvme_host_t h, nvme_subsystem_t s)
 {
-	return c->model;
+	return s ? list_next(&h->subsystems, s, entry) : NULL;
 }
 
-const char *nvme_ctrl_get_state(nvme_ctrl_t c)
+void nvme_refresh_topology(nvme_root_t r)
 {
-	char *state = c->state;
+	struct nvme_host *h, *_h;
 
-	c->state = nvme_get_ctrl_attr(c, "state");
-	if (state)
-		free(state);
-	return c->state;
+	nvme_root_fd_cache_clear(r);
+	nvme_for_each_host_safe(r, h, _h)
+		__nvme_free_host(h);
+	nvme_scan_topology(r, NULL, NULL);
 }
 
-const char *nvme_ctrl_get_numa_node(nvme_ctrl_t c)
+static nvme_ctrl_t nvme_tree_find_ctrl(nvme_root_t r, const char *name)
 {
-	return c->numa_node;
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+
+	if (r->ctrl_index.nr_buckets) {
+		__u32 hash = nvme_ctrl_addr_hash(name, NULL, NULL, NULL);
+		struct list_head *bucket =
+			&r->ctrl_index.name_buckets[hash %
+						    r->ctrl_index.nr_buckets];
+
+		list_for_each(bucket, c, name_hash_entry)
+			if (c->name && !strcmp(c->name, name))
+				return c;
+	}
+
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, s)
+			nvme_subsystem_for_each_ctrl(s, c)
+				if (c->name && !strcmp(c->name, name))
+					return c;
+	return NULL;
 }
 
-const char *nvme_ctrl_get_queue_count(nvme_ctrl_t c)
+static void nvme_tree_remove_namespace(nvme_root_t r, const char *name)
 {
-	return c->queue_count;
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	struct nvme_ns *n, *_n;
+
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			nvme_subsystem_for_each_ns_safe(s, n, _n)
+				if (!strcmp(n->name, name))
+					__nvme_free_ns(n);
+			nvme_subsystem_for_each_ctrl(s, c) {
+				nvme_ctrl_for_each_ns_safe(c, n, _n)
+					if (!strcmp(n->name, name))
+						__nvme_free_ns(n);
+			}
+		}
+	}
 }
 
-const char *nvme_ctrl_get_serial(nvme_ctrl_t c)
+static int nvme_tree_update_namespace(nvme_root_t r, const char *name)
 {
-	return c->serial;
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	struct stat st;
+	int found = 0;
+
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			_cleanup_free_ char *path = NULL;
+
+			if (asprintf(&path, "%s/%s", s->sysfs_dir, name) < 0)
+				return -1;
+			if (stat(path, &st) == 0) {
+				nvme_subsystem_scan_namespace(r, s,
+						(char *)name, NULL, NULL);
+				found++;
+			}
+			nvme_subsystem_for_each_ctrl(s, c) {
+				_cleanup_free_ char *cpath = NULL;
+
+				if (asprintf(&cpath, "%s/%s",
+					     c->sysfs_dir, name) < 0)
+					return -1;
+				if (stat(cpath, &st) == 0) {
+					nvme_ctrl_scan_namespace(r, c,
+							(char *)name);
+					found++;
+				}
+			}
+		}
+	}
+	if (!found) {
+		errno = ENODEV;
+		return -1;
+	}
+	return 0;
 }
 
-const char *nvme_ctrl_get_sqsize(nvme_ctrl_t c)
+static int nvme_tree_update_path(nvme_root_t r, const char *name)
 {
-	return c->sqsize;
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	nvme_path_t p;
+	struct stat st;
+
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, s) {
+			nvme_subsystem_for_each_ctrl(s, c) {
+				_cleanup_free_ char *path = NULL;
+
+				nvme_ctrl_for_each_path(c, p)
+					if (!strcmp(p->name, name))
+						return 0;
+				if (asprintf(&path, "%s/%s",
+					     c->sysfs_dir, name) < 0)
+					return -1;
+				if (stat(path, &st) == 0)
+					return nvme_ctrl_scan_path(r, c,
+							(char *)name);
+			}
+		}
+	}
+	errno = ENODEV;
+	return -1;
 }
 
-const char *nvme_ctrl_get_transport(nvme_ctrl_t c)
+static void nvme_tree_remove_path(nvme_root_t r, const char *name)
 {
-	return c->transport;
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	struct nvme_path *p, *_p;
+
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, s)
+			nvme_subsystem_for_each_ctrl(s, c)
+				nvme_ctrl_for_each_path_safe(c, p, _p)
+					if (!strcmp(p->name, name))
+						nvme_free_path(p);
 }
 
-const char *nvme_ctrl_get_traddr(nvme_ctrl_t c)
+int nvme_topology_apply_event(nvme_root_t r, const char *action,
+			      const char *name)
 {
-	return c->traddr;
+	int i, c, n;
+	bool add;
+
+	if (!r || !action || !name) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!strcmp(action, "add") || !strcmp(action, "change") ||
+	    !strcmp(action, "bind"))
+		add = true;
+	else if (!strcmp(action, "remove"))
+		add = false;
+	else {
+		errno = EINVAL;
+		return -1;
+	}
+
+	nvme_msg(r, LOG_DEBUG, "apply event %s %s\n", action, name);
+
+	if (!add)
+		nvme_fd_cache_invalidate(r, name);
+
+	if (sscanf(name, "nvme%dc%dn%d", &i, &c, &n) == 3) {
+		if (!add) {
+			nvme_tree_remove_path(r, name);
+			return 0;
+		}
+		return nvme_tree_update_path(r, name);
+	}
+	if (sscanf(name, "nvme%dn%d", &i, &n) == 2) {
+		if (!add) {
+			nvme_tree_remove_namespace(r, name);
+			return 0;
+		}
+		return nvme_tree_update_namespace(r, name);
+	}
+	if (sscanf(name, "nvme%d", &i) == 1) {
+		nvme_ctrl_t ctrl = nvme_tree_find_ctrl(r, name);
+
+		if (!add) {
+			if (ctrl)
+				__nvme_free_ctrl(ctrl);
+			return 0;
+		}
+		if (ctrl) {
+			/* the event may reflect a state transition */
+			ctrl->state_expires = 0;
+			nvme_rescan_ctrl(ctrl);
+			return 0;
+		}
+		if (!nvme_scan_ctrl(r, name))
+			return -1;
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
 }
 
-const char *nvme_ctrl_get_trsvcid(nvme_ctrl_t c)
+void nvme_free_tree(nvme_root_t r)
 {
-	return c->trsvcid;
+	struct nvme_host *h, *_h;
+
+	nvme_stop_async_logging(r);
+	free(r->options);
+	nvme_for_each_host_safe(r, h, _h)
+		__nvme_free_host(h);
+	if (r->config_file)
+		free(r->config_file);
+	if (r->application)
+		free(r->application);
+	nvme_root_fd_cache_clear(r);
+	nvme_root_resolv_cache_clear(r);
+	free(r->mi_probe_cache);
+	free(r->scan_match.subsys_name);
+	free(r->scan_match.nqn_prefix);
+	free(r->scan_match.transport);
+	nvme_ctrl_index_free(&r->ctrl_index);
+	free(r->intern.buckets);
+	nvme_iter_cache_clear(r);
+	nvme_buf_pool_free(r->buf_pool);
+	pthread_rwlock_destroy(&r->lock);
+	nvme_arena_free(r);
+	free(r);
 }
 
-const char *nvme_ctrl_get_host_traddr(nvme_ctrl_t c)
+nvme_buf_pool_t nvme_root_get_buf_pool(nvme_root_t r)
 {
-	return c->cfg.host_traddr;
+	if (!r->buf_pool)
+		r->buf_pool = nvme_buf_pool_create(0);
+	return r->buf_pool;
 }
 
-const char *nvme_ctrl_get_host_iface(nvme_ctrl_t c)
+void nvme_root_set_buf_pool(nvme_root_t r, nvme_buf_pool_t pool)
 {
-	return c->cfg.host_iface;
+	nvme_buf_pool_free(r->buf_pool);
+	r->buf_pool = pool;
 }
 
-struct nvme_fabrics_config *nvme_ctrl_get_config(nvme_ctrl_t c)
+void nvme_root_release_fds(nvme_root_t r)
 {
-	return &c->cfg;
+	struct nvme_host *h, *_h;
+
+	nvme_root_fd_cache_clear(r);
+	nvme_for_each_host_safe(r, h, _h)
+		nvme_host_release_fds(h);
 }
 
-const char *nvme_ctrl_get_dhchap_host_key(nvme_ctrl_t c)
+const char *nvme_subsystem_get_nqn(nvme_subsystem_t s)
 {
-	return c->dhchap_key;
+	return s->subsysnqn;
 }
 
-const char *nvme_ctrl_get_cntlid(nvme_ctrl_t c)
+const char *nvme_subsystem_get_sysfs_dir(nvme_subsystem_t s)
 {
-	return c->cntlid;
+	return s->sysfs_dir;
 }
 
-void nvme_ctrl_set_dhchap_host_key(nvme_ctrl_t c, const char *key)
+const char *nvme_subsystem_get_name(nvme_subsystem_t s)
 {
-	if (c->dhchap_key) {
-		free(c->dhchap_key);
-		c->dhchap_key = NULL;
-	}
-	if (key)
-		c->dhchap_key = strdup(key);
+	return s->name;
 }
 
-const char *nvme_ctrl_get_dhchap_key(nvme_ctrl_t c)
+const char *nvme_subsystem_get_type(nvme_subsystem_t s)
 {
-	return c->dhchap_ctrl_key;
+	return s->subsystype;
 }
 
-void nvme_ctrl_set_dhchap_key(nvme_ctrl_t c, const char *key)
+const char *nvme_subsystem_get_application(nvme_subsystem_t s)
 {
-	if (c->dhchap_ctrl_key) {
-		free(c->dhchap_ctrl_key);
-		c->dhchap_ctrl_key = NULL;
-	}
-	if (key)
-		c->dhchap_ctrl_key = strdup(key);
+	return s->application;
 }
 
-void nvme_ctrl_set_discovered(nvme_ctrl_t c, bool discovered)
+void nvme_subsystem_set_application(nvme_subsystem_t s, const char *a)
 {
-	c->discovered = discovered;
+	if (s->application) {
+		free(s->application);
+		s->application = NULL;
+	}
+	if (a)
+		s->application = strdup(a);
 }
 
-bool nvme_ctrl_is_discovered(nvme_ctrl_t c)
+const char *nvme_subsystem_get_iopolicy(nvme_subsystem_t s)
 {
-	return c->discovered;
+	return s->iopolicy;
 }
 
-void nvme_ctrl_set_persistent(nvme_ctrl_t c, bool persistent)
+nvme_ctrl_t nvme_subsystem_first_ctrl(nvme_subsystem_t s)
 {
-	c->persistent = persistent;
+	return list_top(&s->ctrls, struct nvme_ctrl, entry);
 }
 
-bool nvme_ctrl_is_persistent(nvme_ctrl_t c)
+nvme_ctrl_t nvme_subsystem_next_ctrl(nvme_subsystem_t s, nvme_ctrl_t c)
 {
-	return c->persistent;
+	return c ? list_next(&s->ctrls, c, entry) : NULL;
 }
 
-void nvme_ctrl_set_discovery_ctrl(nvme_ctrl_t c, bool discovery)
+nvme_host_t nvme_subsystem_get_host(nvme_subsystem_t s)
 {
-	c->discovery_ctrl = discovery;
+	return s->h;
 }
 
-bool nvme_ctrl_is_discovery_ctrl(nvme_ctrl_t c)
+nvme_ns_t nvme_subsystem_first_ns(nvme_subsystem_t s)
 {
-	return c->discovery_ctrl;
+	return list_top(&s->namespaces, struct nvme_ns, entry);
 }
 
-void nvme_ctrl_set_unique_discovery_ctrl(nvme_ctrl_t c, bool unique)
+nvme_ns_t nvme_subsystem_next_ns(nvme_subsystem_t s, nvme_ns_t n)
 {
-	c->unique_discovery_ctrl = unique;
+	return n ? list_next(&s->namespaces, n, entry) : NULL;
 }
 
-bool nvme_ctrl_is_unique_discovery_ctrl(nvme_ctrl_t c)
+nvme_path_t nvme_namespace_first_path(nvme_ns_t ns)
 {
-	return c->unique_discovery_ctrl;
+	return list_top(&ns->paths, struct nvme_path, nentry);
 }
 
-int nvme_ctrl_identify(nvme_ctrl_t c, struct nvme_id_ctrl *id)
+nvme_path_t nvme_namespace_next_path(nvme_ns_t ns, nvme_path_t p)
 {
-	return nvme_identify_ctrl(nvme_ctrl_get_fd(c), id);
+	return p ? list_next(&ns->paths, p, nentry) : NULL;
 }
 
-nvme_ns_t nvme_ctrl_first_ns(nvme_ctrl_t c)
+static void __nvme_free_ns(struct nvme_ns *n)
 {
-	return list_top(&c->namespaces, struct nvme_ns, entry);
+	nvme_topo_changed(root_from_ns(n));
+	list_del_init(&n->entry);
+	nvme_ns_release_fd(n);
+	nvme_tree_free(n->generic_name);
+	nvme_tree_free(n->name);
+	nvme_tree_free(n->sysfs_dir);
+	nvme_tree_free(n);
 }
 
-nvme_ns_t nvme_ctrl_next_ns(nvme_ctrl_t c, nvme_ns_t n)
+/* Stub for SWIG */
+void nvme_free_ns(struct nvme_ns *n)
 {
-	return n ? list_next(&c->namespaces, n, entry) : NULL;
+	__nvme_free_ns(n);
 }
 
-nvme_path_t nvme_ctrl_first_path(nvme_ctrl_t c)
+static void __nvme_free_subsystem(struct nvme_subsystem *s)
 {
-	return list_top(&c->paths, struct nvme_path, entry);
-}
+	struct nvme_ctrl *c, *_c;
+	struct nvme_ns *n, *_n;
 
-nvme_path_t nvme_ctrl_next_path(nvme_ctrl_t c, nvme_path_t p)
-{
-	return p ? list_next(&c->paths, p, entry) : NULL;
-}
+	list_del_init(&s->entry);
+	nvme_subsystem_for_each_ctrl_safe(s, c, _c)
+		__nvme_free_ctrl(c);
 
-#define FREE_CTRL_ATTR(a) \
-	do { if (a) { free(a); (a) = NULL; } } while (0)
-void nvme_deconfigure_ctrl(nvme_ctrl_t c)
-{
-	nvme_ctrl_release_fd(c);
-	FREE_CTRL_ATTR(c->name);
-	FREE_CTRL_ATTR(c->sysfs_dir);
-	FREE_CTRL_ATTR(c->firmware);
-	FREE_CTRL_ATTR(c->model);
-	FREE_CTRL_ATTR(c->state);
-	FREE_CTRL_ATTR(c->numa_node);
-	FREE_CTRL_ATTR(c->queue_count);
-	FREE_CTRL_ATTR(c->serial);
-	FREE_CTRL_ATTR(c->sqsize);
-	FREE_CTRL_ATTR(c->dhchap_key);
-	FREE_CTRL_ATTR(c->dhchap_ctrl_key);
-	FREE_CTRL_ATTR(c->address);
-	FREE_CTRL_ATTR(c->dctype);
-	FREE_CTRL_ATTR(c->cntrltype);
-	FREE_CTRL_ATTR(c->cntlid);
-	FREE_CTRL_ATTR(c->phy_slot);
+	nvme_subsystem_for_each_ns_safe(s, n, _n)
+		__nvme_free_ns(n);
+
+	nvme_sysfs_dirfd_close(&s->sysfs_fd);
+	if (s->name)
+		nvme_tree_free(s->name);
+	nvme_tree_free(s->sysfs_dir);
+	nvme_tree_free(s->subsysnqn);
+	nvme_tree_free(s->model);
+	nvme_tree_free(s->serial);
+	nvme_tree_free(s->firmware);
+	nvme_tree_free(s->subsystype);
+	if (s->application)
+		free(s->application);
+	nvme_tree_free(s->iopolicy);
+	nvme_tree_free(s);
 }
 
-int nvme_disconnect_ctrl(nvme_ctrl_t c)
+void nvme_subsystem_release_fds(struct nvme_subsystem *s)
 {
-	nvme_root_t r = c->s && c->s->h ? c->s->h->r : NULL;
-	int ret;
+	struct nvme_ctrl *c, *_c;
+	struct nvme_ns *n, *_n;
 
-	ret = nvme_set_attr(nvme_ctrl_get_sysfs_dir(c),
-			    "delete_controller", "1");
-	if (ret < 0) {
-		nvme_msg(r, LOG_ERR, "%s: failed to disconnect, error %d\n",
-			 c->name, errno);
-		return ret;
-	}
-	nvme_msg(r, LOG_INFO, "%s: %s disconnected\n", c->name, c->subsysnqn);
-	nvme_deconfigure_ctrl(c);
-	return 0;
+	nvme_subsystem_for_each_ctrl_safe(s, c, _c)
+		nvme_ctrl_release_fd(c);
+
+	nvme_subsystem_for_each_ns_safe(s, n, _n)
+		nvme_ns_release_fd(n);
+
+	nvme_sysfs_dirfd_close(&s->sysfs_fd);
 }
 
-void nvme_unlink_ctrl(nvme_ctrl_t c)
+/*
+ * Stub for SWIG
+ */
+void nvme_free_subsystem(nvme_subsystem_t s)
 {
-	list_del_init(&c->entry);
-	c->s = NULL;
 }
 
-static void __nvme_free_ctrl(nvme_ctrl_t c)
+struct nvme_subsystem *nvme_alloc_subsystem(struct nvme_host *h,
+					    const char *name,
+					    const char *subsysnqn)
 {
-	struct nvme_path *p, *_p;
-	struct nvme_ns *n, *_n;
-
-	nvme_unlink_ctrl(c);
+	struct nvme_subsystem *s;
 
-	nvme_ctrl_for_each_path_safe(c, p, _p)
-		nvme_free_path(p);
+	s = nvme_tree_calloc(h->r, sizeof(*s));
+	if (!s)
+		return NULL;
 
-	nvme_ctrl_for_each_ns_safe(c, n, _n)
-		__nvme_free_ns(n);
+	s->sysfs_fd = -1;
+	s->h = h;
+	s->subsysnqn = nvme_tree_intern(h->r, subsysnqn);
+	if (name)
+		nvme_init_subsystem(s, name);
+	list_head_init(&s->ctrls);
+	list_head_init(&s->namespaces);
+	list_node_init(&s->entry);
+	list_add(&h->subsystems, &s->entry);
+	h->r->modified = true;
+	return s;
+}
 
-	nvme_deconfigure_ctrl(c);
+struct nvme_subsystem *nvme_lookup_subsystem(struct nvme_host *h,
+					     const char *name,
+					     const char *subsysnqn)
+{
+	struct nvme_subsystem *s;
 
-	FREE_CTRL_ATTR(c->transport);
-	FREE_CTRL_ATTR(c->subsysnqn);
-	FREE_CTRL_ATTR(c->traddr);
-	FREE_CTRL_ATTR(c->cfg.host_traddr);
-	FREE_CTRL_ATTR(c->cfg.host_iface);
-	FREE_CTRL_ATTR(c->trsvcid);
-	free(c);
+	nvme_for_each_subsystem(h, s) {
+		if (subsysnqn && s->subsysnqn &&
+		    strcmp(s->subsysnqn, subsysnqn))
+			continue;
+		if (name && s->name &&
+		    strcmp(s->name, name))
+			continue;
+		if (h->r->application) {
+			if (!s->application)
+				continue;
+			if (strcmp(h->r->application, s->application))
+				continue;
+		}
+		return s;
+	}
+	return nvme_alloc_subsystem(h, name, subsysnqn);
 }
 
-void nvme_free_ctrl(nvme_ctrl_t c)
+static void __nvme_free_host(struct nvme_host *h)
 {
-	__nvme_free_ctrl(c);
+	struct nvme_subsystem *s, *_s;
+
+	list_del_init(&h->entry);
+	nvme_for_each_subsystem_safe(h, s, _s)
+		__nvme_free_subsystem(s);
+	nvme_tree_free(h->hostnqn);
+	if (h->hostid)
+		nvme_tree_free(h->hostid);
+	if (h->dhchap_key)
+		free(h->dhchap_key);
+	nvme_host_set_hostsymname(h, NULL);
+	h->r->modified = true;
+	nvme_tree_free(h);
 }
 
-static bool traddr_is_hostname(const char *transport, const char *traddr)
+void nvme_host_release_fds(struct nvme_host *h)
 {
-	char addrstr[NVMF_TRADDR_SIZE];
+	struct nvme_subsystem *s, *_s;
 
-	if (!traddr || !transport)
-		return false;
-	if (!strcmp(traddr, "none"))
-		return false;
-	if (strcmp(transport, "tcp") &&
-	    strcmp(transport, "rdma"))
-		return false;
-	if (inet_pton(AF_INET, traddr, addrstr) > 0 ||
-	    inet_pton(AF_INET6, traddr, addrstr) > 0)
-		return false;
-	return true;
+	nvme_for_each_subsystem_safe(h, s, _s)
+		nvme_subsystem_release_fds(s);
 }
 
-struct nvme_ctrl *nvme_create_ctrl(nvme_root_t r,
-				   const char *subsysnqn, const char *transport,
-				   const char *traddr, const char *host_traddr,
-				   const char *host_iface, const char *trsvcid)
+/* Stub for SWIG */
+void nvme_free_host(struct nvme_host *h)
 {
-	struct nvme_ctrl *c;
+	__nvme_free_host(h);
+}
 
-	if (!transport) {
-		nvme_msg(r, LOG_ERR, "No transport specified\n");
-		errno = EINVAL;
+struct nvme_host *nvme_lookup_host(nvme_root_t r, const char *hostnqn,
+				   const char *hostid)
+{
+	struct nvme_host *h;
+
+	if (!hostnqn)
 		return NULL;
+	nvme_for_each_host(r, h) {
+		if (strcmp(h->hostnqn, hostnqn))
+			continue;
+		if (hostid && (!h->hostid ||
+		    strcmp(h->hostid, hostid)))
+			continue;
+		return h;
 	}
-	if (strncmp(transport, "loop", 4) &&
-	    strncmp(transport, "pcie", 4) && !traddr) {
-		nvme_msg(r, LOG_ERR, "No transport address for '%s'\n",
-			 transport);
-	       errno = EINVAL;
-	       return NULL;
-	}
-	if (!subsysnqn) {
-		nvme_msg(r, LOG_ERR, "No subsystem NQN specified\n");
-		errno = EINVAL;
-		return NULL;
-	}
-	c = calloc(1, sizeof(*c));
-	if (!c) {
-		errno = ENOMEM;
+	h = nvme_tree_calloc(r, sizeof(*h));
+	if (!h)
 		return NULL;
+	h->hostnqn = nvme_tree_strdup(r, hostnqn);
+	if (hostid)
+		h->hostid = nvme_tree_strdup(r, hostid);
+	list_head_init(&h->subsystems);
+	list_node_init(&h->entry);
+	h->r = r;
+	list_add(&r->hosts, &h->entry);
+	r->modified = true;
+
+	return h;
+}
+
+static int nvme_subsystem_scan_namespaces(nvme_root_t r, nvme_subsystem_t s,
+		nvme_scan_filter_t f, void *f_args)
+{
+	_cleanup_dirents_ struct dirents namespaces = {};
+	int i, ret;
+
+	if (r->create_only) {
+		nvme_msg(r, LOG_DEBUG,
+			 "skipping namespace scan for subsys %s\n",
+			 s->subsysnqn);
+		return 0;
 	}
-	c->fd = -1;
-	nvmf_default_config(&c->cfg);
-	list_head_init(&c->namespaces);
-	list_head_init(&c->paths);
-	list_node_init(&c->entry);
-	c->transport = strdup(transport);
-	c->subsysnqn = strdup(subsysnqn);
-	if (traddr)
-		c->traddr = strdup(traddr);
-	if (host_traddr) {
-		if (traddr_is_hostname(transport, host_traddr))
-			c->cfg.host_traddr = hostname2traddr(r, host_traddr);
-		if (!c->cfg.host_traddr)
-			c->cfg.host_traddr = strdup(host_traddr);
+	namespaces.num = nvme_scan_subsystem_namespaces(s, &namespaces.ents);
+	if (namespaces.num < 0) {
+		nvme_msg(r, LOG_DEBUG,
+			 "failed to scan namespaces for subsys %s: %s\n",
+			 s->subsysnqn, strerror(errno));
+		return namespaces.num;
 	}
-	if (host_iface)
-		c->cfg.host_iface = strdup(host_iface);
-	if (trsvcid)
-		c->trsvcid = strdup(trsvcid);
 
-	return c;
+	if (r->scan_threads > 1 && namespaces.num > 1) {
+		_cleanup_free_ struct nvme_ns **ns = NULL;
+
+		ns = nvme_open_namespaces_threaded(r, s->sysfs_dir,
+						   &namespaces);
+		if (ns) {
+			for (i = 0; i < namespaces.num; i++) {
+				if (!ns[i]) {
+					nvme_msg(r, LOG_DEBUG,
+						 "failed to scan namespace %s: %s\n",
+						 namespaces.ents[i]->d_name,
+						 strerror(errno));
+					continue;
+				}
+				nvme_subsystem_link_namespace(r, s, ns[i],
+							      f, f_args);
+			}
+			return 0;
+		}
+		/* fall back to the serial scan */
+	}
+
+	for (i = 0; i < namespaces.num; i++) {
+		ret = nvme_subsystem_scan_namespace(r, s,
+				namespaces.ents[i]->d_name, f, f_args);
+		if (ret < 0)
+			nvme_msg(r, LOG_DEBUG,
+				 "failed to scan namespace %s: %s\n",
+				 namespaces.ents[i]->d_name, strerror(errno));
+	}
+
+	return 0;
 }
 
-/**
- * _tcp_ctrl_match_host_traddr_no_src_addr() - Match host_traddr w/o src_addr
- * @c:	An existing controller instance
- * @candidate:	Candidate ctrl we're trying to match with @c.
- *
- * On kernels prior to 6.1 (i.e. src_addr is not available), try to match
- * a candidate controller's host_traddr to that of an existing controller.
- *
- * This function takes an optimistic approach. In doubt, it will declare a
- * match and return true.
- *
- * Return: true if @c->host_traddr matches @candidate->host_traddr. false otherwise.
- */
-static bool _tcp_ctrl_match_host_traddr_no_src_addr(struct nvme_ctrl *c, struct candidate_args *candidate)
+static int nvme_init_subsystem(nvme_subsystem_t s, const char *name)
 {
-	if (c->cfg.host_traddr)
-		return candidate->addreq(candidate->host_traddr, c->cfg.host_traddr);
+	nvme_root_t r = s->h ? s->h->r : NULL;
+	_cleanup_free_ char *model = NULL, *firmware = NULL;
+	_cleanup_free_ char *subsystype = NULL, *iopolicy = NULL;
+	char *path;
 
-	/* If c->cfg.host_traddr is NULL, then the controller (c)
-	 * uses the interface's primary address as the source
-	 * address. If c->cfg.host_iface is defined we can
-	 * determine the primary address associated with that
-	 * interface and compare that to the candidate->host_traddr.
-	 */
-	if (c->cfg.host_iface)
-		return nvme_iface_primary_addr_matches(candidate->iface_list,
-						       c->cfg.host_iface,
-						       candidate->host_traddr);
+	if (asprintf(&path, "%s/%s", nvme_subsys_sysfs_dir(), name) < 0)
+		return -1;
 
-	/* If both c->cfg.host_traddr and c->cfg.host_iface are
-	 * NULL, we don't have enough information to make a
-	 * 100% positive match. Regardless, let's be optimistic
-	 * and assume that we have a match.
-	 */
-	nvme_msg(root_from_ctrl(c), LOG_DEBUG,
-		 "Not enough data, but assume %s matches candidate's host_traddr: %s\n",
-		 nvme_ctrl_get_name(c), candidate->host_traddr);
+	model = nvme_get_attr(path, "model");
+	s->model = nvme_tree_intern(r, model ? model : "undefined");
+	s->serial = nvme_get_attr(path, "serial");
+	firmware = nvme_get_attr(path, "firmware_rev");
+	s->firmware = nvme_tree_intern(r, firmware);
+	subsystype = nvme_get_attr(path, "subsystype");
+	if (subsystype)
+		s->subsystype = nvme_tree_intern(r, subsystype);
+	else if (!strcmp(s->subsysnqn, NVME_DISC_SUBSYS_NAME))
+		s->subsystype = nvme_tree_intern(r, "discovery");
+	else
+		s->subsystype = nvme_tree_intern(r, "nvm");
+	s->name = nvme_tree_strdup(r, name);
+	s->sysfs_dir = (char *)path;
+	if (s->h->r->application)
+		s->application = strdup(s->h->r->application);
+	iopolicy = nvme_get_attr(path, "iopolicy");
+	s->iopolicy = nvme_tree_intern(r, iopolicy);
+
+	return 0;
+}
 
+static bool __nvme_scan_subsystem(struct nvme_root *r, nvme_subsystem_t s,
+				  nvme_scan_filter_t f, void *f_args)
+{
+	if (f && !f(s, NULL, NULL, f_args)) {
+		nvme_msg(r, LOG_DEBUG, "filter out subsystem %s\n", s->name);
+		__nvme_free_subsystem(s);
+		return false;
+	}
+	nvme_subsystem_scan_namespaces(r, s, f, f_args);
 	return true;
 }
 
-/**
- * _tcp_ctrl_match_host_iface_no_src_addr() - Match host_iface w/o src_addr
- * @c:	An existing controller instance
- * @candidate:	Candidate ctrl we're trying to match with @c.
- *
- * On kernels prior to 6.1 (i.e. src_addr is not available), try to match
- * a candidate controller's host_iface to that of an existing controller.
- *
- * This function takes an optimistic approach. In doubt, it will declare a
- * match and return true.
- *
- * Return: true if @c->host_iface matches @candidate->host_iface. false otherwise.
- */
-static bool _tcp_ctrl_match_host_iface_no_src_addr(struct nvme_ctrl *c, struct candidate_args *candidate)
+static int nvme_scan_subsystem(struct nvme_root *r, const char *name,
+		nvme_scan_filter_t f, void *f_args)
 {
-	if (c->cfg.host_iface)
-		return streq0(candidate->host_iface, c->cfg.host_iface);
+	struct nvme_subsystem *s = NULL, *_s;
+	_cleanup_free_ char *path = NULL, *subsysnqn = NULL;
+	nvme_host_t h = NULL;
+	int ret;
 
-	/* If c->cfg.host_traddr is not NULL we can infer the controller's (c)
-	 * interface from it and compare it to the candidate->host_iface.
-	 */
-	if (c->cfg.host_traddr) {
-		const char *c_host_iface;
+	nvme_msg(r, LOG_DEBUG, "scan subsystem %s\n", name);
+	ret = asprintf(&path, "%s/%s", nvme_subsys_sysfs_dir(), name);
+	if (ret < 0)
+		return ret;
 
-		c_host_iface = nvme_iface_matching_addr(candidate->iface_list, c->cfg.host_traddr);
-		return streq0(candidate->host_iface, c_host_iface);
+	subsysnqn = nvme_get_attr(path, "subsysnqn");
+	if (!subsysnqn) {
+		errno = ENODEV;
+		return -1;
+	}
+	nvme_for_each_host(r, h) {
+		nvme_for_each_subsystem(h, _s) {
+			/*
+			 * We are always called after nvme_scan_ctrl(),
+			 * so any subsystem we're interested at _must_
+			 * have a name.
+			 */
+			if (!_s->name)
+				continue;
+			if (strcmp(_s->name, name))
+				continue;
+			if (!__nvme_scan_subsystem(r, _s, f, f_args)) {
+				errno = EINVAL;
+				return -1;
+			}
+			s = _s;
+		}
+	}
+	if (!s) {
+		/*
+		 * Subsystem with non-matching controller. odd.
+		 * Create a subsystem with the default host
+		 * and hope for the best.
+		 */
+		nvme_msg(r, LOG_DEBUG, "creating detached subsystem '%s'\n",
+			 name);
+		h = nvme_default_host(r);
+		s = nvme_alloc_subsystem(h, name, subsysnqn);
+		if (!s) {
+			errno = ENOMEM;
+			return -1;
+		}
+		if (!__nvme_scan_subsystem(r, s, f, f_args)) {
+			errno = EINVAL;
+			return -1;
+		}
+	} else if (strcmp(s->subsysnqn, subsysnqn)) {
+		nvme_msg(r, LOG_DEBUG, "NQN mismatch for subsystem '%s'\n",
+			 name);
+		errno = EINVAL;
+		return -1;
 	}
 
-	/* If both c->cfg.host_traddr and c->cfg.host_iface are
-	 * NULL, we don't have enough information to make a
-	 * 100% positive match. Regardless, let's be optimistic
-	 * and assume that we have a match.
-	 */
-	nvme_msg(root_from_ctrl(c), LOG_DEBUG,
-		 "Not enough data, but assume %s matches candidate's host_iface: %s\n",
-		 nvme_ctrl_get_name(c), candidate->host_iface);
+	return 0;
+}
 
-	return true;
+nvme_ctrl_t nvme_path_get_ctrl(nvme_path_t p)
+{
+	return p->c;
 }
 
-/**
- * _tcp_opt_params_match_no_src_addr() - Match optional host_traddr/host_iface w/o src_addr
- * @c:	An existing controller instance
- * @candidate:	Candidate ctrl we're trying to match with @c.
- *
- * Before kernel 6.1, the src_addr was not reported by the kernel which makes
- * it hard to match a candidate's host_traddr and host_iface to an existing
- * controller if that controller was created without specifying the
- * host_traddr and/or host_iface. This function tries its best in the absense
- * of a src_addr to match @c to @candidate. This may not be 100% accurate.
- * Only the src_addr can provide 100% accuracy.
- *
- * This function takes an optimistic approach. In doubt, it will declare a
- * match and return true.
- *
- * Return: true if @c matches @candidate. false otherwise.
- */
-static bool _tcp_opt_params_match_no_src_addr(struct nvme_ctrl *c, struct candidate_args *candidate)
+nvme_ns_t nvme_path_get_ns(nvme_path_t p)
 {
-	/* Check host_traddr only if candidate is interested */
-	if (candidate->host_traddr) {
-		if (!_tcp_ctrl_match_host_traddr_no_src_addr(c, candidate))
-			return false;
-	}
+	return p->n;
+}
 
-	/* Check host_iface only if candidate is interested */
-	if (candidate->host_iface) {
-		if (!_tcp_ctrl_match_host_iface_no_src_addr(c, candidate))
-			return false;
-	}
+const char *nvme_path_get_sysfs_dir(nvme_path_t p)
+{
+	return p->sysfs_dir;
+}
 
-	return true;
+const char *nvme_path_get_name(nvme_path_t p)
+{
+	return p->name;
 }
 
-/**
- * _tcp_opt_params_match() - Match optional host_traddr/host_iface
- * @c:	An existing controller instance
- * @candidate:	Candidate ctrl we're trying to match with @c.
- *
- * The host_traddr and host_iface are optional for TCP. When they are not
- * specified, the kernel looks up the destination IP address (traddr) in the
- * routing table to determine the best interface for the connection. The
- * kernel then retrieves the primary IP address assigned to that interface
- * and uses that as the connection’s source address.
- *
- * An interface’s primary address is the default source address used for
- * all connections made on that interface unless host-traddr is used to
- * override the default. Kernel-selected interfaces and/or source addresses
- * are hidden from user-space applications unless the kernel makes that
- * information available through the "src_addr" attribute in the
- * sysfs (kernel 6.1 or later).
- *
- * Sometimes, an application may force the interface by specifying the
- * "host-iface" or may force a different source address (instead of the
- * primary address) by providing the "host-traddr".
- *
- * If the candidate specifies the host_traddr and/or host_iface but they
- * do not match the existing controller's host_traddr and/or host_iface
- * (they could be NULL), we may still be able to find a match by taking
- * the existing controller's src_addr into consideration since that
- * parameter identifies the actual source address of the connection and
- * therefore can be used to infer the interface of the connection. However,
- * the src_addr can only be read from the nvme device's sysfs "address"
- * attribute starting with kernel 6.1 (or kernels that backported the
- * src_addr patch).
- *
- * For legacy kernels that do not provide the src_addr we must use a
- * different algorithm to match the host_traddr and host_iface, but
- * it's not 100% accurate.
- *
- * Return: true if @c matches @candidate. false otherwise.
- */
-static bool _tcp_opt_params_match(struct nvme_ctrl *c, struct candidate_args *candidate)
+const char *nvme_path_get_ana_state(nvme_path_t p)
 {
-	char *src_addr, buffer[INET6_ADDRSTRLEN];
+	return p->ana_state;
+}
 
-	/* Check if src_addr is available (kernel 6.1 or later) */
-	src_addr = nvme_ctrl_get_src_addr(c, buffer, sizeof(buffer));
-	if (!src_addr)
-		return _tcp_opt_params_match_no_src_addr(c, candidate);
+void nvme_free_path(struct nvme_path *p)
+{
+	list_del_init(&p->entry);
+	list_del_init(&p->nentry);
+	nvme_sysfs_dirfd_close(&p->sysfs_fd);
+	nvme_tree_free(p->name);
+	nvme_tree_free(p->sysfs_dir);
+	nvme_tree_free(p->ana_state);
+	nvme_tree_free(p);
+}
 
-	/* Check host_traddr only if candidate is interested */
-	if (candidate->host_traddr &&
-	    !candidate->addreq(candidate->host_traddr, src_addr))
-		return false;
+static void nvme_subsystem_set_path_ns(nvme_subsystem_t s, nvme_path_t p)
+{
+	char n_name[32] = { };
+	int i, c, nsid, ret;
+	nvme_ns_t n;
 
-	/* Check host_iface only if candidate is interested */
-	if (candidate->host_iface &&
-	    !streq0(candidate->host_iface,
-		    nvme_iface_matching_addr(candidate->iface_list, src_addr)))
-		return false;
+	ret = sscanf(nvme_path_get_name(p), "nvme%dc%dn%d", &i, &c, &nsid);
+	if (ret != 3)
+		return;
 
-	return true;
+	sprintf(n_name, "nvme%dn%d", i, nsid);
+	nvme_subsystem_for_each_ns(s, n) {
+		if (!strcmp(n_name, nvme_ns_get_name(n))) {
+			list_add(&n->paths, &p->nentry);
+			p->n = n;
+		}
+	}
 }
 
-/**
- * _tcp_match_ctrl() - Check if controller matches candidate (TCP only)
- * @c:	An existing controller instance
- * @candidate:	Candidate ctrl we're trying to match with @c.
- *
- * We want to determine if an existing controller can be re-used
- * for the candidate controller we're trying to instantiate.
- *
- * For TCP, we do not have a match if the candidate's transport, traddr,
- * trsvcid are not identical to those of the the existing controller.
- * These 3 parameters are mandatory for a match.
- *
- * The host_traddr and host_iface are optional. When the candidate does
- * not specify them (both NULL), we can ignore them. Otherwise, we must
- * employ advanced investigation techniques to determine if there's a match.
- *
- * Return: true if a match is found, false otherwise.
- */
-static bool _tcp_match_ctrl(struct nvme_ctrl *c, struct candidate_args *candidate)
+static int nvme_ctrl_scan_path(nvme_root_t r, struct nvme_ctrl *c, char *name)
 {
-	if (!streq0(c->transport, candidate->transport))
-		return false;
-
-	if (!streq0(c->trsvcid, candidate->trsvcid))
-		return false;
+	struct nvme_path *p;
+	_cleanup_free_ char *path = NULL, *grpid = NULL;
+	int ret;
 
-	if (!candidate->addreq(c->traddr, candidate->traddr))
-		return false;
+	nvme_msg(r, LOG_DEBUG, "scan controller %s path %s\n",
+		 c->name, name);
+	if (!c->s) {
+		errno = ENXIO;
+		return -1;
+	}
+	ret = asprintf(&path, "%s/%s", c->sysfs_dir, name);
+	if (ret < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
 
-	if (candidate->well_known_nqn && !nvme_ctrl_is_discovery_ctrl(c))
-		return false;
+	p = nvme_tree_calloc(r, sizeof(*p));
+	if (!p) {
+		errno = ENOMEM;
+		return -1;
+	}
 
-	if (candidate->subsysnqn && !streq0(c->subsysnqn, candidate->subsysnqn))
-		return false;
+	p->sysfs_fd = -1;
+	p->c = c;
+	p->name = nvme_tree_strdup(r, name);
+	p->sysfs_dir = path;
+	path = NULL;
+	p->ana_state = nvme_get_path_attr(p, "ana_state");
+	if (!p->ana_state)
+		p->ana_state = strdup("optimized");
 
-	/* Check host_traddr / host_iface only if candidate is interested */
-	if ((candidate->host_iface || candidate->host_traddr) &&
-	    !_tcp_opt_params_match(c, candidate))
-		return false;
+	grpid = nvme_get_path_attr(p, "ana_grpid");
+	if (grpid) {
+		sscanf(grpid, "%d", &p->grpid);
+	}
 
-	return true;
+	list_node_init(&p->nentry);
+	nvme_subsystem_set_path_ns(c->s, p);
+	list_node_init(&p->entry);
+	list_add(&c->paths, &p->entry);
+	return 0;
 }
 
-/**
- * _match_ctrl() - Check if controller matches candidate (non TCP transport)
- * @c:	An existing controller instance
- * @candidate:	Candidate ctrl we're trying to match with @c.
- *
- * We want to determine if an existing controller can be re-used
- * for the candidate controller we're trying to instantiate. This function
- * is used for all transports except TCP.
- *
- * Return: true if a match is found, false otherwise.
- */
-static bool _match_ctrl(struct nvme_ctrl *c, struct candidate_args *candidate)
+int nvme_ctrl_get_fd(nvme_ctrl_t c)
 {
-	if (!streq0(c->transport, candidate->transport))
-		return false;
+	if (c->fd < 0) {
+		c->fd = nvme_open(c->name);
+		if (c->fd < 0)
+			nvme_msg(root_from_ctrl(c), LOG_ERR,
+				 "Failed to open ctrl %s, errno %d\n",
+				 c->name, errno);
+	}
+	return c->fd;
+}
 
-	if (candidate->traddr && c->traddr &&
-	    !candidate->addreq(c->traddr, candidate->traddr))
-		return false;
+void nvme_ctrl_release_fd(nvme_ctrl_t c)
+{
+	nvme_sysfs_dirfd_close(&c->sysfs_fd);
+	if (c->fd < 0)
+		return;
 
-	if (candidate->host_traddr && c->cfg.host_traddr &&
-	    !candidate->addreq(c->cfg.host_traddr, candidate->host_traddr))
-		return false;
+	close(c->fd);
+	c->fd = -1;
+}
 
-	if (candidate->host_iface && c->cfg.host_iface &&
-	    !streq0(c->cfg.host_iface, candidate->host_iface))
-		return false;
+__u32 nvme_ctrl_get_max_xfer_len(nvme_ctrl_t c)
+{
+	int fd;
 
-	if (candidate->trsvcid && c->trsvcid &&
-	    !streq0(c->trsvcid, candidate->trsvcid))
-		return false;
+	if (c->max_xfer_len)
+		return c->max_xfer_len;
 
-	if (candidate->well_known_nqn && !nvme_ctrl_is_discovery_ctrl(c))
-		return false;
+	fd = nvme_ctrl_get_fd(c);
+	if (fd < 0 || nvme_get_log_page_max(fd, &c->max_xfer_len))
+		c->max_xfer_len = NVME_LOG_PAGE_PDU_SIZE;
 
-	if (candidate->subsysnqn && !streq0(c->subsysnqn, candidate->subsysnqn))
-		return false;
+	return c->max_xfer_len;
+}
 
-	return true;
+nvme_subsystem_t nvme_ctrl_get_subsystem(nvme_ctrl_t c)
+{
+	return c->s;
 }
-/**
- * _candidate_init() - Init candidate and get the matching function
- *
- * @candidate:		Candidate struct to initialize
- * @transport:		Transport name
- * @traddr:		Transport address
- * @trsvcid:		Transport service identifier
- * @subsysnqn:		Subsystem NQN
- * @host_traddr:	Host transport address
- * @host_iface:		Host interface name
- * @host_iface:		Host interface name
- *
- * The function _candidate_free() must be called to release resources once
- * the candidate object is not longer required.
- *
- * Return: The matching function to use when comparing an existing
- * controller to the candidate controller.
- */
-static ctrl_match_t _candidate_init(struct candidate_args *candidate,
-				    const char *transport,
-				    const char *traddr,
-				    const char *trsvcid,
-				    const char *subsysnqn,
-				    const char *host_traddr,
-				    const char *host_iface)
+
+const char *nvme_ctrl_get_name(nvme_ctrl_t c)
 {
-	memset(candidate, 0, sizeof(*candidate));
+	return c->name;
+}
 
-	candidate->traddr = traddr;
-	candidate->trsvcid = trsvcid;
-	candidate->transport = transport;
-	candidate->subsysnqn = subsysnqn;
-	candidate->host_iface = host_iface;
-	candidate->host_traddr = host_traddr;
+const char *nvme_ctrl_get_sysfs_dir(nvme_ctrl_t c)
+{
+	return c->sysfs_dir;
+}
 
-	if (streq0(subsysnqn, NVME_DISC_SUBSYS_NAME)) {
-		/* Since TP8013, the NQN of discovery controllers can be the
-		 * well-known NQN (i.e. nqn.2014-08.org.nvmexpress.discovery) or
-		 * a unique NQN. A DC created using the well-known NQN may later
-		 * display a unique NQN when looked up in the sysfs. Therefore,
-		 * ignore (i.e. set to NULL) the well-known NQN when looking for
-		 * a match.
-		 */
-		candidate->subsysnqn = NULL;
-		candidate->well_known_nqn = true;
-	}
+const char *nvme_ctrl_get_subsysnqn(nvme_ctrl_t c)
+{
+	return c->s ? c->s->subsysnqn : c->subsysnqn;
+}
 
-	if (streq0(transport, "tcp")) {
-		/* For TCP we may need to access the interface map.
-		 * Let's retrieve and cache the map.
-		 */
-		if (getifaddrs(&candidate->iface_list) == -1)
-			candidate->iface_list = NULL;
+const char *nvme_ctrl_get_address(nvme_ctrl_t c)
+{
+	return c->address ? c->address : "";
+}
 
-		candidate->addreq = nvme_ipaddrs_eq;
-		return _tcp_match_ctrl;
-	}
+char *nvme_ctrl_get_src_addr(nvme_ctrl_t c, char *src_addr, size_t src_addr_len)
+{
+	size_t l;
+	char *p;
 
-	if (streq0(transport, "rdma")) {
-		candidate->addreq = nvme_ipaddrs_eq;
-		return _match_ctrl;
+	if (!c->address)
+		return NULL;
+
+	p = strstr(c->address, "src_addr=");
+	if (!p)
+		return NULL;
+
+	p += strlen("src_addr=");
+	l = strcspn(p, ",%"); /* % to eliminate IPv6 scope (if present) */
+	if (l >= src_addr_len) {
+		nvme_msg(root_from_ctrl(c), LOG_ERR,
+			 "Buffer for src_addr is too small (%zu must be > %zu)\n",
+			 src_addr_len, l);
+		return NULL;
 	}
 
-	/* All other transport types */
-	candidate->addreq = streqcase0;
-	return _match_ctrl;
+	strncpy(src_addr, p, l);
+	src_addr[l] = '\0';
+	return src_addr;
 }
 
-/**
- * _candidate_free() - Release resources allocated by _candidate_init()
- *
- * @candidate:	data to free.
+/*
+ * Purely informational controller attributes are not read at scan time;
+ * the accessors fetch them from sysfs on first use and memoize the
+ * result in the controller object. The value is read outside
+ * nvme_lazy_lock and committed under it, so concurrent readers racing
+ * on the first access agree on one memoized copy.
  */
-static void _candidate_free(struct candidate_args *candidate)
+static const char *nvme_ctrl_lazy_attr(nvme_ctrl_t c, char **cache,
+				       const char *attr)
 {
-	freeifaddrs(candidate->iface_list); /* This is NULL-safe */
+	char *value;
+
+	if (*cache || !c->sysfs_dir)
+		return *cache;
+	value = nvme_get_ctrl_attr(c, attr);
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (!*cache)
+		*cache = value;
+	else
+		free(value);
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	return *cache;
 }
 
-#define _cleanup_candidate_ __cleanup__(_candidate_free)
+const char *nvme_ctrl_get_phy_slot(nvme_ctrl_t c)
+{
+	char *slot;
+
+	if (c->phy_slot)
+		return c->phy_slot;
+	slot = nvme_ctrl_lookup_phy_slot(root_from_ctrl(c), c->address);
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (!c->phy_slot)
+		c->phy_slot = slot;
+	else
+		free(slot);
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	return c->phy_slot ? c->phy_slot : "";
+}
 
-nvme_ctrl_t __nvme_lookup_ctrl(nvme_subsystem_t s, const char *transport,
-			       const char *traddr, const char *host_traddr,
-			       const char *host_iface, const char *trsvcid,
-			       const char *subsysnqn, nvme_ctrl_t p)
+const char *nvme_ctrl_get_firmware(nvme_ctrl_t c)
 {
-	_cleanup_candidate_ struct candidate_args candidate = {};
-	struct nvme_ctrl *c, *matching_c = NULL;
-	ctrl_match_t ctrl_match;
+	return nvme_ctrl_lazy_attr(c, &c->firmware, "firmware_rev");
+}
 
-	/* Init candidate and get the matching function to use */
-	ctrl_match = _candidate_init(&candidate, transport, traddr, trsvcid,
-				     subsysnqn, host_traddr, host_iface);
+const char *nvme_ctrl_get_model(nvme_ctrl_t c)
+{
+	return nvme_ctrl_lazy_attr(c, &c->model, "model");
+}
 
-	c = p ? nvme_subsystem_next_ctrl(s, p) : nvme_subsystem_first_ctrl(s);
-	for (; c != NULL; c = nvme_subsystem_next_ctrl(s, c)) {
-		if (ctrl_match(c, &candidate)) {
-			matching_c = c;
-			break;
-		}
+const char *nvme_ctrl_get_state(nvme_ctrl_t c)
+{
+	nvme_root_t r = root_from_ctrl(c);
+	unsigned int ttl = r ? r->state_ttl : 0;
+	uint64_t now = 0;
+	char *state, *old;
+
+	if (ttl) {
+		now = nvme_now_ms();
+		if (c->state && now < c->state_expires)
+			return c->state;
 	}
 
-	return matching_c;
+	state = nvme_get_ctrl_attr(c, "state");
+	pthread_mutex_lock(&nvme_lazy_lock);
+	old = c->state;
+	c->state = state;
+	c->state_expires = state && ttl ? now + ttl : 0;
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	free(old);
+	return c->state;
 }
 
-bool nvme_ctrl_config_match(struct nvme_ctrl *c, const char *transport,
-			    const char *traddr, const char *trsvcid,
-			    const char *subsysnqn, const char *host_traddr,
-			    const char *host_iface)
+const char *nvme_ctrl_get_numa_node(nvme_ctrl_t c)
 {
-	_cleanup_candidate_ struct candidate_args candidate = {};
-	ctrl_match_t ctrl_match;
-
-	/* Init candidate and get the matching function to use */
-	ctrl_match = _candidate_init(&candidate, transport, traddr, trsvcid,
-				     subsysnqn, host_traddr, host_iface);
-
-	return ctrl_match(c, &candidate);
+	return nvme_ctrl_lazy_attr(c, &c->numa_node, "numa_node");
 }
 
-nvme_ctrl_t nvme_ctrl_find(nvme_subsystem_t s, const char *transport,
-			   const char *traddr, const char *trsvcid,
-			   const char *subsysnqn, const char *host_traddr,
-			   const char *host_iface)
+const char *nvme_ctrl_get_queue_count(nvme_ctrl_t c)
 {
-	return __nvme_lookup_ctrl(s, transport, traddr, host_traddr, host_iface,
-				  trsvcid, subsysnqn, NULL/*p*/);
+	return nvme_ctrl_lazy_attr(c, &c->queue_count, "queue_count");
 }
 
-nvme_ctrl_t nvme_lookup_ctrl(nvme_subsystem_t s, const char *transport,
-			     const char *traddr, const char *host_traddr,
-			     const char *host_iface, const char *trsvcid,
-			     nvme_ctrl_t p)
+const char *nvme_ctrl_get_serial(nvme_ctrl_t c)
 {
-	nvme_root_t r;
-	struct nvme_ctrl *c;
+	return nvme_ctrl_lazy_attr(c, &c->serial, "serial");
+}
 
-	if (!s || !transport)
-		return NULL;
+const char *nvme_ctrl_get_sqsize(nvme_ctrl_t c)
+{
+	return nvme_ctrl_lazy_attr(c, &c->sqsize, "sqsize");
+}
 
-	c = __nvme_lookup_ctrl(s, transport, traddr, host_traddr,
-			       host_iface, trsvcid, NULL, p);
-	if (c)
-		return c;
+const char *nvme_ctrl_get_transport(nvme_ctrl_t c)
+{
+	return c->transport;
+}
 
-	r = s->h ? s->h->r : NULL;
-	c = nvme_create_ctrl(r, s->subsysnqn, transport, traddr,
-			     host_traddr, host_iface, trsvcid);
-	if (c) {
-		c->s = s;
-		list_add(&s->ctrls, &c->entry);
-		s->h->r->modified = true;
-	}
-	return c;
+const char *nvme_ctrl_get_traddr(nvme_ctrl_t c)
+{
+	return c->traddr;
 }
 
-static int nvme_ctrl_scan_paths(nvme_root_t r, struct nvme_ctrl *c)
+const char *nvme_ctrl_get_trsvcid(nvme_ctrl_t c)
 {
-	_cleanup_dirents_ struct dirents paths = {};
-	int i;
+	return c->trsvcid;
+}
 
-	if (r->create_only) {
-		nvme_msg(r, LOG_DEBUG,
-			 "skipping path scan for ctrl %s\n", c->name);
-		return 0;
-	}
-	paths.num = nvme_scan_ctrl_namespace_paths(c, &paths.ents);
-	if (paths.num < 0)
-		return paths.num;
+const char *nvme_ctrl_get_host_traddr(nvme_ctrl_t c)
+{
+	return c->cfg.host_traddr;
+}
 
-	for (i = 0; i < paths.num; i++)
-		nvme_ctrl_scan_path(r, c, paths.ents[i]->d_name);
+const char *nvme_ctrl_get_host_iface(nvme_ctrl_t c)
+{
+	return c->cfg.host_iface;
+}
 
-	return 0;
+struct nvme_fabrics_config *nvme_ctrl_get_config(nvme_ctrl_t c)
+{
+	return &c->cfg;
 }
 
-static int nvme_ctrl_scan_namespaces(nvme_root_t r, struct nvme_ctrl *c)
+const char *nvme_ctrl_get_dhchap_host_key(nvme_ctrl_t c)
 {
-	_cleanup_dirents_ struct dirents namespaces = {};
-	int i;
+	char *key;
 
-	if (r->create_only) {
-		nvme_msg(r, LOG_DEBUG, "skipping namespace scan for ctrl %s\n",
-			 c->name);
-		return 0;
+	if (c->dhchap_key || !c->sysfs_dir)
+		return c->dhchap_key;
+	/*
+	 * Snapshots do not serialize the secrets; re-read them from
+	 * sysfs with the same filtering as nvme_configure_ctrl().
+	 */
+	key = nvme_get_ctrl_attr(c, "dhchap_secret");
+	if (key && c->s && c->s->h && c->s->h->dhchap_key &&
+			(!strcmp(c->s->h->dhchap_key, key) ||
+			 !strcmp("none", key))) {
+		free(key);
+		key = NULL;
 	}
-	namespaces.num = nvme_scan_ctrl_namespaces(c, &namespaces.ents);
-	for (i = 0; i < namespaces.num; i++)
-		nvme_ctrl_scan_namespace(r, c, namespaces.ents[i]->d_name);
-
-	return 0;
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (!c->dhchap_key)
+		c->dhchap_key = key;
+	else
+		free(key);
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	return c->dhchap_key;
 }
 
-static char *nvme_ctrl_lookup_subsystem_name(nvme_root_t r,
-					     const char *ctrl_name)
+const char *nvme_ctrl_get_cntlid(nvme_ctrl_t c)
 {
-	const char *subsys_dir = nvme_subsys_sysfs_dir();
-	_cleanup_dirents_ struct dirents subsys = {};
-	int i;
-
-	subsys.num = nvme_scan_subsystems(&subsys.ents);
-	if (subsys.num < 0)
-		return NULL;
-	for (i = 0; i < subsys.num; i++) {
-		struct stat st;
-		_cleanup_free_ char *path = NULL;
+	return c->cntlid;
+}
 
-		if (asprintf(&path, "%s/%s/%s", subsys_dir,
-			     subsys.ents[i]->d_name, ctrl_name) < 0) {
-			errno = ENOMEM;
-			return NULL;
-		}
-		nvme_msg(r, LOG_DEBUG, "lookup subsystem %s\n", path);
-		if (stat(path, &st) < 0) {
-			continue;
-		}
-		return strdup(subsys.ents[i]->d_name);
+void nvme_ctrl_set_dhchap_host_key(nvme_ctrl_t c, const char *key)
+{
+	if (c->dhchap_key) {
+		free(c->dhchap_key);
+		c->dhchap_key = NULL;
 	}
-	return NULL;
+	if (key)
+		c->dhchap_key = strdup(key);
 }
 
-static char *nvme_ctrl_lookup_phy_slot(nvme_root_t r, const char *address)
+const char *nvme_ctrl_get_dhchap_key(nvme_ctrl_t c)
 {
-	const char *slots_sysfs_dir = nvme_slots_sysfs_dir();
-	_cleanup_free_ char *target_addr = NULL;
-	_cleanup_dir_ DIR *slots_dir = NULL;
-	int ret;
-	struct dirent *entry;
+	char *key;
 
-	if (!address)
-		return NULL;
+	if (c->dhchap_ctrl_key || !c->sysfs_dir)
+		return c->dhchap_ctrl_key;
+	key = nvme_get_ctrl_attr(c, "dhchap_ctrl_secret");
+	if (key && !strcmp(key, "none")) {
+		free(key);
+		key = NULL;
+	}
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (!c->dhchap_ctrl_key)
+		c->dhchap_ctrl_key = key;
+	else
+		free(key);
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	return c->dhchap_ctrl_key;
+}
 
-	slots_dir = opendir(slots_sysfs_dir);
-	if (!slots_dir) {
-		nvme_msg(r, LOG_WARNING, "failed to open slots dir %s\n",
-		slots_sysfs_dir);
-		return NULL;
+void nvme_ctrl_set_dhchap_key(nvme_ctrl_t c, const char *key)
+{
+	if (c->dhchap_ctrl_key) {
+		free(c->dhchap_ctrl_key);
+		c->dhchap_ctrl_key = NULL;
 	}
+	if (key)
+		c->dhchap_ctrl_key = strdup(key);
+}
 
-	target_addr = strndup(address, 10);
-	while ((entry = readdir(slots_dir))) {
-		if (entry->d_type == DT_DIR &&
-		    strncmp(entry->d_name, ".", 1) != 0 &&
-		    strncmp(entry->d_name, "..", 2) != 0) {
-			_cleanup_free_ char *path = NULL;
-			_cleanup_free_ char *addr = NULL;
+void nvme_ctrl_set_discovered(nvme_ctrl_t c, bool discovered)
+{
+	c->discovered = discovered;
+}
 
-			ret = asprintf(&path, "%s/%s",
-				       slots_sysfs_dir, entry->d_name);
-			if (ret < 0) {
-				errno = ENOMEM;
-				return NULL;
-			}
-			addr = nvme_get_attr(path, "address");
-			if (strcmp(addr, target_addr) == 0)
-				return strdup(entry->d_name);
-		}
-	}
-	return NULL;
+bool nvme_ctrl_is_discovered(nvme_ctrl_t c)
+{
+	return c->discovered;
 }
 
-static int nvme_configure_ctrl(nvme_root_t r, nvme_ctrl_t c, const char *path,
-			       const char *name)
+void nvme_ctrl_set_persistent(nvme_ctrl_t c, bool persistent)
 {
-	DIR *d;
-	char *host_key, *tls_psk;
+	c->persistent = persistent;
+}
 
-	d = opendir(path);
-	if (!d) {
-		nvme_msg(r, LOG_ERR, "Failed to open ctrl dir %s, error %d\n",
-			 path, errno);
-		errno = ENODEV;
-		return -1;
+bool nvme_ctrl_is_persistent(nvme_ctrl_t c)
+{
+	return c->persistent;
+}
+
+bool nvme_ctrl_config_is_dirty(nvme_ctrl_t c)
+{
+	return c->cfg_dirty;
+}
+
+void nvme_ctrl_config_clear_dirty(nvme_ctrl_t c)
+{
+	c->cfg_dirty = false;
+}
+
+void nvme_ctrl_set_discovery_ctrl(nvme_ctrl_t c, bool discovery)
+{
+	c->discovery_ctrl = discovery;
+}
+
+bool nvme_ctrl_is_discovery_ctrl(nvme_ctrl_t c)
+{
+	return c->discovery_ctrl;
+}
+
+void nvme_ctrl_set_unique_discovery_ctrl(nvme_ctrl_t c, bool unique)
+{
+	c->unique_discovery_ctrl = unique;
+}
+
+bool nvme_ctrl_is_unique_discovery_ctrl(nvme_ctrl_t c)
+{
+	return c->unique_discovery_ctrl;
+}
+
+void nvme_ctrl_clear_identify_cache(nvme_ctrl_t c)
+{
+	struct nvme_id_cache_entry *e, *_e;
+
+	list_for_each_safe(&c->id_cache, e, _e, entry) {
+		list_del(&e->entry);
+		free(e->data);
+		free(e);
 	}
-	closedir(d);
+}
 
-	c->fd = -1;
-	c->name = strdup(name);
-	c->sysfs_dir = (char *)path;
-	c->firmware = nvme_get_ctrl_attr(c, "firmware_rev");
-	c->model = nvme_get_ctrl_attr(c, "model");
-	c->state = nvme_get_ctrl_attr(c, "state");
-	c->numa_node = nvme_get_ctrl_attr(c, "numa_node");
-	c->queue_count = nvme_get_ctrl_attr(c, "queue_count");
-	c->serial = nvme_get_ctrl_attr(c, "serial");
-	c->sqsize = nvme_get_ctrl_attr(c, "sqsize");
-	host_key = nvme_get_ctrl_attr(c, "dhchap_secret");
-	if (host_key && c->s && c->s->h && c->s->h->dhchap_key &&
-			(!strcmp(c->s->h->dhchap_key, host_key) ||
-			 !strcmp("none", host_key))) {
-		free(host_key);
-		host_key = NULL;
+void nvme_ctrl_enable_identify_cache(nvme_ctrl_t c, bool enabled)
+{
+	c->id_cache_enabled = enabled;
+	if (!enabled)
+		nvme_ctrl_clear_identify_cache(c);
+}
+
+static struct nvme_id_cache_entry *
+nvme_ctrl_id_cache_find(nvme_ctrl_t c, struct nvme_identify_args *args)
+{
+	struct nvme_id_cache_entry *e;
+
+	list_for_each(&c->id_cache, e, entry) {
+		if (e->cns == args->cns && e->csi == args->csi &&
+		    e->nsid == args->nsid &&
+		    e->cns_specific_id == args->cns_specific_id &&
+		    e->cntid == args->cntid && e->uuidx == args->uuidx)
+			return e;
 	}
-	if (host_key)
-		c->dhchap_key = host_key;
-	c->dhchap_ctrl_key = nvme_get_ctrl_attr(c, "dhchap_ctrl_secret");
-	if (c->dhchap_ctrl_key && !strcmp(c->dhchap_ctrl_key, "none")) {
-		free(c->dhchap_ctrl_key);
-		c->dhchap_ctrl_key = NULL;
+	return NULL;
+}
+
+static void nvme_ctrl_id_cache_store(nvme_ctrl_t c,
+				     struct nvme_identify_args *args)
+{
+	struct nvme_id_cache_entry *e;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return;
+	e->data = malloc(NVME_IDENTIFY_DATA_SIZE);
+	if (!e->data) {
+		free(e);
+		return;
 	}
-	tls_psk = nvme_get_ctrl_attr(c, "tls_key");
-	if (tls_psk) {
-		char *endptr;
-		long key_id = strtol(tls_psk, &endptr, 16);
+	memcpy(e->data, args->data, NVME_IDENTIFY_DATA_SIZE);
+	e->cns = args->cns;
+	e->csi = args->csi;
+	e->nsid = args->nsid;
+	e->cns_specific_id = args->cns_specific_id;
+	e->cntid = args->cntid;
+	e->uuidx = args->uuidx;
+	list_add(&c->id_cache, &e->entry);
+}
 
-		if (endptr != tls_psk) {
-			c->cfg.tls_key = key_id;
-			c->cfg.tls = true;
+int nvme_ctrl_identify_cached(nvme_ctrl_t c, struct nvme_identify_args *args)
+{
+	struct nvme_id_cache_entry *e;
+	int ret;
+
+	if (c->id_cache_enabled) {
+		e = nvme_ctrl_id_cache_find(c, args);
+		if (e) {
+			memcpy(args->data, e->data, NVME_IDENTIFY_DATA_SIZE);
+			if (args->result)
+				*args->result = 0;
+			return 0;
 		}
 	}
-	c->cntrltype = nvme_get_ctrl_attr(c, "cntrltype");
-	c->cntlid = nvme_get_ctrl_attr(c, "cntlid");
-	c->dctype = nvme_get_ctrl_attr(c, "dctype");
-	c->phy_slot = nvme_ctrl_lookup_phy_slot(r, c->address);
 
-	errno = 0; /* cleanup after nvme_get_ctrl_attr() */
-	return 0;
+	args->fd = nvme_ctrl_get_fd(c);
+	if (args->fd < 0)
+		return -1;
+	ret = nvme_identify(args);
+	if (!ret && c->id_cache_enabled)
+		nvme_ctrl_id_cache_store(c, args);
+	return ret;
 }
 
-int nvme_init_ctrl(nvme_host_t h, nvme_ctrl_t c, int instance)
+int nvme_ctrl_identify(nvme_ctrl_t c, struct nvme_id_ctrl *id)
 {
-	_cleanup_free_ char *subsys_name = NULL;
-	_cleanup_free_ char *name = NULL;
-	nvme_subsystem_t s;
-	char *path;
+	struct nvme_identify_args args = {
+		.result = NULL,
+		.data = id,
+		.args_size = sizeof(args),
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.cns = NVME_IDENTIFY_CNS_CTRL,
+		.csi = NVME_CSI_NVM,
+		.nsid = NVME_NSID_NONE,
+		.cntid = NVME_CNTLID_NONE,
+		.cns_specific_id = NVME_CNSSPECID_NONE,
+		.uuidx = NVME_UUID_NONE,
+	};
+
+	return nvme_ctrl_identify_cached(c, &args);
+}
+
+nvme_ns_t nvme_ctrl_first_ns(nvme_ctrl_t c)
+{
+	return list_top(&c->namespaces, struct nvme_ns, entry);
+}
+
+nvme_ns_t nvme_ctrl_next_ns(nvme_ctrl_t c, nvme_ns_t n)
+{
+	return n ? list_next(&c->namespaces, n, entry) : NULL;
+}
+
+nvme_path_t nvme_ctrl_first_path(nvme_ctrl_t c)
+{
+	return list_top(&c->paths, struct nvme_path, entry);
+}
+
+nvme_path_t nvme_ctrl_next_path(nvme_ctrl_t c, nvme_path_t p)
+{
+	return p ? list_next(&c->paths, p, entry) : NULL;
+}
+
+#define FREE_CTRL_ATTR(a) \
+	do { if (a) { nvme_tree_free(a); (a) = NULL; } } while (0)
+void nvme_deconfigure_ctrl(nvme_ctrl_t c)
+{
+	nvme_ctrl_release_fd(c);
+	nvme_ctrl_clear_identify_cache(c);
+	nvme_root_unindex_ctrl_name(c);
+	FREE_CTRL_ATTR(c->name);
+	FREE_CTRL_ATTR(c->sysfs_dir);
+	FREE_CTRL_ATTR(c->firmware);
+	FREE_CTRL_ATTR(c->model);
+	FREE_CTRL_ATTR(c->state);
+	FREE_CTRL_ATTR(c->numa_node);
+	FREE_CTRL_ATTR(c->queue_count);
+	FREE_CTRL_ATTR(c->serial);
+	FREE_CTRL_ATTR(c->sqsize);
+	FREE_CTRL_ATTR(c->dhchap_key);
+	FREE_CTRL_ATTR(c->dhchap_ctrl_key);
+	FREE_CTRL_ATTR(c->address);
+	FREE_CTRL_ATTR(c->dctype);
+	FREE_CTRL_ATTR(c->cntrltype);
+	FREE_CTRL_ATTR(c->cntlid);
+	FREE_CTRL_ATTR(c->phy_slot);
+	FREE_CTRL_ATTR(c->connect_args);
+	FREE_CTRL_ATTR(c->disc_log);
+}
+
+int nvme_disconnect_ctrl(nvme_ctrl_t c)
+{
+	nvme_root_t r = c->s && c->s->h ? c->s->h->r : NULL;
 	int ret;
 
-	ret = asprintf(&name, "nvme%d", instance);
-	if (ret < 0) {
-		errno = ENOMEM;
-		return -1;
-	}
-	ret = asprintf(&path, "%s/%s", nvme_ctrl_sysfs_dir(), name);
+	ret = nvme_set_attr(nvme_ctrl_get_sysfs_dir(c),
+			    "delete_controller", "1");
 	if (ret < 0) {
-		errno = ENOMEM;
+		nvme_msg(r, LOG_ERR, "%s: failed to disconnect, error %d\n",
+			 c->name, errno);
 		return ret;
 	}
+	nvme_msg(r, LOG_INFO, "%s: %s disconnected\n", c->name, c->subsysnqn);
+	nvme_deconfigure_ctrl(c);
+	return 0;
+}
 
-	ret = nvme_configure_ctrl(h->r, c, path, name);
-	if (ret < 0) {
-		free(path);
-		return ret;
-	}
+void nvme_unlink_ctrl(nvme_ctrl_t c)
+{
+	nvme_topo_changed(root_from_ctrl(c));
+	nvme_root_unindex_ctrl(c);
+	list_del_init(&c->entry);
+	c->s = NULL;
+}
 
-	c->address = nvme_get_attr(path, "address");
-	if (!c->address && strcmp(c->transport, "loop")) {
-		errno = ENVME_CONNECT_INVAL_TR;
-		return -1;
-	}
+static void __nvme_free_ctrl(nvme_ctrl_t c)
+{
+	struct nvme_path *p, *_p;
+	struct nvme_ns *n, *_n;
 
-	subsys_name = nvme_ctrl_lookup_subsystem_name(h->r, name);
-	if (!subsys_name) {
-		nvme_msg(h->r, LOG_ERR,
-			 "Failed to lookup subsystem name for %s\n",
-			 c->name);
-		errno = ENVME_CONNECT_LOOKUP_SUBSYS_NAME;
-		return -1;
-	}
-	s = nvme_lookup_subsystem(h, subsys_name, c->subsysnqn);
-	if (!s) {
-		errno = ENVME_CONNECT_LOOKUP_SUBSYS;
-		return -1;
-	}
-	if (s->subsystype && !strcmp(s->subsystype, "discovery"))
-		c->discovery_ctrl = true;
-	c->s = s;
-	list_add(&s->ctrls, &c->entry);
-	return ret;
+	nvme_unlink_ctrl(c);
+
+	nvme_ctrl_for_each_path_safe(c, p, _p)
+		nvme_free_path(p);
+
+	nvme_ctrl_for_each_ns_safe(c, n, _n)
+		__nvme_free_ns(n);
+
+	nvme_deconfigure_ctrl(c);
+
+	FREE_CTRL_ATTR(c->transport);
+	FREE_CTRL_ATTR(c->subsysnqn);
+	FREE_CTRL_ATTR(c->traddr);
+	FREE_CTRL_ATTR(c->cfg.host_traddr);
+	FREE_CTRL_ATTR(c->cfg.host_iface);
+	FREE_CTRL_ATTR(c->trsvcid);
+	nvme_tree_free(c);
 }
 
-static nvme_ctrl_t nvme_ctrl_alloc(nvme_root_t r, nvme_subsystem_t s,
-				   const char *path, const char *name)
+void nvme_free_ctrl(nvme_ctrl_t c)
 {
-	nvme_ctrl_t c, p;
-	_cleanup_free_ char *addr = NULL, *address = NULL;
-	char *a = NULL, *e = NULL;
-	_cleanup_free_ char *transport = NULL;
-	char *traddr = NULL, *trsvcid = NULL;
-	char *host_traddr = NULL, *host_iface = NULL;
-	int ret;
+	__nvme_free_ctrl(c);
+}
+
+static bool traddr_is_hostname(const char *transport, const char *traddr)
+{
+	char addrstr[NVMF_TRADDR_SIZE];
+
+	if (!traddr || !transport)
+		return false;
+	if (!strcmp(traddr, "none"))
+		return false;
+	if (strcmp(transport, "tcp") &&
+	    strcmp(transport, "rdma"))
+		return false;
+	if (inet_pton(AF_INET, traddr, addrstr) > 0 ||
+	    inet_pton(AF_INET6, traddr, addrstr) > 0)
+		return false;
+	return true;
+}
+
+struct nvme_ctrl *nvme_create_ctrl(nvme_root_t r,
+				   const char *subsysnqn, const char *transport,
+				   const char *traddr, const char *host_traddr,
+				   const char *host_iface, const char *trsvcid)
+{
+	struct nvme_ctrl *c;
 
-	transport = nvme_get_attr(path, "transport");
 	if (!transport) {
-		errno = ENXIO;
+		nvme_msg(r, LOG_ERR, "No transport specified\n");
+		errno = EINVAL;
 		return NULL;
 	}
-	/* Parse 'address' string into components */
-	addr = nvme_get_attr(path, "address");
-	if (!addr) {
-		_cleanup_free_ char *rpath = NULL;
-		char *p = NULL, *_a = NULL;
+	if (strncmp(transport, "loop", 4) &&
+	    strncmp(transport, "pcie", 4) && !traddr) {
+		nvme_msg(r, LOG_ERR, "No transport address for '%s'\n",
+			 transport);
+	       errno = EINVAL;
+	       return NULL;
+	}
+	if (!subsysnqn) {
+		nvme_msg(r, LOG_ERR, "No subsystem NQN specified\n");
+		errno = EINVAL;
+		return NULL;
+	}
+	c = nvme_tree_calloc(r, sizeof(*c));
+	if (!c) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	c->fd = -1;
+	c->sysfs_fd = -1;
+	nvmf_default_config(&c->cfg);
+	list_head_init(&c->namespaces);
+	list_head_init(&c->paths);
+	list_head_init(&c->id_cache);
+	list_node_init(&c->entry);
+	c->transport = nvme_tree_intern(r, transport);
+	c->subsysnqn = nvme_tree_intern(r, subsysnqn);
+	if (traddr)
+		c->traddr = nvme_tree_strdup(r, traddr);
+	if (host_traddr) {
+		if (traddr_is_hostname(transport, host_traddr))
+			c->cfg.host_traddr = hostname2traddr(r, host_traddr);
+		if (!c->cfg.host_traddr)
+			c->cfg.host_traddr = strdup(host_traddr);
+	}
+	if (host_iface)
+		c->cfg.host_iface = strdup(host_iface);
+	if (trsvcid)
+		c->trsvcid = nvme_tree_intern(r, trsvcid);
 
-		/* loop transport might not have an address */
-		if (!strcmp(transport, "loop"))
-			goto skip_address;
+	return c;
+}
 
-		/* Older kernel don't support pcie transport addresses */
-		if (strcmp(transport, "pcie")) {
-			errno = ENXIO;
-			return NULL;
-		}
-		/* Figure out the PCI address from the attribute path */
-		rpath = realpath(path, NULL);
-		if (!rpath) {
-			errno = ENOMEM;
-			return NULL;
-		}
-		a = strtok_r(rpath, "/", &e);
-		while(a && strlen(a)) {
-		    if (_a)
-			p = _a;
-		    _a = a;
-		    if (!strncmp(a, "nvme", 4))
-			break;
-		    a = strtok_r(NULL, "/", &e);
-		}
-		if (p)
-			addr = strdup(p);
-	} else if (!strcmp(transport, "pcie")) {
-		/* The 'address' string is the transport address */
-		traddr = addr;
-	} else {
-		address = strdup(addr);
-		a = strtok_r(address, ",", &e);
-		while (a && strlen(a)) {
-			if (!strncmp(a, "traddr=", 7))
-				traddr = a + 7;
-			else if (!strncmp(a, "trsvcid=", 8))
-				trsvcid = a + 8;
-			else if (!strncmp(a, "host_traddr=", 12))
-				host_traddr = a + 12;
-			else if (!strncmp(a, "host_iface=", 11))
-				host_iface = a + 11;
-			a = strtok_r(NULL, ",", &e);
-		}
+/**
+ * _tcp_ctrl_match_host_traddr_no_src_addr() - Match host_traddr w/o src_addr
+ * @c:	An existing controller instance
+ * @candidate:	Candidate ctrl we're trying to match with @c.
+ *
+ * On kernels prior to 6.1 (i.e. src_addr is not available), try to match
+ * a candidate controller's host_traddr to that of an existing controller.
+ *
+ * This function takes an optimistic approach. In doubt, it will declare a
+ * match and return true.
+ *
+ * Return: true if @c->host_traddr matches @candidate->host_traddr. false otherwise.
+ */
+static bool _tcp_ctrl_match_host_traddr_no_src_addr(struct nvme_ctrl *c, struct candidate_args *candidate)
+{
+	if (c->cfg.host_traddr)
+		return candidate->addreq(candidate->host_traddr, c->cfg.host_traddr);
+
+	/* If c->cfg.host_traddr is NULL, then the controller (c)
+	 * uses the interface's primary address as the source
+	 * address. If c->cfg.host_iface is defined we can
+	 * determine the primary address associated with that
+	 * interface and compare that to the candidate->host_traddr.
+	 */
+	if (c->cfg.host_iface)
+		return nvme_iface_primary_addr_matches(candidate->iface_list,
+						       c->cfg.host_iface,
+						       candidate->host_traddr);
+
+	/* If both c->cfg.host_traddr and c->cfg.host_iface are
+	 * NULL, we don't have enough information to make a
+	 * 100% positive match. Regardless, let's be optimistic
+	 * and assume that we have a match.
+	 */
+	nvme_msg(root_from_ctrl(c), LOG_DEBUG,
+		 "Not enough data, but assume %s matches candidate's host_traddr: %s\n",
+		 nvme_ctrl_get_name(c), candidate->host_traddr);
+
+	return true;
+}
+
+/**
+ * _tcp_ctrl_match_host_iface_no_src_addr() - Match host_iface w/o src_addr
+ * @c:	An existing controller instance
+ * @candidate:	Candidate ctrl we're trying to match with @c.
+ *
+ * On kernels prior to 6.1 (i.e. src_addr is not available), try to match
+ * a candidate controller's host_iface to that of an existing controller.
+ *
+ * This function takes an optimistic approach. In doubt, it will declare a
+ * match and return true.
+ *
+ * Return: true if @c->host_iface matches @candidate->host_iface. false otherwise.
+ */
+static bool _tcp_ctrl_match_host_iface_no_src_addr(struct nvme_ctrl *c, struct candidate_args *candidate)
+{
+	if (c->cfg.host_iface)
+		return streq0(candidate->host_iface, c->cfg.host_iface);
+
+	/* If c->cfg.host_traddr is not NULL we can infer the controller's (c)
+	 * interface from it and compare it to the candidate->host_iface.
+	 */
+	if (c->cfg.host_traddr) {
+		const char *c_host_iface;
+
+		c_host_iface = nvme_iface_matching_addr(candidate->iface_list, c->cfg.host_traddr);
+		return streq0(candidate->host_iface, c_host_iface);
 	}
-skip_address:
-	p = NULL;
-	do {
-		c = nvme_lookup_ctrl(s, transport, traddr,
-				     host_traddr, host_iface, trsvcid, p);
-		if (c) {
-			if (!c->name)
-				break;
-			if (!strcmp(c->name, name)) {
-				nvme_msg(r, LOG_DEBUG,
-					 "found existing ctrl %s\n", c->name);
-				break;
-			}
-			nvme_msg(r, LOG_DEBUG, "skipping ctrl %s\n", c->name);
-			p = c;
-		}
-	} while (c);
-	if (!c)
-		c = p;
-	if (!c && !p) {
-		nvme_msg(r, LOG_ERR, "failed to lookup ctrl\n");
-		errno = ENODEV;
-		return NULL;
+
+	/* If both c->cfg.host_traddr and c->cfg.host_iface are
+	 * NULL, we don't have enough information to make a
+	 * 100% positive match. Regardless, let's be optimistic
+	 * and assume that we have a match.
+	 */
+	nvme_msg(root_from_ctrl(c), LOG_DEBUG,
+		 "Not enough data, but assume %s matches candidate's host_iface: %s\n",
+		 nvme_ctrl_get_name(c), candidate->host_iface);
+
+	return true;
+}
+
+/**
+ * _tcp_opt_params_match_no_src_addr() - Match optional host_traddr/host_iface w/o src_addr
+ * @c:	An existing controller instance
+ * @candidate:	Candidate ctrl we're trying to match with @c.
+ *
+ * Before kernel 6.1, the src_addr was not reported by the kernel which makes
+ * it hard to match a candidate's host_traddr and host_iface to an existing
+ * controller if that controller was created without specifying the
+ * host_traddr and/or host_iface. This function tries its best in the absense
+ * of a src_addr to match @c to @candidate. This may not be 100% accurate.
+ * Only the src_addr can provide 100% accuracy.
+ *
+ * This function takes an optimistic approach. In doubt, it will declare a
+ * match and return true.
+ *
+ * Return: true if @c matches @candidate. false otherwise.
+ */
+static bool _tcp_opt_params_match_no_src_addr(struct nvme_ctrl *c, struct candidate_args *candidate)
+{
+	/* Check host_traddr only if candidate is interested */
+	if (candidate->host_traddr) {
+		if (!_tcp_ctrl_match_host_traddr_no_src_addr(c, candidate))
+			return false;
 	}
-	c->address = addr;
-	addr = NULL;
-	if (s->subsystype && !strcmp(s->subsystype, "discovery"))
-		c->discovery_ctrl = true;
-	ret = nvme_configure_ctrl(r, c, path, name);
-	return (ret < 0) ? NULL : c;
+
+	/* Check host_iface only if candidate is interested */
+	if (candidate->host_iface) {
+		if (!_tcp_ctrl_match_host_iface_no_src_addr(c, candidate))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * _tcp_opt_params_match() - Match optional host_traddr/host_iface
+ * @c:	An existing controller instance
+ * @candidate:	Candidate ctrl we're trying to match with @c.
+ *
+ * The host_traddr and host_iface are optional for TCP. When they are not
+ * specified, the kernel looks up the destination IP address (traddr) in the
+ * routing table to determine the best interface for the connection. The
+ * kernel then retrieves the primary IP address assigned to that interface
+ * and uses that as the connection’s source address.
+ *
+ * An interface’s primary address is the default source address used for
+ * all connections made on that interface unless host-traddr is used to
+ * override the default. Kernel-selected interfaces and/or source addresses
+ * are hidden from user-space applications unless the kernel makes that
+ * information available through the "src_addr" attribute in the
+ * sysfs (kernel 6.1 or later).
+ *
+ * Sometimes, an application may force the interface by specifying the
+ * "host-iface" or may force a different source address (instead of the
+ * primary address) by providing the "host-traddr".
+ *
+ * If the candidate specifies the host_traddr and/or host_iface but they
+ * do not match the existing controller's host_traddr and/or host_iface
+ * (they could be NULL), we may still be able to find a match by taking
+ * the existing controller's src_addr into consideration since that
+ * parameter identifies the actual source address of the connection and
+ * therefore can be used to infer the interface of the connection. However,
+ * the src_addr can only be read from the nvme device's sysfs "address"
+ * attribute starting with kernel 6.1 (or kernels that backported the
+ * src_addr patch).
+ *
+ * For legacy kernels that do not provide the src_addr we must use a
+ * different algorithm to match the host_traddr and host_iface, but
+ * it's not 100% accurate.
+ *
+ * Return: true if @c matches @candidate. false otherwise.
+ */
+static bool _tcp_opt_params_match(struct nvme_ctrl *c, struct candidate_args *candidate)
+{
+	char *src_addr, buffer[INET6_ADDRSTRLEN];
+
+	/* Check if src_addr is available (kernel 6.1 or later) */
+	src_addr = nvme_ctrl_get_src_addr(c, buffer, sizeof(buffer));
+	if (!src_addr)
+		return _tcp_opt_params_match_no_src_addr(c, candidate);
+
+	/* Check host_traddr only if candidate is interested */
+	if (candidate->host_traddr &&
+	    !candidate->addreq(candidate->host_traddr, src_addr))
+		return false;
+
+	/* Check host_iface only if candidate is interested */
+	if (candidate->host_iface &&
+	    !streq0(candidate->host_iface,
+		    nvme_iface_matching_addr(candidate->iface_list, src_addr)))
+		return false;
+
+	return true;
+}
+
+/**
+ * _tcp_match_ctrl() - Check if controller matches candidate (TCP only)
+ * @c:	An existing controller instance
+ * @candidate:	Candidate ctrl we're trying to match with @c.
+ *
+ * We want to determine if an existing controller can be re-used
+ * for the candidate controller we're trying to instantiate.
+ *
+ * For TCP, we do not have a match if the candidate's transport, traddr,
+ * trsvcid are not identical to those of the the existing controller.
+ * These 3 parameters are mandatory for a match.
+ *
+ * The host_traddr and host_iface are optional. When the candidate does
+ * not specify them (both NULL), we can ignore them. Otherwise, we must
+ * employ advanced investigation techniques to determine if there's a match.
+ *
+ * Return: true if a match is found, false otherwise.
+ */
+static bool _tcp_match_ctrl(struct nvme_ctrl *c, struct candidate_args *candidate)
+{
+	if (!streq0(c->transport, candidate->transport))
+		return false;
+
+	if (!streq0(c->trsvcid, candidate->trsvcid))
+		return false;
+
+	if (!candidate->addreq(c->traddr, candidate->traddr))
+		return false;
+
+	if (candidate->well_known_nqn && !nvme_ctrl_is_discovery_ctrl(c))
+		return false;
+
+	if (candidate->subsysnqn && !streq0(c->subsysnqn, candidate->subsysnqn))
+		return false;
+
+	/* Check host_traddr / host_iface only if candidate is interested */
+	if ((candidate->host_iface || candidate->host_traddr) &&
+	    !_tcp_opt_params_match(c, candidate))
+		return false;
+
+	return true;
+}
+
+/**
+ * _match_ctrl() - Check if controller matches candidate (non TCP transport)
+ * @c:	An existing controller instance
+ * @candidate:	Candidate ctrl we're trying to match with @c.
+ *
+ * We want to determine if an existing controller can be re-used
+ * for the candidate controller we're trying to instantiate. This function
+ * is used for all transports except TCP.
+ *
+ * Return: true if a match is found, false otherwise.
+ */
+static bool _match_ctrl(struct nvme_ctrl *c, struct candidate_args *candidate)
+{
+	if (!streq0(c->transport, candidate->transport))
+		return false;
+
+	if (candidate->traddr && c->traddr &&
+	    !candidate->addreq(c->traddr, candidate->traddr))
+		return false;
+
+	if (candidate->host_traddr && c->cfg.host_traddr &&
+	    !candidate->addreq(c->cfg.host_traddr, candidate->host_traddr))
+		return false;
+
+	if (candidate->host_iface && c->cfg.host_iface &&
+	    !streq0(c->cfg.host_iface, candidate->host_iface))
+		return false;
+
+	if (candidate->trsvcid && c->trsvcid &&
+	    !streq0(c->trsvcid, candidate->trsvcid))
+		return false;
+
+	if (candidate->well_known_nqn && !nvme_ctrl_is_discovery_ctrl(c))
+		return false;
+
+	if (candidate->subsysnqn && !streq0(c->subsysnqn, candidate->subsysnqn))
+		return false;
+
+	return true;
+}
+/**
+ * _candidate_init() - Init candidate and get the matching function
+ *
+ * @candidate:		Candidate struct to initialize
+ * @transport:		Transport name
+ * @traddr:		Transport address
+ * @trsvcid:		Transport service identifier
+ * @subsysnqn:		Subsystem NQN
+ * @host_traddr:	Host transport address
+ * @host_iface:		Host interface name
+ * @host_iface:		Host interface name
+ *
+ * The function _candidate_free() must be called to release resources once
+ * the candidate object is not longer required.
+ *
+ * Return: The matching function to use when comparing an existing
+ * controller to the candidate controller.
+ */
+static ctrl_match_t _candidate_init(struct candidate_args *candidate,
+				    const char *transport,
+				    const char *traddr,
+				    const char *trsvcid,
+				    const char *subsysnqn,
+				    const char *host_traddr,
+				    const char *host_iface)
+{
+	memset(candidate, 0, sizeof(*candidate));
+
+	candidate->traddr = traddr;
+	candidate->trsvcid = trsvcid;
+	candidate->transport = transport;
+	candidate->subsysnqn = subsysnqn;
+	candidate->host_iface = host_iface;
+	candidate->host_traddr = host_traddr;
+
+	if (streq0(subsysnqn, NVME_DISC_SUBSYS_NAME)) {
+		/* Since TP8013, the NQN of discovery controllers can be the
+		 * well-known NQN (i.e. nqn.2014-08.org.nvmexpress.discovery) or
+		 * a unique NQN. A DC created using the well-known NQN may later
+		 * display a unique NQN when looked up in the sysfs. Therefore,
+		 * ignore (i.e. set to NULL) the well-known NQN when looking for
+		 * a match.
+		 */
+		candidate->subsysnqn = NULL;
+		candidate->well_known_nqn = true;
+	}
+
+	if (streq0(transport, "tcp")) {
+		/* For TCP we may need to access the interface map.
+		 * Let's retrieve and cache the map.
+		 */
+		if (getifaddrs(&candidate->iface_list) == -1)
+			candidate->iface_list = NULL;
+
+		candidate->addreq = nvme_ipaddrs_eq;
+		return _tcp_match_ctrl;
+	}
+
+	if (streq0(transport, "rdma")) {
+		candidate->addreq = nvme_ipaddrs_eq;
+		return _match_ctrl;
+	}
+
+	/* All other transport types */
+	candidate->addreq = streqcase0;
+	return _match_ctrl;
+}
+
+/**
+ * _candidate_free() - Release resources allocated by _candidate_init()
+ *
+ * @candidate:	data to free.
+ */
+static void _candidate_free(struct candidate_args *candidate)
+{
+	freeifaddrs(candidate->iface_list); /* This is NULL-safe */
+}
+
+#define _cleanup_candidate_ __cleanup__(_candidate_free)
+
+nvme_ctrl_t __nvme_lookup_ctrl(nvme_subsystem_t s, const char *transport,
+			       const char *traddr, const char *host_traddr,
+			       const char *host_iface, const char *trsvcid,
+			       const char *subsysnqn, nvme_ctrl_t p)
+{
+	_cleanup_candidate_ struct candidate_args candidate = {};
+	struct nvme_ctrl *c, *matching_c = NULL;
+	ctrl_match_t ctrl_match;
+
+	/* Init candidate and get the matching function to use */
+	ctrl_match = _candidate_init(&candidate, transport, traddr, trsvcid,
+				     subsysnqn, host_traddr, host_iface);
+
+	/*
+	 * With a fully specified key, probe the root-wide hash index
+	 * first; hits are verified with the real matching function. A
+	 * miss (e.g. equivalent address spellings hashing differently)
+	 * falls back to the list walk below.
+	 */
+	if (!p && transport && traddr && trsvcid && candidate.subsysnqn &&
+	    s->h && s->h->r && s->h->r->ctrl_index.nr_buckets) {
+		struct nvme_ctrl_index *idx = &s->h->r->ctrl_index;
+		__u32 hash = nvme_ctrl_addr_hash(candidate.subsysnqn,
+						 transport, traddr, trsvcid);
+
+		list_for_each(&idx->addr_buckets[hash % idx->nr_buckets],
+			      c, addr_hash_entry)
+			if (c->s == s && ctrl_match(c, &candidate))
+				return c;
+	}
+
+	c = p ? nvme_subsystem_next_ctrl(s, p) : nvme_subsystem_first_ctrl(s);
+	for (; c != NULL; c = nvme_subsystem_next_ctrl(s, c)) {
+		if (ctrl_match(c, &candidate)) {
+			matching_c = c;
+			break;
+		}
+	}
+
+	return matching_c;
+}
+
+bool nvme_ctrl_config_match(struct nvme_ctrl *c, const char *transport,
+			    const char *traddr, const char *trsvcid,
+			    const char *subsysnqn, const char *host_traddr,
+			    const char *host_iface)
+{
+	_cleanup_candidate_ struct candidate_args candidate = {};
+	ctrl_match_t ctrl_match;
+
+	/* Init candidate and get the matching function to use */
+	ctrl_match = _candidate_init(&candidate, transport, traddr, trsvcid,
+				     subsysnqn, host_traddr, host_iface);
+
+	return ctrl_match(c, &candidate);
+}
+
+nvme_ctrl_t nvme_ctrl_find(nvme_subsystem_t s, const char *transport,
+			   const char *traddr, const char *trsvcid,
+			   const char *subsysnqn, const char *host_traddr,
+			   const char *host_iface)
+{
+	return __nvme_lookup_ctrl(s, transport, traddr, host_traddr, host_iface,
+				  trsvcid, subsysnqn, NULL/*p*/);
+}
+
+nvme_ctrl_t nvme_lookup_ctrl(nvme_subsystem_t s, const char *transport,
+			     const char *traddr, const char *host_traddr,
+			     const char *host_iface, const char *trsvcid,
+			     nvme_ctrl_t p)
+{
+	nvme_root_t r;
+	struct nvme_ctrl *c;
+
+	if (!s || !transport)
+		return NULL;
+
+	c = __nvme_lookup_ctrl(s, transport, traddr, host_traddr,
+			       host_iface, trsvcid, NULL, p);
+	if (c)
+		return c;
+
+	r = s->h ? s->h->r : NULL;
+	c = nvme_create_ctrl(r, s->subsysnqn, transport, traddr,
+			     host_traddr, host_iface, trsvcid);
+	if (c) {
+		c->s = s;
+		list_add(&s->ctrls, &c->entry);
+		nvme_root_index_ctrl(c);
+		nvme_topo_changed(s->h->r);
+		s->h->r->modified = true;
+	}
+	return c;
+}
+
+static int nvme_ctrl_scan_paths(nvme_root_t r, struct nvme_ctrl *c)
+{
+	_cleanup_dirents_ struct dirents paths = {};
+	int i;
+
+	if (r->create_only) {
+		nvme_msg(r, LOG_DEBUG,
+			 "skipping path scan for ctrl %s\n", c->name);
+		return 0;
+	}
+	paths.num = nvme_scan_ctrl_namespace_paths(c, &paths.ents);
+	if (paths.num < 0)
+		return paths.num;
+
+	for (i = 0; i < paths.num; i++)
+		nvme_ctrl_scan_path(r, c, paths.ents[i]->d_name);
+
+	return 0;
+}
+
+/*
+ * Bulk namespace scan. Dense subsystems can expose a thousand or more
+ * namespaces, and probing each one through individual sysfs attribute
+ * reads dominates the scan time. When enabled via nvme_root_set_bulk_scan()
+ * the active namespace ID list (CNS 02h) is fetched once through the
+ * controller's admin queue, and the Identify Namespace and ID Descriptor
+ * List payloads for all active namespaces are retrieved in a single
+ * batched pass, so each namespace object is assembled from the identify
+ * data instead of per-namespace sysfs round trips.
+ */
+static int nvme_ctrl_identify_active_nsids(struct nvme_ctrl *c, __u32 **nsids)
+{
+	_cleanup_free_ struct nvme_ns_list *list = NULL;
+	__u32 *ids = NULL, *tmp;
+	unsigned int nr = 0, i;
+	__u32 prev = 0;
+	int fd;
+
+	fd = nvme_ctrl_get_fd(c);
+	if (fd < 0)
+		return -1;
+
+	list = __nvme_alloc(sizeof(*list));
+	if (!list) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (;;) {
+		if (nvme_identify_active_ns_list(fd, prev, list))
+			goto free_ids;
+		for (i = 0; i < NVME_ID_NS_LIST_MAX && list->ns[i]; i++)
+			;
+		if (!i)
+			break;
+		tmp = realloc(ids, (nr + i) * sizeof(*tmp));
+		if (!tmp) {
+			errno = ENOMEM;
+			goto free_ids;
+		}
+		ids = tmp;
+		for (i = 0; i < NVME_ID_NS_LIST_MAX && list->ns[i]; i++)
+			ids[nr++] = le32_to_cpu(list->ns[i]);
+		if (i < NVME_ID_NS_LIST_MAX)
+			break;
+		prev = ids[nr - 1];
+	}
+
+	*nsids = ids;
+	return nr;
+
+free_ids:
+	free(ids);
+	return -1;
+}
+
+static void nvme_ns_apply_geometry(struct nvme_ns *n, struct nvme_id_ns *id)
+{
+	__u8 flbas;
+
+	nvme_id_ns_flbas_to_lbaf_inuse(id->flbas, &flbas);
+	n->lbaf_inuse = flbas;
+	n->lba_shift = id->lbaf[flbas].ds;
+	n->lba_size = 1 << n->lba_shift;
+	n->lba_count = le64_to_cpu(id->nsze);
+	n->lba_util = le64_to_cpu(id->nuse);
+	n->meta_size = le16_to_cpu(id->lbaf[flbas].ms);
+	n->util_probed = true;
+}
+
+static void nvme_ns_init_from_id(struct nvme_ns *n, struct nvme_id_ns *id,
+				 void *descs)
+{
+	size_t off;
+
+	nvme_ns_apply_geometry(n, id);
+	memcpy(n->eui64, id->eui64, sizeof(n->eui64));
+	memcpy(n->nguid, id->nguid, sizeof(n->nguid));
+	n->csi = NVME_CSI_NVM;
+
+	for (off = 0;
+	     off + sizeof(struct nvme_ns_id_desc) < NVME_IDENTIFY_DATA_SIZE;) {
+		struct nvme_ns_id_desc *d =
+			(struct nvme_ns_id_desc *)((__u8 *)descs + off);
+
+		if (!d->nidl)
+			break;
+		switch (d->nidt) {
+		case NVME_NIDT_EUI64:
+			memcpy(n->eui64, d->nid, NVME_NIDT_EUI64_LEN);
+			break;
+		case NVME_NIDT_NGUID:
+			memcpy(n->nguid, d->nid, NVME_NIDT_NGUID_LEN);
+			break;
+		case NVME_NIDT_UUID:
+			memcpy(n->uuid, d->nid, NVME_NIDT_UUID_LEN);
+			break;
+		case NVME_NIDT_CSI:
+			n->csi = d->nid[0];
+			break;
+		}
+		off += sizeof(*d) + d->nidl;
+	}
+
+	n->ids_probed = true;
+}
+
+static int nvme_ns_path_nsid(const char *sysfs_dir, const char *name,
+			     __u32 *nsid)
+{
+	_cleanup_free_ char *path = NULL;
+	_cleanup_free_ char *attr = NULL;
+
+	if (asprintf(&path, "%s/%s", sysfs_dir, name) < 0)
+		return -1;
+	attr = nvme_get_attr(path, "nsid");
+	if (!attr)
+		return -1;
+	return nvme_strtou32(attr, nsid);
+}
+
+static int nvme_ctrl_scan_namespaces_bulk(nvme_root_t r, struct nvme_ctrl *c,
+					  struct dirents *namespaces)
+{
+	_cleanup_free_ __u32 *nsids = NULL;
+	_cleanup_free_ struct nvme_identify_args *args = NULL;
+	_cleanup_free_ __u8 *ids = NULL;
+	_cleanup_free_ __u8 *descs = NULL;
+	bool had_fd = c->fd >= 0;
+	int nr, i, ret = -1;
+
+	nr = nvme_ctrl_identify_active_nsids(c, &nsids);
+	if (nr <= 0)
+		goto out;
+
+	ids = __nvme_alloc((size_t)nr * NVME_IDENTIFY_DATA_SIZE);
+	descs = __nvme_alloc((size_t)nr * NVME_IDENTIFY_DATA_SIZE);
+	args = calloc(2 * nr, sizeof(*args));
+	if (!ids || !descs || !args) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct nvme_identify_args id_args = {
+			.args_size = sizeof(id_args),
+			.fd = c->fd,
+			.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+			.csi = NVME_CSI_NVM,
+			.nsid = nsids[i],
+			.cntid = NVME_CNTLID_NONE,
+			.cns_specific_id = NVME_CNSSPECID_NONE,
+			.uuidx = NVME_UUID_NONE,
+		};
+
+		id_args.cns = NVME_IDENTIFY_CNS_NS;
+		id_args.data = ids + (size_t)i * NVME_IDENTIFY_DATA_SIZE;
+		args[i] = id_args;
+		id_args.cns = NVME_IDENTIFY_CNS_NS_DESC_LIST;
+		id_args.data = descs + (size_t)i * NVME_IDENTIFY_DATA_SIZE;
+		args[nr + i] = id_args;
+	}
+
+	if (nvme_identify_batch(args, NULL, 2 * nr))
+		goto out;
+
+	for (i = 0; i < namespaces->num; i++) {
+		_cleanup_free_ char *blkdev = NULL;
+		struct nvme_ns *n;
+		__u32 nsid;
+		int j;
+
+		blkdev = nvme_ns_generic_to_blkdev(namespaces->ents[i]->d_name);
+		if (!blkdev)
+			continue;
+		if (nvme_ns_path_nsid(c->sysfs_dir, blkdev, &nsid)) {
+			nvme_msg(r, LOG_DEBUG,
+				 "bulk scan: no nsid for %s\n", blkdev);
+			continue;
+		}
+		for (j = 0; j < nr; j++)
+			if (nsids[j] == nsid)
+				break;
+		if (j == nr) {
+			nvme_msg(r, LOG_DEBUG,
+				 "bulk scan: %s nsid %u not in active list\n",
+				 blkdev, nsid);
+			continue;
+		}
+
+		n = calloc(1, sizeof(*n));
+		if (!n)
+			continue;
+		n->fd = -1;
+		n->sysfs_fd = -1;
+		n->lbaf_inuse = -1;
+		n->nsid = nsid;
+		n->name = strdup(blkdev);
+		nvme_ns_set_generic_name(n, blkdev);
+		if (asprintf(&n->sysfs_dir, "%s/%s", c->sysfs_dir, blkdev) < 0)
+			n->sysfs_dir = NULL;
+		list_head_init(&n->paths);
+		list_node_init(&n->entry);
+		nvme_ns_init_from_id(n, (struct nvme_id_ns *)
+				     (ids + (size_t)j * NVME_IDENTIFY_DATA_SIZE),
+				     descs + (size_t)j * NVME_IDENTIFY_DATA_SIZE);
+		nvme_ctrl_link_namespace(r, c, n);
+	}
+	ret = 0;
+
+out:
+	if (!had_fd)
+		nvme_ctrl_release_fd(c); /* Do not leak fds */
+	return ret;
+}
+
+/*
+ * Fill the cached geometry of @nss through @c's admin queue with one
+ * batch of Identify Namespace commands, instead of one command (or
+ * several sysfs reads) per namespace on first access.
+ */
+static int nvme_ctrl_prefetch_geometry(struct nvme_ctrl *c,
+				       struct nvme_ns **nss, int nr)
+{
+	_cleanup_free_ struct nvme_identify_args *args = NULL;
+	_cleanup_free_ __u8 *ids = NULL;
+	bool had_fd = c->fd >= 0;
+	int i, ret = -1;
+
+	if (nvme_ctrl_get_fd(c) < 0)
+		return -1;
+
+	ids = __nvme_alloc((size_t)nr * NVME_IDENTIFY_DATA_SIZE);
+	args = calloc(nr, sizeof(*args));
+	if (!ids || !args) {
+		errno = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct nvme_identify_args id_args = {
+			.args_size = sizeof(id_args),
+			.fd = c->fd,
+			.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+			.csi = NVME_CSI_NVM,
+			.nsid = nss[i]->nsid,
+			.cntid = NVME_CNTLID_NONE,
+			.cns_specific_id = NVME_CNSSPECID_NONE,
+			.uuidx = NVME_UUID_NONE,
+			.cns = NVME_IDENTIFY_CNS_NS,
+			.data = ids + (size_t)i * NVME_IDENTIFY_DATA_SIZE,
+		};
+
+		args[i] = id_args;
+	}
+
+	if (nvme_identify_batch(args, NULL, nr))
+		goto out;
+
+	pthread_mutex_lock(&nvme_lazy_lock);
+	for (i = 0; i < nr; i++)
+		nvme_ns_apply_geometry(nss[i], (struct nvme_id_ns *)
+				       (ids + (size_t)i * NVME_IDENTIFY_DATA_SIZE));
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	ret = nr;
+
+out:
+	if (!had_fd)
+		nvme_ctrl_release_fd(c); /* Do not leak fds */
+	return ret;
+}
+
+static int nvme_ns_geometry_pending(struct nvme_ns *n)
+{
+	return !n->util_probed || n->lbaf_inuse < 0;
+}
+
+int nvme_root_prefetch_ns_geometry(nvme_root_t r)
+{
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	struct nvme_ns *n;
+	struct nvme_ns **nss = NULL;
+	int nr, nr_done = 0, ret;
+
+	nvme_for_each_host(r, h) nvme_for_each_subsystem(h, s) {
+		nvme_subsystem_for_each_ctrl(s, c) {
+			nr = 0;
+			nvme_ctrl_for_each_ns(c, n)
+				nr++;
+			/* subsystem namespaces go through the first ctrl */
+			if (c == nvme_subsystem_first_ctrl(s))
+				nvme_subsystem_for_each_ns(s, n)
+					nr++;
+			if (!nr)
+				continue;
+
+			free(nss);
+			nss = calloc(nr, sizeof(*nss));
+			if (!nss) {
+				errno = ENOMEM;
+				return -1;
+			}
+
+			nr = 0;
+			nvme_ctrl_for_each_ns(c, n)
+				if (nvme_ns_geometry_pending(n))
+					nss[nr++] = n;
+			if (c == nvme_subsystem_first_ctrl(s))
+				nvme_subsystem_for_each_ns(s, n)
+					if (nvme_ns_geometry_pending(n))
+						nss[nr++] = n;
+			if (!nr)
+				continue;
+
+			ret = nvme_ctrl_prefetch_geometry(c, nss, nr);
+			if (ret > 0)
+				nr_done += ret;
+		}
+	}
+	free(nss);
+	return nr_done;
+}
+
+static int nvme_ctrl_scan_namespaces(nvme_root_t r, struct nvme_ctrl *c)
+{
+	_cleanup_dirents_ struct dirents namespaces = {};
+	int i;
+
+	if (r->create_only) {
+		nvme_msg(r, LOG_DEBUG, "skipping namespace scan for ctrl %s\n",
+			 c->name);
+		return 0;
+	}
+	namespaces.num = nvme_scan_ctrl_namespaces(c, &namespaces.ents);
+
+	if (r->bulk_scan && namespaces.num > 1 &&
+	    !nvme_ctrl_scan_namespaces_bulk(r, c, &namespaces))
+		return 0;
+
+	if (r->scan_threads > 1 && namespaces.num > 1) {
+		_cleanup_free_ struct nvme_ns **ns = NULL;
+
+		ns = nvme_open_namespaces_threaded(r, c->sysfs_dir,
+						   &namespaces);
+		if (ns) {
+			for (i = 0; i < namespaces.num; i++) {
+				if (!ns[i])
+					continue;
+				nvme_ctrl_link_namespace(r, c, ns[i]);
+			}
+			return 0;
+		}
+		/* fall back to the serial scan */
+	}
+
+	for (i = 0; i < namespaces.num; i++)
+		nvme_ctrl_scan_namespace(r, c, namespaces.ents[i]->d_name);
+
+	return 0;
+}
+
+static char *nvme_ctrl_lookup_subsystem_name(nvme_root_t r,
+					     const char *ctrl_name)
+{
+	const char *subsys_dir = nvme_subsys_sysfs_dir();
+	_cleanup_dirents_ struct dirents subsys = {};
+	int i;
+
+	subsys.num = nvme_scan_subsystems(&subsys.ents);
+	if (subsys.num < 0)
+		return NULL;
+	for (i = 0; i < subsys.num; i++) {
+		struct stat st;
+		_cleanup_free_ char *path = NULL;
+
+		if (asprintf(&path, "%s/%s/%s", subsys_dir,
+			     subsys.ents[i]->d_name, ctrl_name) < 0) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		nvme_msg(r, LOG_DEBUG, "lookup subsystem %s\n", path);
+		if (stat(path, &st) < 0) {
+			continue;
+		}
+		return strdup(subsys.ents[i]->d_name);
+	}
+	return NULL;
+}
+
+static char *nvme_ctrl_lookup_phy_slot(nvme_root_t r, const char *address)
+{
+	const char *slots_sysfs_dir = nvme_slots_sysfs_dir();
+	_cleanup_free_ char *target_addr = NULL;
+	_cleanup_dir_ DIR *slots_dir = NULL;
+	int ret;
+	struct dirent *entry;
+
+	if (!address)
+		return NULL;
+
+	slots_dir = opendir(slots_sysfs_dir);
+	if (!slots_dir) {
+		nvme_msg(r, LOG_WARNING, "failed to open slots dir %s\n",
+		slots_sysfs_dir);
+		return NULL;
+	}
+
+	target_addr = strndup(address, 10);
+	while ((entry = readdir(slots_dir))) {
+		if (entry->d_type == DT_DIR &&
+		    strncmp(entry->d_name, ".", 1) != 0 &&
+		    strncmp(entry->d_name, "..", 2) != 0) {
+			_cleanup_free_ char *path = NULL;
+			_cleanup_free_ char *addr = NULL;
+
+			ret = asprintf(&path, "%s/%s",
+				       slots_sysfs_dir, entry->d_name);
+			if (ret < 0) {
+				errno = ENOMEM;
+				return NULL;
+			}
+			addr = nvme_get_attr(path, "address");
+			if (strcmp(addr, target_addr) == 0)
+				return strdup(entry->d_name);
+		}
+	}
+	return NULL;
+}
+
+static int nvme_configure_ctrl(nvme_root_t r, nvme_ctrl_t c, const char *path,
+			       const char *name)
+{
+	DIR *d;
+	char *host_key, *tls_psk;
+
+	d = opendir(path);
+	if (!d) {
+		nvme_msg(r, LOG_ERR, "Failed to open ctrl dir %s, error %d\n",
+			 path, errno);
+		errno = ENODEV;
+		return -1;
+	}
+	closedir(d);
+
+	c->fd = -1;
+	c->name = strdup(name);
+	nvme_root_index_ctrl(c);
+	c->sysfs_dir = (char *)path;
+	/*
+	 * firmware, model, serial and the queue attributes are loaded
+	 * lazily by their accessors; only attributes the scan and connect
+	 * logic depend on are read here.
+	 */
+	c->state = nvme_get_ctrl_attr(c, "state");
+	host_key = nvme_get_ctrl_attr(c, "dhchap_secret");
+	if (host_key && c->s && c->s->h && c->s->h->dhchap_key &&
+			(!strcmp(c->s->h->dhchap_key, host_key) ||
+			 !strcmp("none", host_key))) {
+		free(host_key);
+		host_key = NULL;
+	}
+	if (host_key)
+		c->dhchap_key = host_key;
+	c->dhchap_ctrl_key = nvme_get_ctrl_attr(c, "dhchap_ctrl_secret");
+	if (c->dhchap_ctrl_key && !strcmp(c->dhchap_ctrl_key, "none")) {
+		free(c->dhchap_ctrl_key);
+		c->dhchap_ctrl_key = NULL;
+	}
+	tls_psk = nvme_get_ctrl_attr(c, "tls_key");
+	if (tls_psk) {
+		char *endptr;
+		long key_id = strtol(tls_psk, &endptr, 16);
+
+		if (endptr != tls_psk) {
+			c->cfg.tls_key = key_id;
+			c->cfg.tls = true;
+		}
+	}
+	c->cntrltype = nvme_get_ctrl_attr(c, "cntrltype");
+	c->cntlid = nvme_get_ctrl_attr(c, "cntlid");
+	c->dctype = nvme_get_ctrl_attr(c, "dctype");
+
+	errno = 0; /* cleanup after nvme_get_ctrl_attr() */
+	return 0;
+}
+
+int nvme_init_ctrl(nvme_host_t h, nvme_ctrl_t c, int instance)
+{
+	_cleanup_free_ char *subsys_name = NULL;
+	_cleanup_free_ char *name = NULL;
+	nvme_subsystem_t s;
+	char *path;
+	int ret;
+
+	ret = asprintf(&name, "nvme%d", instance);
+	if (ret < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ret = asprintf(&path, "%s/%s", nvme_ctrl_sysfs_dir(), name);
+	if (ret < 0) {
+		errno = ENOMEM;
+		return ret;
+	}
+
+	ret = nvme_configure_ctrl(h->r, c, path, name);
+	if (ret < 0) {
+		free(path);
+		return ret;
+	}
+
+	c->address = nvme_get_attr(path, "address");
+	if (!c->address && strcmp(c->transport, "loop")) {
+		errno = ENVME_CONNECT_INVAL_TR;
+		return -1;
+	}
+
+	subsys_name = nvme_ctrl_lookup_subsystem_name(h->r, name);
+	if (!subsys_name) {
+		nvme_msg(h->r, LOG_ERR,
+			 "Failed to lookup subsystem name for %s\n",
+			 c->name);
+		errno = ENVME_CONNECT_LOOKUP_SUBSYS_NAME;
+		return -1;
+	}
+	s = nvme_lookup_subsystem(h, subsys_name, c->subsysnqn);
+	if (!s) {
+		errno = ENVME_CONNECT_LOOKUP_SUBSYS;
+		return -1;
+	}
+	if (s->subsystype && !strcmp(s->subsystype, "discovery"))
+		c->discovery_ctrl = true;
+	c->s = s;
+	list_add(&s->ctrls, &c->entry);
+	nvme_root_index_ctrl(c);
+	nvme_topo_changed(s->h ? s->h->r : NULL);
+	return ret;
+}
+
+static nvme_ctrl_t nvme_ctrl_alloc(nvme_root_t r, nvme_subsystem_t s,
+				   const char *path, const char *name)
+{
+	nvme_ctrl_t c, p;
+	_cleanup_free_ char *addr = NULL, *address = NULL;
+	char *a = NULL, *e = NULL;
+	_cleanup_free_ char *transport = NULL;
+	char *traddr = NULL, *trsvcid = NULL;
+	char *host_traddr = NULL, *host_iface = NULL;
+	int ret;
+
+	transport = nvme_get_attr(path, "transport");
+	if (!transport) {
+		errno = ENXIO;
+		return NULL;
+	}
+	/* Parse 'address' string into components */
+	addr = nvme_get_attr(path, "address");
+	if (!addr) {
+		_cleanup_free_ char *rpath = NULL;
+		char *p = NULL, *_a = NULL;
+
+		/* loop transport might not have an address */
+		if (!strcmp(transport, "loop"))
+			goto skip_address;
+
+		/* Older kernel don't support pcie transport addresses */
+		if (strcmp(transport, "pcie")) {
+			errno = ENXIO;
+			return NULL;
+		}
+		/* Figure out the PCI address from the attribute path */
+		rpath = realpath(path, NULL);
+		if (!rpath) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		a = strtok_r(rpath, "/", &e);
+		while(a && strlen(a)) {
+		    if (_a)
+			p = _a;
+		    _a = a;
+		    if (!strncmp(a, "nvme", 4))
+			break;
+		    a = strtok_r(NULL, "/", &e);
+		}
+		if (p)
+			addr = strdup(p);
+	} else if (!strcmp(transport, "pcie")) {
+		/* The 'address' string is the transport address */
+		traddr = addr;
+	} else {
+		address = strdup(addr);
+		a = strtok_r(address, ",", &e);
+		while (a && strlen(a)) {
+			if (!strncmp(a, "traddr=", 7))
+				traddr = a + 7;
+			else if (!strncmp(a, "trsvcid=", 8))
+				trsvcid = a + 8;
+			else if (!strncmp(a, "host_traddr=", 12))
+				host_traddr = a + 12;
+			else if (!strncmp(a, "host_iface=", 11))
+				host_iface = a + 11;
+			a = strtok_r(NULL, ",", &e);
+		}
+	}
+skip_address:
+	p = NULL;
+	do {
+		c = nvme_lookup_ctrl(s, transport, traddr,
+				     host_traddr, host_iface, trsvcid, p);
+		if (c) {
+			if (!c->name)
+				break;
+			if (!strcmp(c->name, name)) {
+				nvme_msg(r, LOG_DEBUG,
+					 "found existing ctrl %s\n", c->name);
+				break;
+			}
+			nvme_msg(r, LOG_DEBUG, "skipping ctrl %s\n", c->name);
+			p = c;
+		}
+	} while (c);
+	if (!c)
+		c = p;
+	if (!c && !p) {
+		nvme_msg(r, LOG_ERR, "failed to lookup ctrl\n");
+		errno = ENODEV;
+		return NULL;
+	}
+	c->address = addr;
+	addr = NULL;
+	if (s->subsystype && !strcmp(s->subsystype, "discovery"))
+		c->discovery_ctrl = true;
+	ret = nvme_configure_ctrl(r, c, path, name);
+	return (ret < 0) ? NULL : c;
+}
+
+nvme_ctrl_t nvme_scan_ctrl(nvme_root_t r, const char *name)
+{
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	_cleanup_free_ char *path = NULL;
+	_cleanup_free_ char *hostnqn = NULL, *hostid = NULL;
+	_cleanup_free_ char *subsysnqn = NULL, *subsysname = NULL;
+	int ret;
+
+	nvme_msg(r, LOG_DEBUG, "scan controller %s\n", name);
+	ret = asprintf(&path, "%s/%s", nvme_ctrl_sysfs_dir(), name);
+	if (ret < 0) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	hostnqn = nvme_get_attr(path, "hostnqn");
+	hostid = nvme_get_attr(path, "hostid");
+	h = nvme_lookup_host(r, hostnqn, hostid);
+	if (h) {
+		if (h->dhchap_key)
+			free(h->dhchap_key);
+		h->dhchap_key = nvme_get_attr(path, "dhchap_secret");
+		if (h->dhchap_key && !strcmp(h->dhchap_key, "none")) {
+			free(h->dhchap_key);
+			h->dhchap_key = NULL;
+		}
+	}
+	if (!h) {
+		h = nvme_default_host(r);
+		if (!h) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	subsysnqn = nvme_get_attr(path, "subsysnqn");
+	if (!subsysnqn) {
+		errno = ENXIO;
+		return NULL;
+	}
+	subsysname = nvme_ctrl_lookup_subsystem_name(r, name);
+	if (!subsysname) {
+		nvme_msg(r, LOG_DEBUG,
+			 "failed to lookup subsystem for controller %s\n",
+			 name);
+		errno = ENXIO;
+		return NULL;
+	}
+	s = nvme_lookup_subsystem(h, subsysname, subsysnqn);
+
+	if (!s) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	c = nvme_ctrl_alloc(r, s, path, name);
+	if (!c)
+		return NULL;
+
+	path = NULL;
+	nvme_ctrl_scan_namespaces(r, c);
+	nvme_ctrl_scan_paths(r, c);
+	return c;
+}
+
+void nvme_rescan_ctrl(struct nvme_ctrl *c)
+{
+	nvme_root_t r = c->s && c->s->h ? c->s->h->r : NULL;
+	if (!c->s)
+		return;
+	nvme_ctrl_clear_identify_cache(c);
+	nvme_ctrl_scan_namespaces(r, c);
+	nvme_ctrl_scan_paths(r, c);
+	nvme_subsystem_scan_namespaces(r, c->s, NULL, NULL);
+}
+
+static int nvme_bytes_to_lba(nvme_ns_t n, off_t offset, size_t count,
+			    __u64 *lba, __u16 *nlb)
+{
+	int bs;
+
+	bs = nvme_ns_get_lba_size(n);
+	if (!count || offset & (bs - 1) || count & (bs - 1)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*lba = offset >> n->lba_shift;
+	*nlb = (count >> n->lba_shift) - 1;
+	return 0;
+}
+
+int nvme_ns_get_fd(nvme_ns_t n)
+{
+	if (n->fd < 0) {
+		n->fd = nvme_open(n->name);
+		if (n->fd < 0)
+			nvme_msg(root_from_ns(n), LOG_ERR,
+				 "Failed to open ns %s, errno %d\n",
+				 n->name, errno);
+	}
+
+	return n->fd;
+}
+
+void nvme_ns_release_fd(nvme_ns_t n)
+{
+	nvme_sysfs_dirfd_close(&n->sysfs_fd);
+
+	if (n->fd < 0)
+		return;
+
+	close(n->fd);
+	n->fd = -1;
+}
+
+nvme_subsystem_t nvme_ns_get_subsystem(nvme_ns_t n)
+{
+	return n->s;
+}
+
+nvme_ctrl_t nvme_ns_get_ctrl(nvme_ns_t n)
+{
+	return n->c;
+}
+
+int nvme_ns_get_nsid(nvme_ns_t n)
+{
+	return n->nsid;
+}
+
+const char *nvme_ns_get_sysfs_dir(nvme_ns_t n)
+{
+	return n->sysfs_dir;
+}
+
+const char *nvme_ns_get_name(nvme_ns_t n)
+{
+	return n->name;
+}
+
+const char *nvme_ns_get_generic_name(nvme_ns_t n)
+{
+	return n->generic_name;
+}
+
+const char *nvme_ns_get_model(nvme_ns_t n)
+{
+	return n->c ? nvme_ctrl_get_model(n->c) : n->s->model;
+}
+
+const char *nvme_ns_get_serial(nvme_ns_t n)
+{
+	return n->c ? nvme_ctrl_get_serial(n->c) : n->s->serial;
+}
+
+const char *nvme_ns_get_firmware(nvme_ns_t n)
+{
+	return n->c ? nvme_ctrl_get_firmware(n->c) : n->s->firmware;
+}
+
+int nvme_ns_get_lba_size(nvme_ns_t n)
+{
+	return n->lba_size;
+}
+
+int nvme_ns_get_meta_size(nvme_ns_t n)
+{
+	nvme_ns_probe_util(n);
+	return n->meta_size;
+}
+
+uint64_t nvme_ns_get_lba_count(nvme_ns_t n)
+{
+	return n->lba_count;
+}
+
+uint64_t nvme_ns_get_lba_util(nvme_ns_t n)
+{
+	nvme_ns_probe_util(n);
+	return n->lba_util;
+}
+
+enum nvme_csi nvme_ns_get_csi(nvme_ns_t n)
+{
+	nvme_ns_probe_util(n);
+	return n->csi;
+}
+
+const uint8_t *nvme_ns_get_eui64(nvme_ns_t n)
+{
+	nvme_ns_probe_ids(n);
+	return n->eui64;
+}
+
+const uint8_t *nvme_ns_get_nguid(nvme_ns_t n)
+{
+	nvme_ns_probe_ids(n);
+	return n->nguid;
+}
+
+void nvme_ns_get_uuid(nvme_ns_t n, unsigned char out[NVME_UUID_LEN])
+{
+	nvme_ns_probe_ids(n);
+	memcpy(out, n->uuid, NVME_UUID_LEN);
+}
+
+int nvme_ns_identify(nvme_ns_t n, struct nvme_id_ns *ns)
+{
+	return nvme_identify_ns(nvme_ns_get_fd(n), nvme_ns_get_nsid(n), ns);
+}
+
+int nvme_ns_identify_descs(nvme_ns_t n, struct nvme_ns_id_desc *descs)
+{
+	return nvme_identify_ns_descs(nvme_ns_get_fd(n), nvme_ns_get_nsid(n), descs);
+}
+
+int nvme_ns_verify(nvme_ns_t n, off_t offset, size_t count)
+{
+	struct nvme_io_args args = {
+		.args_size = sizeof(args),
+		.fd = nvme_ns_get_fd(n),
+		.nsid = nvme_ns_get_nsid(n),
+		.control = 0,
+		.dsm = 0,
+		.dspec = 0,
+		.reftag = 0,
+		.apptag = 0,
+		.appmask = 0,
+		.storage_tag = 0,
+		.data_len = 0,
+		.data = NULL,
+		.metadata_len = 0,
+		.metadata = NULL,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+
+	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+		return -1;
+
+	return nvme_verify(&args);
+}
+
+int nvme_ns_write_uncorrectable(nvme_ns_t n, off_t offset, size_t count)
+{
+	struct nvme_io_args args = {
+		.args_size = sizeof(args),
+		.fd = nvme_ns_get_fd(n),
+		.nsid = nvme_ns_get_nsid(n),
+		.control = 0,
+		.dsm = 0,
+		.dspec = 0,
+		.reftag = 0,
+		.apptag = 0,
+		.appmask = 0,
+		.storage_tag = 0,
+		.data_len = 0,
+		.data = NULL,
+		.metadata_len = 0,
+		.metadata = NULL,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+
+	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+		return -1;
+
+	return nvme_write_uncorrectable(&args);
+}
+
+int nvme_ns_write_zeros(nvme_ns_t n, off_t offset, size_t count)
+{
+	struct nvme_io_args args = {
+		.args_size = sizeof(args),
+		.fd = nvme_ns_get_fd(n),
+		.nsid = nvme_ns_get_nsid(n),
+		.control = 0,
+		.dsm = 0,
+		.dspec = 0,
+		.reftag = 0,
+		.apptag = 0,
+		.appmask = 0,
+		.storage_tag = 0,
+		.data_len = 0,
+		.data = NULL,
+		.metadata_len = 0,
+		.metadata = NULL,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+
+	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+		return -1;
+
+	return nvme_write_zeros(&args);
+}
+
+int nvme_ns_write(nvme_ns_t n, void *buf, off_t offset, size_t count)
+{
+	struct nvme_io_args args = {
+		.args_size = sizeof(args),
+		.fd = nvme_ns_get_fd(n),
+		.nsid = nvme_ns_get_nsid(n),
+		.control = 0,
+		.dsm = 0,
+		.dspec = 0,
+		.reftag = 0,
+		.apptag = 0,
+		.appmask = 0,
+		.storage_tag = 0,
+		.data_len = count,
+		.data = buf,
+		.metadata_len = 0,
+		.metadata = NULL,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+
+	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+		return -1;
+
+	return nvme_write(&args);
+}
+
+int nvme_ns_read(nvme_ns_t n, void *buf, off_t offset, size_t count)
+{
+	struct nvme_io_args args = {
+		.args_size = sizeof(args),
+		.fd = nvme_ns_get_fd(n),
+		.nsid = nvme_ns_get_nsid(n),
+		.control = 0,
+		.dsm = 0,
+		.dspec = 0,
+		.reftag = 0,
+		.apptag = 0,
+		.appmask = 0,
+		.storage_tag = 0,
+		.data_len = count,
+		.data = buf,
+		.metadata_len = 0,
+		.metadata = NULL,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+
+	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+		return -1;
+
+	return nvme_read(&args);
+}
+
+int nvme_ns_compare(nvme_ns_t n, void *buf, off_t offset, size_t count)
+{
+	struct nvme_io_args args = {
+		.args_size = sizeof(args),
+		.fd = nvme_ns_get_fd(n),
+		.nsid = nvme_ns_get_nsid(n),
+		.control = 0,
+		.dsm = 0,
+		.dspec = 0,
+		.reftag = 0,
+		.apptag = 0,
+		.appmask = 0,
+		.storage_tag = 0,
+		.data_len = count,
+		.data = buf,
+		.metadata_len = 0,
+		.metadata = NULL,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+
+	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+		return -1;
+
+	return nvme_compare(&args);
 }
 
-nvme_ctrl_t nvme_scan_ctrl(nvme_root_t r, const char *name)
+int nvme_ns_flush(nvme_ns_t n)
 {
-	nvme_host_t h;
-	nvme_subsystem_t s;
-	nvme_ctrl_t c;
-	_cleanup_free_ char *path = NULL;
-	_cleanup_free_ char *hostnqn = NULL, *hostid = NULL;
-	_cleanup_free_ char *subsysnqn = NULL, *subsysname = NULL;
-	int ret;
+	return nvme_flush(nvme_ns_get_fd(n), nvme_ns_get_nsid(n));
+}
 
-	nvme_msg(r, LOG_DEBUG, "scan controller %s\n", name);
-	ret = asprintf(&path, "%s/%s", nvme_ctrl_sysfs_dir(), name);
-	if (ret < 0) {
-		errno = ENOMEM;
-		return NULL;
-	}
+static int nvme_strtou64(const char *str, void *res)
+{
+	char *endptr;
+	__u64 v;
 
-	hostnqn = nvme_get_attr(path, "hostnqn");
-	hostid = nvme_get_attr(path, "hostid");
-	h = nvme_lookup_host(r, hostnqn, hostid);
-	if (h) {
-		if (h->dhchap_key)
-			free(h->dhchap_key);
-		h->dhchap_key = nvme_get_attr(path, "dhchap_secret");
-		if (h->dhchap_key && !strcmp(h->dhchap_key, "none")) {
-			free(h->dhchap_key);
-			h->dhchap_key = NULL;
-		}
-	}
-	if (!h) {
-		h = nvme_default_host(r);
-		if (!h) {
-			errno = ENOMEM;
-			return NULL;
-		}
-	}
+	errno = 0;
+	v = strtoull(str, &endptr, 0);
 
-	subsysnqn = nvme_get_attr(path, "subsysnqn");
-	if (!subsysnqn) {
-		errno = ENXIO;
-		return NULL;
+	if (errno != 0)
+		return -errno;
+
+	if (endptr == str) {
+		/* no digits found */
+		return -EINVAL;
 	}
-	subsysname = nvme_ctrl_lookup_subsystem_name(r, name);
-	if (!subsysname) {
-		nvme_msg(r, LOG_DEBUG,
-			 "failed to lookup subsystem for controller %s\n",
-			 name);
-		errno = ENXIO;
-		return NULL;
+
+	*(__u64 *)res = v;
+	return 0;
+}
+
+static int nvme_strtou32(const char *str, void *res)
+{
+	char *endptr;
+	__u32 v;
+
+	errno = 0;
+	v = strtol(str, &endptr, 0);
+
+	if (errno != 0)
+		return -errno;
+
+	if (endptr == str) {
+		/* no digits found */
+		return -EINVAL;
 	}
-	s = nvme_lookup_subsystem(h, subsysname, subsysnqn);
 
-	if (!s) {
-		errno = ENOMEM;
-		return NULL;
+	*(__u32 *)res = v;
+	return 0;
+}
+
+static int nvme_strtoi(const char *str, void *res)
+{
+	char *endptr;
+	int v;
+
+	errno = 0;
+	v = strtol(str, &endptr, 0);
+
+	if (errno != 0)
+		return -errno;
+
+	if (endptr == str) {
+		/* no digits found */
+		return -EINVAL;
 	}
 
-	c = nvme_ctrl_alloc(r, s, path, name);
-	if (!c)
-		return NULL;
+	*(int *)res = v;
+	return 0;
+}
 
-	path = NULL;
-	nvme_ctrl_scan_namespaces(r, c);
-	nvme_ctrl_scan_paths(r, c);
-	return c;
+static int nvme_strtoeuid(const char *str, void *res)
+{
+	memcpy(res, str, 8);
+	return 0;
 }
 
-void nvme_rescan_ctrl(struct nvme_ctrl *c)
+static int nvme_strtouuid(const char *str, void *res)
 {
-	nvme_root_t r = c->s && c->s->h ? c->s->h->r : NULL;
-	if (!c->s)
-		return;
-	nvme_ctrl_scan_namespaces(r, c);
-	nvme_ctrl_scan_paths(r, c);
-	nvme_subsystem_scan_namespaces(r, c->s, NULL, NULL);
+	memcpy(res, str, NVME_UUID_LEN);
+	return 0;
 }
 
-static int nvme_bytes_to_lba(nvme_ns_t n, off_t offset, size_t count,
-			    __u64 *lba, __u16 *nlb)
+struct sysfs_attr_table {
+	void *var;
+	int (*parse)(const char *str, void *res);
+	bool mandatory;
+	const char *name;
+};
+
+#define GETSHIFT(x) (__builtin_ffsll(x) - 1)
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+static int parse_attrs(const char *path, struct sysfs_attr_table *tbl, int size)
 {
-	int bs;
+	char *str;
+	int ret, i;
 
-	bs = nvme_ns_get_lba_size(n);
-	if (!count || offset & (bs - 1) || count & (bs - 1)) {
-		errno = EINVAL;
-		return -1;
+	for (i = 0; i < size; i++) {
+		struct sysfs_attr_table *e = &tbl[i];
+
+		str = nvme_get_attr(path, e->name);
+		if (!str) {
+			if (!e->mandatory)
+				continue;
+			return -ENOENT;
+		}
+		ret = e->parse(str, e->var);
+		free(str);
+		if (ret)
+			return ret;
 	}
 
-	*lba = offset >> n->lba_shift;
-	*nlb = (count >> n->lba_shift) - 1;
 	return 0;
 }
 
-int nvme_ns_get_fd(nvme_ns_t n)
+static int nvme_ns_init(const char *path, struct nvme_ns *ns)
 {
-	if (n->fd < 0) {
-		n->fd = nvme_open(n->name);
-		if (n->fd < 0)
-			nvme_msg(root_from_ns(n), LOG_ERR,
-				 "Failed to open ns %s, errno %d\n",
-				 n->name, errno);
-	}
+	uint64_t size;
+	int ret;
 
-	return n->fd;
+	struct sysfs_attr_table base[] = {
+		{ &ns->nsid,      nvme_strtou32,  true, "nsid" },
+		{ &size,          nvme_strtou64,  true, "size" },
+		{ &ns->lba_size,  nvme_strtou32,  true, "queue/logical_block_size" },
+	};
+
+	ret = parse_attrs(path, base, ARRAY_SIZE(base));
+	if (ret)
+		return ret;
+
+	ns->lba_shift = GETSHIFT(ns->lba_size);
+	/*
+	 * size is in 512 bytes units and lba_count is in lba_size which are not
+	 * necessarily the same.
+	 */
+	ns->lba_count = size >> (ns->lba_shift -  SECTOR_SHIFT);
+
+	return 0;
 }
 
-void nvme_ns_release_fd(nvme_ns_t n)
-{
-	if (n->fd < 0)
+/*
+ * The namespace identifiers are not needed to assemble the topology, so
+ * they are only read from sysfs once an accessor asks for them.
+ */
+static void nvme_ns_probe_ids(struct nvme_ns *ns)
+{
+	uint8_t eui64[8] = { 0 };
+	uint8_t nguid[16] = { 0 };
+	unsigned char uuid[NVME_UUID_LEN] = { 0 };
+	struct sysfs_attr_table ids[] = {
+		{ eui64,          nvme_strtoeuid, false, "eui" },
+		{ nguid,          nvme_strtouuid, false, "nguid" },
+		{ uuid,           nvme_strtouuid, false, "uuid" }
+	};
+
+	if (ns->ids_probed || !ns->sysfs_dir)
 		return;
 
-	close(n->fd);
-	n->fd = -1;
+	parse_attrs(ns->sysfs_dir, ids, ARRAY_SIZE(ids));
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (!ns->ids_probed) {
+		memcpy(ns->eui64, eui64, sizeof(ns->eui64));
+		memcpy(ns->nguid, nguid, sizeof(ns->nguid));
+		memcpy(ns->uuid, uuid, sizeof(ns->uuid));
+		ns->ids_probed = true;
+	}
+	pthread_mutex_unlock(&nvme_lazy_lock);
+}
+
+/*
+ * Utilization and format attributes are similarly deferred; reading them
+ * may require an Identify Namespace command on kernels < 6.8. The probe
+ * runs entirely under nvme_lazy_lock because the fallback opens the
+ * namespace device and issues an ioctl, which cannot be committed
+ * atomically after the fact.
+ */
+static int __nvme_ns_probe_util(struct nvme_ns *ns)
+{
+	_cleanup_free_ char *attr = NULL;
+	const char *path = ns->sysfs_dir;
+	struct stat sb;
+	int ret;
+
+	if (ns->util_probed)
+		return 0;
+	if (!path)
+		return -ENODEV;
+
+	if (asprintf(&attr, "%s/csi", path) < 0)
+		return -errno;
+	ret = stat(attr, &sb);
+	if (ret == 0) {
+		/* only available on kernels >= 6.8 */
+		struct sysfs_attr_table ext[] = {
+			{ &ns->csi,       nvme_strtoi,	 true, "csi" },
+			{ &ns->lba_util,  nvme_strtou64, true, "nuse" },
+			{ &ns->meta_size, nvme_strtoi,	 true, "metadata_bytes"},
+
+		};
+
+		ret = parse_attrs(path, ext, ARRAY_SIZE(ext));
+		if (ret)
+			return ret;
+	} else {
+		_cleanup_free_ struct nvme_id_ns *id = NULL;
+		bool had_fd = ns->fd >= 0;
+		uint8_t flbas;
+
+		id = __nvme_alloc(sizeof(*id));
+		if (!id)
+			return -ENOMEM;
+
+		ret = nvme_ns_identify(ns, id);
+		if (!had_fd && ns->fd >= 0) {
+			/* Do not leak fds; nvme_ns_release_fd() would
+			 * re-enter nvme_lazy_lock for the dirfd */
+			close(ns->fd);
+			ns->fd = -1;
+		}
+		if (ret)
+			return ret;
+
+		nvme_id_ns_flbas_to_lbaf_inuse(id->flbas, &flbas);
+		ns->lbaf_inuse = flbas;
+		ns->lba_count = le64_to_cpu(id->nsze);
+		ns->lba_util = le64_to_cpu(id->nuse);
+		ns->meta_size = le16_to_cpu(id->lbaf[flbas].ms);
+	}
+
+	ns->util_probed = true;
+	return 0;
 }
 
-nvme_subsystem_t nvme_ns_get_subsystem(nvme_ns_t n)
+static int nvme_ns_probe_util(struct nvme_ns *ns)
 {
-	return n->s;
-}
+	int ret;
 
-nvme_ctrl_t nvme_ns_get_ctrl(nvme_ns_t n)
-{
-	return n->c;
-}
+	if (ns->util_probed)
+		return 0;
 
-int nvme_ns_get_nsid(nvme_ns_t n)
-{
-	return n->nsid;
+	pthread_mutex_lock(&nvme_lazy_lock);
+	ret = __nvme_ns_probe_util(ns);
+	pthread_mutex_unlock(&nvme_lazy_lock);
+	return ret;
 }
 
-const char *nvme_ns_get_sysfs_dir(nvme_ns_t n)
+int nvme_ns_get_lbaf_inuse(nvme_ns_t n)
 {
-	return n->sysfs_dir;
-}
+	_cleanup_free_ struct nvme_id_ns *id = NULL;
+	bool had_fd = n->fd >= 0;
+	int ret;
 
-const char *nvme_ns_get_name(nvme_ns_t n)
-{
-	return n->name;
-}
+	if (n->lbaf_inuse >= 0)
+		return n->lbaf_inuse;
 
-const char *nvme_ns_get_generic_name(nvme_ns_t n)
-{
-	return n->generic_name;
-}
+	id = __nvme_alloc(sizeof(*id));
+	if (!id) {
+		errno = ENOMEM;
+		return -1;
+	}
 
-const char *nvme_ns_get_model(nvme_ns_t n)
-{
-	return n->c ? n->c->model : n->s->model;
-}
+	pthread_mutex_lock(&nvme_lazy_lock);
+	if (n->lbaf_inuse < 0) {
+		ret = nvme_ns_identify(n, id);
+		if (!had_fd && n->fd >= 0) {
+			/* Do not leak fds; nvme_ns_release_fd() would
+			 * re-enter nvme_lazy_lock for the dirfd */
+			close(n->fd);
+			n->fd = -1;
+		}
+		if (!ret)
+			nvme_ns_apply_geometry(n, id);
+	}
+	pthread_mutex_unlock(&nvme_lazy_lock);
 
-const char *nvme_ns_get_serial(nvme_ns_t n)
-{
-	return n->c ? n->c->serial : n->s->serial;
+	return n->lbaf_inuse;
 }
 
-const char *nvme_ns_get_firmware(nvme_ns_t n)
+void nvme_ns_invalidate_geometry(nvme_ns_t n)
 {
-	return n->c ? n->c->firmware : n->s->firmware;
-}
+	pthread_mutex_lock(&nvme_lazy_lock);
+	n->util_probed = false;
+	n->lbaf_inuse = -1;
+	pthread_mutex_unlock(&nvme_lazy_lock);
 
-int nvme_ns_get_lba_size(nvme_ns_t n)
-{
-	return n->lba_size;
+	/* the base attributes are cheap; re-read them right away so
+	 * nvme_ns_get_lba_size() reflects a reformat immediately */
+	if (n->sysfs_dir)
+		nvme_ns_init(n->sysfs_dir, n);
 }
 
-int nvme_ns_get_meta_size(nvme_ns_t n)
+static void nvme_ns_set_generic_name(struct nvme_ns *n, const char *name)
 {
-	return n->meta_size;
-}
+	char generic_name[PATH_MAX];
+	int instance, head_instance;
+	int ret;
 
-uint64_t nvme_ns_get_lba_count(nvme_ns_t n)
-{
-	return n->lba_count;
-}
+	ret = sscanf(name, "nvme%dn%d", &instance, &head_instance);
+	if (ret != 2)
+		return;
 
-uint64_t nvme_ns_get_lba_util(nvme_ns_t n)
-{
-	return n->lba_util;
+	sprintf(generic_name, "ng%dn%d", instance, head_instance);
+	n->generic_name = strdup(generic_name);
 }
 
-enum nvme_csi nvme_ns_get_csi(nvme_ns_t n)
+static nvme_ns_t nvme_ns_open(const char *sys_path, const char *name)
 {
-	return n->csi;
-}
+	struct nvme_ns *n;
 
-const uint8_t *nvme_ns_get_eui64(nvme_ns_t n)
-{
-	return n->eui64;
-}
+	n = calloc(1, sizeof(*n));
+	if (!n) {
+		errno = ENOMEM;
+		return NULL;
+	}
 
-const uint8_t *nvme_ns_get_nguid(nvme_ns_t n)
-{
-	return n->nguid;
-}
+	n->fd = -1;
+	n->sysfs_fd = -1;
+	n->lbaf_inuse = -1;
+	n->name = strdup(name);
 
-void nvme_ns_get_uuid(nvme_ns_t n, unsigned char out[NVME_UUID_LEN])
-{
-	memcpy(out, n->uuid, NVME_UUID_LEN);
-}
+	nvme_ns_set_generic_name(n, name);
 
-int nvme_ns_identify(nvme_ns_t n, struct nvme_id_ns *ns)
-{
-	return nvme_identify_ns(nvme_ns_get_fd(n), nvme_ns_get_nsid(n), ns);
+	if (nvme_ns_init(sys_path, n) != 0)
+		goto free_ns;
+
+	list_head_init(&n->paths);
+	list_node_init(&n->entry);
+
+	nvme_ns_release_fd(n); /* Do not leak fds */
+	return n;
+
+free_ns:
+	nvme_tree_free(n->generic_name);
+	nvme_tree_free(n->name);
+	nvme_tree_free(n);
+	return NULL;
 }
 
-int nvme_ns_identify_descs(nvme_ns_t n, struct nvme_ns_id_desc *descs)
+static inline bool nvme_ns_is_generic(const char *name)
 {
-	return nvme_identify_ns_descs(nvme_ns_get_fd(n), nvme_ns_get_nsid(n), descs);
+	int instance, head_instance;
+
+	if (sscanf(name, "ng%dn%d", &instance, &head_instance) != 2)
+		return false;
+	return true;
 }
 
-int nvme_ns_verify(nvme_ns_t n, off_t offset, size_t count)
+static char *nvme_ns_generic_to_blkdev(const char *generic)
 {
-	struct nvme_io_args args = {
-		.args_size = sizeof(args),
-		.fd = nvme_ns_get_fd(n),
-		.nsid = nvme_ns_get_nsid(n),
-		.control = 0,
-		.dsm = 0,
-		.dspec = 0,
-		.reftag = 0,
-		.apptag = 0,
-		.appmask = 0,
-		.storage_tag = 0,
-		.data_len = 0,
-		.data = NULL,
-		.metadata_len = 0,
-		.metadata = NULL,
-		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
-		.result = NULL,
-	};
 
-	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
-		return -1;
+	int instance, head_instance;
+	char blkdev[PATH_MAX];
 
-	return nvme_verify(&args);
+	if (!nvme_ns_is_generic(generic))
+		return strdup(generic);
+
+	sscanf(generic, "ng%dn%d", &instance, &head_instance);
+	sprintf(blkdev, "nvme%dn%d", instance, head_instance);
+
+	return strdup(blkdev);
 }
 
-int nvme_ns_write_uncorrectable(nvme_ns_t n, off_t offset, size_t count)
+static struct nvme_ns *__nvme_scan_namespace(const char *sysfs_dir, const char *name)
 {
-	struct nvme_io_args args = {
-		.args_size = sizeof(args),
-		.fd = nvme_ns_get_fd(n),
-		.nsid = nvme_ns_get_nsid(n),
-		.control = 0,
-		.dsm = 0,
-		.dspec = 0,
-		.reftag = 0,
-		.apptag = 0,
-		.appmask = 0,
-		.storage_tag = 0,
-		.data_len = 0,
-		.data = NULL,
-		.metadata_len = 0,
-		.metadata = NULL,
-		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
-		.result = NULL,
-	};
+	struct nvme_ns *n;
+	_cleanup_free_ char *path = NULL;
+	int ret;
+	_cleanup_free_ char *blkdev = NULL;
 
-	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
-		return -1;
+	blkdev = nvme_ns_generic_to_blkdev(name);
+	if (!blkdev) {
+		errno = ENOMEM;
+		return NULL;
+	}
 
-	return nvme_write_uncorrectable(&args);
+	ret = asprintf(&path, "%s/%s", sysfs_dir, blkdev);
+	if (ret < 0) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	n = nvme_ns_open(path, blkdev);
+	if (!n)
+		return NULL;
+
+	n->sysfs_dir = path;
+	path = NULL;
+
+	return n;
 }
 
-int nvme_ns_write_zeros(nvme_ns_t n, off_t offset, size_t count)
+nvme_ns_t nvme_scan_namespace(const char *name)
 {
-	struct nvme_io_args args = {
-		.args_size = sizeof(args),
-		.fd = nvme_ns_get_fd(n),
-		.nsid = nvme_ns_get_nsid(n),
-		.control = 0,
-		.dsm = 0,
-		.dspec = 0,
-		.reftag = 0,
-		.apptag = 0,
-		.appmask = 0,
-		.storage_tag = 0,
-		.data_len = 0,
-		.data = NULL,
-		.metadata_len = 0,
-		.metadata = NULL,
-		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
-		.result = NULL,
-	};
+	return __nvme_scan_namespace(nvme_ns_sysfs_dir(), name);
+}
 
-	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
-		return -1;
+static int nvme_ctrl_link_namespace(nvme_root_t r, struct nvme_ctrl *c,
+				    struct nvme_ns *n)
+{
+	struct nvme_ns *_n, *__n;
 
-	return nvme_write_zeros(&args);
+	nvme_ctrl_for_each_ns_safe(c, _n, __n) {
+		if (strcmp(n->name, _n->name))
+			continue;
+		__nvme_free_ns(_n);
+	}
+	n->s = c->s;
+	n->c = c;
+	list_add(&c->namespaces, &n->entry);
+	nvme_topo_changed(r);
+	return 0;
 }
 
-int nvme_ns_write(nvme_ns_t n, void *buf, off_t offset, size_t count)
+static int nvme_ctrl_scan_namespace(nvme_root_t r, struct nvme_ctrl *c,
+				    char *name)
 {
-	struct nvme_io_args args = {
-		.args_size = sizeof(args),
-		.fd = nvme_ns_get_fd(n),
-		.nsid = nvme_ns_get_nsid(n),
-		.control = 0,
-		.dsm = 0,
-		.dspec = 0,
-		.reftag = 0,
-		.apptag = 0,
-		.appmask = 0,
-		.storage_tag = 0,
-		.data_len = count,
-		.data = buf,
-		.metadata_len = 0,
-		.metadata = NULL,
-		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
-		.result = NULL,
-	};
+	struct nvme_ns *n;
 
-	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
+	nvme_msg(r, LOG_DEBUG, "scan controller %s namespace %s\n",
+		 c->name, name);
+	if (!c->s) {
+		nvme_msg(r, LOG_DEBUG, "no subsystem for %s\n", name);
+		errno = EINVAL;
+		return -1;
+	}
+	n = __nvme_scan_namespace(c->sysfs_dir, name);
+	if (!n) {
+		nvme_msg(r, LOG_DEBUG, "failed to scan namespace %s\n", name);
 		return -1;
-
-	return nvme_write(&args);
+	}
+	return nvme_ctrl_link_namespace(r, c, n);
 }
 
-int nvme_ns_read(nvme_ns_t n, void *buf, off_t offset, size_t count)
+static void nvme_subsystem_set_ns_path(nvme_subsystem_t s, nvme_ns_t n)
 {
-	struct nvme_io_args args = {
-		.args_size = sizeof(args),
-		.fd = nvme_ns_get_fd(n),
-		.nsid = nvme_ns_get_nsid(n),
-		.control = 0,
-		.dsm = 0,
-		.dspec = 0,
-		.reftag = 0,
-		.apptag = 0,
-		.appmask = 0,
-		.storage_tag = 0,
-		.data_len = count,
-		.data = buf,
-		.metadata_len = 0,
-		.metadata = NULL,
-		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
-		.result = NULL,
-	};
+	nvme_ctrl_t c;
+	nvme_path_t p;
+	int ns_ctrl, ns_nsid, ret;
 
-	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
-		return -1;
+	ret = sscanf(nvme_ns_get_name(n), "nvme%dn%d", &ns_ctrl, &ns_nsid);
+	if (ret != 2)
+		return;
 
-	return nvme_read(&args);
+	nvme_subsystem_for_each_ctrl(s, c) {
+		nvme_ctrl_for_each_path(c, p) {
+			int p_subsys, p_ctrl, p_nsid;
+
+			ret = sscanf(nvme_path_get_name(p), "nvme%dc%dn%d",
+				     &p_subsys, &p_ctrl, &p_nsid);
+			if (ret != 3)
+				continue;
+			if (ns_ctrl == p_subsys && ns_nsid == p_nsid) {
+				list_add(&n->paths, &p->nentry);
+				p->n = n;
+			}
+		}
+	}
 }
 
-int nvme_ns_compare(nvme_ns_t n, void *buf, off_t offset, size_t count)
+static int nvme_subsystem_link_namespace(nvme_root_t r, nvme_subsystem_t s,
+		struct nvme_ns *n, nvme_scan_filter_t f, void *f_args)
 {
-	struct nvme_io_args args = {
-		.args_size = sizeof(args),
-		.fd = nvme_ns_get_fd(n),
-		.nsid = nvme_ns_get_nsid(n),
-		.control = 0,
-		.dsm = 0,
-		.dspec = 0,
-		.reftag = 0,
-		.apptag = 0,
-		.appmask = 0,
-		.storage_tag = 0,
-		.data_len = count,
-		.data = buf,
-		.metadata_len = 0,
-		.metadata = NULL,
-		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
-		.result = NULL,
-	};
+	struct nvme_ns *_n, *__n;
 
-	if (nvme_bytes_to_lba(n, offset, count, &args.slba, &args.nlb))
-		return -1;
+	if (f && !f(NULL, NULL, n, f_args)) {
+		nvme_msg(r, LOG_DEBUG, "filter out namespace %s\n", n->name);
+		__nvme_free_ns(n);
+		return 0;
+	}
+	nvme_subsystem_for_each_ns_safe(s, _n, __n) {
+		struct nvme_path *p, *_p;
 
-	return nvme_compare(&args);
+		if (strcmp(n->name, _n->name))
+			continue;
+		/* Detach paths */
+		nvme_namespace_for_each_path_safe(_n, p, _p) {
+			list_del_init(&p->nentry);
+			p->n = NULL;
+		}
+		list_head_init(&_n->paths);
+		__nvme_free_ns(_n);
+	}
+	n->s = s;
+	list_add(&s->namespaces, &n->entry);
+	nvme_topo_changed(r);
+	nvme_subsystem_set_ns_path(s, n);
+	return 0;
 }
 
-int nvme_ns_flush(nvme_ns_t n)
+static int nvme_subsystem_scan_namespace(nvme_root_t r, nvme_subsystem_t s,
+		char *name, nvme_scan_filter_t f, void *f_args)
 {
-	return nvme_flush(nvme_ns_get_fd(n), nvme_ns_get_nsid(n));
+	struct nvme_ns *n;
+
+	nvme_msg(r, LOG_DEBUG, "scan subsystem %s namespace %s\n",
+		 s->name, name);
+	n = __nvme_scan_namespace(s->sysfs_dir, name);
+	if (!n) {
+		nvme_msg(r, LOG_DEBUG, "failed to scan namespace %s\n", name);
+		return -1;
+	}
+	return nvme_subsystem_link_namespace(r, s, n, f, f_args);
 }
 
-static int nvme_strtou64(const char *str, void *res)
+struct nvme_ns *nvme_subsystem_lookup_namespace(struct nvme_subsystem *s,
+						__u32 nsid)
 {
-	char *endptr;
-	__u64 v;
+	struct nvme_ns *n;
 
-	errno = 0;
-	v = strtoull(str, &endptr, 0);
+	nvme_subsystem_for_each_ns(s, n) {
+		if (nvme_ns_get_nsid(n) == nsid)
+			return n;
+	}
+	return NULL;
+}
 
-	if (errno != 0)
-		return -errno;
+/*
+ * Binary topology snapshots. A snapshot captures the tree fields that
+ * the scan reads eagerly from sysfs; everything the accessors load
+ * lazily is re-read on demand after a snapshot is restored. The header
+ * records the mtimes of the sysfs class directories and each
+ * subsystem and controller record carries the mtime of its own sysfs
+ * directory, so a stale snapshot is rejected cheaply (errno set to
+ * ESTALE) even when only a single subsystem changed, in which case
+ * the caller falls back to a full nvme_scan_topology().
+ */
+#define NVME_SNAPSHOT_MAGIC	0x50414e53	/* "SNAP" */
+#define NVME_SNAPSHOT_VERSION	2
+#define NVME_SNAPSHOT_STR_MAX	4096
+#define NVME_SNAPSHOT_STR_NULL	0xffff
+
+struct nvme_snapshot_hdr {
+	__u32 magic;
+	__u32 version;
+	__u64 subsys_mtime_sec;
+	__u64 subsys_mtime_nsec;
+	__u64 ctrl_mtime_sec;
+	__u64 ctrl_mtime_nsec;
+};
 
-	if (endptr == str) {
-		/* no digits found */
-		return -EINVAL;
-	}
+static void nvme_snapshot_dir_mtime(const char *dir, __u64 *sec, __u64 *nsec)
+{
+	struct stat st;
 
-	*(__u64 *)res = v;
-	return 0;
+	if (!dir || stat(dir, &st) < 0) {
+		*sec = 0;
+		*nsec = 0;
+		return;
+	}
+	*sec = st.st_mtim.tv_sec;
+	*nsec = st.st_mtim.tv_nsec;
 }
 
-static int nvme_strtou32(const char *str, void *res)
+static bool nvme_snapshot_dir_stale(const char *dir, __u64 sec, __u64 nsec)
 {
-	char *endptr;
-	__u32 v;
+	__u64 cur_sec, cur_nsec;
 
-	errno = 0;
-	v = strtol(str, &endptr, 0);
-
-	if (errno != 0)
-		return -errno;
+	nvme_snapshot_dir_mtime(dir, &cur_sec, &cur_nsec);
+	return cur_sec != sec || cur_nsec != nsec;
+}
 
-	if (endptr == str) {
-		/* no digits found */
-		return -EINVAL;
-	}
+static int snap_write_str(FILE *f, const char *str)
+{
+	__u16 len = str ? strlen(str) : NVME_SNAPSHOT_STR_NULL;
+	__u16 le = cpu_to_le16(len);
 
-	*(__u32 *)res = v;
+	if (fwrite(&le, sizeof(le), 1, f) != 1)
+		return -1;
+	if (str && len && fwrite(str, len, 1, f) != 1)
+		return -1;
 	return 0;
 }
 
-static int nvme_strtoi(const char *str, void *res)
+static int snap_read_str(FILE *f, nvme_root_t r, char **out)
 {
-	char *endptr;
-	int v;
+	char buf[NVME_SNAPSHOT_STR_MAX + 1];
+	__u16 le, len;
 
-	errno = 0;
-	v = strtol(str, &endptr, 0);
+	*out = NULL;
+	if (fread(&le, sizeof(le), 1, f) != 1)
+		return -1;
+	len = le16_to_cpu(le);
+	if (len == NVME_SNAPSHOT_STR_NULL)
+		return 0;
+	if (len > NVME_SNAPSHOT_STR_MAX)
+		return -1;
+	if (len && fread(buf, len, 1, f) != 1)
+		return -1;
+	buf[len] = '\0';
+	*out = nvme_tree_strdup(r, buf);
+	return *out ? 0 : -1;
+}
 
-	if (errno != 0)
-		return -errno;
+static int snap_write_u32(FILE *f, __u32 v)
+{
+	__u32 le = cpu_to_le32(v);
 
-	if (endptr == str) {
-		/* no digits found */
-		return -EINVAL;
-	}
+	return fwrite(&le, sizeof(le), 1, f) == 1 ? 0 : -1;
+}
 
-	*(int *)res = v;
+static int snap_read_u32(FILE *f, __u32 *v)
+{
+	__u32 le;
+
+	if (fread(&le, sizeof(le), 1, f) != 1)
+		return -1;
+	*v = le32_to_cpu(le);
 	return 0;
 }
 
-static int nvme_strtoeuid(const char *str, void *res)
+static int snap_write_u64(FILE *f, __u64 v)
 {
-	memcpy(res, str, 8);
-	return 0;
+	__u64 le = cpu_to_le64(v);
+
+	return fwrite(&le, sizeof(le), 1, f) == 1 ? 0 : -1;
 }
 
-static int nvme_strtouuid(const char *str, void *res)
+static int snap_read_u64(FILE *f, __u64 *v)
 {
-	memcpy(res, str, NVME_UUID_LEN);
+	__u64 le;
+
+	if (fread(&le, sizeof(le), 1, f) != 1)
+		return -1;
+	*v = le64_to_cpu(le);
 	return 0;
 }
 
-struct sysfs_attr_table {
-	void *var;
-	int (*parse)(const char *str, void *res);
-	bool mandatory;
-	const char *name;
-};
-
-#define GETSHIFT(x) (__builtin_ffsll(x) - 1)
-#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+static int nvme_snapshot_save_ns(FILE *f, char tag, struct nvme_ns *n)
+{
+	if (fputc(tag, f) == EOF ||
+	    snap_write_str(f, n->name) ||
+	    snap_write_str(f, n->generic_name) ||
+	    snap_write_str(f, n->sysfs_dir) ||
+	    snap_write_u32(f, n->nsid) ||
+	    snap_write_u32(f, n->lba_shift) ||
+	    snap_write_u32(f, n->lba_size) ||
+	    snap_write_u32(f, n->meta_size) ||
+	    snap_write_u64(f, n->lba_count) ||
+	    snap_write_u64(f, n->lba_util))
+		return -1;
+	return 0;
+}
 
-static int parse_attrs(const char *path, struct sysfs_attr_table *tbl, int size)
+static int nvme_snapshot_save_ctrl(FILE *f, struct nvme_ctrl *c)
 {
-	char *str;
-	int ret, i;
+	struct nvme_ns *n;
+	struct nvme_path *p;
+	__u64 sec, nsec;
+	__u32 flags = 0;
+
+	nvme_snapshot_dir_mtime(c->sysfs_dir, &sec, &nsec);
+	if (c->discovery_ctrl)
+		flags |= 1 << 0;
+	if (c->unique_discovery_ctrl)
+		flags |= 1 << 1;
+	if (c->persistent)
+		flags |= 1 << 2;
+
+	if (fputc('C', f) == EOF ||
+	    snap_write_str(f, c->name) ||
+	    snap_write_str(f, c->sysfs_dir) ||
+	    snap_write_str(f, c->address) ||
+	    snap_write_str(f, c->transport) ||
+	    snap_write_str(f, c->traddr) ||
+	    snap_write_str(f, c->trsvcid) ||
+	    snap_write_str(f, c->subsysnqn) ||
+	    snap_write_str(f, c->state) ||
+	    snap_write_str(f, c->cntrltype) ||
+	    snap_write_str(f, c->cntlid) ||
+	    snap_write_str(f, c->dctype) ||
+	    snap_write_u32(f, flags) ||
+	    snap_write_u64(f, sec) ||
+	    snap_write_u64(f, nsec))
+		return -1;
 
-	for (i = 0; i < size; i++) {
-		struct sysfs_attr_table *e = &tbl[i];
+	nvme_ctrl_for_each_ns(c, n)
+		if (nvme_snapshot_save_ns(f, 'n', n))
+			return -1;
 
-		str = nvme_get_attr(path, e->name);
-		if (!str) {
-			if (!e->mandatory)
-				continue;
-			return -ENOENT;
-		}
-		ret = e->parse(str, e->var);
-		free(str);
-		if (ret)
-			return ret;
+	nvme_ctrl_for_each_path(c, p) {
+		if (fputc('P', f) == EOF ||
+		    snap_write_str(f, p->name) ||
+		    snap_write_str(f, p->sysfs_dir) ||
+		    snap_write_str(f, p->ana_state) ||
+		    snap_write_u32(f, p->grpid))
+			return -1;
 	}
-
 	return 0;
 }
 
-static int nvme_ns_init(const char *path, struct nvme_ns *ns)
+static int nvme_snapshot_save(nvme_root_t r, FILE *f)
 {
-	_cleanup_free_ char *attr = NULL;
-	struct stat sb;
-	uint64_t size;
-	int ret;
-
-	struct sysfs_attr_table base[] = {
-		{ &ns->nsid,      nvme_strtou32,  true, "nsid" },
-		{ &size,          nvme_strtou64,  true, "size" },
-		{ &ns->lba_size,  nvme_strtou32,  true, "queue/logical_block_size" },
-		{ ns->eui64,      nvme_strtoeuid, false, "eui" },
-		{ ns->nguid,      nvme_strtouuid, false, "nguid" },
-		{ ns->uuid,       nvme_strtouuid, false, "uuid" }
+	struct nvme_snapshot_hdr hdr = {
+		.magic = cpu_to_le32(NVME_SNAPSHOT_MAGIC),
+		.version = cpu_to_le32(NVME_SNAPSHOT_VERSION),
 	};
+	__u64 sec, nsec;
+	nvme_host_t h;
+	nvme_subsystem_t s;
+	nvme_ctrl_t c;
+	struct nvme_ns *n;
 
-	ret = parse_attrs(path, base, ARRAY_SIZE(base));
-	if (ret)
-		return ret;
-
-	ns->lba_shift = GETSHIFT(ns->lba_size);
-	/*
-	 * size is in 512 bytes units and lba_count is in lba_size which are not
-	 * necessarily the same.
-	 */
-	ns->lba_count = size >> (ns->lba_shift -  SECTOR_SHIFT);
-
-	if (asprintf(&attr, "%s/csi", path) < 0)
-		return -errno;
-	ret = stat(attr, &sb);
-	if (ret == 0) {
-		/* only available on kernels >= 6.8 */
-		struct sysfs_attr_table ext[] = {
-			{ &ns->csi,       nvme_strtoi,	 true, "csi" },
-			{ &ns->lba_util,  nvme_strtou64, true, "nuse" },
-			{ &ns->meta_size, nvme_strtoi,	 true, "metadata_bytes"},
-
-		};
-
-		ret = parse_attrs(path, ext, ARRAY_SIZE(ext));
-		if (ret)
-			return ret;
-	} else {
-		_cleanup_free_ struct nvme_id_ns *id = NULL;
-		uint8_t flbas;
-
-		id = __nvme_alloc(sizeof(*ns));
-		if (!id)
-			return -ENOMEM;
+	nvme_snapshot_dir_mtime(nvme_subsys_sysfs_dir(), &sec, &nsec);
+	hdr.subsys_mtime_sec = cpu_to_le64(sec);
+	hdr.subsys_mtime_nsec = cpu_to_le64(nsec);
+	nvme_snapshot_dir_mtime(nvme_ctrl_sysfs_dir(), &sec, &nsec);
+	hdr.ctrl_mtime_sec = cpu_to_le64(sec);
+	hdr.ctrl_mtime_nsec = cpu_to_le64(nsec);
 
-		ret = nvme_ns_identify(ns, id);
-		if (ret)
-			return ret;
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		goto err;
 
-		nvme_id_ns_flbas_to_lbaf_inuse(id->flbas, &flbas);
-		ns->lba_count = le64_to_cpu(id->nsze);
-		ns->lba_util = le64_to_cpu(id->nuse);
-		ns->meta_size = le16_to_cpu(id->lbaf[flbas].ms);
+	nvme_for_each_host(r, h) {
+		if (fputc('H', f) == EOF ||
+		    snap_write_str(f, h->hostnqn) ||
+		    snap_write_str(f, h->hostid) ||
+		    snap_write_str(f, h->hostsymname))
+			goto err;
+
+		nvme_for_each_subsystem(h, s) {
+			if (fputc('S', f) == EOF ||
+			    snap_write_str(f, s->name) ||
+			    snap_write_str(f, s->sysfs_dir) ||
+			    snap_write_str(f, s->subsysnqn) ||
+			    snap_write_str(f, s->model) ||
+			    snap_write_str(f, s->serial) ||
+			    snap_write_str(f, s->firmware) ||
+			    snap_write_str(f, s->subsystype) ||
+			    snap_write_str(f, s->iopolicy))
+				goto err;
+
+			nvme_snapshot_dir_mtime(s->sysfs_dir, &sec, &nsec);
+			if (snap_write_u64(f, sec) || snap_write_u64(f, nsec))
+				goto err;
+
+			nvme_subsystem_for_each_ns(s, n)
+				if (nvme_snapshot_save_ns(f, 'N', n))
+					goto err;
+
+			nvme_subsystem_for_each_ctrl(s, c)
+				if (nvme_snapshot_save_ctrl(f, c))
+					goto err;
+		}
 	}
-
+	if (fputc('E', f) == EOF)
+		goto err;
 	return 0;
+err:
+	errno = EIO;
+	return -1;
 }
 
-static void nvme_ns_set_generic_name(struct nvme_ns *n, const char *name)
+int nvme_root_save_snapshot(nvme_root_t r, const char *path)
 {
-	char generic_name[PATH_MAX];
-	int instance, head_instance;
-	int ret;
+	_cleanup_file_ FILE *f = NULL;
 
-	ret = sscanf(name, "nvme%dn%d", &instance, &head_instance);
-	if (ret != 2)
-		return;
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
 
-	sprintf(generic_name, "ng%dn%d", instance, head_instance);
-	n->generic_name = strdup(generic_name);
+	return nvme_snapshot_save(r, f);
 }
 
-static nvme_ns_t nvme_ns_open(const char *sys_path, const char *name)
+static struct nvme_ns *nvme_snapshot_load_ns(FILE *f, nvme_root_t r)
 {
 	struct nvme_ns *n;
+	__u32 v;
 
 	n = calloc(1, sizeof(*n));
-	if (!n) {
-		errno = ENOMEM;
+	if (!n)
 		return NULL;
-	}
-
 	n->fd = -1;
-	n->name = strdup(name);
-
-	nvme_ns_set_generic_name(n, name);
-
-	if (nvme_ns_init(sys_path, n) != 0)
-		goto free_ns;
-
+	n->sysfs_fd = -1;
+	n->lbaf_inuse = -1;
 	list_head_init(&n->paths);
 	list_node_init(&n->entry);
 
-	nvme_ns_release_fd(n); /* Do not leak fds */
+	if (snap_read_str(f, NULL, &n->name) ||
+	    snap_read_str(f, NULL, &n->generic_name) ||
+	    snap_read_str(f, NULL, &n->sysfs_dir) ||
+	    snap_read_u32(f, &n->nsid) ||
+	    snap_read_u32(f, &v))
+		goto err;
+	n->lba_shift = v;
+	if (snap_read_u32(f, &v))
+		goto err;
+	n->lba_size = v;
+	if (snap_read_u32(f, &v))
+		goto err;
+	n->meta_size = v;
+	if (snap_read_u64(f, &n->lba_count) ||
+	    snap_read_u64(f, &n->lba_util) ||
+	    !n->name)
+		goto err;
 	return n;
-
-free_ns:
-	free(n->generic_name);
-	free(n->name);
-	free(n);
+err:
+	__nvme_free_ns(n);
 	return NULL;
 }
 
-static inline bool nvme_ns_is_generic(const char *name)
+static int nvme_snapshot_load(nvme_root_t r, FILE *f)
 {
-	int instance, head_instance;
+	struct nvme_snapshot_hdr hdr;
+	__u64 sec, nsec;
+	nvme_host_t h = NULL;
+	nvme_subsystem_t s = NULL;
+	nvme_ctrl_t c = NULL;
+	struct nvme_ns *n;
+	struct nvme_path *p;
+	int tag;
 
-	if (sscanf(name, "ng%dn%d", &instance, &head_instance) != 2)
-		return false;
-	return true;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    le32_to_cpu(hdr.magic) != NVME_SNAPSHOT_MAGIC ||
+	    le32_to_cpu(hdr.version) != NVME_SNAPSHOT_VERSION) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	nvme_snapshot_dir_mtime(nvme_subsys_sysfs_dir(), &sec, &nsec);
+	if (le64_to_cpu(hdr.subsys_mtime_sec) != sec ||
+	    le64_to_cpu(hdr.subsys_mtime_nsec) != nsec)
+		goto stale;
+	nvme_snapshot_dir_mtime(nvme_ctrl_sysfs_dir(), &sec, &nsec);
+	if (le64_to_cpu(hdr.ctrl_mtime_sec) != sec ||
+	    le64_to_cpu(hdr.ctrl_mtime_nsec) != nsec)
+		goto stale;
+
+	while ((tag = fgetc(f)) != EOF) {
+		switch (tag) {
+		case 'H': {
+			_cleanup_free_ char *hostnqn = NULL, *hostid = NULL;
+			_cleanup_free_ char *symname = NULL;
+
+			if (snap_read_str(f, NULL, &hostnqn) ||
+			    snap_read_str(f, NULL, &hostid) ||
+			    snap_read_str(f, NULL, &symname) ||
+			    !hostnqn)
+				goto invalid;
+			h = nvme_lookup_host(r, hostnqn, hostid);
+			if (!h)
+				goto invalid;
+			if (symname)
+				nvme_host_set_hostsymname(h, symname);
+			s = NULL;
+			c = NULL;
+			break;
+		}
+		case 'S':
+			if (!h)
+				goto invalid;
+			s = nvme_tree_calloc(r, sizeof(*s));
+			if (!s)
+				goto invalid;
+			s->h = h;
+			s->sysfs_fd = -1;
+			list_head_init(&s->ctrls);
+			list_head_init(&s->namespaces);
+			list_node_init(&s->entry);
+			if (snap_read_str(f, r, &s->name) ||
+			    snap_read_str(f, r, &s->sysfs_dir) ||
+			    snap_read_str(f, r, &s->subsysnqn) ||
+			    snap_read_str(f, r, &s->model) ||
+			    snap_read_str(f, r, &s->serial) ||
+			    snap_read_str(f, r, &s->firmware) ||
+			    snap_read_str(f, r, &s->subsystype) ||
+			    snap_read_str(f, r, &s->iopolicy) ||
+			    snap_read_u64(f, &sec) ||
+			    snap_read_u64(f, &nsec)) {
+				nvme_tree_free(s);
+				goto invalid;
+			}
+			if (nvme_snapshot_dir_stale(s->sysfs_dir, sec, nsec)) {
+				nvme_tree_free(s);
+				goto stale;
+			}
+			list_add(&h->subsystems, &s->entry);
+			c = NULL;
+			break;
+		case 'C': {
+			__u32 flags;
+
+			if (!s)
+				goto invalid;
+			c = nvme_tree_calloc(r, sizeof(*c));
+			if (!c)
+				goto invalid;
+			c->fd = -1;
+			c->sysfs_fd = -1;
+			nvmf_default_config(&c->cfg);
+			list_head_init(&c->namespaces);
+			list_head_init(&c->paths);
+			list_head_init(&c->id_cache);
+			list_node_init(&c->entry);
+			if (snap_read_str(f, r, &c->name) ||
+			    snap_read_str(f, r, &c->sysfs_dir) ||
+			    snap_read_str(f, r, &c->address) ||
+			    snap_read_str(f, r, &c->transport) ||
+			    snap_read_str(f, r, &c->traddr) ||
+			    snap_read_str(f, r, &c->trsvcid) ||
+			    snap_read_str(f, r, &c->subsysnqn) ||
+			    snap_read_str(f, r, &c->state) ||
+			    snap_read_str(f, r, &c->cntrltype) ||
+			    snap_read_str(f, r, &c->cntlid) ||
+			    snap_read_str(f, r, &c->dctype) ||
+			    snap_read_u32(f, &flags) ||
+			    snap_read_u64(f, &sec) ||
+			    snap_read_u64(f, &nsec)) {
+				nvme_tree_free(c);
+				goto invalid;
+			}
+			if (nvme_snapshot_dir_stale(c->sysfs_dir, sec, nsec)) {
+				nvme_tree_free(c);
+				goto stale;
+			}
+			c->discovery_ctrl = flags & (1 << 0);
+			c->unique_discovery_ctrl = flags & (1 << 1);
+			c->persistent = flags & (1 << 2);
+			c->s = s;
+			list_add(&s->ctrls, &c->entry);
+			nvme_root_index_ctrl(c);
+			break;
+		}
+		case 'N':
+			if (!s)
+				goto invalid;
+			n = nvme_snapshot_load_ns(f, r);
+			if (!n)
+				goto invalid;
+			n->s = s;
+			list_add(&s->namespaces, &n->entry);
+			break;
+		case 'n':
+			if (!c)
+				goto invalid;
+			n = nvme_snapshot_load_ns(f, r);
+			if (!n)
+				goto invalid;
+			n->s = c->s;
+			n->c = c;
+			list_add(&c->namespaces, &n->entry);
+			break;
+		case 'P':
+			if (!c)
+				goto invalid;
+			p = nvme_tree_calloc(r, sizeof(*p));
+			if (!p)
+				goto invalid;
+			list_node_init(&p->entry);
+			list_node_init(&p->nentry);
+			p->sysfs_fd = -1;
+			p->c = c;
+			if (snap_read_str(f, r, &p->name) ||
+			    snap_read_str(f, r, &p->sysfs_dir) ||
+			    snap_read_str(f, r, &p->ana_state) ||
+			    snap_read_u32(f, (__u32 *)&p->grpid) ||
+			    !p->name) {
+				nvme_tree_free(p);
+				goto invalid;
+			}
+			list_add(&c->paths, &p->entry);
+			nvme_subsystem_set_path_ns(c->s, p);
+			break;
+		case 'E':
+			nvme_topo_changed(r);
+			return 0;
+		default:
+			goto invalid;
+		}
+	}
+invalid:
+	errno = EINVAL;
+	return -1;
+stale:
+	errno = ESTALE;
+	return -1;
 }
 
-static char *nvme_ns_generic_to_blkdev(const char *generic)
+int nvme_root_load_snapshot(nvme_root_t r, const char *path)
 {
+	_cleanup_file_ FILE *f = NULL;
 
-	int instance, head_instance;
-	char blkdev[PATH_MAX];
-
-	if (!nvme_ns_is_generic(generic))
-		return strdup(generic);
-
-	sscanf(generic, "ng%dn%d", &instance, &head_instance);
-	sprintf(blkdev, "nvme%dn%d", instance, head_instance);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
 
-	return strdup(blkdev);
+	return nvme_snapshot_load(r, f);
 }
 
-static struct nvme_ns *__nvme_scan_namespace(const char *sysfs_dir, const char *name)
+/*
+ * Shared-memory topology snapshots
+ *
+ * One publisher keeps the serialized snapshot in a POSIX shm segment;
+ * any number of consumers attach read-only and rebuild their tree from
+ * it instead of paying for their own sysfs scan. The payload is
+ * guarded by a seqlock so a consumer that races with a republish
+ * simply retries; the snapshot's own header still carries the sysfs
+ * mtimes, so attaching a stale snapshot fails with ESTALE exactly
+ * like loading a stale snapshot file.
+ */
+#define NVME_SHM_SNAPSHOT_MAGIC	0x4d53564e	/* "NVSM" */
+#define NVME_SHM_SNAPSHOT_RETRIES	100
+
+struct nvme_shm_snapshot {
+	__u32 magic;
+	__u32 capacity;
+	atomic_uint seq;	/* odd while a publish is in progress */
+	__u32 size;
+	char payload[];
+};
+
+int nvme_root_publish_shared(nvme_root_t r, const char *name, size_t capacity)
 {
-	struct nvme_ns *n;
-	_cleanup_free_ char *path = NULL;
+	_cleanup_free_ char *buf = NULL;
+	_cleanup_fd_ int fd = -1;
+	struct nvme_shm_snapshot *shm;
+	size_t len = 0, map_len;
+	unsigned int seq;
+	FILE *f;
 	int ret;
-	_cleanup_free_ char *blkdev = NULL;
 
-	blkdev = nvme_ns_generic_to_blkdev(name);
-	if (!blkdev) {
-		errno = ENOMEM;
-		return NULL;
-	}
+	f = open_memstream(&buf, &len);
+	if (!f)
+		return -1;
+	ret = nvme_snapshot_save(r, f);
+	fclose(f);
+	if (ret)
+		return -1;
 
-	ret = asprintf(&path, "%s/%s", sysfs_dir, blkdev);
-	if (ret < 0) {
-		errno = ENOMEM;
-		return NULL;
+	if (!capacity)
+		capacity = len;
+	if (len > capacity) {
+		errno = ENOSPC;
+		return -1;
 	}
 
-	n = nvme_ns_open(path, blkdev);
-	if (!n)
-		return NULL;
+	fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+		return -1;
 
-	n->sysfs_dir = path;
-	path = NULL;
+	map_len = sizeof(*shm) + capacity;
+	if (ftruncate(fd, map_len) < 0)
+		return -1;
 
-	return n;
-}
+	shm = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		return -1;
 
-nvme_ns_t nvme_scan_namespace(const char *name)
-{
-	return __nvme_scan_namespace(nvme_ns_sysfs_dir(), name);
+	if (shm->magic && shm->magic != NVME_SHM_SNAPSHOT_MAGIC) {
+		munmap(shm, map_len);
+		errno = EINVAL;
+		return -1;
+	}
+	if (shm->magic && shm->capacity != capacity) {
+		munmap(shm, map_len);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+	atomic_store_explicit(&shm->seq, seq + 1, memory_order_release);
+	shm->magic = NVME_SHM_SNAPSHOT_MAGIC;
+	shm->capacity = capacity;
+	memcpy(shm->payload, buf, len);
+	shm->size = len;
+	atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+
+	munmap(shm, map_len);
+	return 0;
 }
 
-static int nvme_ctrl_scan_namespace(nvme_root_t r, struct nvme_ctrl *c,
-				    char *name)
+int nvme_root_attach_shared(nvme_root_t r, const char *name)
 {
-	struct nvme_ns *n, *_n, *__n;
+	_cleanup_free_ char *buf = NULL;
+	_cleanup_fd_ int fd = -1;
+	struct nvme_shm_snapshot *shm;
+	struct stat st;
+	size_t size = 0;
+	unsigned int s1, s2;
+	int i, ret;
+	FILE *f;
 
-	nvme_msg(r, LOG_DEBUG, "scan controller %s namespace %s\n",
-		 c->name, name);
-	if (!c->s) {
-		nvme_msg(r, LOG_DEBUG, "no subsystem for %s\n", name);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) < 0)
+		return -1;
+	if ((size_t)st.st_size < sizeof(*shm)) {
 		errno = EINVAL;
 		return -1;
 	}
-	n = __nvme_scan_namespace(c->sysfs_dir, name);
-	if (!n) {
-		nvme_msg(r, LOG_DEBUG, "failed to scan namespace %s\n", name);
+
+	shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		return -1;
+
+	if (shm->magic != NVME_SHM_SNAPSHOT_MAGIC ||
+	    sizeof(*shm) + shm->capacity > (size_t)st.st_size) {
+		munmap(shm, st.st_size);
+		errno = EINVAL;
 		return -1;
 	}
-	nvme_ctrl_for_each_ns_safe(c, _n, __n) {
-		if (strcmp(n->name, _n->name))
+
+	for (i = 0; i < NVME_SHM_SNAPSHOT_RETRIES; i++) {
+		s1 = atomic_load_explicit(&shm->seq, memory_order_acquire);
+		if (s1 & 1)
 			continue;
-		__nvme_free_ns(_n);
+
+		size = shm->size;
+		if (size > shm->capacity)
+			continue;
+		free(buf);
+		buf = malloc(size ? size : 1);
+		if (!buf) {
+			munmap(shm, st.st_size);
+			return -1;
+		}
+		memcpy(buf, shm->payload, size);
+
+		s2 = atomic_load_explicit(&shm->seq, memory_order_acquire);
+		if (s1 == s2)
+			break;
 	}
-	n->s = c->s;
-	n->c = c;
-	list_add(&c->namespaces, &n->entry);
+	munmap(shm, st.st_size);
+	if (i == NVME_SHM_SNAPSHOT_RETRIES) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	f = fmemopen(buf, size, "r");
+	if (!f)
+		return -1;
+	ret = nvme_snapshot_load(r, f);
+	fclose(f);
+	return ret;
+}
+
+int nvme_root_unpublish_shared(const char *name)
+{
+	return shm_unlink(name);
+}
+
+struct nvme_stats_obj {
+	/* exactly one of these is set */
+	nvme_path_t path;
+	nvme_ns_t ns;
+
+	/* one open attribute fd and one sample slot per counter */
+	int *fds;
+	struct nvme_stat_sample *samples;
+};
+
+struct nvme_stats_sampler {
+	nvme_root_t r;
+	char **counters;
+	unsigned int nr_counters;
+	struct nvme_stats_obj *objs;
+	unsigned int nr_objs;
+	/* false until the first sample; deltas start from the second */
+	bool primed;
+};
+
+static int nvme_stats_obj_init(struct nvme_stats_sampler *s,
+			       struct nvme_stats_obj *o,
+			       nvme_path_t p, nvme_ns_t n)
+{
+	int dfd = p ? nvme_path_sysfs_fd(p) : nvme_ns_sysfs_fd(n);
+	unsigned int i;
+
+	o->path = p;
+	o->ns = n;
+	o->fds = calloc(s->nr_counters, sizeof(*o->fds));
+	o->samples = calloc(s->nr_counters, sizeof(*o->samples));
+	if (o->fds) {
+		/* zero-filled slots are a valid fd; mark them unopened */
+		for (i = 0; i < s->nr_counters; i++)
+			o->fds[i] = -1;
+	}
+	if (!o->fds || !o->samples)
+		return -1;
+
+	for (i = 0; i < s->nr_counters; i++)
+		if (dfd >= 0)
+			o->fds[i] = openat(dfd, s->counters[i],
+					   O_RDONLY | O_CLOEXEC);
 	return 0;
 }
 
-static void nvme_subsystem_set_ns_path(nvme_subsystem_t s, nvme_ns_t n)
+nvme_stats_sampler_t nvme_stats_sampler_create(nvme_root_t r,
+					       const char *const *counters,
+					       unsigned int nr_counters)
 {
+	struct nvme_stats_sampler *s;
+	unsigned int nr = 0, i = 0;
+	nvme_subsystem_t su;
+	nvme_host_t h;
 	nvme_ctrl_t c;
 	nvme_path_t p;
-	int ns_ctrl, ns_nsid, ret;
-
-	ret = sscanf(nvme_ns_get_name(n), "nvme%dn%d", &ns_ctrl, &ns_nsid);
-	if (ret != 2)
-		return;
+	nvme_ns_t n;
 
-	nvme_subsystem_for_each_ctrl(s, c) {
-		nvme_ctrl_for_each_path(c, p) {
-			int p_subsys, p_ctrl, p_nsid;
+	if (!r || !counters || !nr_counters) {
+		errno = EINVAL;
+		return NULL;
+	}
 
-			ret = sscanf(nvme_path_get_name(p), "nvme%dc%dn%d",
-				     &p_subsys, &p_ctrl, &p_nsid);
-			if (ret != 3)
-				continue;
-			if (ns_ctrl == p_subsys && ns_nsid == p_nsid) {
-				list_add(&n->paths, &p->nentry);
-				p->n = n;
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, su) {
+			nvme_subsystem_for_each_ns(su, n)
+				nr++;
+			nvme_subsystem_for_each_ctrl(su, c) {
+				nvme_ctrl_for_each_ns(c, n)
+					nr++;
+				nvme_ctrl_for_each_path(c, p)
+					nr++;
 			}
 		}
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		goto fail;
+	s->r = r;
+	s->nr_counters = nr_counters;
+	s->counters = calloc(nr_counters, sizeof(*s->counters));
+	s->objs = calloc(nr, sizeof(*s->objs));
+	if (!s->counters || (nr && !s->objs))
+		goto fail;
+	for (i = 0; i < nr_counters; i++) {
+		s->counters[i] = strdup(counters[i]);
+		if (!s->counters[i])
+			goto fail;
 	}
+
+	nvme_for_each_host(r, h)
+		nvme_for_each_subsystem(h, su) {
+			nvme_subsystem_for_each_ns(su, n)
+				if (nvme_stats_obj_init(s, &s->objs[s->nr_objs++],
+							NULL, n))
+					goto fail;
+			nvme_subsystem_for_each_ctrl(su, c) {
+				nvme_ctrl_for_each_ns(c, n)
+					if (nvme_stats_obj_init(s, &s->objs[s->nr_objs++],
+								NULL, n))
+						goto fail;
+				nvme_ctrl_for_each_path(c, p)
+					if (nvme_stats_obj_init(s, &s->objs[s->nr_objs++],
+								p, NULL))
+						goto fail;
+			}
+		}
+
+	return s;
+
+fail:
+	nvme_stats_sampler_free(s);
+	errno = ENOMEM;
+	return NULL;
 }
 
-static int nvme_subsystem_scan_namespace(nvme_root_t r, nvme_subsystem_t s,
-		char *name, nvme_scan_filter_t f, void *f_args)
+int nvme_stats_sampler_sample(nvme_stats_sampler_t s)
 {
-	struct nvme_ns *n, *_n, *__n;
+	unsigned int i, j;
+	int filled = 0;
 
-	nvme_msg(r, LOG_DEBUG, "scan subsystem %s namespace %s\n",
-		 s->name, name);
-	n = __nvme_scan_namespace(s->sysfs_dir, name);
-	if (!n) {
-		nvme_msg(r, LOG_DEBUG, "failed to scan namespace %s\n", name);
+	if (!s) {
+		errno = EINVAL;
 		return -1;
 	}
-	if (f && !f(NULL, NULL, n, f_args)) {
-		nvme_msg(r, LOG_DEBUG, "filter out namespace %s\n", name);
-		__nvme_free_ns(n);
-		return 0;
-	}
-	nvme_subsystem_for_each_ns_safe(s, _n, __n) {
-		struct nvme_path *p, *_p;
 
-		if (strcmp(n->name, _n->name))
-			continue;
-		/* Detach paths */
-		nvme_namespace_for_each_path_safe(_n, p, _p) {
-			list_del_init(&p->nentry);
-			p->n = NULL;
+	for (i = 0; i < s->nr_objs; i++) {
+		struct nvme_stats_obj *o = &s->objs[i];
+
+		for (j = 0; j < s->nr_counters; j++) {
+			struct nvme_stat_sample *smp = &o->samples[j];
+			char buf[64];
+			ssize_t len;
+			char *end;
+			__u64 v;
+
+			len = o->fds[j] < 0 ? -1 :
+				pread(o->fds[j], buf, sizeof(buf) - 1, 0);
+			if (len <= 0) {
+				smp->valid = false;
+				smp->delta = 0;
+				continue;
+			}
+			buf[len] = '\0';
+			v = strtoull(buf, &end, 0);
+			if (end == buf) {
+				smp->valid = false;
+				smp->delta = 0;
+				continue;
+			}
+
+			smp->delta = (s->primed && smp->valid) ?
+				(__s64)(v - smp->value) : 0;
+			smp->value = v;
+			smp->valid = true;
+			filled++;
 		}
-		list_head_init(&_n->paths);
-		__nvme_free_ns(_n);
 	}
-	n->s = s;
-	list_add(&s->namespaces, &n->entry);
-	nvme_subsystem_set_ns_path(s, n);
-	return 0;
+
+	s->primed = true;
+	return filled;
 }
 
-struct nvme_ns *nvme_subsystem_lookup_namespace(struct nvme_subsystem *s,
-						__u32 nsid)
+unsigned int nvme_stats_sampler_nr_objects(nvme_stats_sampler_t s)
 {
-	struct nvme_ns *n;
+	return s ? s->nr_objs : 0;
+}
 
-	nvme_subsystem_for_each_ns(s, n) {
-		if (nvme_ns_get_nsid(n) == nsid)
-			return n;
+nvme_path_t nvme_stats_sampler_obj_path(nvme_stats_sampler_t s,
+					unsigned int i)
+{
+	if (!s || i >= s->nr_objs)
+		return NULL;
+	return s->objs[i].path;
+}
+
+nvme_ns_t nvme_stats_sampler_obj_ns(nvme_stats_sampler_t s, unsigned int i)
+{
+	if (!s || i >= s->nr_objs)
+		return NULL;
+	return s->objs[i].ns;
+}
+
+const struct nvme_stat_sample *
+nvme_stats_sampler_obj_samples(nvme_stats_sampler_t s, unsigned int i)
+{
+	if (!s || i >= s->nr_objs)
+		return NULL;
+	return s->objs[i].samples;
+}
+
+void nvme_stats_sampler_free(nvme_stats_sampler_t s)
+{
+	unsigned int i, j;
+
+	if (!s)
+		return;
+	for (i = 0; i < s->nr_objs; i++) {
+		struct nvme_stats_obj *o = &s->objs[i];
+
+		if (o->fds)
+			for (j = 0; j < s->nr_counters; j++)
+				if (o->fds[j] >= 0)
+					close(o->fds[j]);
+		free(o->fds);
+		free(o->samples);
 	}
-	return NULL;
+	free(s->objs);
+	if (s->counters)
+		for (i = 0; i < s->nr_counters; i++)
+			free(s->counters[i]);
+	free(s->counters);
+	free(s);
 }
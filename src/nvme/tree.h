@@ -70,6 +70,482 @@ const char *nvme_root_get_application(nvme_root_t r);
  */
 void nvme_root_skip_namespaces(nvme_root_t r);
 
+/**
+ * nvme_root_set_scan_threads - Set number of threads used for scanning
+ * @r:		&nvme_root_t object
+ * @threads:	Maximum number of worker threads
+ *
+ * Scanning the topology of a large host issues hundreds of blocking
+ * sysfs reads. When @threads is larger than one the attribute reads
+ * are distributed over a pool of up to @threads worker threads; the
+ * tree itself is still assembled from the calling thread. A value of
+ * zero or one selects the default serial scan.
+ */
+void nvme_root_set_scan_threads(nvme_root_t r, unsigned int threads);
+
+/**
+ * nvme_root_set_bulk_scan - Build namespaces from batched identify data
+ * @r:		&nvme_root_t object
+ * @enabled:	true to enable the bulk namespace scan
+ *
+ * When enabled, scanning a controller fetches the active namespace ID
+ * list and batches the Identify Namespace and ID Descriptor List
+ * commands for all active namespaces through the controller's admin
+ * queue, instead of reading several sysfs attributes per namespace.
+ * This bounds the scan cost of a dense subsystem by a handful of
+ * admin commands rather than thousands of sysfs round trips.
+ *
+ * Issuing identify commands requires the scanning process to be able
+ * to open the controller character device; when it cannot, or when a
+ * controller rejects the commands, the scan transparently falls back
+ * to the sysfs walk.
+ */
+void nvme_root_set_bulk_scan(nvme_root_t r, bool enabled);
+
+/**
+ * nvme_root_set_scan_match - Restrict scanning to matching entries
+ * @r:			&nvme_root_t object
+ * @subsys_name:	Only scan the subsystem with this sysfs name
+ * @nqn_prefix:		Only scan subsystems whose NQN starts with this
+ * @transport:		Only scan controllers using this transport
+ *
+ * Installs pre-scan predicates evaluated before nvme_scan_topology()
+ * descends into a sysfs entry, so non-matching subsystems and
+ * controllers are skipped without paying for their full scan. Any
+ * criterion may be NULL to match everything; pass all NULL to clear.
+ * Unlike an &nvme_scan_filter_t, which runs after an entry has been
+ * scanned, these predicates avoid the sysfs I/O entirely.
+ */
+void nvme_root_set_scan_match(nvme_root_t r, const char *subsys_name,
+			      const char *nqn_prefix, const char *transport);
+
+/**
+ * nvme_root_get_buf_pool - Buffer pool attached to the tree
+ * @r:	&nvme_root_t object
+ *
+ * Returns the tree's buffer pool, creating one with default flags on
+ * first use. The pool is freed together with @r.
+ *
+ * Return: The pool handle, or NULL on allocation failure.
+ */
+nvme_buf_pool_t nvme_root_get_buf_pool(nvme_root_t r);
+
+/**
+ * nvme_root_set_buf_pool - Install a buffer pool on the tree
+ * @r:		&nvme_root_t object
+ * @pool:	Pool created with nvme_buf_pool_create(); may be NULL
+ *
+ * Replaces (and frees) any pool previously attached to @r. Use this to
+ * attach a pool created with %NVME_BUF_POOL_HUGETLB. Ownership of
+ * @pool passes to @r.
+ */
+void nvme_root_set_buf_pool(nvme_root_t r, nvme_buf_pool_t pool);
+
+/**
+ * nvme_root_open() - Open a device through the root's fd cache
+ * @r:		&nvme_root_t object
+ * @name:	Device name, e.g. "nvme0" or "nvme0n1"
+ *
+ * Like nvme_open(), but keeps the fd open in a per-root cache keyed by
+ * name, so steady-state polling of the same devices performs no
+ * open/close syscalls. Cached fds are owned by the cache: do not close
+ * them. They stay valid until evicted (LRU, see
+ * nvme_root_set_fd_cache_size()), invalidated by a topology change, or
+ * the root is freed. With a cache size of zero this behaves exactly
+ * like nvme_open() and the caller owns the fd.
+ *
+ * Return: An open file descriptor, or -1 on failure with errno set.
+ */
+int nvme_root_open(nvme_root_t r, const char *name);
+
+/**
+ * nvme_root_set_fd_cache_size() - Cap the root's device fd cache
+ * @r:		&nvme_root_t object
+ * @max_fds:	Maximum number of fds kept open; 0 disables caching
+ *
+ * The least recently used entries are closed when the cache exceeds
+ * @max_fds. The default cap is 32.
+ */
+void nvme_root_set_fd_cache_size(nvme_root_t r, unsigned int max_fds);
+
+/**
+ * nvme_root_fd_cache_clear() - Close all fds in the root's fd cache
+ * @r:	&nvme_root_t object
+ *
+ * Invalidate the cache, e.g. after a topology change. Called
+ * implicitly by nvme_refresh_topology(), nvme_root_release_fds() and
+ * nvme_free_tree().
+ */
+void nvme_root_fd_cache_clear(nvme_root_t r);
+
+/**
+ * nvme_root_set_state_ttl() - Set the controller state cache window
+ * @r:		&nvme_root_t object
+ * @millis:	Validity of a read state attribute in milliseconds;
+ *		0 re-reads on every call
+ *
+ * nvme_ctrl_get_state() re-reads the sysfs state attribute only once
+ * the previously read value is older than @millis (default 100), so
+ * path-selection loops that query every controller per decision do
+ * not turn into a syscall storm. Applying a controller uevent through
+ * nvme_topology_apply_event() drops the cached value right away; see
+ * nvme_ctrl_get_state().
+ */
+void nvme_root_set_state_ttl(nvme_root_t r, unsigned int millis);
+
+/**
+ * nvme_root_set_resolv_ttl() - Set the hostname resolution cache TTL
+ * @r:		&nvme_root_t object
+ * @seconds:	Cache lifetime of a resolved address; 0 disables caching
+ *
+ * Transport addresses given as hostnames are resolved with
+ * getaddrinfo(), which can stall for seconds when DNS is slow.
+ * Resolved addresses are kept on @r for @seconds (default 60) so that
+ * reconnect loops do not repeat the resolver round trip for every
+ * attempt. Setting a TTL of 0 drops the cache and disables it.
+ */
+void nvme_root_set_resolv_ttl(nvme_root_t r, unsigned int seconds);
+
+/**
+ * nvme_root_resolv_cache_clear() - Drop all cached hostname resolutions
+ * @r:	&nvme_root_t object
+ *
+ * Use to force fresh DNS lookups before the TTL expires, e.g. after a
+ * known DNS change.
+ */
+void nvme_root_resolv_cache_clear(nvme_root_t r);
+
+/**
+ * nvme_root_resolve_hostnames() - Prefetch hostname resolutions
+ * @r:		&nvme_root_t object
+ * @hostnames:	Array of hostnames to resolve
+ * @n:		Number of entries in @hostnames
+ *
+ * Resolves all given hostnames concurrently and fills the resolution
+ * cache, so that a subsequent reconnect wave is served from the cache
+ * and a slow DNS server cannot serialize fabric recovery.
+ *
+ * Return: the number of successfully resolved hostnames, or -1 on
+ * failure with errno set.
+ */
+int nvme_root_resolve_hostnames(nvme_root_t r, const char *const *hostnames,
+				unsigned int n);
+
+/**
+ * struct nvme_root_stats - Snapshot of library activity counters
+ * @ioctls:		Passthru commands submitted to the kernel
+ * @ioctl_errors:	Passthru commands that failed with a negative result
+ * @bytes_transferred:	Sum of the data lengths of successful passthru commands
+ * @connect_attempts:	Fabrics connect attempts written to /dev/nvme-fabrics
+ * @connect_errors:	Fabrics connect attempts that failed
+ * @scans:		Topology scan passes over sysfs
+ * @mi_submissions:	NVMe-MI requests submitted to an endpoint
+ * @mi_errors:		NVMe-MI requests that failed
+ *
+ * Counters are maintained unconditionally; updates are relaxed atomic
+ * increments on the fast paths, so reading a snapshot is cheap but not
+ * a consistent cut across all fields. The ioctl counters are kept
+ * process-wide because the ioctl API carries no root context, the
+ * remaining counters are per root.
+ */
+struct nvme_root_stats {
+	__u64 ioctls;
+	__u64 ioctl_errors;
+	__u64 bytes_transferred;
+	__u64 connect_attempts;
+	__u64 connect_errors;
+	__u64 scans;
+	__u64 mi_submissions;
+	__u64 mi_errors;
+};
+
+/**
+ * nvme_root_get_stats() - Read the activity counters
+ * @r:		&nvme_root_t object
+ * @stats:	Filled with the current counter values
+ */
+void nvme_root_get_stats(nvme_root_t r, struct nvme_root_stats *stats);
+
+/**
+ * nvme_root_reset_stats() - Zero the activity counters
+ * @r:		&nvme_root_t object
+ *
+ * Also resets the process-wide ioctl counters.
+ */
+void nvme_root_reset_stats(nvme_root_t r);
+
+/**
+ * nvme_root_read_lock() - Take the topology lock for reading
+ * @r:	&nvme_root_t object
+ *
+ * The library does not lock internally on behalf of the caller; a tree
+ * is single-threaded unless these functions are used. The model is
+ * read-mostly: any number of threads may walk the tree and call the
+ * accessors while holding the read lock, and a thread that changes the
+ * topology - nvme_scan_topology(), nvme_refresh_topology(),
+ * nvme_update_config(), creating, connecting or freeing hosts,
+ * controllers or namespaces, and nvme_free_tree() - must hold the
+ * write lock exclusively.
+ *
+ * Accessors that lazily fetch and memoize sysfs attributes are safe
+ * under the read lock; the memoization is synchronized internally.
+ * nvme_ctrl_get_state() is the exception: once its validity window
+ * (see nvme_root_set_state_ttl()) has expired it replaces the cached
+ * state string and therefore needs the write lock.
+ *
+ * The lock is not recursive and readers block writers, so do not call
+ * a topology-changing function while holding the read lock.
+ */
+void nvme_root_read_lock(nvme_root_t r);
+
+/**
+ * nvme_root_read_unlock() - Release the topology lock taken for reading
+ * @r:	&nvme_root_t object
+ */
+void nvme_root_read_unlock(nvme_root_t r);
+
+/**
+ * nvme_root_write_lock() - Take the topology lock exclusively
+ * @r:	&nvme_root_t object
+ *
+ * Required around topology changes when other threads access the tree
+ * concurrently; see nvme_root_read_lock() for the model.
+ */
+void nvme_root_write_lock(nvme_root_t r);
+
+/**
+ * nvme_root_write_unlock() - Release the exclusively held topology lock
+ * @r:	&nvme_root_t object
+ */
+void nvme_root_write_unlock(nvme_root_t r);
+
+/**
+ * nvme_root_get_ctrl_array() - Contiguous array of all controllers
+ * @r:	&nvme_root_t object
+ * @nr:	Filled with the number of entries
+ *
+ * Returns the controllers of all hosts and subsystems laid out in one
+ * contiguous array, so a loop over all of them is cache-linear instead
+ * of chasing list pointers across the heap. The array is owned by @r
+ * and rebuilt lazily after a topology change; it stays valid until the
+ * next topology change or nvme_free_tree(). Do not free it.
+ *
+ * Return: The array, or NULL with @nr set to 0 if the tree is empty or,
+ * with errno set, on allocation failure.
+ */
+nvme_ctrl_t *nvme_root_get_ctrl_array(nvme_root_t r, unsigned int *nr);
+
+/**
+ * nvme_root_get_ns_array() - Contiguous array of all namespaces
+ * @r:	&nvme_root_t object
+ * @nr:	Filled with the number of entries
+ *
+ * Like nvme_root_get_ctrl_array(), but over the namespaces of all
+ * subsystems and controllers, in traversal order.
+ *
+ * Return: The array, or NULL with @nr set to 0 if the tree is empty or,
+ * with errno set, on allocation failure.
+ */
+nvme_ns_t *nvme_root_get_ns_array(nvme_root_t r, unsigned int *nr);
+
+/**
+ * nvme_root_save_snapshot() - Serialize the topology to a binary file
+ * @r:		&nvme_root_t object
+ * @path:	File to write the snapshot to
+ *
+ * Writes a compact binary snapshot of the scanned topology, including
+ * the mtimes of the sysfs class directories it was taken from. A later
+ * nvme_root_load_snapshot() restores the tree without walking sysfs.
+ * Only eagerly scanned attributes are captured; lazily loaded ones are
+ * re-read from sysfs on first access after a restore.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_root_save_snapshot(nvme_root_t r, const char *path);
+
+/**
+ * nvme_root_load_snapshot() - Restore a topology snapshot
+ * @r:		&nvme_root_t object, typically freshly created
+ * @path:	File written by nvme_root_save_snapshot()
+ *
+ * Validates the snapshot against the current sysfs class directory
+ * mtimes and populates @r from it. If the topology changed since the
+ * snapshot was taken the call fails with errno set to ESTALE and the
+ * caller should fall back to nvme_scan_topology(); after a partial
+ * load failure use nvme_refresh_topology() to start from a clean tree.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_root_load_snapshot(nvme_root_t r, const char *path);
+
+/**
+ * nvme_root_prefetch_ns_geometry() - Batch-fill cached namespace geometry
+ * @r:	&nvme_root_t object
+ *
+ * Fills the cached geometry (block size, metadata size, in-use format
+ * index, utilization) of every namespace that has not been probed yet,
+ * batching the Identify Namespace commands through each controller's
+ * admin queue. Call once after a scan to avoid a per-namespace command
+ * or sysfs round trip on first access; namespaces whose controller
+ * cannot be opened are left for lazy probing.
+ *
+ * Return: The number of namespaces filled, or -1 with errno set on
+ * allocation failure.
+ */
+int nvme_root_prefetch_ns_geometry(nvme_root_t r);
+
+/**
+ * nvme_root_publish_shared() - Publish the topology to a shm segment
+ * @r:		&nvme_root_t object
+ * @name:	POSIX shared memory name (leading '/', see shm_open(3))
+ * @capacity:	Payload bytes to reserve in the segment, 0 to size it to
+ *		the current snapshot
+ *
+ * Serializes the topology as with nvme_root_save_snapshot() and stores
+ * it, seqlock-protected, in the named shared memory segment, creating
+ * the segment if needed. One publisher process calls this after every
+ * scan; other processes rebuild their tree from the segment with
+ * nvme_root_attach_shared() instead of scanning sysfs themselves.
+ * Size @capacity for the largest expected topology: republishing into
+ * an existing segment fails with ENOSPC rather than growing it, since
+ * consumers map the segment at its creation size.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_root_publish_shared(nvme_root_t r, const char *name, size_t capacity);
+
+/**
+ * nvme_root_attach_shared() - Populate a tree from a shm snapshot
+ * @r:		&nvme_root_t object, typically freshly created
+ * @name:	Segment published with nvme_root_publish_shared()
+ *
+ * Attaches the named segment read-only, takes a consistent copy of the
+ * snapshot under its seqlock and populates @r from it, subject to the
+ * same staleness check as nvme_root_load_snapshot() (errno ESTALE).
+ * Fails with EAGAIN if a concurrent publisher keeps invalidating the
+ * read. The segment is unmapped again before returning; @r holds its
+ * own copy of the topology.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_root_attach_shared(nvme_root_t r, const char *name);
+
+/**
+ * nvme_root_unpublish_shared() - Remove a published shm snapshot
+ * @name:	Segment published with nvme_root_publish_shared()
+ *
+ * Unlinks the shared memory segment; processes that already attached
+ * are unaffected.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_root_unpublish_shared(const char *name);
+
+/**
+ * struct nvme_stat_sample - One sampled counter value
+ * @value:	Raw counter value from the most recent sample
+ * @delta:	Change since the previous sample; zero on the first
+ *		sample and after a failed read
+ * @valid:	Whether the most recent read of this counter succeeded
+ */
+struct nvme_stat_sample {
+	__u64 value;
+	__s64 delta;
+	bool valid;
+};
+
+/**
+ * typedef nvme_stats_sampler_t - Batched sysfs counter sampler
+ *
+ * Reads a fixed set of numeric sysfs attributes for every path and
+ * namespace in the tree in one pass, keeping the attribute files open
+ * between samples. Declared once with nvme_stats_sampler_create() and
+ * driven with nvme_stats_sampler_sample().
+ */
+typedef struct nvme_stats_sampler *nvme_stats_sampler_t;
+
+/**
+ * nvme_stats_sampler_create() - Declare a counter set over the tree
+ * @r:		&nvme_root_t object with a scanned topology
+ * @counters:	Names of the sysfs attributes to sample, relative to
+ *		each object's sysfs directory
+ * @nr_counters: Number of entries in @counters
+ *
+ * Enumerates every path and namespace in @r and opens the named
+ * attributes once, so that each nvme_stats_sampler_sample() call is a
+ * single read per counter with no path lookups. Counters that don't
+ * exist for an object are marked invalid rather than failing the
+ * sampler.
+ *
+ * The sampler borrows the tree's objects: free it before rescanning or
+ * freeing @r.
+ *
+ * Return: The sampler, or NULL on failure with errno set.
+ */
+nvme_stats_sampler_t nvme_stats_sampler_create(nvme_root_t r,
+					       const char *const *counters,
+					       unsigned int nr_counters);
+
+/**
+ * nvme_stats_sampler_sample() - Take one sample of all counters
+ * @s:	Sampler created by nvme_stats_sampler_create()
+ *
+ * Re-reads every declared counter for every object and updates the
+ * per-counter deltas against the previous sample.
+ *
+ * Return: The number of counters successfully read, or -1 on failure
+ * with errno set.
+ */
+int nvme_stats_sampler_sample(nvme_stats_sampler_t s);
+
+/**
+ * nvme_stats_sampler_nr_objects() - Number of sampled objects
+ * @s:	Sampler created by nvme_stats_sampler_create()
+ *
+ * Return: The number of paths and namespaces covered by @s.
+ */
+unsigned int nvme_stats_sampler_nr_objects(nvme_stats_sampler_t s);
+
+/**
+ * nvme_stats_sampler_obj_path() - Path object behind a sampler slot
+ * @s:	Sampler created by nvme_stats_sampler_create()
+ * @i:	Object index, below nvme_stats_sampler_nr_objects()
+ *
+ * Return: The &nvme_path_t sampled at index @i, or NULL if that slot
+ * holds a namespace.
+ */
+nvme_path_t nvme_stats_sampler_obj_path(nvme_stats_sampler_t s,
+					unsigned int i);
+
+/**
+ * nvme_stats_sampler_obj_ns() - Namespace object behind a sampler slot
+ * @s:	Sampler created by nvme_stats_sampler_create()
+ * @i:	Object index, below nvme_stats_sampler_nr_objects()
+ *
+ * Return: The &nvme_ns_t sampled at index @i, or NULL if that slot
+ * holds a path.
+ */
+nvme_ns_t nvme_stats_sampler_obj_ns(nvme_stats_sampler_t s, unsigned int i);
+
+/**
+ * nvme_stats_sampler_obj_samples() - Sampled values for one object
+ * @s:	Sampler created by nvme_stats_sampler_create()
+ * @i:	Object index, below nvme_stats_sampler_nr_objects()
+ *
+ * Return: An array of the object's samples, one entry per declared
+ * counter, in declaration order. Valid until the next sample call.
+ */
+const struct nvme_stat_sample *
+nvme_stats_sampler_obj_samples(nvme_stats_sampler_t s, unsigned int i);
+
+/**
+ * nvme_stats_sampler_free() - Release a sampler
+ * @s:	Sampler created by nvme_stats_sampler_create()
+ *
+ * Closes the sampled attribute files and frees the sampler.
+ */
+void nvme_stats_sampler_free(nvme_stats_sampler_t s);
+
 /**
  * nvme_root_release_fds - Close all opened file descriptors in the tree
  * @r:	&nvme_root_t object
@@ -591,6 +1067,30 @@ int nvme_ns_get_lba_size(nvme_ns_t n);
  */
 int nvme_ns_get_meta_size(nvme_ns_t n);
 
+/**
+ * nvme_ns_get_lbaf_inuse() - In-use LBA format index of a namespace
+ * @n:	Namespace instance
+ *
+ * The index is learned from identify data and cached on @n, together
+ * with the geometry it decodes to; repeated calls do not issue further
+ * commands.
+ *
+ * Return: The in-use LBA format index, or -1 with errno set if it
+ * could not be determined
+ */
+int nvme_ns_get_lbaf_inuse(nvme_ns_t n);
+
+/**
+ * nvme_ns_invalidate_geometry() - Drop cached geometry of a namespace
+ * @n:	Namespace instance
+ *
+ * Call after an operation that may change the namespace format (e.g.
+ * Format NVM) so the cached block size, metadata size, format index
+ * and utilization are re-read on next access instead of serving stale
+ * values.
+ */
+void nvme_ns_invalidate_geometry(nvme_ns_t n);
+
 /**
  * nvme_ns_get_lba_count() - LBA count of a namespace
  * @n:	Namespace instance
@@ -869,6 +1369,18 @@ int nvme_ctrl_get_fd(nvme_ctrl_t c);
  */
 void nvme_ctrl_release_fd(nvme_ctrl_t c);
 
+/**
+ * nvme_ctrl_get_max_xfer_len() - Maximal log page transfer size
+ * @c:	Controller instance
+ *
+ * Discovers the controller's MDTS limit on first use and caches the
+ * result on @c; see nvme_get_log_page_max(). Falls back to
+ * %NVME_LOG_PAGE_PDU_SIZE if the limit cannot be determined.
+ *
+ * Return: Maximal chunk size to use for chunked log page reads from @c
+ */
+__u32 nvme_ctrl_get_max_xfer_len(nvme_ctrl_t c);
+
 /**
  * nvme_ctrl_get_name() - sysfs name of a controller
  * @c:	Controller instance
@@ -933,6 +1445,13 @@ const char *nvme_ctrl_get_model(nvme_ctrl_t c);
  * nvme_ctrl_get_state() - Running state of a controller
  * @c:	Controller instance
  *
+ * The state is cached for a short validity window (see
+ * nvme_root_set_state_ttl()), so tight path-selection loops calling
+ * this for every path do not issue a sysfs read per call. A uevent
+ * applied through nvme_topology_apply_event() invalidates the cache
+ * immediately, so transitions are picked up on the next call even
+ * within the window.
+ *
  * Return: String indicating the running state of @c
  */
 const char *nvme_ctrl_get_state(nvme_ctrl_t c);
@@ -1105,6 +1624,29 @@ void nvme_ctrl_set_persistent(nvme_ctrl_t c, bool persistent);
  */
 bool nvme_ctrl_is_persistent(nvme_ctrl_t c);
 
+/**
+ * nvme_ctrl_config_is_dirty() - Check for unacknowledged config changes
+ * @c:	Controller instance
+ *
+ * The flag is raised whenever a config merge, update or JSON application
+ * actually changes the effective fabrics configuration of @c; passes that
+ * reapply an unchanged configuration leave it alone. Reconcile loops can
+ * therefore skip controllers whose flag is clear.
+ *
+ * Return: %true if the configuration changed since the flag was last
+ * cleared with nvme_ctrl_config_clear_dirty()
+ */
+bool nvme_ctrl_config_is_dirty(nvme_ctrl_t c);
+
+/**
+ * nvme_ctrl_config_clear_dirty() - Acknowledge config changes
+ * @c:	Controller instance
+ *
+ * Clear the flag reported by nvme_ctrl_config_is_dirty(), typically after
+ * a reconcile pass has acted on the changed configuration.
+ */
+void nvme_ctrl_config_clear_dirty(nvme_ctrl_t c);
+
 /**
  * nvme_ctrl_set_discovery_ctrl() - Set the 'discovery_ctrl' flag
  * @c:		Controller to be modified
@@ -1158,6 +1700,45 @@ bool nvme_ctrl_is_unique_discovery_ctrl(nvme_ctrl_t c);
  */
 int nvme_ctrl_identify(nvme_ctrl_t c, struct nvme_id_ctrl *id);
 
+/**
+ * nvme_ctrl_enable_identify_cache() - Enable identify payload caching
+ * @c:		Controller instance
+ * @enabled:	true to enable the cache, false to disable it
+ *
+ * When enabled, identify payloads retrieved via nvme_ctrl_identify_cached()
+ * are memoized on @c, keyed by the (cns, csi, nsid, cntid, uuidx) tuple of
+ * the request. Subsequent lookups with the same key are served from the
+ * cache without issuing an ioctl. The cache is dropped when the controller
+ * is rescanned or deconfigured; disabling the cache also drops it.
+ *
+ * Caching is off by default as identify data may change across controller
+ * resets, namespace management commands or firmware activations.
+ */
+void nvme_ctrl_enable_identify_cache(nvme_ctrl_t c, bool enabled);
+
+/**
+ * nvme_ctrl_clear_identify_cache() - Drop cached identify payloads
+ * @c:	Controller instance
+ *
+ * Discards all identify payloads cached on @c. Use after issuing commands
+ * which may change identify data, e.g. namespace management or format.
+ */
+void nvme_ctrl_clear_identify_cache(nvme_ctrl_t c);
+
+/**
+ * nvme_ctrl_identify_cached() - Issue an identify command through the cache
+ * @c:		Controller instance
+ * @args:	&struct nvme_identify_args argument structure
+ *
+ * Serves the identify request described by @args from the cache of @c when
+ * identify caching is enabled and a matching payload is present; otherwise
+ * issues the command against the controller device and, on success, caches
+ * the payload. The @args fd member is filled in from @c.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_ctrl_identify_cached(nvme_ctrl_t c, struct nvme_identify_args *args);
+
 /**
  * nvme_disconnect_ctrl() - Disconnect a controller
  * @c:	Controller instance
@@ -1339,6 +1920,23 @@ int nvme_read_config(nvme_root_t r, const char *config_file);
  */
 void nvme_refresh_topology(nvme_root_t r);
 
+/**
+ * nvme_topology_apply_event() - Incrementally update nvme_root_t contents
+ * @r:		nvme_root_t object
+ * @action:	Uevent action, one of "add", "change", "bind" or "remove"
+ * @name:	Kernel device name, e.g. "nvme0", "nvme0n1" or "nvme0c1n1"
+ *
+ * Applies a single kernel uevent to @r by scanning or removing just the
+ * affected controller, namespace, or path object. All other elements of
+ * the topology, including cached file descriptors, are left untouched.
+ * This avoids the cost of a full nvme_refresh_topology() when feeding
+ * events from udev or a netlink uevent socket.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_topology_apply_event(nvme_root_t r, const char *action,
+			      const char *name);
+
 /**
  * nvme_update_config() - Update JSON configuration
  * @r:	nvme_root_t object
@@ -1381,6 +1979,36 @@ int nvme_dump_tree(nvme_root_t r);
  */
 char *nvme_get_attr(const char *d, const char *attr);
 
+/**
+ * nvme_get_attr_at() - Read sysfs attribute relative to a directory fd
+ * @dirfd:	Open fd on the sysfs object directory (O_PATH suffices)
+ * @attr:	Attribute name
+ *
+ * Like nvme_get_attr(), but resolves @attr with openat() relative to
+ * @dirfd, avoiding a full path walk per attribute.
+ *
+ * Return: String with the attribute content of @attr not including the
+ * trailing newline or NULL in case of an error
+ */
+char *nvme_get_attr_at(int dirfd, const char *attr);
+
+/**
+ * nvme_get_attrs() - Read a list of sysfs attributes in one pass
+ * @dir:	Sysfs directory of the object
+ * @attrs:	Array of @n attribute names
+ * @values:	Array receiving @n attribute values; entries for
+ *		attributes that could not be read are set to NULL
+ * @n:		Number of attributes to read
+ *
+ * Opens @dir once and reads every attribute relative to it. Each
+ * non-NULL entry of @values is allocated and must be freed by the
+ * caller.
+ *
+ * Return: Number of attributes read, or -1 if @dir could not be opened.
+ */
+int nvme_get_attrs(const char *dir, const char *const *attrs,
+		   char **values, unsigned int n);
+
 /**
  * nvme_get_subsys_attr() - Read subsystem sysfs attribute
  * @s:		nvme_subsystem_t object
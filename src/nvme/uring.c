@@ -0,0 +1,1077 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ * Copyright (c) 2024 Western Digital Corporation or its affiliates.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ccan/endian/endian.h>
+
+#include "uring.h"
+#include "linux.h"
+#include "private.h"
+#include "cleanup.h"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * The ring is driven through the raw syscall interface rather than
+ * liburing to avoid a new library dependency; only the small subset
+ * needed for NVME_URING_CMD_ADMIN passthrough is implemented.
+ */
+struct nvme_uring_queue {
+	int ring_fd;
+	unsigned int depth;
+
+	/* submission ring */
+	void *sq_ring;
+	size_t sq_ring_sz;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_sz;
+	unsigned int sq_tail_local;
+	unsigned int to_submit;
+
+	/* completion ring */
+	void *cq_ring;
+	size_t cq_ring_sz;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned int cq_head_local;
+
+	/* completions are polled rather than interrupt driven */
+	bool polled;
+};
+
+static int nvme_io_uring_setup(unsigned int entries,
+			       struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int nvme_io_uring_enter(int ring_fd, unsigned int to_submit,
+			       unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+int nvme_uring_queue_create_flags(unsigned int depth, unsigned int flags,
+				  nvme_uring_queue_t *queue)
+{
+	struct io_uring_params p = {
+		/* NVMe passthrough needs the large SQE and CQE formats */
+		.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32,
+	};
+	struct nvme_uring_queue *q;
+	int ring_fd;
+
+	if (!depth || !queue ||
+	    (flags & ~(NVME_URING_QUEUE_POLLED | NVME_URING_QUEUE_HYBRID_POLL))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (flags & (NVME_URING_QUEUE_POLLED | NVME_URING_QUEUE_HYBRID_POLL))
+		p.flags |= IORING_SETUP_IOPOLL;
+	if (flags & NVME_URING_QUEUE_HYBRID_POLL) {
+#ifdef IORING_SETUP_HYBRID_IOPOLL
+		p.flags |= IORING_SETUP_HYBRID_IOPOLL;
+#else
+		errno = ENOTSUP;
+		return -1;
+#endif
+	}
+
+	q = calloc(1, sizeof(*q));
+	if (!q) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	ring_fd = nvme_io_uring_setup(depth, &p);
+	if (ring_fd < 0) {
+		free(q);
+		if (errno == ENOSYS || errno == EINVAL)
+			errno = ENOTSUP;
+		return -1;
+	}
+	q->ring_fd = ring_fd;
+	q->depth = p.sq_entries;
+
+	q->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	q->cq_ring_sz = p.cq_off.cqes +
+		p.cq_entries * 2 * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (q->cq_ring_sz > q->sq_ring_sz)
+			q->sq_ring_sz = q->cq_ring_sz;
+		q->cq_ring_sz = q->sq_ring_sz;
+	}
+
+	q->sq_ring = mmap(NULL, q->sq_ring_sz, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring_fd,
+			  IORING_OFF_SQ_RING);
+	if (q->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		q->cq_ring = q->sq_ring;
+	} else {
+		q->cq_ring = mmap(NULL, q->cq_ring_sz,
+				  PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, ring_fd,
+				  IORING_OFF_CQ_RING);
+		if (q->cq_ring == MAP_FAILED)
+			goto fail;
+	}
+
+	/* 128-byte SQEs, hence the doubled size */
+	q->sqes_sz = p.sq_entries * 2 * sizeof(struct io_uring_sqe);
+	q->sqes = mmap(NULL, q->sqes_sz, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (q->sqes == MAP_FAILED)
+		goto fail;
+
+	q->sq_head = q->sq_ring + p.sq_off.head;
+	q->sq_tail = q->sq_ring + p.sq_off.tail;
+	q->sq_mask = q->sq_ring + p.sq_off.ring_mask;
+	q->sq_array = q->sq_ring + p.sq_off.array;
+	q->cq_head = q->cq_ring + p.cq_off.head;
+	q->cq_tail = q->cq_ring + p.cq_off.tail;
+	q->cq_mask = q->cq_ring + p.cq_off.ring_mask;
+	q->cqes = q->cq_ring + p.cq_off.cqes;
+
+	q->sq_tail_local = *q->sq_tail;
+	q->cq_head_local = *q->cq_head;
+	q->polled = !!(p.flags & IORING_SETUP_IOPOLL);
+
+	*queue = q;
+	return 0;
+
+fail:
+	nvme_uring_queue_free(q);
+	errno = ENOMEM;
+	return -1;
+}
+
+int nvme_uring_queue_create(unsigned int depth, nvme_uring_queue_t *queue)
+{
+	return nvme_uring_queue_create_flags(depth, 0, queue);
+}
+
+void nvme_uring_queue_free(nvme_uring_queue_t q)
+{
+	if (!q)
+		return;
+	if (q->sqes && q->sqes != MAP_FAILED)
+		munmap(q->sqes, q->sqes_sz);
+	if (q->cq_ring && q->cq_ring != MAP_FAILED &&
+	    q->cq_ring != q->sq_ring)
+		munmap(q->cq_ring, q->cq_ring_sz);
+	if (q->sq_ring && q->sq_ring != MAP_FAILED)
+		munmap(q->sq_ring, q->sq_ring_sz);
+	if (q->ring_fd >= 0)
+		close(q->ring_fd);
+	free(q);
+}
+
+static struct io_uring_sqe *nvme_uring_get_sqe(struct nvme_uring_queue *q)
+{
+	unsigned int head, idx;
+	struct io_uring_sqe *sqe;
+
+	head = __atomic_load_n(q->sq_head, __ATOMIC_ACQUIRE);
+	if (q->sq_tail_local - head >= q->depth) {
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	idx = q->sq_tail_local & *q->sq_mask;
+	/* 128-byte SQEs */
+	sqe = (struct io_uring_sqe *)((char *)q->sqes +
+			(idx * 2 * sizeof(struct io_uring_sqe)));
+	memset(sqe, 0, 2 * sizeof(struct io_uring_sqe));
+	q->sq_array[idx] = idx;
+	q->sq_tail_local++;
+	q->to_submit++;
+	return sqe;
+}
+
+static int nvme_uring_queue_cmd_op(struct nvme_uring_queue *q, int fd,
+				   struct nvme_uring_cmd *cmd, void *userdata,
+				   __u32 cmd_op)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = nvme_uring_get_sqe(q);
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = IORING_OP_URING_CMD;
+	sqe->fd = fd;
+	sqe->cmd_op = cmd_op;
+	sqe->user_data = (__u64)(uintptr_t)userdata;
+	memcpy(sqe->cmd, cmd, sizeof(*cmd));
+	return 0;
+}
+
+static int nvme_uring_queue_cmd(struct nvme_uring_queue *q, int fd,
+				struct nvme_uring_cmd *cmd, void *userdata)
+{
+	return nvme_uring_queue_cmd_op(q, fd, cmd, userdata,
+				       NVME_URING_CMD_ADMIN);
+}
+
+int nvme_uring_admin_passthru(nvme_uring_queue_t q, int fd,
+			      struct nvme_passthru_cmd64 *cmd, void *userdata)
+{
+	struct nvme_uring_cmd ucmd = {
+		.opcode		= cmd->opcode,
+		.flags		= cmd->flags,
+		.nsid		= cmd->nsid,
+		.cdw2		= cmd->cdw2,
+		.cdw3		= cmd->cdw3,
+		.metadata	= cmd->metadata,
+		.addr		= cmd->addr,
+		.metadata_len	= cmd->metadata_len,
+		.data_len	= cmd->data_len,
+		.cdw10		= cmd->cdw10,
+		.cdw11		= cmd->cdw11,
+		.cdw12		= cmd->cdw12,
+		.cdw13		= cmd->cdw13,
+		.cdw14		= cmd->cdw14,
+		.cdw15		= cmd->cdw15,
+		.timeout_ms	= cmd->timeout_ms,
+	};
+
+	return nvme_uring_queue_cmd(q, fd, &ucmd, userdata);
+}
+
+int nvme_uring_identify(nvme_uring_queue_t q, struct nvme_identify_args *args,
+			void *userdata)
+{
+	struct nvme_uring_cmd cmd;
+
+	if (args->args_size < sizeof(*args)) {
+		errno = EINVAL;
+		return -1;
+	}
+	nvme_init_identify_cmd(&cmd, args);
+	return nvme_uring_queue_cmd(q, args->fd, &cmd, userdata);
+}
+
+int nvme_uring_get_log(nvme_uring_queue_t q, struct nvme_get_log_args *args,
+		       void *userdata)
+{
+	struct nvme_uring_cmd cmd;
+
+	if (args->args_size < sizeof(*args)) {
+		errno = EINVAL;
+		return -1;
+	}
+	nvme_init_get_log_cmd(&cmd, args);
+	return nvme_uring_queue_cmd(q, args->fd, &cmd, userdata);
+}
+
+int nvme_uring_fw_download(nvme_uring_queue_t q,
+			   struct nvme_fw_download_args *args, void *userdata)
+{
+	struct nvme_uring_cmd cmd;
+
+	if (args->args_size < sizeof(*args)) {
+		errno = EINVAL;
+		return -1;
+	}
+	nvme_init_fw_download_cmd(&cmd, args);
+	return nvme_uring_queue_cmd(q, args->fd, &cmd, userdata);
+}
+
+int nvme_uring_set_features(nvme_uring_queue_t q,
+			    struct nvme_set_features_args *args, void *userdata)
+{
+	struct nvme_uring_cmd cmd;
+
+	if (args->args_size < sizeof(*args)) {
+		errno = EINVAL;
+		return -1;
+	}
+	nvme_init_set_features_cmd(&cmd, args);
+	return nvme_uring_queue_cmd(q, args->fd, &cmd, userdata);
+}
+
+int nvme_uring_get_features(nvme_uring_queue_t q,
+			    struct nvme_get_features_args *args, void *userdata)
+{
+	struct nvme_uring_cmd cmd;
+
+	if (args->args_size < sizeof(*args)) {
+		errno = EINVAL;
+		return -1;
+	}
+	nvme_init_get_features_cmd(&cmd, args);
+	return nvme_uring_queue_cmd(q, args->fd, &cmd, userdata);
+}
+
+int nvme_uring_zns_mgmt_recv(nvme_uring_queue_t q,
+			     struct nvme_zns_mgmt_recv_args *args,
+			     void *userdata)
+{
+	struct nvme_uring_cmd cmd;
+
+	if (args->args_size < sizeof(*args)) {
+		errno = EINVAL;
+		return -1;
+	}
+	nvme_init_zns_mgmt_recv_cmd(&cmd, args);
+	/* I/O command set command, not an admin command */
+	return nvme_uring_queue_cmd_op(q, args->fd, &cmd, userdata,
+				       NVME_URING_CMD_IO);
+}
+
+int nvme_uring_submit(nvme_uring_queue_t q)
+{
+	unsigned int to_submit = q->to_submit;
+	int ret;
+
+	if (!to_submit)
+		return 0;
+
+	__atomic_store_n(q->sq_tail, q->sq_tail_local, __ATOMIC_RELEASE);
+	ret = nvme_io_uring_enter(q->ring_fd, to_submit, 0, 0);
+	if (ret < 0)
+		return -1;
+	q->to_submit -= ret;
+	return ret;
+}
+
+int nvme_uring_reap(nvme_uring_queue_t q, struct nvme_uring_completion *comps,
+		    unsigned int max, unsigned int min)
+{
+	unsigned int got = 0;
+
+	while (got < max) {
+		struct io_uring_cqe *cqe;
+		unsigned int tail, idx;
+
+		tail = __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE);
+		if (q->cq_head_local == tail) {
+			int ret;
+			bool wait = got < min;
+
+			/*
+			 * Polled rings never post completions on their
+			 * own; even a non-blocking reap must enter the
+			 * kernel for one poll sweep.
+			 */
+			if (!wait && !q->polled)
+				break;
+			ret = nvme_io_uring_enter(q->ring_fd, 0,
+						  wait ? min - got : 0,
+						  IORING_ENTER_GETEVENTS);
+			if (ret < 0 && errno != EINTR)
+				return -1;
+			if (!wait &&
+			    __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE) ==
+			    q->cq_head_local)
+				break;
+			continue;
+		}
+
+		idx = q->cq_head_local & *q->cq_mask;
+		/* 32-byte CQEs */
+		cqe = &q->cqes[idx * 2];
+		comps[got].userdata = (void *)(uintptr_t)cqe->user_data;
+		comps[got].status = cqe->res;
+		comps[got].result = cqe->big_cqe[0];
+		got++;
+
+		q->cq_head_local++;
+		__atomic_store_n(q->cq_head, q->cq_head_local,
+				 __ATOMIC_RELEASE);
+	}
+
+	return got;
+}
+
+#else /* !HAVE_IO_URING */
+
+int nvme_uring_queue_create(unsigned int depth, nvme_uring_queue_t *queue)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_queue_create_flags(unsigned int depth, unsigned int flags,
+				  nvme_uring_queue_t *queue)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+void nvme_uring_queue_free(nvme_uring_queue_t q)
+{
+}
+
+int nvme_uring_admin_passthru(nvme_uring_queue_t q, int fd,
+			      struct nvme_passthru_cmd64 *cmd, void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_identify(nvme_uring_queue_t q, struct nvme_identify_args *args,
+			void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_get_log(nvme_uring_queue_t q, struct nvme_get_log_args *args,
+		       void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_fw_download(nvme_uring_queue_t q,
+			   struct nvme_fw_download_args *args, void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_set_features(nvme_uring_queue_t q,
+			    struct nvme_set_features_args *args, void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_get_features(nvme_uring_queue_t q,
+			    struct nvme_get_features_args *args, void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_zns_mgmt_recv(nvme_uring_queue_t q,
+			     struct nvme_zns_mgmt_recv_args *args,
+			     void *userdata)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_submit(nvme_uring_queue_t q)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+int nvme_uring_reap(nvme_uring_queue_t q, struct nvme_uring_completion *comps,
+		    unsigned int max, unsigned int min)
+{
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif /* HAVE_IO_URING */
+
+#define NVME_URING_BATCH_DEPTH	64
+
+/*
+ * Common engine for the batch helpers: keep up to NVME_URING_BATCH_DEPTH
+ * commands in flight, refilling the queue as completions drain. Index of
+ * the originating argument structure travels as the userdata cookie.
+ */
+static int nvme_uring_run_batch(unsigned int n, int *status,
+		unsigned int depth,
+		int (*queue_one)(nvme_uring_queue_t q, void *ctx,
+				 unsigned int idx),
+		void (*complete_one)(void *ctx, unsigned int idx,
+				     struct nvme_uring_completion *comp),
+		void *ctx)
+{
+	nvme_uring_queue_t q;
+	unsigned int queued = 0, submitted = 0, done = 0;
+	int ret = 0, nr_failed = 0;
+
+	if (!depth)
+		depth = NVME_URING_BATCH_DEPTH;
+	if (nvme_uring_queue_create(depth, &q))
+		return -1;
+
+	while (done < n) {
+		struct nvme_uring_completion comps[NVME_URING_BATCH_DEPTH];
+		int got, i;
+
+		while (queued < n) {
+			if (queue_one(q, ctx, queued)) {
+				if (errno == EAGAIN)
+					break;
+				ret = -1;
+				goto out;
+			}
+			queued++;
+		}
+		got = nvme_uring_submit(q);
+		if (got < 0) {
+			ret = -1;
+			goto out;
+		}
+		submitted += got;
+		got = nvme_uring_reap(q, comps,
+				      min(depth, NVME_URING_BATCH_DEPTH), 1);
+		if (got < 0) {
+			ret = -1;
+			goto out;
+		}
+		for (i = 0; i < got; i++) {
+			unsigned int idx = (uintptr_t)comps[i].userdata;
+
+			if (status)
+				status[idx] = comps[i].status;
+			if (comps[i].status)
+				nr_failed++;
+			else if (complete_one)
+				complete_one(ctx, idx, &comps[i]);
+			done++;
+		}
+	}
+
+	if (nr_failed) {
+		errno = EIO;
+		ret = -1;
+	}
+out:
+	/*
+	 * Commands already handed to the kernel keep DMA-writing into the
+	 * caller's buffers; drain them before the rings go away, as
+	 * nvme_fw_download_pipelined() does.
+	 */
+	while (done < submitted) {
+		struct nvme_uring_completion comps[NVME_URING_BATCH_DEPTH];
+		int got = nvme_uring_reap(q, comps,
+					  min(depth, NVME_URING_BATCH_DEPTH),
+					  1);
+		int i;
+
+		if (got <= 0)
+			break;
+		for (i = 0; i < got; i++) {
+			if (status)
+				status[(uintptr_t)comps[i].userdata] =
+					comps[i].status;
+			done++;
+		}
+	}
+	nvme_uring_queue_free(q);
+	return ret;
+}
+
+static int nvme_uring_queue_one_identify(nvme_uring_queue_t q, void *ctx,
+					 unsigned int idx)
+{
+	struct nvme_identify_args *args = ctx;
+
+	return nvme_uring_identify(q, &args[idx], (void *)(uintptr_t)idx);
+}
+
+static void nvme_uring_complete_one_identify(void *ctx, unsigned int idx,
+					     struct nvme_uring_completion *comp)
+{
+	struct nvme_identify_args *args = ctx;
+
+	if (args[idx].result)
+		*args[idx].result = comp->result;
+}
+
+static int nvme_uring_queue_one_get_log(nvme_uring_queue_t q, void *ctx,
+					unsigned int idx)
+{
+	struct nvme_get_log_args *args = ctx;
+
+	return nvme_uring_get_log(q, &args[idx], (void *)(uintptr_t)idx);
+}
+
+static void nvme_uring_complete_one_get_log(void *ctx, unsigned int idx,
+					    struct nvme_uring_completion *comp)
+{
+	struct nvme_get_log_args *args = ctx;
+
+	if (args[idx].result)
+		*args[idx].result = comp->result;
+}
+
+static int nvme_uring_queue_one_set_features(nvme_uring_queue_t q, void *ctx,
+					     unsigned int idx)
+{
+	struct nvme_set_features_args *args = ctx;
+
+	return nvme_uring_set_features(q, &args[idx], (void *)(uintptr_t)idx);
+}
+
+static void nvme_uring_complete_one_set_features(void *ctx, unsigned int idx,
+						 struct nvme_uring_completion *comp)
+{
+	struct nvme_set_features_args *args = ctx;
+
+	if (args[idx].result)
+		*args[idx].result = comp->result;
+}
+
+static int nvme_uring_queue_one_get_features(nvme_uring_queue_t q, void *ctx,
+					     unsigned int idx)
+{
+	struct nvme_get_features_args *args = ctx;
+
+	return nvme_uring_get_features(q, &args[idx], (void *)(uintptr_t)idx);
+}
+
+static void nvme_uring_complete_one_get_features(void *ctx, unsigned int idx,
+						 struct nvme_uring_completion *comp)
+{
+	struct nvme_get_features_args *args = ctx;
+
+	if (args[idx].result)
+		*args[idx].result = comp->result;
+}
+
+int nvme_identify_batch(struct nvme_identify_args *args, int *status,
+			unsigned int n)
+{
+	unsigned int i;
+	int nr_failed = 0, ret;
+
+	if (!args || !n) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = nvme_uring_run_batch(n, status, 0,
+				   nvme_uring_queue_one_identify,
+				   nvme_uring_complete_one_identify, args);
+	if (!ret || errno != ENOTSUP)
+		return ret;
+
+	/* no io_uring support; fall back to one blocking ioctl at a time */
+	for (i = 0; i < n; i++) {
+		ret = nvme_identify(&args[i]);
+		if (status)
+			status[i] = ret;
+		if (ret)
+			nr_failed++;
+	}
+	if (nr_failed) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+int nvme_get_log_batch(struct nvme_get_log_args *args, int *status,
+		       unsigned int n)
+{
+	return __nvme_get_log_batch(args, status, n, 0);
+}
+
+int nvme_set_features_batch(struct nvme_set_features_args *args, int *status,
+			    unsigned int n)
+{
+	unsigned int i;
+	int nr_failed = 0, ret;
+
+	if (!args || !n) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = nvme_uring_run_batch(n, status, 0,
+				   nvme_uring_queue_one_set_features,
+				   nvme_uring_complete_one_set_features, args);
+	if (!ret || errno != ENOTSUP)
+		return ret;
+
+	/* no io_uring support; fall back to one blocking ioctl at a time */
+	for (i = 0; i < n; i++) {
+		ret = nvme_set_features(&args[i]);
+		if (status)
+			status[i] = ret;
+		if (ret)
+			nr_failed++;
+	}
+	if (nr_failed) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+int nvme_get_features_batch(struct nvme_get_features_args *args, int *status,
+			    unsigned int n)
+{
+	unsigned int i;
+	int nr_failed = 0, ret;
+
+	if (!args || !n) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = nvme_uring_run_batch(n, status, 0,
+				   nvme_uring_queue_one_get_features,
+				   nvme_uring_complete_one_get_features, args);
+	if (!ret || errno != ENOTSUP)
+		return ret;
+
+	/* no io_uring support; fall back to one blocking ioctl at a time */
+	for (i = 0; i < n; i++) {
+		ret = nvme_get_features(&args[i]);
+		if (status)
+			status[i] = ret;
+		if (ret)
+			nr_failed++;
+	}
+	if (nr_failed) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
+
+#define NVME_URING_FW_DEPTH	8
+
+int nvme_fw_download_pipelined(int fd, __u32 size, __u32 xfer, __u32 offset,
+			       void *buf, unsigned int depth)
+{
+	struct nvme_fw_download_args args = {
+		.args_size = sizeof(args),
+		.fd = fd,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+		.result = NULL,
+	};
+	nvme_uring_queue_t q;
+	unsigned int inflight = 0;
+	__u32 next = 0;
+	int err = 0;
+
+	if (!buf || !xfer || (xfer & 0x3) || (offset & 0x3)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!size)
+		return 0;
+	if (!depth)
+		depth = NVME_URING_FW_DEPTH;
+
+	if (nvme_uring_queue_create(depth, &q)) {
+		if (errno != ENOTSUP)
+			return -1;
+		/* no io_uring support; fall back to the blocking sequence */
+		return nvme_fw_download_seq(fd, size, xfer, offset, buf);
+	}
+
+	/*
+	 * Offsets are independent for Firmware Image Download, so a window
+	 * of chunks can be in flight concurrently. On the first failure no
+	 * further chunks are queued, but everything already submitted is
+	 * drained before returning.
+	 */
+	while (inflight || (!err && next < size)) {
+		struct nvme_uring_completion comps[NVME_URING_BATCH_DEPTH];
+		int got, i;
+
+		while (!err && next < size && inflight < depth) {
+			args.offset = offset + next;
+			args.data = (char *)buf + next;
+			args.data_len = min(xfer, size - next);
+			if (nvme_uring_fw_download(q, &args, NULL)) {
+				if (errno == EAGAIN)
+					break;
+				err = -1;
+				continue;
+			}
+			next += args.data_len;
+			inflight++;
+		}
+		if (nvme_uring_submit(q) < 0) {
+			err = -1;
+			break;
+		}
+		got = nvme_uring_reap(q, comps,
+				      min(depth, NVME_URING_BATCH_DEPTH),
+				      inflight ? 1 : 0);
+		if (got < 0) {
+			err = -1;
+			break;
+		}
+		for (i = 0; i < got; i++) {
+			inflight--;
+			if (comps[i].status && !err) {
+				err = comps[i].status;
+				if (err < 0) {
+					errno = -err;
+					err = -1;
+				}
+			}
+		}
+	}
+
+	nvme_uring_queue_free(q);
+	return err;
+}
+
+/*
+ * Streaming zone enumeration: two report buffers, with the Report Zones
+ * command for the next batch kept in flight while the caller consumes
+ * the current one. Without io_uring support the iterator degrades to
+ * one blocking command per batch, still in constant memory.
+ */
+struct nvme_zone_iter {
+	int fd;
+	__u32 nsid;
+	__u16 zrasf;
+	__u64 next_slba;
+	__u64 zsze;
+	unsigned int batch;
+	__u32 buf_len;
+	struct nvme_zone_report *buf[2];
+	int cur;
+	nvme_uring_queue_t q;
+	bool inflight;
+	bool eof;
+};
+
+static void nvme_zone_iter_args(struct nvme_zone_iter *iter, int target,
+				struct nvme_zns_mgmt_recv_args *args)
+{
+	*args = (struct nvme_zns_mgmt_recv_args) {
+		.args_size = sizeof(*args),
+		.fd = iter->fd,
+		.nsid = iter->nsid,
+		.slba = iter->next_slba,
+		.zra = NVME_ZNS_ZRA_REPORT_ZONES,
+		.zrasf = iter->zrasf,
+		.zras_feat = true,
+		.data = iter->buf[target],
+		.data_len = iter->buf_len,
+		.timeout = NVME_DEFAULT_IOCTL_TIMEOUT,
+	};
+}
+
+static int nvme_zone_iter_prefetch(struct nvme_zone_iter *iter, int target)
+{
+	struct nvme_zns_mgmt_recv_args args;
+
+	nvme_zone_iter_args(iter, target, &args);
+	if (nvme_uring_zns_mgmt_recv(iter->q, &args, NULL))
+		return -1;
+	if (nvme_uring_submit(iter->q) < 0)
+		return -1;
+	iter->inflight = true;
+	return 0;
+}
+
+nvme_zone_iter_t nvme_zone_iter_open(int fd, __u32 nsid, __u64 slba,
+				     enum nvme_zns_report_options opts,
+				     unsigned int batch)
+{
+	_cleanup_free_ struct nvme_id_ns *id_ns = NULL;
+	_cleanup_free_ struct nvme_zns_id_ns *zns_id = NULL;
+	struct nvme_zone_iter *iter;
+	__u8 lbaf;
+
+	if (!batch) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	id_ns = __nvme_alloc(sizeof(*id_ns));
+	zns_id = __nvme_alloc(sizeof(*zns_id));
+	if (!id_ns || !zns_id) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* the zone size is needed to step the start LBA between batches */
+	if (nvme_identify_ns(fd, nsid, id_ns))
+		return NULL;
+	if (nvme_zns_identify_ns(fd, nsid, zns_id))
+		return NULL;
+	nvme_id_ns_flbas_to_lbaf_inuse(id_ns->flbas, &lbaf);
+
+	iter = calloc(1, sizeof(*iter));
+	if (!iter) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	iter->fd = fd;
+	iter->nsid = nsid;
+	iter->zrasf = (__u16)opts;
+	iter->next_slba = slba;
+	iter->batch = batch;
+	iter->zsze = le64_to_cpu(zns_id->lbafe[lbaf].zsze);
+	iter->buf_len = sizeof(struct nvme_zone_report) +
+		batch * sizeof(struct nvme_zns_desc);
+	iter->cur = 1;
+
+	if (!iter->zsze) {
+		free(iter);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	iter->buf[0] = __nvme_alloc(iter->buf_len);
+	iter->buf[1] = __nvme_alloc(iter->buf_len);
+	if (!iter->buf[0] || !iter->buf[1]) {
+		nvme_zone_iter_close(iter);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* double-buffering needs only one command in flight plus slack */
+	if (nvme_uring_queue_create(2, &iter->q)) {
+		if (errno != ENOTSUP) {
+			nvme_zone_iter_close(iter);
+			return NULL;
+		}
+		iter->q = NULL;
+	} else if (nvme_zone_iter_prefetch(iter, 0)) {
+		/* e.g. not a character device; use blocking commands */
+		nvme_uring_queue_free(iter->q);
+		iter->q = NULL;
+	}
+
+	return iter;
+}
+
+void nvme_zone_iter_close(nvme_zone_iter_t iter)
+{
+	if (!iter)
+		return;
+	if (iter->q && iter->inflight) {
+		struct nvme_uring_completion comp;
+
+		/* the pending command still targets one of our buffers */
+		nvme_uring_reap(iter->q, &comp, 1, 1);
+	}
+	nvme_uring_queue_free(iter->q);
+	free(iter->buf[0]);
+	free(iter->buf[1]);
+	free(iter);
+}
+
+int nvme_zone_iter_next(nvme_zone_iter_t iter, struct nvme_zns_desc **descs,
+			unsigned int *nr)
+{
+	struct nvme_zone_report *report;
+	int target, ret;
+	__u64 n;
+
+	if (!iter || !descs || !nr) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (iter->eof) {
+		*nr = 0;
+		return 0;
+	}
+
+	target = iter->cur ^ 1;
+	if (iter->q) {
+		struct nvme_uring_completion comp;
+
+		if (!iter->inflight && nvme_zone_iter_prefetch(iter, target))
+			return -1;
+		ret = nvme_uring_reap(iter->q, &comp, 1, 1);
+		iter->inflight = false;
+		if (ret < 0)
+			return -1;
+		if (comp.status) {
+			if (comp.status < 0) {
+				errno = -comp.status;
+				return -1;
+			}
+			return comp.status;
+		}
+	} else {
+		struct nvme_zns_mgmt_recv_args args;
+
+		nvme_zone_iter_args(iter, target, &args);
+		ret = nvme_zns_mgmt_recv(&args);
+		if (ret)
+			return ret;
+	}
+
+	report = iter->buf[target];
+	n = le64_to_cpu(report->nr_zones);
+	if (n > iter->batch)
+		n = iter->batch;
+	if (!n) {
+		iter->eof = true;
+		*nr = 0;
+		return 0;
+	}
+
+	iter->next_slba = le64_to_cpu(report->entries[n - 1].zslba) +
+		iter->zsze;
+	iter->cur = target;
+
+	if (n < iter->batch) {
+		/* a partial report means no zones remain past it */
+		iter->eof = true;
+	} else if (iter->q && nvme_zone_iter_prefetch(iter, target ^ 1)) {
+		/* keep going with blocking commands */
+		nvme_uring_queue_free(iter->q);
+		iter->q = NULL;
+	}
+
+	*descs = report->entries;
+	*nr = n;
+	return 1;
+}
+
+int __nvme_get_log_batch(struct nvme_get_log_args *args, int *status,
+			 unsigned int n, unsigned int depth)
+{
+	unsigned int i;
+	int nr_failed = 0, ret;
+
+	if (!args || !n) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = nvme_uring_run_batch(n, status, depth,
+				   nvme_uring_queue_one_get_log,
+				   nvme_uring_complete_one_get_log, args);
+	if (!ret || errno != ENOTSUP)
+		return ret;
+
+	/* no io_uring support; fall back to one blocking ioctl at a time */
+	for (i = 0; i < n; i++) {
+		ret = nvme_get_log(&args[i]);
+		if (status)
+			status[i] = ret;
+		if (ret)
+			nr_failed++;
+	}
+	if (nr_failed) {
+		errno = EIO;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * This file is part of libnvme.
+ * Copyright (c) 2024 Western Digital Corporation or its affiliates.
+ */
+
+#ifndef _LIBNVME_URING_H
+#define _LIBNVME_URING_H
+
+#include "ioctl.h"
+
+/**
+ * DOC: uring.h
+ *
+ * Asynchronous admin command interface built on io_uring passthrough.
+ *
+ * The blocking helpers in ioctl.h issue one ioctl() at a time, so
+ * sweeping many controllers serializes on per-command latency. This
+ * interface queues NVMe admin commands on an io_uring instance via
+ * NVME_URING_CMD_ADMIN, allowing a single thread to keep many commands
+ * in flight and reap completions as they arrive.
+ *
+ * Support depends on both the kernel (5.19 or later) and the
+ * controller's character device; when unavailable the calls fail with
+ * errno set to ENOTSUP.
+ */
+
+typedef struct nvme_uring_queue *nvme_uring_queue_t;
+
+/**
+ * struct nvme_uring_completion - Completed async admin command
+ * @userdata:	Cookie passed at submission time
+ * @result:	Command dword 0/1 result of the completed command
+ * @status:	NVMe status code, or negative errno
+ */
+struct nvme_uring_completion {
+	void *userdata;
+	__u64 result;
+	int status;
+};
+
+/**
+ * nvme_uring_queue_create() - Create an async admin command queue
+ * @depth:	Maximum number of commands kept in flight
+ * @queue:	Receives the created queue object
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_queue_create(unsigned int depth, nvme_uring_queue_t *queue);
+
+/**
+ * enum nvme_uring_queue_flags - Queue creation flags
+ * @NVME_URING_QUEUE_POLLED:	  Reap completions by actively polling the
+ *				  device instead of waiting for an interrupt
+ * @NVME_URING_QUEUE_HYBRID_POLL: Polled completions preceded by a short
+ *				  sleep, trading some latency for CPU time
+ */
+enum nvme_uring_queue_flags {
+	NVME_URING_QUEUE_POLLED		= 1 << 0,
+	NVME_URING_QUEUE_HYBRID_POLL	= 1 << 1,
+};
+
+/**
+ * nvme_uring_queue_create_flags() - Create an async admin command queue
+ * @depth:	Maximum number of commands kept in flight
+ * @flags:	Bitwise OR of &enum nvme_uring_queue_flags
+ * @queue:	Receives the created queue object
+ *
+ * Like nvme_uring_queue_create(), but lets the caller request polled
+ * completion modes. On a polled queue nvme_uring_reap() drives command
+ * completion from the calling thread rather than from an interrupt,
+ * which removes the interrupt and wakeup latency from the completion
+ * path at the cost of burning the polling thread's CPU. The character
+ * device must have been opened for polled I/O and the kernel must
+ * support polled passthrough commands; otherwise commands fail with
+ * EOPNOTSUPP at submission time.
+ *
+ * Return: 0 on success, -1 on failure with errno set. ENOTSUP indicates
+ * the kernel does not support the requested completion mode.
+ */
+int nvme_uring_queue_create_flags(unsigned int depth, unsigned int flags,
+				  nvme_uring_queue_t *queue);
+
+/**
+ * nvme_uring_queue_free() - Release an async admin command queue
+ * @queue:	Queue created by nvme_uring_queue_create()
+ *
+ * Any commands still in flight are abandoned.
+ */
+void nvme_uring_queue_free(nvme_uring_queue_t queue);
+
+/**
+ * nvme_uring_admin_passthru() - Queue an arbitrary admin command
+ * @queue:	Queue to submit on
+ * @fd:		File descriptor of an nvme character device
+ * @cmd:	Fully initialized passthrough command
+ * @userdata:	Cookie returned with the completion
+ *
+ * Queues @cmd without submitting it to the kernel; call
+ * nvme_uring_submit() to kick off all queued commands.
+ *
+ * Return: 0 on success, -1 on failure with errno set. EAGAIN indicates
+ * a full queue; reap completions and retry.
+ */
+int nvme_uring_admin_passthru(nvme_uring_queue_t queue, int fd,
+			      struct nvme_passthru_cmd64 *cmd,
+			      void *userdata);
+
+/**
+ * nvme_uring_identify() - Queue an Identify command
+ * @queue:	Queue to submit on
+ * @args:	&struct nvme_identify_args argument structure
+ * @userdata:	Cookie returned with the completion
+ *
+ * Async variant of nvme_identify(); @args->fd selects the target
+ * device and must be an nvme character device.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_identify(nvme_uring_queue_t queue,
+			struct nvme_identify_args *args, void *userdata);
+
+/**
+ * nvme_uring_get_log() - Queue a Get Log Page command
+ * @queue:	Queue to submit on
+ * @args:	&struct nvme_get_log_args argument structure
+ * @userdata:	Cookie returned with the completion
+ *
+ * Async variant of nvme_get_log(); @args->fd selects the target
+ * device and must be an nvme character device.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_get_log(nvme_uring_queue_t queue,
+		       struct nvme_get_log_args *args, void *userdata);
+
+/**
+ * nvme_uring_fw_download() - Queue a Firmware Image Download command
+ * @queue:	Queue to submit on
+ * @args:	&struct nvme_fw_download_args argument structure
+ * @userdata:	Cookie returned with the completion
+ *
+ * Async variant of nvme_fw_download(); @args->fd selects the target
+ * device and must be an nvme character device.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_fw_download(nvme_uring_queue_t queue,
+			   struct nvme_fw_download_args *args, void *userdata);
+
+/**
+ * nvme_uring_set_features() - Queue a Set Features command
+ * @queue:	Queue to submit on
+ * @args:	&struct nvme_set_features_args argument structure
+ * @userdata:	Cookie returned with the completion
+ *
+ * Async variant of nvme_set_features(); @args->fd selects the target
+ * device and must be an nvme character device.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_set_features(nvme_uring_queue_t queue,
+			    struct nvme_set_features_args *args,
+			    void *userdata);
+
+/**
+ * nvme_uring_get_features() - Queue a Get Features command
+ * @queue:	Queue to submit on
+ * @args:	&struct nvme_get_features_args argument structure
+ * @userdata:	Cookie returned with the completion
+ *
+ * Async variant of nvme_get_features(); @args->fd selects the target
+ * device and must be an nvme character device.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_get_features(nvme_uring_queue_t queue,
+			    struct nvme_get_features_args *args,
+			    void *userdata);
+
+/**
+ * nvme_uring_zns_mgmt_recv() - Queue a Zone Management Receive command
+ * @queue:	Queue to submit on
+ * @args:	&struct nvme_zns_mgmt_recv_args argument structure
+ * @userdata:	Cookie returned with the completion
+ *
+ * Async variant of nvme_zns_mgmt_recv(); @args->fd selects the target
+ * device and must be an nvme character device. Unlike the other helpers
+ * this queues an I/O command set command, via NVME_URING_CMD_IO.
+ *
+ * Return: 0 on success, -1 on failure with errno set.
+ */
+int nvme_uring_zns_mgmt_recv(nvme_uring_queue_t queue,
+			     struct nvme_zns_mgmt_recv_args *args,
+			     void *userdata);
+
+/**
+ * nvme_uring_submit() - Submit all queued commands to the kernel
+ * @queue:	Queue with pending commands
+ *
+ * Return: Number of commands submitted on success, -1 on failure with
+ * errno set.
+ */
+int nvme_uring_submit(nvme_uring_queue_t queue);
+
+/**
+ * nvme_uring_reap() - Collect completed commands
+ * @queue:	Queue to reap from
+ * @comps:	Array receiving up to @max completions
+ * @max:	Capacity of @comps
+ * @min:	Minimum number of completions to wait for
+ *
+ * Fills @comps with available completions, blocking until at least
+ * @min commands have completed. Pass @min = 0 to poll.
+ *
+ * Return: Number of completions reaped on success, -1 on failure with
+ * errno set.
+ */
+int nvme_uring_reap(nvme_uring_queue_t queue,
+		    struct nvme_uring_completion *comps,
+		    unsigned int max, unsigned int min);
+
+/**
+ * nvme_identify_batch() - Drive a batch of Identify commands
+ * @args:	Array of @n initialized &struct nvme_identify_args; the
+ *		fd member of each entry selects its target device
+ * @status:	Optional array of @n per-command completion codes
+ * @n:		Number of commands in the batch
+ *
+ * Drives all @n commands concurrently over an internal io_uring queue
+ * and returns once every command has completed. Falls back to
+ * sequential blocking submission when io_uring passthrough is not
+ * available.
+ *
+ * Return: 0 when all commands succeed, -1 with errno set otherwise;
+ * per-command results are reported through @status.
+ */
+int nvme_identify_batch(struct nvme_identify_args *args, int *status,
+			unsigned int n);
+
+/**
+ * nvme_get_log_batch() - Drive a batch of Get Log Page commands
+ * @args:	Array of @n initialized &struct nvme_get_log_args; the
+ *		fd member of each entry selects its target device
+ * @status:	Optional array of @n per-command completion codes
+ * @n:		Number of commands in the batch
+ *
+ * Drives all @n commands concurrently over an internal io_uring queue
+ * and returns once every command has completed. Falls back to
+ * sequential blocking submission when io_uring passthrough is not
+ * available.
+ *
+ * Return: 0 when all commands succeed, -1 with errno set otherwise;
+ * per-command results are reported through @status.
+ */
+int nvme_get_log_batch(struct nvme_get_log_args *args, int *status,
+		       unsigned int n);
+
+/**
+ * nvme_set_features_batch() - Drive a batch of Set Features commands
+ * @args:	Array of @n initialized &struct nvme_set_features_args; the
+ *		fd member of each entry selects its target device
+ * @status:	Optional array of @n per-command completion codes
+ * @n:		Number of commands in the batch
+ *
+ * Drives all @n commands concurrently over an internal io_uring queue
+ * and returns once every command has completed, turning e.g. a dozen
+ * serialized per-feature round trips during namespace provisioning into
+ * one overlapped burst. Falls back to sequential blocking submission
+ * when io_uring passthrough is not available.
+ *
+ * Return: 0 when all commands succeed, -1 with errno set otherwise;
+ * per-command results are reported through @status.
+ */
+int nvme_set_features_batch(struct nvme_set_features_args *args, int *status,
+			    unsigned int n);
+
+/**
+ * nvme_get_features_batch() - Drive a batch of Get Features commands
+ * @args:	Array of @n initialized &struct nvme_get_features_args; the
+ *		fd member of each entry selects its target device
+ * @status:	Optional array of @n per-command completion codes
+ * @n:		Number of commands in the batch
+ *
+ * Drives all @n commands concurrently over an internal io_uring queue
+ * and returns once every command has completed. Falls back to
+ * sequential blocking submission when io_uring passthrough is not
+ * available.
+ *
+ * Return: 0 when all commands succeed, -1 with errno set otherwise;
+ * per-command results are reported through @status.
+ */
+int nvme_get_features_batch(struct nvme_get_features_args *args, int *status,
+			    unsigned int n);
+
+/**
+ * nvme_fw_download_pipelined() - Firmware download with pipelined chunks
+ * @fd:		File descriptor of nvme device
+ * @size:	Total size of the firmware image to transfer
+ * @xfer:	Maximum size per chunk
+ * @offset:	Starting offset to send the image
+ * @buf:	Firmware image payload to send
+ * @depth:	Number of chunks kept in flight, or 0 for the default
+ *
+ * Pipelined variant of nvme_fw_download_seq(): chunk offsets are
+ * independent for Firmware Image Download, so up to @depth transfers are
+ * kept outstanding instead of waiting out a round trip per chunk, which
+ * dominates transfer time on fabrics. On the first failed chunk no
+ * further chunks are issued, in-flight transfers are drained, and the
+ * failure is returned. Falls back to the blocking sequence when io_uring
+ * passthrough is not available; @fd must then still name the device, but
+ * need not be a character device.
+ *
+ * Return: 0 on success, the nvme command status of the first failed
+ * chunk if a response was received (see &enum nvme_status_field) or -1
+ * with errno set otherwise.
+ */
+int nvme_fw_download_pipelined(int fd, __u32 size, __u32 xfer, __u32 offset,
+			       void *buf, unsigned int depth);
+
+typedef struct nvme_zone_iter *nvme_zone_iter_t;
+
+/**
+ * nvme_zone_iter_open() - Start a streaming zone report
+ * @fd:		File descriptor of nvme device
+ * @nsid:	Namespace identifier of the zoned namespace
+ * @slba:	Starting LBA of the first zone to report
+ * @opts:	Reporting option filter, see &enum nvme_zns_report_options
+ * @batch:	Number of zone descriptors fetched per Report Zones command
+ *
+ * Enumerates the zones of a namespace in batches of @batch descriptors
+ * using partial reports, so memory use stays constant regardless of
+ * zone count. When io_uring passthrough is available the Report Zones
+ * command for the next batch is kept in flight while the caller works
+ * on the current one; otherwise each batch is fetched with a blocking
+ * command. Extended zone reports are not supported as their descriptor
+ * stride is namespace specific.
+ *
+ * Return: An iterator to pass to nvme_zone_iter_next(), or NULL on
+ * failure with errno set.
+ */
+nvme_zone_iter_t nvme_zone_iter_open(int fd, __u32 nsid, __u64 slba,
+				     enum nvme_zns_report_options opts,
+				     unsigned int batch);
+
+/**
+ * nvme_zone_iter_next() - Fetch the next batch of zone descriptors
+ * @iter:	Iterator returned by nvme_zone_iter_open()
+ * @descs:	Receives a pointer to the batch of zone descriptors
+ * @nr:		Receives the number of descriptors in the batch
+ *
+ * The returned descriptors live in an internal buffer that stays valid
+ * until the next call on @iter; they are not byte-swapped.
+ *
+ * Return: 1 when a batch is available, 0 at the end of the namespace,
+ * the nvme command status if a response was received (see &enum
+ * nvme_status_field) or -1 with errno set otherwise.
+ */
+int nvme_zone_iter_next(nvme_zone_iter_t iter, struct nvme_zns_desc **descs,
+			unsigned int *nr);
+
+/**
+ * nvme_zone_iter_close() - Release a zone report iterator
+ * @iter:	Iterator returned by nvme_zone_iter_open()
+ *
+ * Waits out any in-flight Report Zones command, then frees all
+ * resources held by @iter.
+ */
+void nvme_zone_iter_close(nvme_zone_iter_t iter);
+
+#endif /* _LIBNVME_URING_H */
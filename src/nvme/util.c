@@ -14,8 +14,13 @@
 #include <errno.h>
 #include <malloc.h>
 
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
+
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/param.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
@@ -480,6 +485,51 @@ void nvme_init_dsm_range(struct nvme_dsm_range *dsm, __u32 *ctx_attrs,
 	}
 }
 
+/*
+ * Bulk converters for callers that already assemble whole descriptors:
+ * the input uses the wire layout with CPU-endian values, so on
+ * little-endian targets the conversion degenerates into one flat copy
+ * (or nothing at all in place) instead of a transpose with per-field
+ * stores, and the compiler is free to vectorize it. Only big-endian
+ * targets pay for the swaps.
+ */
+void nvme_init_dsm_range_buf(struct nvme_dsm_range *dsm,
+			     const struct nvme_dsm_range *ranges,
+			     __u16 nr_ranges)
+{
+#if HAVE_LITTLE_ENDIAN
+	if (dsm != ranges)
+		memcpy(dsm, ranges, (size_t)nr_ranges * sizeof(*dsm));
+#else
+	int i;
+
+	for (i = 0; i < nr_ranges; i++) {
+		dsm[i].cattr = cpu_to_le32(ranges[i].cattr);
+		dsm[i].nlb = cpu_to_le32(ranges[i].nlb);
+		dsm[i].slba = cpu_to_le64(ranges[i].slba);
+	}
+#endif
+}
+
+void nvme_init_copy_range_buf(struct nvme_copy_range *copy,
+			      const struct nvme_copy_range *ranges, __u16 nr)
+{
+#if HAVE_LITTLE_ENDIAN
+	if (copy != ranges)
+		memcpy(copy, ranges, (size_t)nr * sizeof(*copy));
+#else
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		copy[i].nlb = cpu_to_le16(ranges[i].nlb);
+		copy[i].slba = cpu_to_le64(ranges[i].slba);
+		copy[i].eilbrt = cpu_to_le32(ranges[i].eilbrt);
+		copy[i].elbatm = cpu_to_le16(ranges[i].elbatm);
+		copy[i].elbat = cpu_to_le16(ranges[i].elbat);
+	}
+#endif
+}
+
 void nvme_init_ctrl_list(struct nvme_ctrl_list *cntlist, __u16 num_ctrls,
 			  __u16 *ctrlist)
 {
@@ -630,7 +680,162 @@ const char *nvme_errno_to_string(int status)
 	return s;
 }
 
+/*
+ * TTL-based hostname resolution cache. getaddrinfo() can stall for
+ * seconds when DNS is slow, and reconnect loops resolve the same
+ * hostnames over and over; resolved addresses are therefore kept on
+ * the root for a configurable time. A single mutex covers the caches
+ * of all roots so nvme_root_resolve_hostnames() can fill the cache
+ * from worker threads.
+ */
+static pthread_mutex_t nvme_resolv_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void nvme_resolv_entry_free(struct nvme_resolv_cache_entry *e)
+{
+	list_del(&e->entry);
+	free(e->hostname);
+	free(e->traddr);
+	free(e);
+}
+
+static char *nvme_resolv_cache_lookup(struct nvme_root *r, const char *hostname)
+{
+	struct nvme_resolv_cache_entry *e, *_e;
+	char *traddr = NULL;
+	time_t now = time(NULL);
+
+	if (!r || !r->resolv_cache.ttl)
+		return NULL;
+
+	pthread_mutex_lock(&nvme_resolv_mutex);
+	list_for_each_safe(&r->resolv_cache.entries, e, _e, entry) {
+		if (e->expires <= now) {
+			nvme_resolv_entry_free(e);
+			continue;
+		}
+		if (!strcasecmp(e->hostname, hostname)) {
+			traddr = strdup(e->traddr);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&nvme_resolv_mutex);
+	return traddr;
+}
+
+static void nvme_resolv_cache_store(struct nvme_root *r, const char *hostname,
+				    const char *traddr)
+{
+	struct nvme_resolv_cache_entry *e;
+
+	if (!r || !r->resolv_cache.ttl)
+		return;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return;
+	e->hostname = strdup(hostname);
+	e->traddr = strdup(traddr);
+	if (!e->hostname || !e->traddr) {
+		free(e->hostname);
+		free(e->traddr);
+		free(e);
+		return;
+	}
+	e->expires = time(NULL) + r->resolv_cache.ttl;
+	pthread_mutex_lock(&nvme_resolv_mutex);
+	list_add(&r->resolv_cache.entries, &e->entry);
+	pthread_mutex_unlock(&nvme_resolv_mutex);
+}
+
+void nvme_root_set_resolv_ttl(nvme_root_t r, unsigned int seconds)
+{
+	r->resolv_cache.ttl = seconds;
+	if (!seconds)
+		nvme_root_resolv_cache_clear(r);
+}
+
+void nvme_root_resolv_cache_clear(nvme_root_t r)
+{
+	struct nvme_resolv_cache_entry *e, *_e;
+
+	pthread_mutex_lock(&nvme_resolv_mutex);
+	list_for_each_safe(&r->resolv_cache.entries, e, _e, entry)
+		nvme_resolv_entry_free(e);
+	pthread_mutex_unlock(&nvme_resolv_mutex);
+}
+
 #ifdef HAVE_NETDB
+struct nvme_resolv_queue {
+	nvme_root_t r;
+	const char *const *hostnames;
+	unsigned int n;
+	unsigned int next;
+	unsigned int resolved;
+	pthread_mutex_t lock;
+};
+
+static void *nvme_resolv_worker(void *arg)
+{
+	struct nvme_resolv_queue *queue = arg;
+
+	for (;;) {
+		unsigned int i;
+		char *traddr;
+
+		pthread_mutex_lock(&queue->lock);
+		i = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+		if (i >= queue->n)
+			break;
+		traddr = hostname2traddr(queue->r, queue->hostnames[i]);
+		if (!traddr)
+			continue;
+		free(traddr);
+		pthread_mutex_lock(&queue->lock);
+		queue->resolved++;
+		pthread_mutex_unlock(&queue->lock);
+	}
+	return NULL;
+}
+
+#define NVME_RESOLV_PREFETCH_THREADS	8
+
+int nvme_root_resolve_hostnames(nvme_root_t r, const char *const *hostnames,
+				unsigned int n)
+{
+	struct nvme_resolv_queue queue = {
+		.r = r,
+		.hostnames = hostnames,
+		.n = n,
+	};
+	pthread_t workers[NVME_RESOLV_PREFETCH_THREADS];
+	unsigned int i, nr_workers, started = 0;
+
+	if (!hostnames && n) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!n)
+		return 0;
+
+	pthread_mutex_init(&queue.lock, NULL);
+	nr_workers = n < NVME_RESOLV_PREFETCH_THREADS ?
+		n : NVME_RESOLV_PREFETCH_THREADS;
+	for (i = 0; i < nr_workers; i++) {
+		if (pthread_create(&workers[i], NULL,
+				   nvme_resolv_worker, &queue))
+			break;
+		started++;
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	if (!started)
+		nvme_resolv_worker(&queue);
+	pthread_mutex_destroy(&queue.lock);
+
+	return queue.resolved;
+}
+
 char *hostname2traddr(struct nvme_root *r, const char *traddr)
 {
 	struct addrinfo *host_info, hints = {.ai_family = AF_UNSPEC};
@@ -639,6 +844,10 @@ char *hostname2traddr(struct nvme_root *r, const char *traddr)
 	char *ret_traddr = NULL;
 	int ret;
 
+	ret_traddr = nvme_resolv_cache_lookup(r, traddr);
+	if (ret_traddr)
+		return ret_traddr;
+
 	ret = getaddrinfo(traddr, NULL, &hints, &host_info);
 	if (ret) {
 		nvme_msg(r, LOG_ERR, "failed to resolve host %s info\n",
@@ -669,12 +878,24 @@ char *hostname2traddr(struct nvme_root *r, const char *traddr)
 		goto free_addrinfo;
 	}
 	ret_traddr = strdup(addrstr);
+	if (ret_traddr)
+		nvme_resolv_cache_store(r, traddr, ret_traddr);
 
 free_addrinfo:
 	freeaddrinfo(host_info);
 	return ret_traddr;
 }
 #else /* HAVE_NETDB */
+int nvme_root_resolve_hostnames(nvme_root_t r, const char *const *hostnames,
+				unsigned int n)
+{
+	nvme_msg(NULL, LOG_ERR, "No support for hostname IP address resolution; " \
+		"recompile with libnss support.\n");
+
+	errno = -ENOTSUP;
+	return -1;
+}
+
 char *hostname2traddr(struct nvme_root *r, const char *traddr)
 {
 	nvme_msg(NULL, LOG_ERR, "No support for hostname IP address resolution; " \
@@ -1151,3 +1372,454 @@ void *__nvme_realloc(void *p, size_t len)
 
 	return result;
 }
+
+#define NVME_BUF_POOL_HUGE_MIN	(2 * 1024 * 1024)
+
+/*
+ * Pool buffers carry their bookkeeping in a header page in front of
+ * the payload, so the payload itself stays page-aligned and releasing
+ * a buffer is O(1).
+ */
+struct nvme_pool_buf {
+	struct list_node entry;
+	size_t len;
+	size_t map_len;
+	bool huge;
+};
+
+struct nvme_buf_pool {
+	struct list_head free_bufs;
+	struct list_head busy_bufs;
+	pthread_mutex_t lock;
+	unsigned long flags;
+};
+
+static void *nvme_pool_buf_to_ptr(struct nvme_pool_buf *buf)
+{
+	return (char *)buf + getpagesize();
+}
+
+static struct nvme_pool_buf *nvme_ptr_to_pool_buf(void *p)
+{
+	return (struct nvme_pool_buf *)((char *)p - getpagesize());
+}
+
+nvme_buf_pool_t nvme_buf_pool_create(unsigned long flags)
+{
+	struct nvme_buf_pool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	list_head_init(&pool->free_bufs);
+	list_head_init(&pool->busy_bufs);
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->flags = flags;
+	return pool;
+}
+
+static void nvme_pool_buf_destroy(struct nvme_pool_buf *buf)
+{
+	if (buf->huge)
+		munmap(buf, buf->map_len);
+	else
+		free(buf);
+}
+
+static struct nvme_pool_buf *nvme_pool_buf_new(struct nvme_buf_pool *pool,
+					       size_t len)
+{
+	size_t page = getpagesize();
+	size_t map_len = round_up(len, page) + page;
+	struct nvme_pool_buf *buf = NULL;
+
+#ifdef MAP_HUGETLB
+	if ((pool->flags & NVME_BUF_POOL_HUGETLB) &&
+	    map_len >= NVME_BUF_POOL_HUGE_MIN) {
+		size_t huge_len = round_up(map_len, NVME_BUF_POOL_HUGE_MIN);
+
+		buf = mmap(NULL, huge_len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (buf == MAP_FAILED) {
+			buf = NULL;
+		} else {
+			buf->huge = true;
+			buf->map_len = huge_len;
+			buf->len = huge_len - page;
+		}
+	}
+#endif
+	if (!buf) {
+		if (posix_memalign((void *)&buf, page, map_len))
+			return NULL;
+		memset(buf, 0, sizeof(*buf));
+		buf->huge = false;
+		buf->map_len = map_len;
+		buf->len = map_len - page;
+	}
+	return buf;
+}
+
+void *nvme_buf_pool_alloc(nvme_buf_pool_t pool, size_t len)
+{
+	struct nvme_pool_buf *buf, *best = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	list_for_each(&pool->free_bufs, buf, entry) {
+		if (buf->len < len)
+			continue;
+		if (!best || buf->len < best->len)
+			best = buf;
+	}
+	if (best)
+		list_del(&best->entry);
+	pthread_mutex_unlock(&pool->lock);
+
+	if (!best) {
+		best = nvme_pool_buf_new(pool, len);
+		if (!best) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	list_add(&pool->busy_bufs, &best->entry);
+	pthread_mutex_unlock(&pool->lock);
+
+	memset(nvme_pool_buf_to_ptr(best), 0, best->len);
+	return nvme_pool_buf_to_ptr(best);
+}
+
+void nvme_buf_pool_release(nvme_buf_pool_t pool, void *p)
+{
+	struct nvme_pool_buf *buf;
+
+	if (!p)
+		return;
+
+	buf = nvme_ptr_to_pool_buf(p);
+	pthread_mutex_lock(&pool->lock);
+	list_del(&buf->entry);
+	list_add(&pool->free_bufs, &buf->entry);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void nvme_buf_pool_free(nvme_buf_pool_t pool)
+{
+	struct nvme_pool_buf *buf, *_buf;
+
+	if (!pool)
+		return;
+
+	list_for_each_safe(&pool->free_bufs, buf, _buf, entry)
+		nvme_pool_buf_destroy(buf);
+	list_for_each_safe(&pool->busy_bufs, buf, _buf, entry)
+		nvme_pool_buf_destroy(buf);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+/*
+ * NSID-indexed view of an ANA log. Entries live in an open-addressed
+ * hash table with linear probing; NSID 0 is invalid per spec and marks
+ * empty slots, so no separate occupancy flag is needed.
+ */
+struct nvme_ana_index_entry {
+	__u32 nsid;
+	__u32 grpid;
+	__u8 state;
+};
+
+struct nvme_ana_index {
+	struct nvme_ana_index_entry *slots;
+	size_t nr_slots;
+	size_t nr_nsids;
+	__u64 chgcnt;
+};
+
+#define NVME_ANA_INDEX_MIN_SLOTS	16
+
+nvme_ana_index_t nvme_ana_index_create(void)
+{
+	struct nvme_ana_index *index;
+
+	index = calloc(1, sizeof(*index));
+	if (!index)
+		errno = ENOMEM;
+	return index;
+}
+
+void nvme_ana_index_free(nvme_ana_index_t index)
+{
+	if (!index)
+		return;
+	free(index->slots);
+	free(index);
+}
+
+static size_t nvme_ana_index_slot(const struct nvme_ana_index *index,
+				  __u32 nsid)
+{
+	/* Fibonacci hashing; NSIDs are typically small and sequential */
+	return (nsid * 2654435761u) & (index->nr_slots - 1);
+}
+
+static void nvme_ana_index_insert(struct nvme_ana_index *index, __u32 nsid,
+				  __u32 grpid, __u8 state)
+{
+	size_t slot = nvme_ana_index_slot(index, nsid);
+
+	while (index->slots[slot].nsid &&
+	       index->slots[slot].nsid != nsid)
+		slot = (slot + 1) & (index->nr_slots - 1);
+
+	if (!index->slots[slot].nsid)
+		index->nr_nsids++;
+	index->slots[slot].nsid = nsid;
+	index->slots[slot].grpid = grpid;
+	index->slots[slot].state = state;
+}
+
+int nvme_ana_index_update(nvme_ana_index_t index,
+			  const struct nvme_ana_log *log, size_t len)
+{
+	size_t offset = sizeof(*log), nr = 0, want;
+	__u16 ngrps;
+	__u16 grp;
+
+	if (!index || !log || len < sizeof(*log)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* first pass: validate the descriptor chain and count namespaces */
+	ngrps = le16_to_cpu(log->ngrps);
+	for (grp = 0; grp < ngrps; grp++) {
+		const struct nvme_ana_group_desc *desc;
+		__u32 nnsids;
+
+		if (len - offset < sizeof(*desc)) {
+			errno = EPROTO;
+			return -1;
+		}
+		desc = (const void *)((const char *)log + offset);
+		nnsids = le32_to_cpu(desc->nnsids);
+		if ((len - offset - sizeof(*desc)) / sizeof(__le32) < nnsids) {
+			errno = EPROTO;
+			return -1;
+		}
+		nr += nnsids;
+		offset += sizeof(*desc) + nnsids * sizeof(__le32);
+	}
+
+	/* grow to keep the table at most half full; never shrink, so
+	 * steady-state refreshes on ANA-change events do not allocate */
+	want = NVME_ANA_INDEX_MIN_SLOTS;
+	while (want < nr * 2)
+		want <<= 1;
+	if (want > index->nr_slots) {
+		struct nvme_ana_index_entry *slots;
+
+		slots = calloc(want, sizeof(*slots));
+		if (!slots) {
+			errno = ENOMEM;
+			return -1;
+		}
+		free(index->slots);
+		index->slots = slots;
+		index->nr_slots = want;
+	} else {
+		memset(index->slots, 0,
+		       index->nr_slots * sizeof(*index->slots));
+	}
+	index->nr_nsids = 0;
+
+	/* second pass: populate */
+	offset = sizeof(*log);
+	for (grp = 0; grp < ngrps; grp++) {
+		const struct nvme_ana_group_desc *desc =
+			(const void *)((const char *)log + offset);
+		__u32 nnsids = le32_to_cpu(desc->nnsids);
+		__u32 grpid = le32_to_cpu(desc->grpid);
+		__u32 i;
+
+		for (i = 0; i < nnsids; i++) {
+			__u32 nsid = le32_to_cpu(desc->nsids[i]);
+
+			if (nsid)
+				nvme_ana_index_insert(index, nsid, grpid,
+						      desc->state);
+		}
+		offset += sizeof(*desc) + nnsids * sizeof(__le32);
+	}
+
+	index->chgcnt = le64_to_cpu(log->chgcnt);
+	return 0;
+}
+
+int nvme_ana_index_lookup(nvme_ana_index_t index, __u32 nsid,
+			  enum nvme_ana_state *state, __u32 *grpid)
+{
+	size_t slot;
+
+	if (!index || !nsid) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!index->nr_slots) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	slot = nvme_ana_index_slot(index, nsid);
+	while (index->slots[slot].nsid) {
+		if (index->slots[slot].nsid == nsid) {
+			if (state)
+				*state = index->slots[slot].state;
+			if (grpid)
+				*grpid = index->slots[slot].grpid;
+			return 0;
+		}
+		slot = (slot + 1) & (index->nr_slots - 1);
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+__u64 nvme_ana_index_chgcnt(nvme_ana_index_t index)
+{
+	return index->chgcnt;
+}
+
+/*
+ * Table-driven log page decoders
+ *
+ * Each table lists the little-endian fields of a log page (offset,
+ * width, consecutive count). The decoder copies the raw page once and
+ * swaps every listed field in one linear pass, so downstream field
+ * access is plain native-endian loads instead of a le*_to_cpu per
+ * access. On little-endian hosts the wire format is the native format
+ * and decoding degenerates to the copy (or to nothing in place).
+ */
+struct nvme_le_field {
+	__u16 off;
+	__u8 width;
+	__u8 count;
+};
+
+static void nvme_decode_le_fields(void *out, const void *in, size_t len,
+				  const struct nvme_le_field *fields,
+				  unsigned int nr)
+{
+	if (out != in)
+		memcpy(out, in, len);
+
+#if HAVE_BIG_ENDIAN
+	for (unsigned int i = 0; i < nr; i++) {
+		__u8 *p = (__u8 *)out + fields[i].off;
+		unsigned int j;
+
+		for (j = 0; j < fields[i].count; j++, p += fields[i].width) {
+			switch (fields[i].width) {
+			case 2: {
+				__u16 v;
+
+				memcpy(&v, p, sizeof(v));
+				v = le16_to_cpu(v);
+				memcpy(p, &v, sizeof(v));
+				break;
+			}
+			case 4: {
+				__u32 v;
+
+				memcpy(&v, p, sizeof(v));
+				v = le32_to_cpu(v);
+				memcpy(p, &v, sizeof(v));
+				break;
+			}
+			case 8: {
+				__u64 v;
+
+				memcpy(&v, p, sizeof(v));
+				v = le64_to_cpu(v);
+				memcpy(p, &v, sizeof(v));
+				break;
+			}
+			}
+		}
+	}
+#endif
+}
+
+#define NVME_LE_FIELD(type, member, w, n) \
+	{ offsetof(type, member), (w), (n) }
+
+static const struct nvme_le_field nvme_smart_log_fields[] = {
+	NVME_LE_FIELD(struct nvme_smart_log, warning_temp_time, 4, 2),
+	NVME_LE_FIELD(struct nvme_smart_log, temp_sensor, 2, 8),
+	NVME_LE_FIELD(struct nvme_smart_log, thm_temp1_trans_count, 4, 4),
+};
+
+void nvme_smart_log_decode(const struct nvme_smart_log *raw,
+			   struct nvme_smart_log *log)
+{
+	nvme_decode_le_fields(log, raw, sizeof(*log), nvme_smart_log_fields,
+			      ARRAY_SIZE(nvme_smart_log_fields));
+}
+
+static const struct nvme_le_field nvme_error_log_fields[] = {
+	NVME_LE_FIELD(struct nvme_error_log_page, error_count, 8, 1),
+	NVME_LE_FIELD(struct nvme_error_log_page, sqid, 2, 4),
+	NVME_LE_FIELD(struct nvme_error_log_page, lba, 8, 1),
+	NVME_LE_FIELD(struct nvme_error_log_page, nsid, 4, 1),
+	NVME_LE_FIELD(struct nvme_error_log_page, cs, 8, 1),
+	NVME_LE_FIELD(struct nvme_error_log_page, trtype_spec_info, 2, 1),
+};
+
+void nvme_error_log_decode(const struct nvme_error_log_page *raw,
+			   struct nvme_error_log_page *log,
+			   unsigned int entries)
+{
+	unsigned int i;
+
+	for (i = 0; i < entries; i++)
+		nvme_decode_le_fields(log + i, raw + i, sizeof(*log),
+				      nvme_error_log_fields,
+				      ARRAY_SIZE(nvme_error_log_fields));
+}
+
+static const struct nvme_le_field nvme_pel_hdr_fields[] = {
+	NVME_LE_FIELD(struct nvme_persistent_event_log, tnev, 4, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, tll, 8, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, lhl, 2, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, ts, 8, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, pcc, 8, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, vid, 2, 2),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, gen_number, 2, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_log, rci, 4, 1),
+};
+
+void nvme_pel_header_decode(const struct nvme_persistent_event_log *raw,
+			    struct nvme_persistent_event_log *log)
+{
+	nvme_decode_le_fields(log, raw, sizeof(*log), nvme_pel_hdr_fields,
+			      ARRAY_SIZE(nvme_pel_hdr_fields));
+}
+
+static const struct nvme_le_field nvme_pel_entry_fields[] = {
+	NVME_LE_FIELD(struct nvme_persistent_event_entry, cntlid, 2, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_entry, ets, 8, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_entry, pelpid, 2, 1),
+	NVME_LE_FIELD(struct nvme_persistent_event_entry, vsil, 2, 2),
+};
+
+void nvme_pel_entry_decode(const struct nvme_persistent_event_entry *raw,
+			   struct nvme_persistent_event_entry *entry)
+{
+	nvme_decode_le_fields(entry, raw, sizeof(*entry),
+			      nvme_pel_entry_fields,
+			      ARRAY_SIZE(nvme_pel_entry_fields));
+}
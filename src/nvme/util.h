@@ -10,6 +10,8 @@
 #define _LIBNVME_UTIL_H
 
 #include <ifaddrs.h>
+#include <limits.h>
+#include <time.h>
 
 #include "types.h"
 
@@ -122,6 +124,22 @@ void nvme_init_ctrl_list(struct nvme_ctrl_list *cntlist, __u16 num_ctrls,
 void nvme_init_dsm_range(struct nvme_dsm_range *dsm, __u32 *ctx_attrs,
 			  __u32 *llbas, __u64 *slbas, __u16 nr_ranges);
 
+/**
+ * nvme_init_dsm_range_buf() - Converts an array of data set ranges in place
+ * @dsm:	DSM range array in the command payload
+ * @ranges:	Source descriptors in wire layout with CPU native endian values
+ * @nr_ranges:	Number of descriptors to convert
+ *
+ * Bulk alternative to nvme_init_dsm_range() for callers that assemble whole
+ * descriptors rather than parallel field arrays. @dsm may be equal to @ranges,
+ * in which case the conversion happens in place directly inside the command
+ * payload. On little endian targets the conversion is a plain copy (or a
+ * no-op in place).
+ */
+void nvme_init_dsm_range_buf(struct nvme_dsm_range *dsm,
+			     const struct nvme_dsm_range *ranges,
+			     __u16 nr_ranges);
+
 /**
  * nvme_init_copy_range() - Constructs a copy range structure
  * @copy:	Copy range array
@@ -136,6 +154,22 @@ void nvme_init_copy_range(struct nvme_copy_range *copy, __u16 *nlbs,
 			  __u64 *slbas, __u32 *eilbrts, __u32 *elbatms,
 			  __u32 *elbats, __u16 nr);
 
+/**
+ * nvme_init_copy_range_buf() - Converts an array of copy ranges in place
+ * @copy:	Copy range array in the command payload
+ * @ranges:	Source descriptors in wire layout with CPU native endian values
+ * @nr:		Number of descriptors to convert
+ *
+ * Bulk alternative to nvme_init_copy_range() for descriptor format 0h. @copy
+ * may be equal to @ranges for an in-place conversion inside the command
+ * payload. On little endian targets the conversion is a plain copy (or a
+ * no-op in place). The extended formats keep their per-field initializers
+ * because the 16 byte reference tag is not representable in the wire layout
+ * input.
+ */
+void nvme_init_copy_range_buf(struct nvme_copy_range *copy,
+			      const struct nvme_copy_range *ranges, __u16 nr);
+
 /**
  * nvme_init_copy_range_f1() - Constructs a copy range f1 structure
  * @copy:	Copy range array
@@ -713,4 +747,214 @@ const char *nvme_iface_matching_addr(const struct ifaddrs *iface_list, const cha
  */
 bool nvme_iface_primary_addr_matches(const struct ifaddrs *iface_list, const char *iface, const char *addr);
 
+typedef struct nvme_buf_pool *nvme_buf_pool_t;
+
+/**
+ * NVME_BUF_POOL_HUGETLB - Back large pool buffers with huge pages
+ *
+ * Buffers of 2MB and up are allocated from the hugetlb pool when
+ * possible, falling back to regular pages when no huge pages are
+ * available.
+ */
+#define NVME_BUF_POOL_HUGETLB	(1 << 0)
+
+/**
+ * nvme_buf_pool_create() - Create a reusable buffer pool
+ * @flags:	Bitwise-or'd %NVME_BUF_POOL_* allocation flags
+ *
+ * Creates a pool of page-aligned, zeroed buffers suitable for log page
+ * and identify payloads. Released buffers are recycled by later
+ * allocations of the same or smaller size instead of going back to the
+ * system, avoiding repeated mmap/munmap cycles for callers that fetch
+ * large log pages periodically.
+ *
+ * Return: Pool handle, or NULL on failure with errno set.
+ */
+nvme_buf_pool_t nvme_buf_pool_create(unsigned long flags);
+
+/**
+ * nvme_buf_pool_alloc() - Allocate a buffer from a pool
+ * @pool:	Pool to allocate from
+ * @len:	Minimal usable buffer length in bytes
+ *
+ * Reuses the smallest recycled buffer of at least @len bytes, or
+ * allocates a fresh one. The buffer is page-aligned and zeroed and
+ * must be returned with nvme_buf_pool_release(), not free().
+ *
+ * Return: Buffer of at least @len bytes, or NULL on failure with
+ * errno set.
+ */
+void *nvme_buf_pool_alloc(nvme_buf_pool_t pool, size_t len);
+
+/**
+ * nvme_buf_pool_release() - Return a buffer to its pool
+ * @pool:	Pool the buffer was allocated from
+ * @buf:	Buffer obtained from nvme_buf_pool_alloc(); may be NULL
+ *
+ * The buffer is kept for reuse and stays valid memory until the pool
+ * itself is freed.
+ */
+void nvme_buf_pool_release(nvme_buf_pool_t pool, void *buf);
+
+/**
+ * nvme_buf_pool_free() - Free a pool and all its buffers
+ * @pool:	Pool to free; may be NULL
+ *
+ * Releases every buffer the pool handed out, including ones not yet
+ * returned with nvme_buf_pool_release().
+ */
+void nvme_buf_pool_free(nvme_buf_pool_t pool);
+
+typedef struct nvme_ana_index *nvme_ana_index_t;
+
+/**
+ * nvme_ana_index_create() - Create an NSID-indexed view of an ANA log
+ *
+ * The index is empty until the first nvme_ana_index_update(); lookups
+ * on an empty index fail with errno set to ENOENT.
+ *
+ * Return: Index handle, or NULL on failure with errno set.
+ */
+nvme_ana_index_t nvme_ana_index_create(void);
+
+/**
+ * nvme_ana_index_free() - Free an ANA index
+ * @index:	Index to free; may be NULL
+ */
+void nvme_ana_index_free(nvme_ana_index_t index);
+
+/**
+ * nvme_ana_index_update() - Rebuild an ANA index from a log page
+ * @index:	Index created by nvme_ana_index_create()
+ * @log:	ANA log to index, e.g. from nvme_get_ana_log_atomic()
+ * @len:	Length of @log in bytes
+ *
+ * Walks the variable-length group descriptors once and indexes every
+ * namespace by NSID. The index keeps its table across updates and only
+ * grows it when the namespace count demands, so refreshing after an ANA
+ * change event does not allocate in steady state. @log is not referenced
+ * after the call returns.
+ *
+ * Return: 0 on success, -1 with errno set otherwise; EPROTO indicates a
+ * log whose descriptors overrun @len.
+ */
+int nvme_ana_index_update(nvme_ana_index_t index,
+			  const struct nvme_ana_log *log, size_t len);
+
+/**
+ * nvme_ana_index_lookup() - Look up the ANA state of a namespace
+ * @index:	Index to search
+ * @nsid:	Namespace NSID to look up
+ * @state:	If non-NULL, receives the namespace's ANA state
+ * @grpid:	If non-NULL, receives the namespace's ANA group identifier
+ *
+ * Return: 0 if @nsid was found, -1 with errno set to ENOENT otherwise.
+ */
+int nvme_ana_index_lookup(nvme_ana_index_t index, __u32 nsid,
+			  enum nvme_ana_state *state, __u32 *grpid);
+
+/**
+ * nvme_ana_index_chgcnt() - Change count of the indexed ANA log
+ * @index:	Index to query
+ *
+ * Return: The change count of the log most recently passed to
+ * nvme_ana_index_update(), or 0 if the index was never updated.
+ */
+__u64 nvme_ana_index_chgcnt(nvme_ana_index_t index);
+
+/**
+ * DOC: Log page decoders
+ *
+ * The decode functions convert a raw log page into a native-endian
+ * copy in one table-driven linear pass, so consumers that walk the
+ * same page repeatedly read plain native fields instead of converting
+ * each access with le*_to_cpu(). Decoding in place (@raw == the
+ * output) is allowed; on little-endian hosts it is free.
+ */
+
+/**
+ * nvme_smart_log_decode() - Decode a SMART / Health log page
+ * @raw:	Raw log page as returned by the controller
+ * @log:	Receives the native-endian copy, may equal @raw
+ */
+void nvme_smart_log_decode(const struct nvme_smart_log *raw,
+			   struct nvme_smart_log *log);
+
+/**
+ * nvme_error_log_decode() - Decode Error Information log entries
+ * @raw:	Raw log entries as returned by the controller
+ * @log:	Receives the native-endian copies, may equal @raw
+ * @entries:	Number of entries to decode
+ */
+void nvme_error_log_decode(const struct nvme_error_log_page *raw,
+			   struct nvme_error_log_page *log,
+			   unsigned int entries);
+
+/**
+ * nvme_pel_header_decode() - Decode a Persistent Event Log header
+ * @raw:	Raw log header as returned by the controller
+ * @log:	Receives the native-endian copy, may equal @raw
+ */
+void nvme_pel_header_decode(const struct nvme_persistent_event_log *raw,
+			    struct nvme_persistent_event_log *log);
+
+/**
+ * nvme_pel_entry_decode() - Decode a Persistent Event header
+ * @raw:	Raw event header as returned by the controller
+ * @entry:	Receives the native-endian copy, may equal @raw
+ */
+void nvme_pel_entry_decode(const struct nvme_persistent_event_entry *raw,
+			   struct nvme_persistent_event_entry *entry);
+
+/**
+ * DOC: Deadline budgets
+ *
+ * Operations built from many commands (chunked log reads, retry loops)
+ * can be bounded by an absolute deadline instead of one timeout per
+ * command, giving a predictable worst-case duration for the whole
+ * operation. Deadlines are expressed as CLOCK_MONOTONIC time in
+ * milliseconds; zero means no deadline.
+ */
+
+/**
+ * nvme_deadline_after() - Compute an absolute deadline
+ * @timeout_ms:	Budget, in milliseconds from now
+ *
+ * Return: The CLOCK_MONOTONIC time @timeout_ms from now, in
+ * milliseconds, suitable as a deadline for operations that accept one.
+ */
+static inline __u64 nvme_deadline_after(unsigned int timeout_ms)
+{
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		return 0;
+	return (__u64)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeout_ms;
+}
+
+/**
+ * nvme_deadline_remaining() - Milliseconds left before a deadline
+ * @deadline:	Deadline from nvme_deadline_after(), or zero for none
+ *
+ * Return: -1 when @deadline is zero (unbounded), otherwise the number
+ * of milliseconds remaining, clamped to zero once the deadline has
+ * passed.
+ */
+static inline int nvme_deadline_remaining(__u64 deadline)
+{
+	struct timespec now;
+	__u64 now_ms;
+
+	if (!deadline)
+		return -1;
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		return -1;
+	now_ms = (__u64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	if (now_ms >= deadline)
+		return 0;
+	if (deadline - now_ms > INT_MAX)
+		return INT_MAX;
+	return deadline - now_ms;
+}
+
 #endif /* _LIBNVME_UTIL_H */
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/**
+ * This file is part of libnvme.
+ * Copyright (c) 2026 SUSE Software Solutions
+ *
+ * Microbenchmark for the NVMe-MI framing hot path: the per-message
+ * integrity check computed over the request header and payload, as
+ * done by nvme_mi_submit() for every command on a MIC-enabled
+ * transport. Reports ns/op and MB/s; run via `meson test --benchmark`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libnvme-mi.h>
+
+#define MIC_DATA_SIZE	4096
+#define MIC_ITERS	65536
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* from the library, not in public includes */
+extern __u32 nvme_mi_crc32_update(__u32 crc, void *data, size_t len);
+
+static volatile __u32 sink;
+
+int main(void)
+{
+	struct nvme_mi_admin_req_hdr hdr = { 0 };
+	unsigned char *data = malloc(MIC_DATA_SIZE);
+	unsigned long long start, ns;
+	unsigned long i;
+	__u32 crc;
+
+	for (i = 0; i < MIC_DATA_SIZE; i++)
+		data[i] = i * 2654435761U >> 24;
+
+	start = now_ns();
+	for (i = 0; i < MIC_ITERS; i++) {
+		crc = 0xffffffff;
+		crc = nvme_mi_crc32_update(crc, &hdr, sizeof(hdr));
+		crc = nvme_mi_crc32_update(crc, data, MIC_DATA_SIZE);
+		sink = ~crc;
+	}
+	ns = now_ns() - start;
+
+	printf("%-16s %12.1f ns/op  %10.1f MB/s\n", "mi_framing",
+	       (double)ns / MIC_ITERS,
+	       (double)MIC_ITERS * (sizeof(hdr) + MIC_DATA_SIZE) * 1000.0 / ns);
+
+	free(data);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/**
+ * This file is part of libnvme.
+ * Copyright (c) 2026 SUSE Software Solutions
+ *
+ * Microbenchmarks for the library's hot kernels, reporting ns/op (and
+ * MB/s for the byte-stream kernels) so releases can be gated on
+ * numbers. Run via `meson test --benchmark`; a single benchmark can
+ * be selected by passing its name on the command line.
+ *
+ * The scan benchmark runs against a synthetic sysfs tree when
+ * LIBNVME_SYSFS_PATH is set (see src/nvme/sysfs.c) and is skipped
+ * otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include <libnvme.h>
+
+#include <nvme/base64.h>
+#include <nvme/crc32.h>
+#include <nvme/private.h>
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, unsigned long iters,
+		   unsigned long long ns, unsigned long long bytes)
+{
+	printf("%-16s %12.1f ns/op", name, (double)ns / iters);
+	if (bytes)
+		printf("  %10.1f MB/s", (double)bytes * 1000.0 / ns);
+	printf("\n");
+}
+
+/* defeat dead code elimination of the benchmarked kernels */
+static volatile unsigned int sink;
+
+#define CRC_BUF_SIZE	(64 * 1024)
+#define CRC_ITERS	8192
+
+static void bench_crc32(void)
+{
+	unsigned char *buf = malloc(CRC_BUF_SIZE);
+	unsigned long long start;
+	uint32_t crc = 0;
+	unsigned long i;
+
+	for (i = 0; i < CRC_BUF_SIZE; i++)
+		buf[i] = i * 2654435761U >> 24;
+
+	start = now_ns();
+	for (i = 0; i < CRC_ITERS; i++)
+		crc = nvme_crc32c(crc, buf, CRC_BUF_SIZE);
+	report("crc32c", CRC_ITERS, now_ns() - start,
+	       (unsigned long long)CRC_ITERS * CRC_BUF_SIZE);
+
+	sink = crc;
+	free(buf);
+}
+
+#define B64_KEY_SIZE	32	/* typical TLS PSK configured key length */
+#define B64_ITERS	2000000
+
+static void bench_base64(void)
+{
+	unsigned char key[B64_KEY_SIZE], out[B64_KEY_SIZE + 4];
+	char enc[B64_KEY_SIZE * 2];
+	unsigned long long start;
+	unsigned long i;
+	int len = 0;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = i * 77;
+
+	start = now_ns();
+	for (i = 0; i < B64_ITERS; i++)
+		len = base64_encode(key, sizeof(key), enc);
+	report("base64_encode", B64_ITERS, now_ns() - start,
+	       (unsigned long long)B64_ITERS * sizeof(key));
+
+	start = now_ns();
+	for (i = 0; i < B64_ITERS; i++)
+		sink = base64_decode(enc, len, out);
+	report("base64_decode", B64_ITERS, now_ns() - start,
+	       (unsigned long long)B64_ITERS * sizeof(key));
+}
+
+#define OPTS_ITERS	200000
+
+static void bench_build_options(void)
+{
+	nvme_root_t r = nvme_create_root(stderr, LOG_ERR);
+	unsigned long long start;
+	unsigned long i;
+	nvme_host_t h;
+	nvme_ctrl_t c;
+
+	h = nvme_lookup_host(r, "nqn.2014-08.org.nvmexpress:uuid:"
+			     "12345678-1234-1234-1234-123456789abc", NULL);
+	c = nvme_create_ctrl(r, "nqn.2019-06.io.bench:subsys", "tcp",
+			     "192.168.0.1", NULL, NULL, "4420");
+
+	/*
+	 * Pretend the kernel supports every fabrics option so the full
+	 * argument string is built without touching /dev/nvme-fabrics.
+	 */
+	r->options = calloc(1, sizeof(*r->options));
+	memset(r->options, 1, sizeof(*r->options));
+
+	start = now_ns();
+	for (i = 0; i < OPTS_ITERS; i++) {
+		char *argstr = NULL;
+
+		if (build_options(h, c, &argstr)) {
+			fprintf(stderr, "build_options failed\n");
+			exit(EXIT_FAILURE);
+		}
+		free(argstr);
+	}
+	report("build_options", OPTS_ITERS, now_ns() - start, 0);
+
+	nvme_free_ctrl(c);
+	nvme_free_tree(r);
+}
+
+#define STATUS_ITERS	5000000
+
+static void bench_status_to_string(void)
+{
+	static const int codes[] = {
+		0x0, 0x2, 0x4, 0xb, 0x82, 0x187, 0x282, 0x1a0, 0x2002,
+	};
+	unsigned long long start;
+	unsigned long i;
+
+	start = now_ns();
+	for (i = 0; i < STATUS_ITERS; i++)
+		sink += *nvme_status_to_string(codes[i % 9], i & 1);
+	report("status_to_string", STATUS_ITERS, now_ns() - start, 0);
+}
+
+#define SCAN_ITERS	50
+
+static void bench_scan(void)
+{
+	unsigned long long start;
+	unsigned long i;
+
+	if (!getenv("LIBNVME_SYSFS_PATH")) {
+		printf("%-16s skipped (LIBNVME_SYSFS_PATH not set)\n", "scan");
+		return;
+	}
+
+	start = now_ns();
+	for (i = 0; i < SCAN_ITERS; i++) {
+		nvme_root_t r = nvme_scan(NULL);
+
+		if (!r) {
+			fprintf(stderr, "scan failed\n");
+			exit(EXIT_FAILURE);
+		}
+		nvme_free_tree(r);
+	}
+	report("scan", SCAN_ITERS, now_ns() - start, 0);
+}
+
+static const struct {
+	const char *name;
+	void (*fn)(void);
+} benchmarks[] = {
+	{ "crc32", bench_crc32 },
+	{ "base64", bench_base64 },
+	{ "build_options", bench_build_options },
+	{ "status_to_string", bench_status_to_string },
+	{ "scan", bench_scan },
+};
+
+int main(int argc, char **argv)
+{
+	unsigned long i;
+	bool run = false;
+
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		if (argc > 1 && strcmp(argv[1], benchmarks[i].name))
+			continue;
+		benchmarks[i].fn();
+		run = true;
+	}
+	if (!run) {
+		fprintf(stderr, "unknown benchmark '%s'\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -5,8 +5,10 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 
 #include "../../src/nvme/ioctl.h"
 #include "util.h"
@@ -18,6 +20,10 @@ struct mock_cmds {
 };
 
 static int mock_fd = -1;
+static bool mock_fd_any;
+static uint32_t mock_latency_us;
+static uint32_t mock_jitter_us;
+static unsigned int mock_jitter_seed = 0x6e766d65;
 static struct mock_cmds mock_admin_cmds = {.name = "admin"};
 static struct mock_cmds mock_io_cmds = {.name = "IO"};
 
@@ -38,6 +44,35 @@ static void mock_cmds_done(const struct mock_cmds *mock_cmds)
 void set_mock_fd(int fd)
 {
 	mock_fd = fd;
+	mock_fd_any = false;
+}
+
+void set_mock_fd_any(void)
+{
+	mock_fd_any = true;
+}
+
+void set_mock_latency(uint32_t latency_us, uint32_t jitter_us)
+{
+	mock_latency_us = latency_us;
+	mock_jitter_us = jitter_us;
+	mock_jitter_seed = 0x6e766d65;
+}
+
+static void mock_apply_latency(const struct mock_cmd *mock_cmd)
+{
+	uint32_t latency_us = mock_cmd->latency_us ?: mock_latency_us;
+	uint32_t jitter_us = mock_cmd->latency_us ?
+		mock_cmd->jitter_us : mock_jitter_us;
+	struct timespec ts;
+
+	if (jitter_us)
+		latency_us += rand_r(&mock_jitter_seed) % jitter_us;
+	if (!latency_us)
+		return;
+	ts.tv_sec = latency_us / 1000000;
+	ts.tv_nsec = (latency_us % 1000000) * 1000L;
+	nanosleep(&ts, NULL);
 }
 
 void set_mock_admin_cmds(const struct mock_cmd *cmds, size_t len)
@@ -117,6 +152,15 @@ void end_mock_cmds(void)
 	} \
 })
 
+/* serve result and data without checking the caller's arguments */
+#define execute_relaxed_ioctl(cmd, mock_cmd) ({ \
+	(cmd)->result = (mock_cmd)->result; \
+	if ((mock_cmd)->out_data) { \
+		memcpy((void *)(uintptr_t)(cmd)->addr, (mock_cmd)->out_data, \
+		       (mock_cmd)->out_data_len ?: (cmd)->data_len); \
+	} \
+})
+
 #ifdef HAVE_GLIBC_IOCTL
 int ioctl(int fd, unsigned long request, ...)
 #else
@@ -129,7 +173,8 @@ int ioctl(int fd, int request, ...)
 	va_list args;
 	void *cmd;
 
-	check(fd == mock_fd, "got fd %d, expected %d", fd, mock_fd);
+	check(mock_fd_any || fd == mock_fd,
+	      "got fd %d, expected %d", fd, mock_fd);
 	switch (request) {
 	case NVME_IOCTL_ADMIN_CMD:
 		mock_cmds = &mock_admin_cmds;
@@ -159,13 +204,24 @@ int ioctl(int fd, int request, ...)
 	cmd = va_arg(args, void *);
 	va_end(args);
 	if (result64) {
-		execute_ioctl((struct nvme_passthru_cmd64 *)cmd, mock_cmd);
+		if (mock_cmd->relaxed)
+			execute_relaxed_ioctl((struct nvme_passthru_cmd64 *)cmd,
+					      mock_cmd);
+		else
+			execute_ioctl((struct nvme_passthru_cmd64 *)cmd,
+				      mock_cmd);
 	} else {
 		check((uint32_t)mock_cmd->result == mock_cmd->result,
 		      "expected 64-bit %s for result %" PRIu64,
 		      __func__, mock_cmd->result);
-		execute_ioctl((struct nvme_passthru_cmd *)cmd, mock_cmd);
+		if (mock_cmd->relaxed)
+			execute_relaxed_ioctl((struct nvme_passthru_cmd *)cmd,
+					      mock_cmd);
+		else
+			execute_ioctl((struct nvme_passthru_cmd *)cmd,
+				      mock_cmd);
 	}
+	mock_apply_latency(mock_cmd);
 	if (mock_cmd->err < 0) {
 		errno = -mock_cmd->err;
 		return -1;
@@ -3,6 +3,7 @@
 #ifndef _LIBNVME_TEST_IOCTL_MOCK_H
 #define _LIBNVME_TEST_IOCTL_MOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -33,6 +34,14 @@
  *       If `result` doesn't fit in a u32, the ioctl() must be the 64-bit one.
  * @err: If negative, ioctl() returns -1 and sets `errno` to `-err`.
  *       Otherwise, ioctl() returns `err`, representing a NVMe status code.
+ * @latency_us: if nonzero, the ioctl() sleeps this long before returning,
+ *              overriding any default set with set_mock_latency()
+ * @jitter_us: upper bound of a pseudo-random (deterministically seeded)
+ *             extra delay added to `latency_us`
+ * @relaxed: if true, only consume the mock and serve its result and
+ *           `out_data` without checking the caller's arguments. Used by
+ *           performance harnesses, where the exact argument sequence is
+ *           covered by the correctness tests instead.
  */
 struct mock_cmd {
 	uint8_t opcode;
@@ -55,6 +64,9 @@ struct mock_cmd {
 	uint32_t out_data_len;
 	uint64_t result;
 	int err;
+	uint32_t latency_us;
+	uint32_t jitter_us;
+	bool relaxed;
 };
 
 /**
@@ -63,6 +75,25 @@ struct mock_cmd {
  */
 void set_mock_fd(int fd);
 
+/**
+ * set_mock_fd_any() - accept NVMe passthru ioctls() on any file descriptor
+ *
+ * Disables the file descriptor check, so one mock sequence can serve
+ * many mocked controllers. Undone by the next set_mock_fd() call.
+ */
+void set_mock_fd_any(void);
+
+/**
+ * set_mock_latency() - sets the default synthetic command latency
+ * @latency_us: time every mocked ioctl() sleeps before returning
+ * @jitter_us: upper bound of a pseudo-random extra delay per command
+ *
+ * Commands with a nonzero per-command `latency_us` override the
+ * default. The jitter sequence is deterministically seeded, so runs
+ * are reproducible.
+ */
+void set_mock_latency(uint32_t latency_us, uint32_t jitter_us);
+
 /**
  * set_mock_admin_cmds() - mocks NVMe admin passthru ioctl() invocations
  * @cmds: pointer to start of the mock_cmd slice
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*
+ * Latency regression harness on top of the mocked ioctl() layer: the
+ * mocks inject synthetic per-command latency and jitter, and the
+ * tests assert that chunked and retried operations issue the expected
+ * number of commands by bounding their total wall-clock time. The
+ * argument-level correctness of these paths is covered by the other
+ * tests in this directory, so most mocks here run relaxed.
+ */
+
+#include <libnvme.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ccan/array_size/array_size.h>
+#include <ccan/endian/endian.h>
+
+#include "mock.h"
+#include "util.h"
+
+#define TEST_FD 0xFD
+#define PDU_SIZE NVME_LOG_PAGE_PDU_SIZE
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*
+ * The lower bound is exact: nanosleep() never returns early. The
+ * upper bound is deliberately loose so slow CI machines do not flake,
+ * while still catching pathological behavior like a retry storm
+ * issuing many times the expected command count.
+ */
+static void check_elapsed(const char *name, uint64_t elapsed_us,
+			  uint64_t expected_us)
+{
+	check(elapsed_us >= expected_us,
+	      "%s took %" PRIu64 " us, expected at least %" PRIu64 " us",
+	      name, elapsed_us, expected_us);
+	check(elapsed_us <= expected_us * 10 + 100000,
+	      "%s took %" PRIu64 " us, expected around %" PRIu64 " us",
+	      name, elapsed_us, expected_us);
+	printf("%-24s %8" PRIu64 " us (floor %" PRIu64 " us)\n",
+	       name, elapsed_us, expected_us);
+}
+
+#define CHUNK_LATENCY_US 500
+#define NUM_CHUNKS 16
+
+static void test_log_chunking_latency(void)
+{
+	struct mock_cmd mock_admin_cmds[NUM_CHUNKS];
+	__u8 *buf = malloc(NUM_CHUNKS * PDU_SIZE);
+	__u32 result;
+	struct nvme_get_log_args args = {
+		.lpo = 0,
+		.result = &result,
+		.log = buf,
+		.args_size = sizeof(args),
+		.fd = TEST_FD,
+		.timeout = 0,
+		.lid = NVME_LOG_LID_ERROR,
+		.len = NUM_CHUNKS * PDU_SIZE,
+		.nsid = NVME_NSID_ALL,
+		.csi = NVME_CSI_NVM,
+	};
+	uint64_t start;
+	size_t i;
+
+	memset(mock_admin_cmds, 0, sizeof(mock_admin_cmds));
+	for (i = 0; i < NUM_CHUNKS; i++) {
+		mock_admin_cmds[i].opcode = nvme_admin_get_log_page;
+		mock_admin_cmds[i].relaxed = true;
+		mock_admin_cmds[i].latency_us = CHUNK_LATENCY_US;
+		mock_admin_cmds[i].jitter_us = CHUNK_LATENCY_US / 10;
+	}
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	start = now_us();
+	check(!nvme_get_log_page(TEST_FD, PDU_SIZE, &args),
+	      "get log page failed: %m");
+	check_elapsed("log chunking", now_us() - start,
+		      (uint64_t)NUM_CHUNKS * CHUNK_LATENCY_US);
+	end_mock_cmds();
+	free(buf);
+}
+
+#define ANA_LATENCY_US 300
+
+static void test_ana_retry_latency(void)
+{
+	struct nvme_ana_log header1, header2, header3;
+	struct nvme_ana_group_desc group;
+	__le32 nsids[PDU_SIZE / sizeof(*group.nsids)];
+	__u8 log_page1[sizeof(header1) + sizeof(group) + sizeof(nsids)],
+	     log_page2[sizeof(header2) + sizeof(group) + sizeof(nsids)];
+	__u32 len = PDU_SIZE * 2;
+	/*
+	 * Same command sequence as test_chgcnt_max_retries() in ana.c:
+	 * each full read is two chunked commands plus a chgcnt check,
+	 * and a changing chgcnt forces a full retry until max_retries
+	 * is exceeded. Five commands must hit the wire.
+	 */
+	struct mock_cmd mock_admin_cmds[] = {
+		{
+			.relaxed = true,
+			.out_data = log_page1,
+			.out_data_len = PDU_SIZE,
+		},
+		{
+			.relaxed = true,
+			.out_data = log_page1 + PDU_SIZE,
+			.out_data_len = sizeof(log_page1) - PDU_SIZE,
+		},
+		{
+			.relaxed = true,
+			.out_data = log_page2,
+			.out_data_len = PDU_SIZE,
+		},
+		{
+			.relaxed = true,
+			.out_data = log_page2 + PDU_SIZE,
+			.out_data_len = sizeof(log_page2) - PDU_SIZE,
+		},
+		{
+			.relaxed = true,
+			.out_data = &header3,
+			.out_data_len = sizeof(header3),
+		},
+	};
+	struct nvme_ana_log *log = malloc(len);
+	uint64_t start;
+
+	memset(&header1, 0, sizeof(header1));
+	header1.chgcnt = cpu_to_le64(1);
+	header1.ngrps = cpu_to_le16(1);
+	header2 = header1;
+	header2.chgcnt = cpu_to_le64(2);
+	header3 = header1;
+	header3.chgcnt = cpu_to_le64(3);
+	memset(&group, 0, sizeof(group));
+	group.nnsids = cpu_to_le32(ARRAY_SIZE(nsids));
+	memset(nsids, 0, sizeof(nsids));
+	memcpy(log_page1, &header1, sizeof(header1));
+	memcpy(log_page1 + sizeof(header1), &group, sizeof(group));
+	memcpy(log_page1 + sizeof(header1) + sizeof(group),
+	       nsids, sizeof(nsids));
+	memcpy(log_page2, &header2, sizeof(header2));
+	memcpy(log_page2 + sizeof(header2), &group, sizeof(group));
+	memcpy(log_page2 + sizeof(header2) + sizeof(group),
+	       nsids, sizeof(nsids));
+
+	set_mock_latency(ANA_LATENCY_US, ANA_LATENCY_US / 10);
+	set_mock_admin_cmds(mock_admin_cmds, ARRAY_SIZE(mock_admin_cmds));
+	start = now_us();
+	check(nvme_get_ana_log_atomic(TEST_FD, false, false, 2, log, &len),
+	      "get log page succeeded despite changing chgcnt");
+	check(errno == EAGAIN, "unexpected error: %m");
+	check_elapsed("ana retry loop", now_us() - start,
+		      (uint64_t)ARRAY_SIZE(mock_admin_cmds) * ANA_LATENCY_US);
+	end_mock_cmds();
+	set_mock_latency(0, 0);
+	free(log);
+}
+
+#define NUM_CTRLS 4096
+#define CTRL_LATENCY_US 10
+
+static void test_many_controllers(void)
+{
+	struct mock_cmd *mock_admin_cmds;
+	struct nvme_id_ctrl id;
+	uint64_t start, elapsed;
+	int fd;
+
+	mock_admin_cmds = calloc(NUM_CTRLS, sizeof(*mock_admin_cmds));
+	check(mock_admin_cmds, "out of memory");
+	for (fd = 0; fd < NUM_CTRLS; fd++) {
+		mock_admin_cmds[fd].opcode = nvme_admin_identify;
+		mock_admin_cmds[fd].relaxed = true;
+		mock_admin_cmds[fd].latency_us = CTRL_LATENCY_US;
+	}
+	set_mock_fd_any();
+	set_mock_admin_cmds(mock_admin_cmds, NUM_CTRLS);
+	start = now_us();
+	for (fd = 0; fd < NUM_CTRLS; fd++)
+		check(!nvme_identify_ctrl(fd, &id),
+		      "identify ctrl %d failed: %m", fd);
+	elapsed = now_us() - start;
+	check_elapsed("4096 controllers", elapsed,
+		      (uint64_t)NUM_CTRLS * CTRL_LATENCY_US);
+	printf("%-24s %8.0f cmds/s\n", "",
+	       (double)NUM_CTRLS * 1000000.0 / elapsed);
+	end_mock_cmds();
+	set_mock_fd(TEST_FD);
+	free(mock_admin_cmds);
+}
+
+int main(void)
+{
+	set_mock_fd(TEST_FD);
+	test_log_chunking_latency();
+	test_ana_retry_latency();
+	test_many_controllers();
+	return EXIT_SUCCESS;
+}
@@ -6,6 +6,7 @@
 
 #undef NDEBUG
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -15,6 +16,7 @@
 
 /* we define a custom transport, so need the internal headers */
 #include "nvme/private.h"
+#include "nvme/util.h"
 
 #include "libnvme-mi.h"
 
@@ -1908,6 +1910,72 @@ static void test_endpoint_quirk_probe(struct nvme_mi_ep *ep)
 	assert(rc == 0);
 }
 
+/* test: per-opcode response-time stats and adaptive timeouts */
+static void test_cmd_stats(nvme_mi_ep_t ep)
+{
+	struct nvme_mi_read_nvm_ss_info ss_info;
+	struct nvme_mi_cmd_stats stats;
+	unsigned int i, timeout;
+	int rc;
+
+	test_set_transport_callback(ep, test_read_mi_data_cb, NULL);
+
+	/* unsampled opcode has no stats */
+	rc = nvme_mi_ep_get_cmd_stats(ep, false, 0xff, &stats);
+	assert(rc != 0);
+
+	for (i = 0; i < 20; i++) {
+		rc = nvme_mi_mi_read_mi_data_subsys(ep, &ss_info);
+		assert(rc == 0);
+	}
+
+	rc = nvme_mi_ep_get_cmd_stats(ep, false, nvme_mi_mi_opcode_mi_data_read,
+				      &stats);
+	assert(rc == 0);
+	assert(stats.count >= 20);
+	assert(stats.min_us <= stats.avg_us);
+	assert(stats.avg_us <= stats.max_us);
+
+	/* enough samples for a derived timeout, bounded by the static one */
+	timeout = nvme_mi_ep_get_timeout(ep);
+	assert(stats.timeout_ms);
+	assert(stats.timeout_ms <= timeout);
+
+	/* commands still succeed with the adaptive model engaged, and the
+	 * static timeout is restored afterwards */
+	nvme_mi_ep_set_adaptive_timeout(ep, true);
+	rc = nvme_mi_mi_read_mi_data_subsys(ep, &ss_info);
+	assert(rc == 0);
+	assert(nvme_mi_ep_get_timeout(ep) == timeout);
+	nvme_mi_ep_set_adaptive_timeout(ep, false);
+}
+
+/* test: endpoint deadline budgets */
+static void test_deadline(nvme_mi_ep_t ep)
+{
+	struct nvme_mi_read_nvm_ss_info ss_info;
+	unsigned int timeout;
+	int rc;
+
+	test_set_transport_callback(ep, test_read_mi_data_cb, NULL);
+	timeout = nvme_mi_ep_get_timeout(ep);
+
+	/* an expired deadline fails commands before they start */
+	nvme_mi_ep_set_deadline(ep, nvme_deadline_after(0));
+	rc = nvme_mi_mi_read_mi_data_subsys(ep, &ss_info);
+	assert(rc != 0);
+	assert(errno == ETIMEDOUT);
+
+	/* a generous one does not, and the static timeout survives the
+	 * per-command clamp */
+	nvme_mi_ep_set_deadline(ep, nvme_deadline_after(10000));
+	rc = nvme_mi_mi_read_mi_data_subsys(ep, &ss_info);
+	assert(rc == 0);
+	assert(nvme_mi_ep_get_timeout(ep) == timeout);
+
+	nvme_mi_ep_set_deadline(ep, 0);
+}
+
 #define DEFINE_TEST(name) { #name, test_ ## name }
 struct test {
 	const char *name;
@@ -1950,6 +2018,8 @@ struct test {
 	DEFINE_TEST(admin_sanitize_nvm),
 	DEFINE_TEST(admin_get_log_split),
 	DEFINE_TEST(endpoint_quirk_probe),
+	DEFINE_TEST(cmd_stats),
+	DEFINE_TEST(deadline),
 };
 
 static void run_test(struct test *test, FILE *logfd, nvme_mi_ep_t ep)
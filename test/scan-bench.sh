@@ -0,0 +1,26 @@
+#!/bin/bash
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+# This file is part of libnvme.
+# Copyright (c) 2026 SUSE Software Solutions
+#
+# Times nvme_scan_topology() against generated synthetic sysfs trees:
+# a production-like 40-subsystem multipath layout and a large one with
+# tens of thousands of nodes. Run via `meson test --benchmark`.
+#
+# $1: sysfs-gen binary
+# $2: bench binary
+
+set -e
+
+SYSFS_GEN="$1"
+BENCH="$2"
+
+TMP_DIR="$(mktemp -d)"
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+"$SYSFS_GEN" "$TMP_DIR/prod" 40 4 8
+LIBNVME_SYSFS_PATH="$TMP_DIR/prod" "$BENCH" scan
+
+"$SYSFS_GEN" "$TMP_DIR/large" 500 4 16
+LIBNVME_SYSFS_PATH="$TMP_DIR/large" "$BENCH" scan
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/**
+ * This file is part of libnvme.
+ * Copyright (c) 2026 SUSE Software Solutions
+ *
+ * Fabricates a synthetic sysfs tree with a configurable number of
+ * subsystems, controllers per subsystem and shared namespaces per
+ * subsystem, laid out the way the kernel presents a multipathed
+ * fabrics topology. Point LIBNVME_SYSFS_PATH (see src/nvme/sysfs.c)
+ * at the generated directory to scan it without hardware, e.g. for
+ * the scan benchmark in bench.c or to reproduce a production layout
+ * in CI:
+ *
+ *   sysfs-gen /tmp/sysfs 40 4 8
+ *   LIBNVME_SYSFS_PATH=/tmp/sysfs bench scan
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static const char *basedir;
+
+static void mkdir_at(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+static void mkdir_at(const char *fmt, ...)
+{
+	char path[1024];
+	int off;
+	va_list ap;
+
+	off = snprintf(path, sizeof(path), "%s", basedir);
+	va_start(ap, fmt);
+	vsnprintf(path + off, sizeof(path) - off, fmt, ap);
+	va_end(ap);
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		fprintf(stderr, "mkdir %s: %m\n", path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void write_attr(const char *value, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+static void write_attr(const char *value, const char *fmt, ...)
+{
+	char path[1024];
+	int off;
+	va_list ap;
+	FILE *f;
+
+	off = snprintf(path, sizeof(path), "%s", basedir);
+	va_start(ap, fmt);
+	vsnprintf(path + off, sizeof(path) - off, fmt, ap);
+	va_end(ap);
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "open %s: %m\n", path);
+		exit(EXIT_FAILURE);
+	}
+	fprintf(f, "%s\n", value);
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long nr_subsys, ctrls_per_subsys, ns_per_subsys;
+	unsigned long s, c, n, ctrl = 0;
+	char value[256];
+
+	if (argc != 5) {
+		fprintf(stderr,
+			"usage: %s <dir> <subsystems> <ctrls-per-subsys> <ns-per-subsys>\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+	basedir = argv[1];
+	nr_subsys = strtoul(argv[2], NULL, 0);
+	ctrls_per_subsys = strtoul(argv[3], NULL, 0);
+	ns_per_subsys = strtoul(argv[4], NULL, 0);
+
+	if (mkdir(basedir, 0755) && errno != EEXIST) {
+		fprintf(stderr, "mkdir %s: %m\n", basedir);
+		return EXIT_FAILURE;
+	}
+	mkdir_at("/sys");
+	mkdir_at("/sys/class");
+	mkdir_at("/sys/class/nvme");
+	mkdir_at("/sys/class/nvme-subsystem");
+	mkdir_at("/sys/block");
+	mkdir_at("/sys/bus");
+	mkdir_at("/sys/bus/pci");
+	mkdir_at("/sys/bus/pci/slots");
+
+	for (s = 0; s < nr_subsys; s++) {
+		unsigned long first_ctrl = ctrl;
+
+		mkdir_at("/sys/class/nvme-subsystem/nvme-subsys%lu", s);
+		snprintf(value, sizeof(value),
+			 "nqn.2019-06.io.synthetic:subsys%lu", s);
+		write_attr(value,
+			   "/sys/class/nvme-subsystem/nvme-subsys%lu/subsysnqn",
+			   s);
+		write_attr("Synthetic NVMe",
+			   "/sys/class/nvme-subsystem/nvme-subsys%lu/model", s);
+		snprintf(value, sizeof(value), "SN%08lu", s);
+		write_attr(value,
+			   "/sys/class/nvme-subsystem/nvme-subsys%lu/serial", s);
+		write_attr("1.0",
+			   "/sys/class/nvme-subsystem/nvme-subsys%lu/firmware_rev",
+			   s);
+		write_attr("numa",
+			   "/sys/class/nvme-subsystem/nvme-subsys%lu/iopolicy",
+			   s);
+		write_attr("nvm",
+			   "/sys/class/nvme-subsystem/nvme-subsys%lu/subsystype",
+			   s);
+
+		/* shared (subsystem-level) namespaces */
+		for (n = 0; n < ns_per_subsys; n++) {
+			mkdir_at("/sys/class/nvme-subsystem/nvme-subsys%lu/nvme%lun%lu",
+				 s, first_ctrl, n + 1);
+			mkdir_at("/sys/class/nvme-subsystem/nvme-subsys%lu/nvme%lun%lu/queue",
+				 s, first_ctrl, n + 1);
+			snprintf(value, sizeof(value), "%lu", n + 1);
+			write_attr(value,
+				   "/sys/class/nvme-subsystem/nvme-subsys%lu/nvme%lun%lu/nsid",
+				   s, first_ctrl, n + 1);
+			write_attr("2097152",
+				   "/sys/class/nvme-subsystem/nvme-subsys%lu/nvme%lun%lu/size",
+				   s, first_ctrl, n + 1);
+			write_attr("512",
+				   "/sys/class/nvme-subsystem/nvme-subsys%lu/nvme%lun%lu/queue/logical_block_size",
+				   s, first_ctrl, n + 1);
+		}
+
+		for (c = 0; c < ctrls_per_subsys; c++, ctrl++) {
+			/* membership entry in the subsystem directory */
+			mkdir_at("/sys/class/nvme-subsystem/nvme-subsys%lu/nvme%lu",
+				 s, ctrl);
+
+			mkdir_at("/sys/class/nvme/nvme%lu", ctrl);
+			snprintf(value, sizeof(value),
+				 "nqn.2019-06.io.synthetic:subsys%lu", s);
+			write_attr(value,
+				   "/sys/class/nvme/nvme%lu/subsysnqn", ctrl);
+			write_attr("tcp",
+				   "/sys/class/nvme/nvme%lu/transport", ctrl);
+			snprintf(value, sizeof(value),
+				 "traddr=192.168.%lu.%lu,trsvcid=%lu",
+				 s / 250, s % 250 + 1, 4420 + c);
+			write_attr(value,
+				   "/sys/class/nvme/nvme%lu/address", ctrl);
+			write_attr("live",
+				   "/sys/class/nvme/nvme%lu/state", ctrl);
+			snprintf(value, sizeof(value), "%lu", c + 1);
+			write_attr(value,
+				   "/sys/class/nvme/nvme%lu/cntlid", ctrl);
+			write_attr("io",
+				   "/sys/class/nvme/nvme%lu/cntrltype", ctrl);
+			write_attr("none",
+				   "/sys/class/nvme/nvme%lu/dctype", ctrl);
+			write_attr("Synthetic NVMe",
+				   "/sys/class/nvme/nvme%lu/model", ctrl);
+			snprintf(value, sizeof(value), "SN%08lu", s);
+			write_attr(value,
+				   "/sys/class/nvme/nvme%lu/serial", ctrl);
+			write_attr("1.0",
+				   "/sys/class/nvme/nvme%lu/firmware_rev",
+				   ctrl);
+			write_attr("nqn.2014-08.org.nvmexpress:uuid:"
+				   "11111111-2222-3333-4444-555555555555",
+				   "/sys/class/nvme/nvme%lu/hostnqn", ctrl);
+			write_attr("11111111-2222-3333-4444-555555555555",
+				   "/sys/class/nvme/nvme%lu/hostid", ctrl);
+			write_attr("0",
+				   "/sys/class/nvme/nvme%lu/numa_node", ctrl);
+
+			/* one path node per shared namespace */
+			for (n = 0; n < ns_per_subsys; n++) {
+				mkdir_at("/sys/class/nvme/nvme%lu/nvme%luc%lun%lu",
+					 ctrl, first_ctrl, ctrl, n + 1);
+				write_attr("optimized",
+					   "/sys/class/nvme/nvme%lu/nvme%luc%lun%lu/ana_state",
+					   ctrl, first_ctrl, ctrl, n + 1);
+				write_attr("1",
+					   "/sys/class/nvme/nvme%lu/nvme%luc%lun%lu/ana_grpid",
+					   ctrl, first_ctrl, ctrl, n + 1);
+			}
+		}
+	}
+
+	printf("%s: %lu subsystems, %lu controllers, %lu namespaces\n",
+	       basedir, nr_subsys, nr_subsys * ctrls_per_subsys,
+	       nr_subsys * ns_per_subsys);
+	return EXIT_SUCCESS;
+}
@@ -210,10 +210,83 @@ static void test_uriparser_bad(void)
 	}
 }
 
+static void check_view(const struct nvme_uri_view *v, const char *expected)
+{
+	char buf[256];
+
+	if (!expected) {
+		assert(v->str == NULL);
+		return;
+	}
+	assert(v->str != NULL);
+	assert(nvme_uri_view_decode(v, buf, sizeof(buf)) >= 0);
+	assert(strcmp(buf, expected) == 0);
+}
+
+static void test_uriparser_view(void)
+{
+	printf("Testing zero-allocation URI parser:\n");
+	for (int i = 0; i < ARRAY_SIZE(test_data); i++) {
+		const struct test_data *d = &test_data[i];
+		struct nvme_fabrics_uri_view view;
+		int j;
+
+		printf(" '%s'...", d->uri);
+		assert(nvme_parse_uri_view(&view, d->uri) == 0);
+
+		check_view(&view.scheme, d->scheme);
+		check_view(&view.protocol, d->proto);
+		check_view(&view.userinfo, d->user);
+		check_view(&view.host, d->host);
+		assert(d->port == view.port);
+		for (j = 0; j < view.nr_path_segments; j++) {
+			assert(d->path[j] != NULL);
+			check_view(&view.path_segments[j], d->path[j]);
+		}
+		assert(d->path[j] == NULL);
+		check_view(&view.query, d->query);
+		check_view(&view.fragment, d->frag);
+		printf("  OK\n");
+	}
+
+	printf("Testing malformed URI strings (view):\n");
+	for (int i = 0; i < ARRAY_SIZE(test_data_bad); i++) {
+		struct nvme_fabrics_uri_view view;
+
+		printf(" '%s'...", test_data_bad[i]);
+		assert(nvme_parse_uri_view(&view, test_data_bad[i]) == -1);
+		printf("   OK\n");
+	}
+}
+
+static void test_uriparser_batch(void)
+{
+	struct nvme_fabrics_uri_view views[ARRAY_SIZE(test_data)];
+	const char *uris[ARRAY_SIZE(test_data)];
+	int i;
+
+	printf("Testing batch URI parsing...");
+	for (i = 0; i < ARRAY_SIZE(test_data); i++)
+		uris[i] = test_data[i].uri;
+	assert(nvme_parse_uri_batch(views, uris, ARRAY_SIZE(test_data)) ==
+	       ARRAY_SIZE(test_data));
+	for (i = 0; i < ARRAY_SIZE(test_data); i++)
+		check_view(&views[i].host, test_data[i].host);
+
+	/* a malformed entry is zeroed and not counted */
+	uris[0] = "nonsense";
+	assert(nvme_parse_uri_batch(views, uris, ARRAY_SIZE(test_data)) ==
+	       ARRAY_SIZE(test_data) - 1);
+	assert(views[0].scheme.str == NULL);
+	printf("  OK\n");
+}
+
 int main(int argc, char *argv[])
 {
 	test_uriparser();
 	test_uriparser_bad();
+	test_uriparser_view();
+	test_uriparser_batch();
 
 	fflush(stdout);
 